@@ -4,6 +4,7 @@
 #include <click/glue.hh>
 
 #include "basiconoffchannel.hh"
+#include "paramfile.hh"
 
 CLICK_DECLS
 
@@ -81,6 +82,13 @@ BasicOnOffChannel::load_cdf_from_file(const String filename, ErrorHandler *errh,
     return -1;
   }
 
+  /* A binary file starts with the magic number, it is read without parsing */
+  if ((_ff.peek_line(in, errh) > 0) && (in.length() >= 4) && (memcmp(in.data(), PARAMFILE_MAGIC, 4) == 0)) {
+    int ret = load_cdf_binary(errh, dist);
+    _ff.cleanup();
+    return ret;
+  }
+
   /* Extract the first line, which contain the length of the input */
   if ((_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &len) != in.end() - 1)) {
     errh->error("BasicOnOff input file error : bad input (reading length)");
@@ -126,6 +134,46 @@ BasicOnOffChannel::load_cdf_from_file(const String filename, ErrorHandler *errh,
   return 0;
 }
 
+int
+BasicOnOffChannel::load_cdf_binary(ErrorHandler *errh, Vector<CDFPoint> &dist)
+{
+  unsigned char head[PARAMFILE_HEADER_SIZE];
+  struct paramfile_header header;
+  Vector<uint32_t> raw;
+  CDFPoint point;
+  uint32_t i;
+  char extra;
+
+  /* Header */
+  if ((_ff.read(head, PARAMFILE_HEADER_SIZE, errh) != PARAMFILE_HEADER_SIZE) || (paramfile_decode_header(head, &header) != 0)
+      || (header.type != PARAMFILE_CDF) || (paramfile_payload_size(&header) > 0x7FFFFFFFU)) {
+    errh->error("BasicOnOff input file error : bad binary header");
+    return -2;
+  }
+
+  /* (length, cumulated probability) pairs, in one read */
+  raw.resize((int) (2 * header.count));
+  if ((_ff.read(raw.begin(), (uint32_t) (8 * header.count), errh) != (int) (8 * header.count))
+      || (paramfile_fnv1a(0xcbf29ce484222325ULL, (const unsigned char *) raw.begin(), (size_t) (8 * header.count)) != header.checksum)
+      || (_ff.read(&extra, 1, errh) != 0)) {
+    errh->error("BasicOnOff input file error : truncated or bad checksum");
+    return -3;
+  }
+  dist.reserve((int) header.count);
+  for (i = 0; i < header.count; ++i) {
+    point.point = (int) paramfile_get_u32((const unsigned char *) &raw[2 * i]);
+    point.probability = paramfile_get_u32((const unsigned char *) &raw[2 * i + 1]);
+    /* Check for overflow */
+    if (point.point < 0) {
+      errh->error("BasicOnOff input file error : bad input (too large unsigned)");
+      dist.clear();
+      return -4;
+    }
+    dist.push_back(point);
+  }
+  return 0;
+}
+
 int
 BasicOnOffChannel::initialize(ErrorHandler *errh)
 {
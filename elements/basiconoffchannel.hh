@@ -28,6 +28,8 @@ class BasicOnOffChannel : public Element {
 
     /* Load a CDF for a file */
     int load_cdf_from_file(const String, ErrorHandler *, Vector<CDFPoint>&);
+    /* Load a CDF from the opened file, in binary format (see paramfile.hh) */
+    int load_cdf_binary(ErrorHandler *, Vector<CDFPoint>&);
 
     /* Generate a random number from a Cumulative distribution functions */
     int thresholdrand(const Vector<CDFPoint>&);
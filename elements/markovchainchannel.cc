@@ -5,6 +5,7 @@
 #include <click/confparse.hh>
 
 #include "markovchainchannel.hh"
+#include "paramfile.hh"
 
 CLICK_DECLS
 void
@@ -46,6 +47,13 @@ MarkovChainChannel::initialize(ErrorHandler *errh)
     return -1;
   }
 
+  /* A binary file starts with the magic number, it is read without parsing */
+  if ((_ff.peek_line(in, errh) > 0) && (in.length() >= 4) && (memcmp(in.data(), PARAMFILE_MAGIC, 4) == 0)) {
+    int ret = initialize_binary(errh);
+    _ff.cleanup();
+    return ret;
+  }
+
   /* Extract the first line, which contain the length of the input */
   if ((_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &len) != in.end() - 1)) {
     errh->error("MarkovChain input file error : bad input (reading length)");
@@ -53,6 +61,14 @@ MarkovChainChannel::initialize(ErrorHandler *errh)
     return -2;
   }
 
+  /* A length of 0 introduces the sparse representation */
+  _sparse = (len == 0);
+  if (_sparse) {
+    int ret = initialize_sparse(errh);
+    _ff.cleanup();
+    return ret;
+  }
+
   /* Reserve the place needed directly, to reduce the number of size change */
   _success_probablilty.reserve(len);
   /* The total number of states is also the modulo for forgetting old information */
@@ -84,17 +100,164 @@ MarkovChainChannel::initialize(ErrorHandler *errh)
   return 0;
 }
 
+int
+MarkovChainChannel::initialize_binary(ErrorHandler *errh)
+{
+  unsigned char head[PARAMFILE_HEADER_SIZE];
+  struct paramfile_header header;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  uint32_t i;
+  char extra;
+
+  /* Header */
+  if ((_ff.read(head, PARAMFILE_HEADER_SIZE, errh) != PARAMFILE_HEADER_SIZE) || (paramfile_decode_header(head, &header) != 0)
+      || (header.order == 0) || (header.order >= 64)) {
+    errh->error("MarkovChain input file error : bad binary header");
+    return -2;
+  }
+  if (paramfile_payload_size(&header) > 0x7FFFFFFFU) {
+    errh->error("MarkovChain input file error : too large");
+    return -2;
+  }
+  _state_modulo = ((uint64_t) 1) << header.order;
+  _current_state = header.initial_state % _state_modulo;
+  _sparse = (header.type == PARAMFILE_MARKOV_SPARSE);
+
+  /* The payload is read in place, and only converted on big-endian hosts */
+  if (_sparse) {
+    _default_probability = header.default_probability;
+    _sparse_states.resize((int) header.count);
+    _sparse_probability.resize((int) header.count);
+    if ((_ff.read(_sparse_states.begin(), (uint32_t) (8 * header.count), errh) != (int) (8 * header.count))
+        || (_ff.read(_sparse_probability.begin(), (uint32_t) (4 * header.count), errh) != (int) (4 * header.count))) {
+      errh->error("MarkovChain input file error : truncated");
+      return -3;
+    }
+    hash = paramfile_fnv1a(hash, (const unsigned char *) _sparse_states.begin(), (size_t) (8 * header.count));
+    hash = paramfile_fnv1a(hash, (const unsigned char *) _sparse_probability.begin(), (size_t) (4 * header.count));
+    if (!paramfile_host_le()) {
+      for (i = 0; i < header.count; ++i) {
+        _sparse_states[i] = paramfile_get_u64((const unsigned char *) &_sparse_states[i]);
+        _sparse_probability[i] = paramfile_get_u32((const unsigned char *) &_sparse_probability[i]);
+      }
+    }
+  } else if ((header.type == PARAMFILE_MARKOV) && (header.count == _state_modulo)) {
+    _success_probablilty.resize((int) header.count);
+    if (_ff.read(_success_probablilty.begin(), (uint32_t) (4 * header.count), errh) != (int) (4 * header.count)) {
+      errh->error("MarkovChain input file error : truncated");
+      return -3;
+    }
+    hash = paramfile_fnv1a(hash, (const unsigned char *) _success_probablilty.begin(), (size_t) (4 * header.count));
+    if (!paramfile_host_le()) {
+      for (i = 0; i < header.count; ++i) {
+        _success_probablilty[i] = paramfile_get_u32((const unsigned char *) &_success_probablilty[i]);
+      }
+    }
+  } else {
+    errh->error("MarkovChain input file error : not a Markov chain");
+    return -2;
+  }
+
+  /* Integrity */
+  if ((hash != header.checksum) || (_ff.read(&extra, 1, errh) != 0)) {
+    errh->error("MarkovChain input file error : bad checksum");
+    _success_probablilty.clear();
+    _sparse_states.clear();
+    _sparse_probability.clear();
+    return -3;
+  }
+  return 0;
+}
+
+int
+MarkovChainChannel::initialize_sparse(ErrorHandler *errh)
+{
+  String in;
+  uint32_t k, buffer;
+  uint64_t len, state;
+
+  /* Order of the chain, which gives the modulo */
+  if ((_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &k) != in.end() - 1) || (k == 0) || (k >= 64)) {
+    errh->error("MarkovChain input file error : bad input (reading order)");
+    return -2;
+  }
+  _state_modulo = ((uint64_t) 1) << k;
+
+  /* Initial state */
+  if ((_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &_current_state) != in.end() - 1)) {
+    errh->error("MarkovChain input file error : bad input (reading initial state)");
+    return -2;
+  }
+  _current_state %= _state_modulo;
+
+  /* Probability of success in the states that are not listed */
+  if ((_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &_default_probability) != in.end() - 1)) {
+    errh->error("MarkovChain input file error : bad input (reading default probability)");
+    return -2;
+  }
+
+  /* Number of listed states */
+  if ((_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &len) != in.end() - 1)) {
+    errh->error("MarkovChain input file error : bad input (reading length)");
+    return -2;
+  }
+
+  /* Read the (state, probability of success) pairs */
+  while (len != 0) {
+    --len;
+    if ((_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &state) != in.end() - 1)
+        || (_ff.read_line(in, errh) <= 0) || (cp_integer(in.begin(), in.end() - 1, 10, &buffer) != in.end() - 1)) {
+      errh->error("MarkovChain input file error : bad input");
+      _sparse_states.clear();
+      _sparse_probability.clear();
+      return -3;
+    }
+    /* The states are sorted, for the binary search */
+    if (_sparse_states.size() && (state <= _sparse_states.back())) {
+      errh->error("MarkovChain input file error : states not sorted");
+      _sparse_states.clear();
+      _sparse_probability.clear();
+      return -3;
+    }
+    _sparse_states.push_back(state);
+    _sparse_probability.push_back(buffer);
+  }
+  return 0;
+}
+
 void
 MarkovChainChannel::cleanup(CleanupStage)
 {
   _success_probablilty.clear();
+  _sparse_states.clear();
+  _sparse_probability.clear();
 }
 
 void
 MarkovChainChannel::push (int, Packet *p)
 {
   /* Evaluate the transmission */
-  bool transmit = click_random() < _success_probablilty[_current_state];
+  uint32_t probability;
+  if (_sparse) {
+    /* Binary search of the current state among the listed ones */
+    int min = 0, max = _sparse_states.size(), pos;
+    while (min < max) {
+      pos = min + (max - min) / 2;
+      if (_sparse_states[pos] < _current_state) {
+        min = pos + 1;
+      } else {
+        max = pos;
+      }
+    }
+    if ((min < _sparse_states.size()) && (_sparse_states[min] == _current_state)) {
+      probability = _sparse_probability[min];
+    } else {
+      probability = _default_probability;
+    }
+  } else {
+    probability = _success_probablilty[_current_state];
+  }
+  bool transmit = click_random() < probability;
 
   /* Update the state */
   _current_state = ((_current_state << 1) + transmit) % _state_modulo;
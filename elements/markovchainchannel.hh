@@ -11,6 +11,15 @@ class MarkovChainChannel : public Element {
     /* Variables used to store the statistic representation from the configuration files */
     Vector<uint32_t> _success_probablilty;
 
+    /*
+     * Sparse representation, used for high orders:
+     * only the visited states are listed, the others have the default probability
+     */
+    bool _sparse;
+    Vector<uint64_t> _sparse_states;         // Sorted
+    Vector<uint32_t> _sparse_probability;
+    uint32_t _default_probability;
+
     /* FileDescriptor */
     FromFile _ff;
 
@@ -20,8 +29,13 @@ class MarkovChainChannel : public Element {
      *  _current_state & (1 << i) means that (i + 1) step ago it was a success
      * The _state_contains the first state to forget, that is (1 << k)
      */
-    uint32_t _current_state;
-    uint32_t _state_modulo;
+    uint64_t _current_state;
+    uint64_t _state_modulo;
+
+    /* Read the sparse representation, after its first line */
+    int initialize_sparse(ErrorHandler *errh);
+    /* Read the binary representation (see paramfile.hh) */
+    int initialize_binary(ErrorHandler *errh);
 
   public:
     /* Behaviour descriptors */
@@ -8,21 +8,34 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <cmath>
+#include <algorithm>
 
 const struct option ParamBasicMTA::long_options[] = {
   {"free",        required_argument, 0,  'f' },
   {"err",         required_argument, 0,  'r' },
   {"markov",      required_argument, 0,  'm' },
+  {"run-memory",  required_argument, 0,  'M' },
+  {"spill",             no_argument, 0,  's' },
+  {"percentile",  required_argument, 0,  'p' },
+  {"threshold",   required_argument, 0,  'C' },
   {NULL,                          0, 0,   0  }
 };
 
 const char * const ParamBasicMTA::needfiles = "MTA needs 3 output files on non human-readable output";
+const char * const ParamBasicMTA::bufferfull = "MTA run buffer full: increase --run-memory or use --spill";
+const char * const ParamBasicMTA::badthreshold = "MTA threshold: --percentile needs a value in ]0,100[, --threshold a length";
 
 int
 ParamBasicMTA::init(const int argc, char **argv, const bool human_readable, const char** err)
 {
   int opt, k;
+  size_t memory = DEFAULT_RUN_MEMORY;
+  bool spill = false;
+  double percentile = 0;
+  char *end;
+  unsigned long fixed = 0;
   optind = 1;
+  threshold_rule = MTA_THRESHOLD_STDDEV;
   k = 0;
   error_filename = NULL;
   free_filename = NULL;
@@ -43,6 +56,28 @@ ParamBasicMTA::init(const int argc, char **argv, const bool human_readable, cons
       case 'k':
          k = atoi(optarg);
         break;
+      case 'M':
+         memory = ((size_t) strtoul(optarg, NULL, 10)) << 20;
+        break;
+      case 's':
+         spill = true;
+        break;
+      case 'p':
+        percentile = strtod(optarg, &end);
+        if ((*end != '\0') || !(percentile > 0) || !(percentile < 100)) {
+          *err = badthreshold;
+          return -1;
+        }
+        threshold_rule = MTA_THRESHOLD_PERCENTILE;
+        break;
+      case 'C':
+        fixed = strtoul(optarg, &end, 10);
+        if ((*end != '\0') || (*optarg == '\0') || (fixed > UINT32_MAX)) {
+          *err = badthreshold;
+          return -1;
+        }
+        threshold_rule = MTA_THRESHOLD_FIXED;
+        break;
       default:
         *err = unknownOption;
         return opt;
@@ -76,7 +111,12 @@ ParamBasicMTA::init(const int argc, char **argv, const bool human_readable, cons
   length = 0;
   length_error = 0;
   second_round = false;
-  C = 0;
+  C = (uint32_t) fixed;
+  error_bursts = 0;
+  error_mean = 0;
+  error_m2 = 0;
+  error_quantile.init(percentile / 100);
+  runs.init(memory, spill);
   /* Sub-module initialization */
   markov->init(k, markov_filename);
   return onoff->init(error_filename, free_filename);
@@ -86,62 +126,129 @@ void
 ParamBasicMTA::clean(void)
 {
   /* Clean sub-modules */
+  runs.clean();
   onoff->clean();
   markov->clean();
 }
 
-int
-ParamBasicMTA::addChar(const bool input)
+void
+ParamBasicMTA::addRun(const bool input, const uint32_t len)
 {
-  if (second_round) {
-    /* Second round */
-    if (input == current_state) {
-      /* Same input as before */
-      if (!input) {
-        /* If it's an error, we can directly add it to the markov chain */
-        markov->addChar(input);
-      }
-      /* Increase the length of the current state */
-      ++length;
-    } else {
-      /* We will change the 'current_state' at the end of the call, thus we need to clean the current one */
-      if (current_state) {
-        /* It's error-free but are we above or below the threshold ? */
-        if (length > C) {
-          /* Above the threshold: it's totally error-free */
-          if (length_error != 0) {
-            /* We probably had an error burst before that we didn't clean, thus push it now */
-            onoff->addChars(false, length_error);
-          }
-          /* Clean the error length: we have no error left */
-          length_error = 0;
-          /* Add the error-free period */
-          onoff->addChars(true, length);
-        } else {
-          /* Below the threshold: count as error */
-          uint32_t temp;
-          for (temp = 0; temp < length; ++temp) {
-            /* Update the markov chain describing the error */
-            markov->addChar(true);
-          }
-          /* Add it to the error buffer */
-          length_error += length;
+  if (input == current_state) {
+    /* Same input as before */
+    if (!input) {
+      /* If it's an error, we can directly add it to the markov chain */
+      markov->addRun(input, len);
+    }
+    /* Increase the length of the current state */
+    length += len;
+  } else {
+    /* We will change the 'current_state' at the end of the call, thus we need to clean the current one */
+    if (current_state) {
+      /* It's error-free but are we above or below the threshold ? */
+      if (length > C) {
+        /* Above the threshold: it's totally error-free */
+        if (length_error != 0) {
+          /* We probably had an error burst before that we didn't clean, thus push it now */
+          onoff->addChars(false, length_error);
         }
-        /* The new input is an error, we can directly add it to the markov chain */
-        markov->addChar(input);
+        /* Clean the error length: we have no error left */
+        length_error = 0;
+        /* Add the error-free period */
+        onoff->addChars(true, length);
       } else {
-        /* Last periode was an error period, add it to the error buffer */
+        /* Below the threshold: count as error, update the markov chain describing the error */
+        markov->addRun(true, length);
+        /* Add it to the error buffer */
         length_error += length;
       }
-      /* Now the current state have only one element */
-      length = 1;
+      /* The new input is an error, we can directly add it to the markov chain */
+      markov->addRun(input, len);
+    } else {
+      /* Last periode was an error period, add it to the error buffer */
+      length_error += length;
     }
-  } else {
-    /* First round: use sub-module On-Off to evaluate the error-free bursts lengths (without any threshold) */
-    onoff->addChar(input);
+    /* Now the current state have only the new elements */
+    length = len;
   }
   /* Remember the last input */
   current_state = input;
+}
+
+inline void
+ParamBasicMTA::closeFirstBurst()
+{
+  double delta;
+  /* Length can be null at the begining */
+  if ((length != 0) && !current_state) {
+    ++error_bursts;
+    switch (threshold_rule) {
+      case MTA_THRESHOLD_STDDEV:
+        delta = ((double) length) - error_mean;
+        error_mean += delta / ((double) error_bursts);
+        error_m2 += delta * (((double) length) - error_mean);
+        break;
+      case MTA_THRESHOLD_PERCENTILE:
+        error_quantile.add((double) length);
+        break;
+    }
+  }
+}
+
+inline void
+ParamBasicMTA::addFirstRun(const bool input, const uint32_t len)
+{
+  if (input == current_state) {
+    length += len;
+  } else {
+    closeFirstBurst();
+    current_state = input;
+    length = len;
+  }
+}
+
+int
+ParamBasicMTA::addChar(const bool input)
+{
+  if (second_round) {
+    /* Second round */
+    addRun(input, 1);
+  } else {
+    /* First round: statistics of the error bursts lengths (without any threshold) */
+    addFirstRun(input, 1);
+    /* Remember the trace for the second round */
+    if (runs.add(input, 1)) {
+      std::cerr << bufferfull << std::endl;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int
+ParamBasicMTA::addBits(const uint64_t *words, const size_t nbits)
+{
+  size_t pos, run;
+  if (nbits == 0) {
+    return 0;
+  }
+  if (second_round) {
+    /* Second round: work on runs */
+    for (pos = 0; pos < nbits; pos += run) {
+      run = runLength(words, pos, nbits);
+      addRun(bitAt(words, pos), (uint32_t) run);
+    }
+  } else {
+    /* First round: statistics of the error bursts, and record of the trace for the second round */
+    for (pos = 0; pos < nbits; pos += run) {
+      run = runLength(words, pos, nbits);
+      addFirstRun(bitAt(words, pos), (uint32_t) run);
+      if (runs.add(bitAt(words, pos), (uint32_t) run)) {
+        std::cerr << bufferfull << std::endl;
+        return -1;
+      }
+    }
+  }
   return 0;
 }
 
@@ -149,32 +256,46 @@ bool
 ParamBasicMTA::nextRound()
 {
   assert(!second_round);
-  /* Consider the last bit */
-  onoff->addChar(!current_state);
+  /* Consider the last burst */
+  closeFirstBurst();
   /* Calculate the threshold C */
-  double mean = 0, standard_deviation = 0, temp, total = (double)onoff->getRawErrorBurstNumber();
-  const std::map<uint32_t, uint64_t>* errors = onoff->getRawErrorBurstLengthCDF();
-  std::map<uint32_t, uint64_t>::const_iterator it;
-  for (it = errors->begin(); it != errors->end(); ++it) {
-    mean += ((double) it->first) * ((double) it->second) / total;
-  }
-  for (it = errors->begin(); it != errors->end(); ++it) {
-    temp = ((double) it->first) - mean;
-    temp *= temp;
-    standard_deviation += temp * ((double) it->second) / total;
-  }
-  total = mean + std::sqrt(standard_deviation);
+  double total = C;
+  switch (threshold_rule) {
+    case MTA_THRESHOLD_STDDEV:
+      /* Mean plus (population) standard deviation */
+      total = (error_bursts == 0) ? 0 : error_mean + std::sqrt(error_m2 / ((double) error_bursts));
+      break;
+    case MTA_THRESHOLD_PERCENTILE:
+      total = error_quantile.value();
+      break;
+  }
   if ((!std::isfinite(total)) || (total >= UINT32_MAX)) {
     std::cerr << "OVERFLOW" << std::endl;
   }
   C = (uint32_t)total;
-  /* Clean and start new round */
-  onoff->clean();
-  onoff->init(NULL, NULL);
+  /* Start new round */
+  current_state = false;
   length = 0;
   length_error = 0;
   second_round = true;
-  return true;
+  /* Replay the trace from the run-length record */
+  bool value;
+  uint32_t len;
+  int ret;
+  if (runs.rewind()) {
+    std::cerr << "Unable to replay the trace" << std::endl;
+    exit(-1);
+  }
+  while ((ret = runs.next(&value, &len)) > 0) {
+    addRun(value, len);
+  }
+  if (ret < 0) {
+    std::cerr << "Unable to replay the trace" << std::endl;
+    exit(-1);
+  }
+  runs.clean();
+  /* No need to read the input again */
+  return false;
 }
 
 void
@@ -189,10 +310,7 @@ ParamBasicMTA::finalize(const uint32_t max_rand)
       }
       onoff->addChars(true, length);
     } else {
-      uint32_t temp;
-      for (temp = 0; temp < length; ++temp) {
-        markov->addChar(true);
-      }
+      markov->addRun(true, length);
       length_error += length;
       onoff->addChars(false, length_error);
     }
@@ -205,6 +323,60 @@ ParamBasicMTA::finalize(const uint32_t max_rand)
   markov->finalize(max_rand);
 }
 
+int
+ParamBasicMTA::netemModel(const uint32_t max_rand, NetemModel& netem) const
+{
+  RunLengths losses, inside, periods, free, receptions;
+  RunLengths::const_iterator a, b;
+  double period, rate, internal, pairs, wa;
+
+  /*
+   * Lost runs and short received runs: the Markov chain of the concatenated error periods,
+   * long received runs: the error-free periods
+   */
+  onoff->runLengths(periods, free);
+  if (markov->runLengths(max_rand, 0, losses, inside)) {
+    return -1;
+  }
+  if (periods.empty() || free.empty()) {
+    /* No loss, or a single error period */
+    netem.fit(losses, inside.empty() ? free : inside);
+    return 0;
+  }
+
+  /*
+   * Per error period: 'internal' short received runs, 'internal' + 1 lost runs and 'pairs' consecutive lost packets
+   * in the chain, one of them being actually separated by an error-free period
+   */
+  period = NetemModel::mean(periods);
+  rate = inside.empty() ? 1. : NetemModel::mean(losses) / (NetemModel::mean(losses) + NetemModel::mean(inside));
+  internal = inside.empty() ? 0. : (1 - rate) * period / NetemModel::mean(inside);
+  pairs = rate * period - internal;
+  if (markov->runLengths(max_rand, (pairs > 1) ? 1. / pairs : 1., losses, inside)) {
+    return -1;
+  }
+
+  /* Received runs: the error-free period and the short runs of an error period */
+  wa = 1. / (internal + 1);
+  a = free.begin();
+  b = inside.begin();
+  while ((a != free.end()) || (b != inside.end())) {
+    if ((b == inside.end()) || ((a != free.end()) && (a->first < b->first))) {
+      receptions.push_back(std::make_pair(a->first, wa * a->second));
+      ++a;
+    } else if ((a == free.end()) || (b->first < a->first)) {
+      receptions.push_back(std::make_pair(b->first, (1 - wa) * b->second));
+      ++b;
+    } else {
+      receptions.push_back(std::make_pair(a->first, wa * a->second + (1 - wa) * b->second));
+      ++a;
+      ++b;
+    }
+  }
+  netem.fit(losses, receptions);
+  return 0;
+}
+
 void
 ParamBasicMTA::printBinary(void)
 {
@@ -213,6 +385,16 @@ ParamBasicMTA::printBinary(void)
   markov->printBinary();
 }
 
+int
+ParamBasicMTA::printPacked(const uint32_t max_rand)
+{
+  /* Use the sub-modules to print in packed format */
+  if (onoff->printPacked(max_rand) || markov->printPacked(max_rand)) {
+    return -1;
+  }
+  return 0;
+}
+
 void
 ParamBasicMTA::printHuman(const uint32_t max_rand)
 {
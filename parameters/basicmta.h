@@ -3,17 +3,32 @@
 
 #include "module.h"
 #include <getopt.h>
-#include <map>
 #include <iostream>
 #include <fstream>
 
 #include "markovchain.h"
 #include "basiconoff.h"
+#include "runbuffer.h"
+#include "quantile.h"
+
+//! Default memory used to record the trace between the two rounds (256MiB, 64M bursts)
+#define DEFAULT_RUN_MEMORY (((size_t) 256) << 20)
+
+//! Threshold C: mean plus standard deviation of the error burst lengths (default)
+#define MTA_THRESHOLD_STDDEV 0
+//! Threshold C: percentile of the error burst lengths
+#define MTA_THRESHOLD_PERCENTILE 1
+//! Threshold C: fixed value
+#define MTA_THRESHOLD_FIXED 2
 
 /**
  * Extract a Basic MTA representation.
  * Basic MTA is a "simplified" version of the standard MTA model where instead of trying to fit a mathematical representation of the distribution of the
- * error/error-free lengths, it directly return the CDF of those.
+ * error/error-free lengths, it directly return the CDF of those.\n
+ * The trace is only read once: the first round records it as a run-length vector (4 bytes per burst,
+ * bounded by --run-memory) that is replayed from memory, or from a temporary file with --spill, for the second round.\n
+ * The first round only keeps streaming statistics of the error burst lengths to compute the threshold C
+ * (Welford's mean and variance, or a P-square percentile estimation), no histogram is built.
  */
 class ParamBasicMTA : public ParamModule {
 
@@ -26,7 +41,16 @@ class ParamBasicMTA : public ParamModule {
      * Error message: This module need more files
      */
     static const char * const needfiles;
+    /**
+     * Error message: The run-length record is full
+     */
+    static const char * const bufferfull;
+    /**
+     * Error message: Invalid threshold rule
+     */
+    static const char * const badthreshold;
 
+  protected:
     //! State of the last packet (success/error)
     bool current_state;
     //! Duration of the last state (number of consecutive packets in that state)
@@ -36,6 +60,8 @@ class ParamBasicMTA : public ParamModule {
 
     //! Are-we in the second round or the first ?
     bool second_round;
+    //! Run-length record of the trace, filled during the first round and replayed for the second
+    RunBuffer runs;
     //! Markov chain used to caracterize the concatenated error bursts
     ParamMarckovChain *markov;
     //! Basic On-Off model used to caracterize the distributions of error/error-free bursts
@@ -43,6 +69,18 @@ class ParamBasicMTA : public ParamModule {
     //! Threshold between error-free error-free bursts and error error-free bursts
     uint32_t C;
 
+    /* First round: statistics of the error burst lengths */
+    //! Rule used to compute C (MTA_THRESHOLD_*)
+    int threshold_rule;
+    //! Number of error bursts
+    uint64_t error_bursts;
+    //! Mean length of the error bursts (Welford)
+    double error_mean;
+    //! Sum of the squared differences of the lengths to the mean (Welford)
+    double error_m2;
+    //! Estimation of the percentile of the error burst lengths (MTA_THRESHOLD_PERCENTILE)
+    StreamingQuantile error_quantile;
+
     /* Output */
     //! Ouput file for the error bursts distribution
     const char *error_filename;
@@ -51,15 +89,36 @@ class ParamBasicMTA : public ParamModule {
     //! Ouput file for the Markov chain of the concatenated error bursts
     const char *markov_filename;
 
+    /**
+     * Second round: add a run of identical input chars (same as 'len' calls to addChar)
+     * @param in True if the packets were received, False if they weren't
+     * @param len Number of packets
+     */
+    void addRun(const bool in, const uint32_t len);
+
+    /**
+     * First round: add a run of identical input chars to the current burst
+     * @param in True if the packets were received, False if they weren't
+     * @param len Number of packets
+     */
+    inline void addFirstRun(const bool in, const uint32_t len);
+
+    /**
+     * First round: register the current burst in the statistics if it is an error burst
+     */
+    inline void closeFirstBurst();
 
   public:
     /* Methodes of ParamModule */
     int init(const int, char **, const bool, const char**);
     void clean();
     int addChar(const bool);
+    int addBits(const uint64_t *, const size_t);
     bool nextRound();
     void finalize(const uint32_t);
+    int netemModel(const uint32_t, NetemModel&) const;
     void printBinary();
+    int printPacked(const uint32_t);
     void printHuman(const uint32_t);
 
     //! Name of this module
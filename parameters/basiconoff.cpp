@@ -2,6 +2,8 @@
 #define __STDC_LIMIT_MACROS
 
 #include "basiconoff.h"
+#include "counts.h"
+#include "paramwriter.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -28,6 +30,9 @@ ParamBasicOnOff::init(const char * const filename_error, const char * const file
   error_total = 0;
   current_state = false;
   length = 0;
+  fragment = false;
+  head_set = false;
+  half_life = 0;
   return 0;
 }
 
@@ -69,11 +74,13 @@ ParamBasicOnOff::init(const int argc, char **argv, const bool human_readable, co
 void
 ParamBasicOnOff::clean(void)
 {
-  /* Clear all the maps */
+  /* Clear all the histograms */
   success_length.clear();
   error_length.clear();
   success_length_final.clear();
   error_length_final.clear();
+  success_decayed.clear();
+  error_decayed.clear();
 }
 
 int
@@ -83,11 +90,8 @@ ParamBasicOnOff::addChar(const bool input)
     /* If we are still in the same state, increase the stored counter */
     ++length;
   } else {
-    /* The state is changing, use the other function to flush the internal counter */
-    /* Length can be null at the begining */
-    if (length) {
-      addChars(current_state, length);
-    }
+    /* The state is changing, flush the internal counter */
+    closeRun();
     /* Reset counter and state */
     current_state = input;
     length = 1;
@@ -95,62 +99,272 @@ ParamBasicOnOff::addChar(const bool input)
   return 0;
 }
 
+inline void
+ParamBasicOnOff::closeRun()
+{
+  /* Length can be null at the begining */
+  if (length) {
+    if (fragment && !head_set) {
+      /* The first burst of a part may continue the last burst of the previous part */
+      head_set = true;
+      head_state = current_state;
+      head_length = length;
+    } else {
+      /* Use the other function to register the burst */
+      addChars(current_state, length);
+    }
+  }
+}
+
+inline void
+ParamBasicOnOff::addRun(const bool input, const uint32_t len)
+{
+  if (input == current_state) {
+    length += len;
+  } else {
+    closeRun();
+    current_state = input;
+    length = len;
+  }
+}
+
+int
+ParamBasicOnOff::addBits(const uint64_t *words, const size_t nbits)
+{
+  size_t pos, run;
+  for (pos = 0; pos < nbits; pos += run) {
+    /* Runs are found by counting the trailing zeros of the words XORed with the run value */
+    run = runLength(words, pos, nbits);
+    addRun(bitAt(words, pos), (uint32_t) run);
+  }
+  return 0;
+}
+
 int
 ParamBasicOnOff::addChars(const bool input, const uint32_t len)
 {
-  std::map<uint32_t, uint64_t>::iterator temp;
   if (input) {
-    /* It's the end of an error-free burst, try to increase the corresponding mapped entry */
-    temp = success_length.find(len);
-    if (temp == success_length.end()) {
-      /* The entry didn't exist, create it */
-      success_length.insert(std::pair<uint32_t,uint64_t>(len, 1));
-    } else {
-      ++((*temp).second);
-    }
+    /* It's the end of an error-free burst */
+    success_length.increment(len);
     ++success_total;
   } else {
-    /* It's the end of an error burst, try to increase the corresponding mapped entry */
-    temp = error_length.find(len);
-    if (temp == error_length.end()) {
-      /* The entry didn't exist, create it */
-      error_length.insert(std::pair<uint32_t,uint64_t>(len, 1));
-    } else {
-      ++((*temp).second);
-    }
+    /* It's the end of an error burst */
+    error_length.increment(len);
     ++error_total;
   }
   return 0;
 }
 
-bool
-ParamBasicOnOff::nextRound()
+ParamModule*
+ParamBasicOnOff::fork(const uint64_t history, const unsigned int nbits)
 {
-  /* It's a one-pass algorithm */
-  return false;
+  ParamBasicOnOff *part = new ParamBasicOnOff();
+  part->error_filename = NULL;
+  part->free_filename = NULL;
+  part->init(NULL, NULL);
+  part->fragment = true;
+  return part;
 }
 
+int
+ParamBasicOnOff::join(ParamModule *p)
+{
+  ParamBasicOnOff *part = dynamic_cast<ParamBasicOnOff*>(p);
+  if (part == NULL) {
+    return -1;
+  }
+  if (part->head_set) {
+    /* The first burst of the part continues or follows our last burst, which is then complete */
+    addRun(part->head_state, part->head_length);
+    closeRun();
+    /* The bursts inside the part are complete */
+    success_length.merge(part->success_length);
+    error_length.merge(part->error_length);
+    success_total += part->success_total;
+    error_total += part->error_total;
+    /* The last burst of the part is still open */
+    current_state = part->current_state;
+    length = part->length;
+  } else if (part->length) {
+    /* The part is a single burst */
+    addRun(part->current_state, part->length);
+  }
+  part->clean();
+  delete part;
+  return 0;
+}
 
 void
-ParamBasicOnOff::calculate_values(const uint32_t manx_rand, const std::map<uint32_t, uint64_t> &map, const uint64_t total, std::map<uint32_t, uint32_t> &final)
+ParamBasicOnOff::saveHistogram(std::ostream& out, const BurstHistogram& histogram, const uint32_t extra)
 {
-  uint64_t temp_total = 0;
-  std::map<uint32_t, uint64_t>::const_iterator it;
+  BurstHistogram::const_iterator it;
+  const BurstHistogram *source = &histogram;
+  BurstHistogram copy;
+  if (extra) {
+    copy.merge(histogram);
+    copy.increment(extra);
+    source = &copy;
+  }
+  counts_write_u64(out, source->size());
+  for (it = source->begin(); it != source->end(); ++it) {
+    counts_write_u32(out, it->first);
+    counts_write_u64(out, it->second);
+  }
+}
 
-  for (it = map.begin(); it != map.end(); ++it) {
-    temp_total += (*it).second;
-    final.insert(std::pair<uint32_t,uint32_t>(it->first, (uint32_t)(((long double) temp_total) / ((long double) total) * ((long double) manx_rand))));
+int
+ParamBasicOnOff::loadHistogram(std::istream& in, BurstHistogram& histogram)
+{
+  uint64_t size, i, nb;
+  uint32_t len;
+  if (counts_read_u64(in, &size)) {
+    return -1;
+  }
+  for (i = 0; i < size; ++i) {
+    if (counts_read_u32(in, &len) || counts_read_u64(in, &nb)) {
+      return -1;
+    }
+    histogram.add(len, nb);
+  }
+  return 0;
+}
+
+/*
+ * Snapshot payload (the current burst is registered as if the trace ended here):
+ *  - uint64: total number of error-free bursts, then of error bursts
+ *  - error-free bursts histogram, then error bursts histogram, each being:
+ *    - uint64: number of distinct lengths
+ *    - for each length, by increasing length: uint32 length, uint64 number of bursts
+ */
+int
+ParamBasicOnOff::saveCounts(std::ostream& out)
+{
+  const uint32_t open_success = (length && current_state) ? length : 0;
+  const uint32_t open_error = (length && !current_state) ? length : 0;
+  counts_write_header(out, name());
+  counts_write_u64(out, success_total + (open_success ? 1 : 0));
+  counts_write_u64(out, error_total + (open_error ? 1 : 0));
+  saveHistogram(out, success_length, open_success);
+  saveHistogram(out, error_length, open_error);
+  return out.good() ? 0 : -1;
+}
+
+int
+ParamBasicOnOff::loadCounts(std::istream& in)
+{
+  int ret = counts_read_header(in, name());
+  if (ret) {
+    return ret;
+  }
+  success_length.clear();
+  error_length.clear();
+  current_state = false;
+  length = 0;
+  if (counts_read_u64(in, &success_total) || counts_read_u64(in, &error_total)) {
+    return -4;
+  }
+  if (loadHistogram(in, success_length) || loadHistogram(in, error_length)) {
+    return -5;
+  }
+  return 0;
+}
+
+int
+ParamBasicOnOff::merge(const ParamModule *o)
+{
+  const ParamBasicOnOff *other = dynamic_cast<const ParamBasicOnOff*>(o);
+  if (other == NULL) {
+    return -1;
+  }
+  success_length.merge(other->success_length);
+  error_length.merge(other->error_length);
+  success_total += other->success_total;
+  error_total += other->error_total;
+  /* The other trace is independent: its current burst is complete */
+  if (other->length) {
+    addChars(other->current_state, other->length);
+  }
+  return 0;
+}
+
+uint64_t
+ParamBasicOnOff::stateCount() const
+{
+  /* Distinct burst lengths */
+  return success_length.size() + error_length.size();
+}
+
+int
+ParamBasicOnOff::setHalfLife(const double h)
+{
+  if (!(h > 0)) {
+    return -1;
   }
+  half_life = h;
+  return 0;
+}
+
+void
+ParamBasicOnOff::foldHistogram(const double factor, const BurstHistogram& histogram, DecayedCounts& counts)
+{
+  BurstHistogram::const_iterator it;
+  DecayedCounts::Counts recent;
+  recent.reserve(histogram.size());
+  for (it = histogram.begin(); it != histogram.end(); ++it) {
+    recent.push_back(std::make_pair((uint64_t) it->first, it->second));
+  }
+  counts.fold(factor, recent);
+}
+
+void
+ParamBasicOnOff::decay(const uint64_t packets)
+{
+  const double factor = DecayedCounts::factor(packets, half_life);
+  /* The current burst is not over: it is counted by a later decay */
+  foldHistogram(factor, success_length, success_decayed);
+  foldHistogram(factor, error_length, error_decayed);
+  success_length.clear();
+  error_length.clear();
+  success_total = 0;
+  error_total = 0;
 }
 
+void
+ParamBasicOnOff::decayedCdf(const uint32_t max_rand, const DecayedCounts& counts, BurstCDF& dest)
+{
+  double temp_total = 0;
+  DecayedCounts::const_iterator it;
+
+  dest.clear();
+  dest.reserve(counts.size());
+  for (it = counts.begin(); it != counts.end(); ++it) {
+    temp_total += it->second;
+    dest.push_back(std::pair<uint32_t, uint32_t>((uint32_t) it->first, (uint32_t)(((long double) temp_total) / ((long double) counts.total()) * ((long double) max_rand))));
+  }
+}
+
+bool
+ParamBasicOnOff::nextRound()
+{
+  /* It's a one-pass algorithm */
+  return false;
+}
+
+
 void
 ParamBasicOnOff::finalize(const uint32_t max_rand)
 {
+  if (half_life > 0) {
+    /* Online snapshot: the current burst is still open, nothing is flushed */
+    decayedCdf(max_rand, success_decayed, success_length_final);
+    decayedCdf(max_rand, error_decayed, error_length_final);
+    return;
+  }
   /* Flush the last entry */
   addChar(!current_state);
   /* Create the final tables */
-  calculate_values(max_rand, success_length, success_total, success_length_final);
-  calculate_values(max_rand, error_length, error_total, error_length_final);
+  success_length.cdf(max_rand, success_total, success_length_final);
+  error_length.cdf(max_rand, error_total, error_length_final);
 }
 
 //! Try to write something to output and detect any error
@@ -163,10 +377,11 @@ ParamBasicOnOff::finalize(const uint32_t max_rand)
 //"
 
 void
-ParamBasicOnOff::printBinaryToFile(const std::map<uint32_t, uint32_t> &map, const char* dest)
+ParamBasicOnOff::printBinaryToFile(const BurstCDF &map, const char* dest)
 {
   std::ofstream output;
-  output.open(dest);
+  std::string output_name = paramfile_output(dest);
+  output.open(output_name.c_str());
 #if __WORDSIZE == 64
   size_t temp = map.size();
   assert(temp < UINT32_MAX);
@@ -175,12 +390,50 @@ ParamBasicOnOff::printBinaryToFile(const std::map<uint32_t, uint32_t> &map, cons
   uint32_t size = map.size();
 #endif /* __WORDSIZE == 64 */
   WRITE(size)
-  std::map<uint32_t, uint32_t>::const_iterator it;
+  BurstCDF::const_iterator it;
   for (it = map.begin(); it != map.end(); ++it) {
     WRITE(it->first);
     WRITE(it->second);
   }
   output.close();
+  if (paramfile_replace(dest, output_name)) {
+    std::cerr << "Unable to replace " << dest << std::endl;
+    exit(-1);
+  }
+}
+
+void
+ParamBasicOnOff::cdfRuns(const BurstCDF& distribution, RunLengths& runs)
+{
+  BurstCDF::const_iterator it;
+  uint32_t previous = 0;
+  runs.clear();
+  if (distribution.empty() || (distribution.back().second == 0)) {
+    return;
+  }
+  /* Normalized by the last value: the CDF is truncated below max_rand */
+  for (it = distribution.begin(); it != distribution.end(); ++it) {
+    if (it->second > previous) {
+      runs.push_back(std::make_pair((uint64_t) it->first, ((double) (it->second - previous)) / distribution.back().second));
+      previous = it->second;
+    }
+  }
+}
+
+void
+ParamBasicOnOff::runLengths(RunLengths& losses, RunLengths& receptions) const
+{
+  cdfRuns(error_length_final, losses);
+  cdfRuns(success_length_final, receptions);
+}
+
+int
+ParamBasicOnOff::netemModel(const uint32_t max_rand, NetemModel& netem) const
+{
+  RunLengths losses, receptions;
+  runLengths(losses, receptions);
+  netem.fit(losses, receptions);
+  return 0;
 }
 
 void
@@ -190,13 +443,38 @@ ParamBasicOnOff::printBinary(void)
   printBinaryToFile(error_length_final, error_filename);
 }
 
+int
+ParamBasicOnOff::printPackedToFile(const BurstCDF &map, const char* dest, const uint32_t max_rand)
+{
+  ParamWriter writer(PARAMFILE_CDF, max_rand, map.size());
+  BurstCDF::const_iterator it;
+  for (it = map.begin(); it != map.end(); ++it) {
+    writer.addU32(it->first);
+    writer.addU32(it->second);
+  }
+  if (writer.write(dest)) {
+    std::cerr << "error when writing to output" << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+int
+ParamBasicOnOff::printPacked(const uint32_t max_rand)
+{
+  if (printPackedToFile(success_length_final, free_filename, max_rand) || printPackedToFile(error_length_final, error_filename, max_rand)) {
+    return -1;
+  }
+  return 0;
+}
+
 void
-ParamBasicOnOff::printHumanToStream(const uint32_t max_rand, const std::map<uint32_t, uint32_t> &map, std::ostream &streamout)
+ParamBasicOnOff::printHumanToStream(const uint32_t max_rand, const BurstCDF &map, std::ostream &streamout)
 {
   streamout << "(MaxRand: 0x" << std::hex << max_rand << ")" << std::endl;
   streamout << "CDF size: " << map.size() << std::endl;
 
-  std::map<uint32_t, uint32_t>::const_iterator it;
+  BurstCDF::const_iterator it;
   for (it = map.begin(); it != map.end(); ++it) {
     streamout << "- " << it->first << ": 0x" << std::hex << it->second << " (" << ((long double)it->second/((long double) max_rand))*100 << "%)" << std::endl;
   }
@@ -2,8 +2,10 @@
 #define BASICONOFF_H
 
 #include "module.h"
+#include "histogram.h"
+#include "decay.h"
+#include "netem.h"
 #include <getopt.h>
-#include <map>
 #include <iostream>
 #include <fstream>
 
@@ -31,20 +33,38 @@ class ParamBasicOnOff : public ParamModule {
     uint64_t error_total;
 
     //! Collection of (length,number of error-free bursts of that lenght)
-    std::map<uint32_t, uint64_t> success_length;
+    BurstHistogram success_length;
     //! Collection of (length,number of error bursts of that lenght)
-    std::map<uint32_t, uint64_t> error_length;
+    BurstHistogram error_length;
 
     //! Collection of (length, Cumulated probability, in regard of rand_max, of an error-free bursts of that lenght)
-    std::map<uint32_t, uint32_t> success_length_final;
+    BurstCDF success_length_final;
     //! Collection of (length, Cumulated probability, in regard of rand_max, of an error bursts of that lenght)
-    std::map<uint32_t, uint32_t> error_length_final;
+    BurstCDF error_length_final;
 
     //! State of the last packet (success/error)
     bool current_state;
     //! Duration of the last state (number of consecutive packets in that state)
     uint32_t length;
 
+    /* Parallel counting (see fork) */
+    //! Is this module counting a part of the trace ? (its first burst may be continued by the previous part)
+    bool fragment;
+    //! Was the first burst of the part closed ?
+    bool head_set;
+    //! State of the first burst of the part
+    bool head_state;
+    //! Length of the first burst of the part
+    uint32_t head_length;
+
+    /* Online mode (exponential forgetting) */
+    //! Half-life of the counts, in packets (0 if not online)
+    double half_life;
+    //! Decayed number of error-free bursts of each length
+    DecayedCounts success_decayed;
+    //! Decayed number of error bursts of each length
+    DecayedCounts error_decayed;
+
     /* Output */
     //! Ouput file for the error bursts distribution
     const char *error_filename;
@@ -52,37 +72,97 @@ class ParamBasicOnOff : public ParamModule {
     const char *free_filename;
 
     /* Helper functions */
-    /**
-     * Extract '(*)_length_final' from '\1_length'.
-     * @param max_rand CLICK_RAND_MAX used by click
-     * @param source '\1_length'
-     * @param nb Number of elements
-     * @param dest '(*)_length_final'
-    */
-    static void calculate_values(const uint32_t max_rand, const std::map<uint32_t, uint64_t>& source, const uint64_t nb, std::map<uint32_t, uint32_t>& dest);
-
     /**
      * Print a distribution to a file, in 'binary' format
      * @param distribution Distribution to be printed
      * @param filename Name of the file in which we will print the output
      */
-    static void printBinaryToFile(const std::map<uint32_t, uint32_t>& distribution, const char* filename);
+    static void printBinaryToFile(const BurstCDF& distribution, const char* filename);
+    /**
+     * Probability of each length of a distribution
+     * @param distribution Distribution (cumulated probabilities, relatively to max_rand)
+     * @param runs Set to the probability of each length
+     */
+    static void cdfRuns(const BurstCDF& distribution, RunLengths& runs);
+    /**
+     * Print a distribution to a file, in the binary parameter format (see paramfile.h)
+     * @param distribution Distribution to be printed
+     * @param filename Name of the file in which we will print the output
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @return Ok: 0, -1 in case of error
+     */
+    static int printPackedToFile(const BurstCDF& distribution, const char* filename, const uint32_t max_rand);
     /**
      * Print a distribution to a file, in human-readable format
      * @param max_rand CLICK_RAND_MAX used by click
      * @param distribution Distribution to be printed
      * @param destination Destination in which we will print the output
      */
-    static void printHumanToStream(const uint32_t max_rand, const std::map<uint32_t, uint32_t>& distribution, std::ostream& destination);
+    static void printHumanToStream(const uint32_t max_rand, const BurstCDF& distribution, std::ostream& destination);
+
+    /**
+     * Add the bursts of a histogram to decayed counts (online mode)
+     * @param factor Decay factor of the old counts
+     * @param histogram Bursts counted since the previous decay
+     * @param counts Decayed counts
+     */
+    static void foldHistogram(const double factor, const BurstHistogram& histogram, DecayedCounts& counts);
+
+    /**
+     * Build the cumulative distribution function of decayed counts (online mode), as BurstHistogram::cdf
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @param counts Decayed number of bursts of each length
+     * @param dest Cumulative distribution function
+     */
+    static void decayedCdf(const uint32_t max_rand, const DecayedCounts& counts, BurstCDF& dest);
+
+    /**
+     * Add a run of identical input chars (same as 'len' calls to addChar)
+     * @param in True if the packets were received, False if they weren't
+     * @param len Number of packets
+     */
+    inline void addRun(const bool in, const uint32_t len);
+
+    /**
+     * Register the current burst, if any (or keep it aside if it's the first one of a part)
+     */
+    inline void closeRun();
+
+    /**
+     * Write a histogram to a count snapshot
+     * @param out Output stream
+     * @param histogram Histogram
+     * @param extra Length of a burst to count in addition to the histogram (0: none)
+     */
+    static void saveHistogram(std::ostream& out, const BurstHistogram& histogram, const uint32_t extra);
+
+    /**
+     * Read a histogram from a count snapshot
+     * @param in Input stream
+     * @param histogram Histogram, the bursts read are added to it
+     * @return Ok: 0, -1 in case of error
+     */
+    static int loadHistogram(std::istream& in, BurstHistogram& histogram);
 
   public:
     /* Methodes of ParamModule */
     int init(const int, char **, const bool, const char**);
     void clean();
     int addChar(const bool);
+    int addBits(const uint64_t *, const size_t);
+    ParamModule* fork(const uint64_t, const unsigned int);
+    int join(ParamModule *);
+    int saveCounts(std::ostream&);
+    int loadCounts(std::istream&);
+    int merge(const ParamModule *);
+    int setHalfLife(const double);
+    void decay(const uint64_t);
+    uint64_t stateCount() const;
     bool nextRound();
     void finalize(const uint32_t);
+    int netemModel(const uint32_t, NetemModel&) const;
     void printBinary();
+    int printPacked(const uint32_t);
     void printHuman(const uint32_t);
 
     /**
@@ -104,21 +184,28 @@ class ParamBasicOnOff : public ParamModule {
      */
     int addChars(const bool in, uint32_t len);
 
+    /**
+     * Distributions of the lengths of the error and error-free bursts, from the finalized CDFs
+     * @param losses Set to the probability of each length of the error bursts
+     * @param receptions Set to the probability of each length of the error-free bursts
+     */
+    void runLengths(RunLengths& losses, RunLengths& receptions) const;
+
     /* Get direct source data */
     //! Get the raw 'success_length'
-    const std::map<uint32_t, uint64_t>* getRawErrorFreeBurstLengthCDF(void) { return &success_length; }
+    const BurstHistogram* getRawErrorFreeBurstLengthCDF(void) { return &success_length; }
     //! Get the total number of error-free bursts
     uint64_t getRawErrorFreeBurstNumber(void) { return success_total; }
     //! Get the raw 'error_length'
-    const std::map<uint32_t, uint64_t>* getRawErrorBurstLengthCDF(void) { return &error_length; }
+    const BurstHistogram* getRawErrorBurstLengthCDF(void) { return &error_length; }
     //! Get the total number of error bursts
     uint64_t getRawErrorBurstNumber(void) { return error_total; }
 
     /* Get direct output data */
     //! Get the raw 'success_length_final'
-    const std::map<uint32_t, uint32_t>* getErrorFreeBurstLengthCDF(void) { return &success_length_final; }
+    const BurstCDF* getErrorFreeBurstLengthCDF(void) { return &success_length_final; }
     //! Get the raw 'error_length_final'
-    const std::map<uint32_t, uint32_t>* getErrorBurstLengthCDF(void) { return &error_length_final; }
+    const BurstCDF* getErrorBurstLengthCDF(void) { return &error_length_final; }
 
     //! Name of this module
     static const char* name() { return "basiconoff"; }
@@ -0,0 +1,333 @@
+/** @file batch.cpp Implementation of the batch mode: several input files, each with its own modules */
+
+#include "batch.h"
+#include "driver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <glob.h>
+#include <iostream>
+#include <map>
+#include <algorithm>
+
+/**
+ * Name of an input file in the output names: without its directory and extension (nor .gz)
+ * @param path Path of the file
+ * @return Name
+ */
+static std::string
+file_stem(const char *path)
+{
+  std::string name(path);
+  size_t pos = name.find_last_of('/');
+  if (pos != std::string::npos) {
+    name.erase(0, pos + 1);
+  }
+  if ((name.size() > 3) && (name.compare(name.size() - 3, 3, ".gz") == 0)) {
+    name.erase(name.size() - 3);
+  }
+  pos = name.find_last_of('.');
+  if ((pos != std::string::npos) && (pos > 0)) {
+    name.erase(pos);
+  }
+  return name;
+}
+
+int
+expand_inputs(const std::vector<const char*> &patterns, std::vector<std::string> *files)
+{
+  std::vector<const char*>::const_iterator it;
+  glob_t matches;
+  size_t i;
+
+  for (it = patterns.begin(); it != patterns.end(); ++it) {
+    if ((strpbrk(*it, "*?[") == NULL) || (access(*it, F_OK) == 0)) {
+      files->push_back(*it);
+      continue;
+    }
+    if (glob(*it, 0, NULL, &matches) != 0) {
+      std::cerr << "No input file matches " << *it << std::endl;
+      return -12;
+    }
+    for (i = 0; i < matches.gl_pathc; ++i) {
+      files->push_back(matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+  }
+  return 0;
+}
+
+/**
+ * Read an input file and feed it to the ParamModules (one or two rounds), counting the lost packets
+ * @param input_file Name of the input file
+ * @param mods Modules to feed
+ * @param packets Set to the number of packets
+ * @param losses Set to the number of lost packets (0)
+ * @return : 0K : 0, error-code if != 0
+ */
+static int
+read_counted(const char *input_file, const ModuleList &mods, uint64_t *packets, uint64_t *losses)
+{
+  TraceReader in;
+  const uint64_t *words;
+  ModuleList second;
+  ModuleList::const_iterator it;
+  ssize_t nbits;
+  size_t i, n;
+  uint64_t word;
+  int ret;
+
+  if (in.open(input_file)) {
+    std::cerr << "Unable to read " << input_file << " (" << strerror(errno) << ")" << std::endl;
+    return -12;
+  }
+  *packets = 0;
+  *losses = 0;
+  while ((nbits = in.next(&words)) > 0) {
+    n = (((size_t) nbits) + 63) >> 6;
+    for (i = 0; i < n; ++i) {
+      word = words[i];
+      if ((i + 1 == n) && ((nbits & 63) != 0)) {
+        word &= (((uint64_t) 1) << (nbits & 63)) - 1;
+      }
+      *losses += (uint64_t) __builtin_popcountll(word);
+    }
+    *packets += (uint64_t) nbits;
+    for (it = mods.begin(); it != mods.end(); ++it) {
+      ret = (*it)->addBits(words, (size_t) nbits);
+      if (ret) {
+        std::cerr << "Parsing error" << ret << std::endl;
+        return ret;
+      }
+    }
+  }
+  if (nbits < 0) {
+    return read_error(&in, nbits);
+  }
+  *losses = *packets - *losses;
+
+  /* Do a second run if needed */
+  for (it = mods.begin(); it != mods.end(); ++it) {
+    if ((*it)->nextRound()) {
+      second.push_back(*it);
+    }
+  }
+  if (!second.empty()) {
+    if (in.rewind()) {
+      std::cerr << "2nd round needed, input file needed" << std::endl;
+      return -13;
+    }
+    ret = extract(&in, second);
+    if (ret) {
+      return ret;
+    }
+  }
+  in.close();
+  return 0;
+}
+
+/**
+ * Input files processed by the threads of the batch mode
+ */
+struct batch_work {
+  const std::vector<std::string> *files;            //!< Input files
+  const std::vector<std::pair<int, char**> > *classes; //!< Arguments of the classes, '%f' and '%n' standing for the file
+  bool human_readable;                              //!< Generate output human-readable or not
+  int format;                                       //!< Format of the non human-readable output (OUTPUT_*)
+  uint32_t max_rand;                                //!< CLICK_RAND_MAX used by click
+  std::ostream *summary;                            //!< Destination of the summary table
+  size_t next;                                      //!< Next file to process
+  pthread_mutex_t lock;                             //!< Protects 'next', 'ret' and the creation of modules (getopt)
+  pthread_mutex_t print_lock;                       //!< Protects the outputs
+  int ret;                                          //!< First error
+};
+
+/**
+ * Process one input file of the batch mode: count it, print the parameters and a line of the summary
+ * @param w Batch
+ * @param index Index of the file
+ * @return : 0K : 0, error-code if != 0
+ */
+static int
+process_file(struct batch_work *w, const size_t index)
+{
+  const char *file = (*w->files)[index].c_str();
+  std::vector<struct class_args> args(w->classes->size());
+  Patterns patterns;
+  ModuleList mods;
+  ModuleList::const_iterator it;
+  ParamModule *mod;
+  uint64_t packets = 0, losses = 0;
+  std::vector<uint64_t> states;
+  struct timeval start;
+  char number[24];
+  size_t i;
+  int ret = 0;
+
+  gettimeofday(&start, NULL);
+  snprintf(number, sizeof(number), "%zu", index + 1);
+  patterns.push_back(std::make_pair(std::string("%f"), file_stem(file)));
+  patterns.push_back(std::make_pair(std::string("%n"), std::string(number)));
+  pthread_mutex_lock(&w->lock);
+  for (i = 0; i < args.size(); ++i) {
+    expand_args((*w->classes)[i].first, (*w->classes)[i].second, patterns, &args[i]);
+    mod = create_module((int) args[i].args.size(), &args[i].argv[0], w->human_readable, w->format, &ret);
+    if (mod == NULL) {
+      break;
+    }
+    mods.push_back(mod);
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  if (ret == 0) {
+    ret = read_counted(file, mods, &packets, &losses);
+  }
+  if (ret == 0) {
+    for (it = mods.begin(); it != mods.end(); ++it) {
+      states.push_back((*it)->stateCount());
+      (*it)->finalize(w->max_rand);
+    }
+    pthread_mutex_lock(&w->print_lock);
+    if (w->human_readable) {
+      std::cout << std::dec << "File " << file << std::endl;
+    }
+    ret = print_finalized(mods, w->human_readable, w->format, w->max_rand);
+    if (ret == 0) {
+      *w->summary << std::dec << file << " " << packets << " "
+                  << (packets ? ((double) losses) / ((double) packets) : 0) << " " << elapsed(&start);
+      for (i = 0; i < states.size(); ++i) {
+        *w->summary << " " << states[i];
+      }
+      *w->summary << std::endl;
+    }
+    pthread_mutex_unlock(&w->print_lock);
+  }
+  if (ret) {
+    pthread_mutex_lock(&w->print_lock);
+    std::cerr << "Unable to process " << file << " (" << ret << ")" << std::endl;
+    pthread_mutex_unlock(&w->print_lock);
+  }
+  drop_parts(mods);
+  return ret;
+}
+
+/**
+ * Thread entry point: process input files until there is no more
+ * @param arg The batch (struct batch_work)
+ * @return NULL
+ */
+static void *
+process_files(void *arg)
+{
+  struct batch_work *w = (struct batch_work *) arg;
+  size_t index;
+  int ret;
+  for (;;) {
+    pthread_mutex_lock(&w->lock);
+    index = w->next++;
+    pthread_mutex_unlock(&w->lock);
+    if (index >= w->files->size()) {
+      break;
+    }
+    ret = process_file(w, index);
+    if (ret) {
+      pthread_mutex_lock(&w->lock);
+      if (w->ret == 0) {
+        w->ret = ret;
+      }
+      pthread_mutex_unlock(&w->lock);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Verify that the output names of the batch mode are distinct: the names of two files may give the same '%f'
+ * @param files Input files
+ * @param classes Arguments of the classes (argc, argv), '%f' standing for the name of the file and '%n' for its number
+ * @return : 0K : 0, error-code if != 0
+ */
+static int
+check_outputs(const std::vector<std::string> &files, const std::vector<std::pair<int, char**> > &classes)
+{
+  std::map<std::string, size_t> outputs;
+  std::map<std::string, size_t>::const_iterator found;
+  struct class_args args;
+  Patterns patterns(2);
+  char number[24];
+  size_t f, i;
+  int a;
+
+  patterns[0].first = "%f";
+  patterns[1].first = "%n";
+  for (f = 0; f < files.size(); ++f) {
+    snprintf(number, sizeof(number), "%zu", f + 1);
+    patterns[0].second = file_stem(files[f].c_str());
+    patterns[1].second = number;
+    for (i = 0; i < classes.size(); ++i) {
+      expand_args(classes[i].first, classes[i].second, patterns, &args);
+      for (a = 1; a < classes[i].first; ++a) {
+        /* Only the arguments depending on the file are outputs of this file */
+        if ((strstr(classes[i].second[a], "%f") == NULL) && (strstr(classes[i].second[a], "%n") == NULL)) {
+          continue;
+        }
+        found = outputs.find(args.args[(size_t) a]);
+        if ((found != outputs.end()) && (found->second != f)) {
+          std::cerr << files[found->second] << " and " << files[f] << " both give the output " << args.args[(size_t) a]
+                    << " (use %n to number the outputs)" << std::endl;
+          return -19;
+        }
+        outputs[args.args[(size_t) a]] = f;
+      }
+    }
+  }
+  return 0;
+}
+
+int
+read_batch(const std::vector<std::string> &files, const std::vector<std::pair<int, char**> > &classes,
+           const unsigned int threads, const bool human_readable, const int format, const uint32_t max_rand)
+{
+  struct batch_work work;
+  std::vector<pthread_t> ids(std::min((size_t) threads, files.size()));
+  size_t i;
+  int ret;
+
+  ret = check_outputs(files, classes);
+  if (ret) {
+    return ret;
+  }
+  work.files = &files;
+  work.classes = &classes;
+  work.human_readable = human_readable;
+  work.format = format;
+  work.max_rand = max_rand;
+  /* The human-readable and netem parameters go to the standard output */
+  work.summary = (human_readable || (format == OUTPUT_NETEM)) ? &std::cerr : &std::cout;
+  work.next = 0;
+  work.ret = 0;
+  pthread_mutex_init(&work.lock, NULL);
+  pthread_mutex_init(&work.print_lock, NULL);
+
+  *work.summary << "# file packets loss-rate seconds";
+  for (i = 0; i < classes.size(); ++i) {
+    *work.summary << " states(" << classes[i].second[0] << ")";
+  }
+  *work.summary << std::endl;
+  for (i = 0; i < ids.size(); ++i) {
+    if (pthread_create(&ids[i], NULL, process_files, &work)) {
+      std::cerr << "Unable to create thread" << std::endl;
+      exit(-1);
+    }
+  }
+  for (i = 0; i < ids.size(); ++i) {
+    pthread_join(ids[i], NULL);
+  }
+  pthread_mutex_destroy(&work.print_lock);
+  pthread_mutex_destroy(&work.lock);
+  return work.ret;
+}
@@ -0,0 +1,31 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Expand the input files of the batch mode: the patterns which are not existing files are matched with glob
+ * @param patterns Files or patterns
+ * @param files Set to the files
+ * @return : 0K : 0, error-code if != 0
+ */
+int expand_inputs(const std::vector<const char*> &patterns, std::vector<std::string> *files);
+
+/**
+ * Process several input files, each with its own modules, on a pool of threads.
+ * A failing file is reported and the others are still processed.
+ * @param files Input files
+ * @param classes Arguments of the classes (argc, argv), '%f' standing for the name of the file and '%n' for its number
+ * @param threads Number of files processed at the same time
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @return : 0K : 0, error-code of the first failing file otherwise
+ */
+int read_batch(const std::vector<std::string> &files, const std::vector<std::pair<int, char**> > &classes,
+               const unsigned int threads, const bool human_readable, const int format, const uint32_t max_rand);
+
+#endif
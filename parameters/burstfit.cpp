@@ -0,0 +1,419 @@
+/** @file burstfit.cpp Implementation of the parametric burst length distributions */
+
+#include "burstfit.h"
+
+#include <math.h>
+#include <float.h>
+#include <vector>
+
+//! Maximal number of evaluations of the likelihood when maximizing it numerically
+#define BURSTFIT_MAX_EVALUATIONS 4000
+//! Maximal number of iterations of the Expectation-Maximization of the mixture
+#define BURSTFIT_MAX_EM 1000
+//! Relative improvement of the log-likelihood under which the maximization stops
+#define BURSTFIT_TOLERANCE 1e-12
+
+//! Distinct lengths of a histogram: (length, number of bursts)
+typedef std::vector<std::pair<uint32_t, double> > burst_points;
+
+/**
+ * Log-likelihood of distinct lengths
+ * @param d Distribution
+ * @param points Distinct lengths
+ * @return Log-likelihood
+ */
+static double
+points_log_likelihood(const BurstDistribution& d, const burst_points& points)
+{
+  double ll = 0;
+  burst_points::const_iterator it;
+  for (it = points.begin(); it != points.end(); ++it) {
+    ll += it->second * d.logProbability(it->first);
+  }
+  return ll;
+}
+
+/**
+ * Logarithm of a probability computed as a difference, floored to avoid -inf on underflow
+ * @param p Probability
+ * @return log(p)
+ */
+static inline double
+safe_log(const double p)
+{
+  return log((p > DBL_MIN) ? p : DBL_MIN);
+}
+
+//! Log of P(length = len) for a geometric distribution
+static inline double
+geometric_log_probability(const double q, const uint32_t len)
+{
+  if (len == 1) {
+    return log1p(-q);
+  }
+  return log1p(-q) + ((double) (len - 1)) * safe_log(q);
+}
+
+unsigned int
+BurstDistribution::parameterCount(const uint32_t family)
+{
+  switch (family) {
+    case BURSTFIT_GEOMETRIC:
+    case BURSTFIT_PARETO:
+      return 1;
+    case BURSTFIT_WEIBULL:
+    case BURSTFIT_LOGNORMAL:
+      return 2;
+    case BURSTFIT_GEOMETRIC_MIXTURE:
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+const char*
+BurstDistribution::familyName(const uint32_t family)
+{
+  switch (family) {
+    case BURSTFIT_GEOMETRIC:
+      return "geometric";
+    case BURSTFIT_WEIBULL:
+      return "weibull";
+    case BURSTFIT_PARETO:
+      return "pareto";
+    case BURSTFIT_LOGNORMAL:
+      return "lognormal";
+    case BURSTFIT_GEOMETRIC_MIXTURE:
+      return "geometric-mixture";
+    default:
+      return "none";
+  }
+}
+
+double
+BurstDistribution::logProbability(const uint32_t len) const
+{
+  double a, b, l = (double) len;
+  switch (family) {
+    case BURSTFIT_GEOMETRIC:
+      return geometric_log_probability(params[0], len);
+    case BURSTFIT_WEIBULL:
+      /* P(length > l) = exp(-(l / scale)^shape) */
+      a = pow((l - 1) / params[0], params[1]);
+      b = pow(l / params[0], params[1]);
+      return -a + safe_log(-expm1(a - b));
+    case BURSTFIT_PARETO:
+      /* P(length >= l) = l^-alpha */
+      return -params[0] * log(l) + safe_log(-expm1(-params[0] * log1p(1 / l)));
+    case BURSTFIT_LOGNORMAL:
+      /* P(length <= l) = Phi((log(l) - mu) / sigma) */
+      b = (log(l) - params[0]) / params[1];
+      if (len == 1) {
+        return safe_log(0.5 * erfc(-b / M_SQRT2));
+      }
+      a = (log(l - 1) - params[0]) / params[1];
+      if (a > 0) {
+        /* Use the upper tail, more precise */
+        return safe_log(0.5 * (erfc(a / M_SQRT2) - erfc(b / M_SQRT2)));
+      }
+      return safe_log(0.5 * (erfc(-b / M_SQRT2) - erfc(-a / M_SQRT2)));
+    case BURSTFIT_GEOMETRIC_MIXTURE:
+      a = log(params[0]) + geometric_log_probability(params[1], len);
+      b = log1p(-params[0]) + geometric_log_probability(params[2], len);
+      if (a < b) {
+        return b + log1p(exp(a - b));
+      }
+      return a + log1p(exp(b - a));
+    default:
+      return -HUGE_VAL;
+  }
+}
+
+double
+BurstDistribution::logLikelihood(const BurstHistogram& histogram) const
+{
+  double ll = 0;
+  BurstHistogram::const_iterator it;
+  for (it = histogram.begin(); it != histogram.end(); ++it) {
+    ll += ((double) it->second) * logProbability(it->first);
+  }
+  return ll;
+}
+
+//! Function maximized by nelder_mead
+struct fit_target {
+  //! Distinct lengths
+  const burst_points *points;
+  //! Distribution, its parameters are set from the point evaluated
+  BurstDistribution distribution;
+};
+
+/**
+ * Negative log-likelihood of a point of the search space.
+ * The positive parameters are searched by their logarithm.
+ * @param x Point
+ * @param target Function
+ * @return -log-likelihood, HUGE_VAL if undefined
+ */
+static double
+fit_evaluate(const double *x, fit_target& target)
+{
+  double ll;
+  switch (target.distribution.family) {
+    case BURSTFIT_WEIBULL:
+      target.distribution.params[0] = exp(x[0]);
+      target.distribution.params[1] = exp(x[1]);
+      break;
+    case BURSTFIT_PARETO:
+      target.distribution.params[0] = exp(x[0]);
+      break;
+    case BURSTFIT_LOGNORMAL:
+      target.distribution.params[0] = x[0];
+      target.distribution.params[1] = exp(x[1]);
+      break;
+  }
+  ll = points_log_likelihood(target.distribution, *target.points);
+  if (isnan(ll)) {
+    return HUGE_VAL;
+  }
+  return -ll;
+}
+
+/**
+ * Minimize a function with the Nelder-Mead simplex method
+ * @param target Function
+ * @param x Starting point, set to the minimum found
+ * @param n Number of dimensions (<= BURSTFIT_MAX_PARAMS)
+ * @param step Size of the initial simplex
+ */
+static void
+nelder_mead(fit_target& target, double *x, const unsigned int n, const double step)
+{
+  double simplex[BURSTFIT_MAX_PARAMS + 1][BURSTFIT_MAX_PARAMS], value[BURSTFIT_MAX_PARAMS + 1];
+  double centroid[BURSTFIT_MAX_PARAMS], trial[BURSTFIT_MAX_PARAMS], expanded[BURSTFIT_MAX_PARAMS];
+  double f_trial, f_expanded;
+  unsigned int i, j, best, worst, second, evaluations = 0;
+
+  for (i = 0; i <= n; ++i) {
+    for (j = 0; j < n; ++j) {
+      simplex[i][j] = x[j] + (((i != 0) && (i - 1 == j)) ? step : 0);
+    }
+    value[i] = fit_evaluate(simplex[i], target);
+    ++evaluations;
+  }
+  while (evaluations < BURSTFIT_MAX_EVALUATIONS) {
+    /* Order: best, second worst, worst */
+    best = 0;
+    worst = 0;
+    for (i = 1; i <= n; ++i) {
+      if (value[i] < value[best]) {
+        best = i;
+      }
+      if (value[i] > value[worst]) {
+        worst = i;
+      }
+    }
+    second = best;
+    for (i = 0; i <= n; ++i) {
+      if ((i != worst) && (value[i] > value[second])) {
+        second = i;
+      }
+    }
+    if (value[worst] - value[best] <= BURSTFIT_TOLERANCE * (fabs(value[best]) + DBL_MIN)) {
+      break;
+    }
+    for (j = 0; j < n; ++j) {
+      centroid[j] = 0;
+      for (i = 0; i <= n; ++i) {
+        if (i != worst) {
+          centroid[j] += simplex[i][j] / n;
+        }
+      }
+    }
+    /* Reflection */
+    for (j = 0; j < n; ++j) {
+      trial[j] = 2 * centroid[j] - simplex[worst][j];
+    }
+    f_trial = fit_evaluate(trial, target);
+    ++evaluations;
+    if (f_trial < value[best]) {
+      /* Expansion */
+      for (j = 0; j < n; ++j) {
+        expanded[j] = 3 * centroid[j] - 2 * simplex[worst][j];
+      }
+      f_expanded = fit_evaluate(expanded, target);
+      ++evaluations;
+      if (f_expanded < f_trial) {
+        for (j = 0; j < n; ++j) {
+          trial[j] = expanded[j];
+        }
+        f_trial = f_expanded;
+      }
+    } else if (!(f_trial < value[second])) {
+      /* Contraction, toward the best of the worst point and the reflected one */
+      if (f_trial < value[worst]) {
+        for (j = 0; j < n; ++j) {
+          simplex[worst][j] = trial[j];
+        }
+        value[worst] = f_trial;
+      }
+      for (j = 0; j < n; ++j) {
+        trial[j] = (centroid[j] + simplex[worst][j]) / 2;
+      }
+      f_trial = fit_evaluate(trial, target);
+      ++evaluations;
+      if (!(f_trial < value[worst])) {
+        /* Shrink toward the best point */
+        for (i = 0; i <= n; ++i) {
+          if (i != best) {
+            for (j = 0; j < n; ++j) {
+              simplex[i][j] = (simplex[i][j] + simplex[best][j]) / 2;
+            }
+            value[i] = fit_evaluate(simplex[i], target);
+            ++evaluations;
+          }
+        }
+        continue;
+      }
+    }
+    for (j = 0; j < n; ++j) {
+      simplex[worst][j] = trial[j];
+    }
+    value[worst] = f_trial;
+  }
+  best = 0;
+  for (i = 1; i <= n; ++i) {
+    if (value[i] < value[best]) {
+      best = i;
+    }
+  }
+  for (j = 0; j < n; ++j) {
+    x[j] = simplex[best][j];
+  }
+  fit_evaluate(x, target);
+}
+
+/**
+ * Fit a mixture of two geometric distributions with the Expectation-Maximization algorithm
+ * @param points Distinct lengths
+ * @param mean Mean length
+ * @param d Distribution, set to the mixture
+ */
+static void
+fit_mixture(const burst_points& points, const double mean, BurstDistribution& d)
+{
+  double weight, sum, sum_length, total, r, ll, previous = -HUGE_VAL;
+  unsigned int iteration;
+  burst_points::const_iterator it;
+
+  /* Start from a short and a long component around the mean */
+  d.params[0] = 0.5;
+  d.params[1] = 1 - 1 / (1 + (mean - 1) / 4);
+  d.params[2] = 1 - 1 / (1 + (mean - 1) * 4);
+  for (iteration = 0; iteration < BURSTFIT_MAX_EM; ++iteration) {
+    /* Expectation: share of each length coming from the first component */
+    weight = 0;
+    sum = 0;
+    sum_length = 0;
+    total = 0;
+    ll = 0;
+    for (it = points.begin(); it != points.end(); ++it) {
+      const double a = log(d.params[0]) + geometric_log_probability(d.params[1], it->first);
+      const double b = log1p(-d.params[0]) + geometric_log_probability(d.params[2], it->first);
+      r = 1 / (1 + exp(b - a));
+      ll += it->second * ((a < b) ? b + log1p(exp(a - b)) : a + log1p(exp(b - a)));
+      weight += it->second * r;
+      sum += it->second * r * it->first;
+      sum_length += it->second * it->first;
+      total += it->second;
+    }
+    if (ll - previous <= BURSTFIT_TOLERANCE * fabs(ll)) {
+      break;
+    }
+    previous = ll;
+    /* Maximization: the mean of each component gives its q */
+    if (!(weight > 0) || !(weight < total)) {
+      break;
+    }
+    d.params[0] = weight / total;
+    d.params[1] = 1 - weight / sum;
+    d.params[2] = 1 - (total - weight) / (sum_length - sum);
+  }
+}
+
+BurstDistribution
+BurstDistribution::fit(const uint32_t family, const BurstHistogram& histogram)
+{
+  BurstDistribution d;
+  burst_points points;
+  BurstHistogram::const_iterator it;
+  double total = 0, mean = 0, log_mean = 0, log_variance = 0, temp, x[BURSTFIT_MAX_PARAMS];
+  burst_points::const_iterator p;
+  fit_target target;
+
+  points.reserve(histogram.size());
+  for (it = histogram.begin(); it != histogram.end(); ++it) {
+    points.push_back(std::pair<uint32_t, double>(it->first, (double) it->second));
+    total += (double) it->second;
+    mean += ((double) it->first) * ((double) it->second);
+  }
+  mean /= total;
+
+  d.family = family;
+  target.points = &points;
+  target.distribution = d;
+  switch (family) {
+    case BURSTFIT_GEOMETRIC:
+      /* Closed form */
+      d.params[0] = 1 - 1 / mean;
+      break;
+    case BURSTFIT_WEIBULL:
+      /* Start from the geometric distribution (shape 1) */
+      x[0] = (mean > 1) ? -log(-log1p(-1 / mean)) : 0;
+      x[1] = 0;
+      nelder_mead(target, x, 2, 0.5);
+      d = target.distribution;
+      break;
+    case BURSTFIT_PARETO:
+      x[0] = 0;
+      nelder_mead(target, x, 1, 0.5);
+      d = target.distribution;
+      break;
+    case BURSTFIT_LOGNORMAL:
+      /* Start from the moments of the logarithm of the lengths */
+      for (p = points.begin(); p != points.end(); ++p) {
+        log_mean += log(p->first - 0.5) * p->second / total;
+      }
+      for (p = points.begin(); p != points.end(); ++p) {
+        temp = log(p->first - 0.5) - log_mean;
+        log_variance += temp * temp * p->second / total;
+      }
+      x[0] = log_mean;
+      x[1] = (log_variance > 0.01) ? log(sqrt(log_variance)) : log(0.1);
+      nelder_mead(target, x, 2, 0.5);
+      d = target.distribution;
+      break;
+    case BURSTFIT_GEOMETRIC_MIXTURE:
+      fit_mixture(points, mean, d);
+      break;
+  }
+  d.log_likelihood = points_log_likelihood(d, points);
+  return d;
+}
+
+BurstDistribution
+BurstDistribution::fitBest(const BurstHistogram& histogram, BurstDistribution *all)
+{
+  BurstDistribution best, current;
+  uint32_t family;
+  for (family = 1; family <= BURSTFIT_FAMILIES; ++family) {
+    current = fit(family, histogram);
+    if (all != NULL) {
+      all[family - 1] = current;
+    }
+    if ((best.family == 0) || (current.aic() < best.aic())) {
+      best = current;
+    }
+  }
+  return best;
+}
@@ -0,0 +1,83 @@
+#ifndef BURSTFIT_H
+#define BURSTFIT_H
+
+#include "histogram.h"
+
+//! Geometric distribution, parameter: q (probability to continue the burst)
+#define BURSTFIT_GEOMETRIC 1
+//! Discretized Weibull distribution, parameters: scale, shape
+#define BURSTFIT_WEIBULL 2
+//! Discretized Pareto distribution (minimum 1), parameter: alpha
+#define BURSTFIT_PARETO 3
+//! Discretized lognormal distribution, parameters: mu, sigma
+#define BURSTFIT_LOGNORMAL 4
+//! Mixture of two geometric distributions, parameters: weight of the first one, q1, q2
+#define BURSTFIT_GEOMETRIC_MIXTURE 5
+
+//! Number of families
+#define BURSTFIT_FAMILIES 5
+//! Maximal number of parameters of a family
+#define BURSTFIT_MAX_PARAMS 3
+
+/**
+ * Parametric distribution of burst lengths (lengths >= 1).
+ * Each family is sampled in O(1) from uniform random numbers U in (0,1):
+ *  - geometric: 1 + floor(log(U) / log(q))
+ *  - Weibull: ceil(scale * (-log(U))^(1 / shape)), at least 1
+ *  - Pareto: floor(U^(-1 / alpha))
+ *  - lognormal: ceil(exp(mu + sigma * Z)), at least 1, Z standard normal (Box-Muller)
+ *  - mixture: geometric with q1 if U < weight, with q2 otherwise
+ */
+class BurstDistribution {
+
+  public:
+    //! Family (BURSTFIT_*), 0 if not fitted
+    uint32_t family;
+    //! Parameters
+    double params[BURSTFIT_MAX_PARAMS];
+    //! Log-likelihood of the histogram the distribution was fitted on
+    double log_likelihood;
+
+    BurstDistribution() : family(0), log_likelihood(0) {}
+
+    //! Number of parameters of a family
+    static unsigned int parameterCount(const uint32_t family);
+    //! Name of a family
+    static const char* familyName(const uint32_t family);
+
+    /**
+     * Logarithm of the probability of a length
+     * @param len Length of the burst (>= 1)
+     * @return log(P(length = len))
+     */
+    double logProbability(const uint32_t len) const;
+
+    /**
+     * Log-likelihood of a histogram
+     * @param histogram Histogram of burst lengths
+     * @return Sum over the bursts of log(P(length))
+     */
+    double logLikelihood(const BurstHistogram& histogram) const;
+
+    //! Akaike information criterion: 2 * number of parameters - 2 * log-likelihood
+    double aic() const { return 2.0 * parameterCount(family) - 2.0 * log_likelihood; }
+
+    /**
+     * Fit a family on a histogram by maximum likelihood
+     * @param family Family (BURSTFIT_*)
+     * @param histogram Histogram of burst lengths (non empty)
+     * @return Fitted distribution
+     */
+    static BurstDistribution fit(const uint32_t family, const BurstHistogram& histogram);
+
+    /**
+     * Fit all the families and keep the best one.
+     * The families do not have the same number of parameters, the one with the lowest AIC is kept.
+     * @param histogram Histogram of burst lengths (non empty)
+     * @param all If not NULL, set to the fit of each family (BURSTFIT_FAMILIES entries, family i + 1 in position i)
+     * @return Best distribution
+     */
+    static BurstDistribution fitBest(const BurstHistogram& histogram, BurstDistribution *all);
+};
+
+#endif
@@ -0,0 +1,73 @@
+/** @file countmin.cpp Implementation of the count-min sketch */
+
+#include "countmin.h"
+
+#include <algorithm>
+#include <cmath>
+
+CountMinSketch::CountMinSketch(const double e, const double delta)
+  : total(0), eps(e)
+{
+  unsigned int i;
+  uint64_t seed = 0x9E3779B97F4A7C15ULL;
+  width = (size_t) ceil(exp(1.0) / e);
+  depth = (unsigned int) ceil(log(1.0 / delta));
+  if (depth < 1) {
+    depth = 1;
+  }
+  for (i = 0; i < depth; ++i) {
+    seed += 0x9E3779B97F4A7C15ULL;
+    seeds[i] = seed;
+  }
+  counters = new uint64_t[width * depth]();
+}
+
+CountMinSketch::~CountMinSketch()
+{
+  delete[] (counters);
+}
+
+bool
+CountMinSketch::valid(const double e, const double delta)
+{
+  return (e >= 1e-9) && (e < 1) && (delta > 0) && (delta < 1) && (log(1.0 / delta) <= COUNTMIN_MAX_DEPTH);
+}
+
+uint64_t
+CountMinSketch::add(const uint64_t key, const uint64_t nb)
+{
+  size_t idx[COUNTMIN_MAX_DEPTH];
+  unsigned int i;
+  uint64_t min = ~((uint64_t) 0);
+  for (i = 0; i < depth; ++i) {
+    idx[i] = index(i, key);
+    min = std::min(min, counters[idx[i]]);
+  }
+  min += nb;
+  /* Conservative update: a counter already above the new estimate counts other keys */
+  for (i = 0; i < depth; ++i) {
+    if (counters[idx[i]] < min) {
+      counters[idx[i]] = min;
+    }
+  }
+  total += nb;
+  return min;
+}
+
+uint64_t
+CountMinSketch::estimate(const uint64_t key) const
+{
+  unsigned int i;
+  uint64_t min = ~((uint64_t) 0);
+  for (i = 0; i < depth; ++i) {
+    min = std::min(min, counters[index(i, key)]);
+  }
+  return min;
+}
+
+void
+CountMinSketch::clear()
+{
+  std::fill(counters, counters + (width * depth), 0);
+  total = 0;
+}
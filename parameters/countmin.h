@@ -0,0 +1,95 @@
+#ifndef COUNTMIN_H
+#define COUNTMIN_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+
+//! Maximal number of rows of a CountMinSketch (delta >= e^-32)
+#define COUNTMIN_MAX_DEPTH 32
+
+/**
+ * Count-min sketch with conservative updates.
+ * depth = ceil(ln(1 / delta)) rows of width = ceil(e / eps) counters, each row indexed by its own hash of the key.
+ * The estimate of a key is the minimum of its counters: it is never below the true count and,
+ * with probability at least 1 - delta, exceeds it by at most eps * N (N: total of all the counts).\n
+ * Conservative update: only the counters below the new estimate are raised, which keeps the same
+ * guarantee with a smaller error (the sketch is then no longer linear: two sketches cannot be added).
+ */
+class CountMinSketch {
+
+  private:
+    //! Counters, row by row
+    uint64_t *counters;
+    //! Counters per row
+    size_t width;
+    //! Number of rows
+    unsigned int depth;
+    //! Seed of the hash of each row
+    uint64_t seeds[COUNTMIN_MAX_DEPTH];
+    //! Total of the counts (N)
+    uint64_t total;
+    //! Relative error of the estimates
+    double eps;
+
+    /* Not copyable */
+    CountMinSketch(const CountMinSketch&);
+    CountMinSketch& operator=(const CountMinSketch&);
+
+    //! Index of a key in a row
+    inline size_t index(const unsigned int row, const uint64_t key) const {
+      uint64_t x = key ^ seeds[row];
+      /* splitmix64 finalizer, then the 32 high bits scaled to the width (width < 2^32) */
+      x ^= x >> 30;
+      x *= 0xBF58476D1CE4E5B9ULL;
+      x ^= x >> 27;
+      x *= 0x94D049BB133111EBULL;
+      x ^= x >> 31;
+      return (row * width) + (size_t) (((x >> 32) * width) >> 32);
+    }
+
+  public:
+    /**
+     * Create an empty sketch
+     * @param eps Relative error, in ]0,1[ (at least 1e-9)
+     * @param delta Probability that an estimate exceeds the error, in ]0,1[ (at least e^-32)
+     */
+    CountMinSketch(const double eps, const double delta);
+    ~CountMinSketch();
+
+    /**
+     * Is a sketch possible for these parameters ?
+     * @param eps Relative error
+     * @param delta Probability that an estimate exceeds the error
+     */
+    static bool valid(const double eps, const double delta);
+
+    /**
+     * Count a key (conservative update)
+     * @param key Key
+     * @param nb Number of occurences
+     * @return New estimate of the key
+     */
+    uint64_t add(const uint64_t key, const uint64_t nb);
+
+    /**
+     * Estimate the count of a key
+     * @param key Key
+     * @return Estimate, never below the true count
+     */
+    uint64_t estimate(const uint64_t key) const;
+
+    //! Total of the counts (N)
+    uint64_t size() const { return total; }
+
+    //! Maximal error of the estimates (eps * N), with probability 1 - delta
+    uint64_t errorBound() const { return (uint64_t) (eps * (double) total); }
+
+    //! Memory used by the counters, in bytes
+    size_t memory() const { return width * depth * sizeof(uint64_t); }
+
+    //! Set all the counters to 0
+    void clear();
+};
+
+#endif
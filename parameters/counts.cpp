@@ -0,0 +1,82 @@
+/** @file counts.cpp Implementation of the count snapshot helpers */
+
+#include "counts.h"
+#include <string.h>
+#include <string>
+
+void
+counts_write_u32(std::ostream &out, const uint32_t value)
+{
+  char buf[4];
+  unsigned int i;
+  for (i = 0; i < 4; ++i) {
+    buf[i] = (char) ((value >> (8 * i)) & 0xFF);
+  }
+  out.write(buf, 4);
+}
+
+void
+counts_write_u64(std::ostream &out, const uint64_t value)
+{
+  counts_write_u32(out, (uint32_t) (value & 0xFFFFFFFF));
+  counts_write_u32(out, (uint32_t) (value >> 32));
+}
+
+int
+counts_read_u32(std::istream &in, uint32_t *value)
+{
+  unsigned char buf[4];
+  unsigned int i;
+  in.read((char *) buf, 4);
+  if (!in.good()) {
+    return -1;
+  }
+  *value = 0;
+  for (i = 0; i < 4; ++i) {
+    *value |= ((uint32_t) buf[i]) << (8 * i);
+  }
+  return 0;
+}
+
+int
+counts_read_u64(std::istream &in, uint64_t *value)
+{
+  uint32_t low, high;
+  if (counts_read_u32(in, &low) || counts_read_u32(in, &high)) {
+    return -1;
+  }
+  *value = (((uint64_t) high) << 32) | low;
+  return 0;
+}
+
+void
+counts_write_header(std::ostream &out, const char *name)
+{
+  out.write(COUNTS_MAGIC, 4);
+  counts_write_u32(out, COUNTS_VERSION);
+  counts_write_u32(out, (uint32_t) strlen(name));
+  out.write(name, (std::streamsize) strlen(name));
+}
+
+int
+counts_read_header(std::istream &in, const char *name)
+{
+  char magic[4];
+  uint32_t version, len;
+  in.read(magic, 4);
+  if ((!in.good()) || (memcmp(magic, COUNTS_MAGIC, 4) != 0)) {
+    return -1;
+  }
+  if (counts_read_u32(in, &version) || (version != COUNTS_VERSION)) {
+    return -2;
+  }
+  if (counts_read_u32(in, &len) || (len != strlen(name))) {
+    return -3;
+  }
+  std::string stored(len, '\0');
+  in.read(&stored[0], (std::streamsize) len);
+  if ((!in.good()) || (stored != name)) {
+    return -3;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef COUNTS_H
+#define COUNTS_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <iostream>
+
+/** @file counts.h Helpers for the count snapshot files.
+ * A count snapshot contains the raw counters of a module, before finalization, so that
+ * the counts of several traces can be merged afterwards.\n
+ * Format (all the integers are little-endian):
+ *  - magic "PMCS"
+ *  - uint32: version of the format (COUNTS_VERSION)
+ *  - uint32: length of the module name, followed by the name (not '\\0' ended)
+ *  - module-dependant payload
+ */
+
+//! Magic number of the count snapshot files
+#define COUNTS_MAGIC "PMCS"
+
+//! Version of the count snapshot format
+#define COUNTS_VERSION 1
+
+/**
+ * Write a 32-bit integer, little-endian
+ * @param out Output stream
+ * @param value Value
+ */
+void counts_write_u32(std::ostream& out, const uint32_t value);
+
+/**
+ * Write a 64-bit integer, little-endian
+ * @param out Output stream
+ * @param value Value
+ */
+void counts_write_u64(std::ostream& out, const uint64_t value);
+
+/**
+ * Read a 32-bit integer, little-endian
+ * @param in Input stream
+ * @param value Set to the value read
+ * @return Ok: 0, -1 in case of error
+ */
+int counts_read_u32(std::istream& in, uint32_t *value);
+
+/**
+ * Read a 64-bit integer, little-endian
+ * @param in Input stream
+ * @param value Set to the value read
+ * @return Ok: 0, -1 in case of error
+ */
+int counts_read_u64(std::istream& in, uint64_t *value);
+
+/**
+ * Write the header of a count snapshot
+ * @param out Output stream
+ * @param name Name of the module
+ */
+void counts_write_header(std::ostream& out, const char *name);
+
+/**
+ * Read and check the header of a count snapshot
+ * @param in Input stream
+ * @param name Name of the expected module
+ * @return Ok: 0, -1 if the file isn't a snapshot, -2 if the version is unknown, -3 if it's a snapshot of another module
+ */
+int counts_read_header(std::istream& in, const char *name);
+
+#endif
@@ -0,0 +1,56 @@
+/** @file decay.cpp Implementation of the exponentially decayed counters */
+
+#include "decay.h"
+
+#include <cmath>
+
+double
+DecayedCounts::factor(const uint64_t packets, const double half_life)
+{
+  return pow(2.0, -((double) packets) / half_life);
+}
+
+void
+DecayedCounts::fold(const double f, const Counts& counts)
+{
+  Weights::const_iterator it = weights.begin();
+  Counts::const_iterator c = counts.begin();
+  double w;
+
+  /* Merge of the two sorted lists */
+  scratch.clear();
+  scratch.reserve(weights.size() + counts.size());
+  sum = 0;
+  while ((it != weights.end()) || (c != counts.end())) {
+    if ((c == counts.end()) || ((it != weights.end()) && (it->first < c->first))) {
+      w = it->second * f;
+      if (w >= DECAY_MIN_WEIGHT) {
+        scratch.push_back(std::make_pair(it->first, w));
+        sum += w;
+      }
+      ++it;
+    } else {
+      w = (double) c->second;
+      if ((it != weights.end()) && (it->first == c->first)) {
+        w += it->second * f;
+        ++it;
+      }
+      scratch.push_back(std::make_pair(c->first, w));
+      sum += w;
+      ++c;
+    }
+  }
+  weights.swap(scratch);
+  /* Release the memory of a table which shrank a lot */
+  if (scratch.capacity() > 4 * weights.size() + 1024) {
+    Weights().swap(scratch);
+  }
+}
+
+void
+DecayedCounts::clear()
+{
+  Weights().swap(weights);
+  Weights().swap(scratch);
+  sum = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef DECAY_H
+#define DECAY_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//! Weight below which a decayed counter is forgotten (keeps the memory bounded)
+#define DECAY_MIN_WEIGHT 0.01
+
+/**
+ * Exponentially decayed counters, for the online mode.
+ * The modules keep counting in their usual (integer) tables, which are regularly folded into these
+ * weighted counters: the old weights are multiplied by the decay factor, then the new counts are added.
+ * Counters whose weight fall below DECAY_MIN_WEIGHT are dropped, so that the memory only depends
+ * on the number of keys seen during the last half-lives.
+ */
+class DecayedCounts {
+
+  public:
+    //! (key, weight), sorted by key
+    typedef std::vector<std::pair<uint64_t, double> > Weights;
+    //! (key, count), sorted by key
+    typedef std::vector<std::pair<uint64_t, uint64_t> > Counts;
+    //! Iterator over the (key, weight) pairs, by increasing key
+    typedef Weights::const_iterator const_iterator;
+
+  private:
+    //! Weights, sorted by key
+    Weights weights;
+    //! Buffer used while folding
+    Weights scratch;
+    //! Sum of the weights
+    double sum;
+
+  public:
+    DecayedCounts() : sum(0) {}
+
+    /**
+     * Decay factor of a number of packets
+     * @param packets Number of packets
+     * @param half_life Half-life, in packets
+     * @return 2^(-packets / half_life)
+     */
+    static double factor(const uint64_t packets, const double half_life);
+
+    /**
+     * Decay the weights, then add new counts
+     * @param factor Decay factor of the old weights (in ]0,1])
+     * @param counts New counts, sorted by key
+     */
+    void fold(const double factor, const Counts& counts);
+
+    //! First (smallest) key
+    const_iterator begin() const { return weights.begin(); }
+    //! After the last key
+    const_iterator end() const { return weights.end(); }
+    //! Number of keys
+    size_t size() const { return weights.size(); }
+    //! Sum of the weights
+    double total() const { return sum; }
+
+    //! Forget everything
+    void clear();
+};
+
+#endif
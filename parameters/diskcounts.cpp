@@ -0,0 +1,202 @@
+/** @file diskcounts.cpp Implementation of the memory-mapped counters */
+
+#include "diskcounts.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+//! Counters per page (4KiB): the increments are sorted by index >> DISK_COUNTS_PAGE_SHIFT
+#define DISK_COUNTS_PAGE_SHIFT 9
+//! Bits sorted by each pass of the radix sort
+#define DISK_COUNTS_RADIX_BITS 11
+//! Counters between two lookups of the next data of the file (64KiB)
+#define DISK_COUNTS_SKIP (((uint64_t) 1) << 13)
+
+DiskCounts::DiskCounts()
+  : fd(-1), counters(NULL), slots(0), limit(DISK_COUNTS_BUFFER), seek_data(true)
+{
+}
+
+DiskCounts::~DiskCounts()
+{
+  close();
+}
+
+int
+DiskCounts::open(const char *path, const uint64_t count, const size_t buffer)
+{
+  void *map;
+  int saved;
+
+  close();
+  if ((count == 0) || (count > (((uint64_t) -1) >> 4))) {
+    errno = EINVAL;
+    return -1;
+  }
+  fd = ::open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+  /* A scratch file: it only lives as long as the descriptor */
+  unlink(path);
+  if (ftruncate(fd, (off_t) (count * sizeof(uint64_t))) != 0) {
+    saved = errno;
+    close();
+    errno = saved;
+    return -1;
+  }
+  map = mmap(NULL, (size_t) (count * sizeof(uint64_t)), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+  if (map == MAP_FAILED) {
+    saved = errno;
+    close();
+    errno = saved;
+    return -1;
+  }
+  counters = (uint64_t *) map;
+  slots = count;
+  limit = (buffer == 0) ? 1 : buffer;
+  pending.reserve(limit);
+  seek_data = true;
+  return 0;
+}
+
+void
+DiskCounts::close()
+{
+  if (counters != NULL) {
+    munmap(counters, (size_t) (slots * sizeof(uint64_t)));
+    counters = NULL;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  slots = 0;
+  std::vector<uint64_t>().swap(pending);
+  std::vector<uint64_t>().swap(scratch);
+}
+
+void
+DiskCounts::sortPending()
+{
+  unsigned int bits = 0, shift;
+  size_t i, count[1 << DISK_COUNTS_RADIX_BITS], sum, temp;
+  const size_t digits = ((size_t) 1) << DISK_COUNTS_RADIX_BITS;
+  uint64_t digit;
+
+  /* Number of bits of the page numbers */
+  while ((bits < 64) && (((slots - 1) >> DISK_COUNTS_PAGE_SHIFT) >> bits) != 0) {
+    ++bits;
+  }
+  scratch.resize(pending.size());
+  /* LSD radix sort, stable: the order inside a page does not matter */
+  for (shift = DISK_COUNTS_PAGE_SHIFT; shift < DISK_COUNTS_PAGE_SHIFT + bits; shift += DISK_COUNTS_RADIX_BITS) {
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < pending.size(); ++i) {
+      ++count[(pending[i] >> shift) & (digits - 1)];
+    }
+    sum = 0;
+    for (i = 0; i < digits; ++i) {
+      temp = count[i];
+      count[i] = sum;
+      sum += temp;
+    }
+    for (i = 0; i < pending.size(); ++i) {
+      digit = (pending[i] >> shift) & (digits - 1);
+      scratch[count[digit]++] = pending[i];
+    }
+    pending.swap(scratch);
+  }
+}
+
+void
+DiskCounts::flush()
+{
+  std::vector<uint64_t>::const_iterator it;
+  if (pending.empty()) {
+    return;
+  }
+  sortPending();
+  for (it = pending.begin(); it != pending.end(); ++it) {
+    ++counters[*it];
+  }
+  pending.clear();
+}
+
+bool
+DiskCounts::next(uint64_t& index)
+{
+  off_t data;
+  flush();
+  while (index < slots) {
+    if (seek_data && ((index & (DISK_COUNTS_SKIP - 1)) == 0)) {
+      /* Jump over the holes (pages never written) */
+      data = lseek(fd, (off_t) (index * sizeof(uint64_t)), SEEK_DATA);
+      if (data < 0) {
+        if (errno == ENXIO) {
+          /* Only holes after index */
+          return false;
+        }
+        /* Not supported by the file system: scan everything */
+        seek_data = false;
+      } else if (((uint64_t) data) / sizeof(uint64_t) > index) {
+        index = ((uint64_t) data) / sizeof(uint64_t);
+      }
+    }
+    if (counters[index] != 0) {
+      return true;
+    }
+    ++index;
+  }
+  return false;
+}
+
+void
+DiskCounts::clear()
+{
+  pending.clear();
+  /* Punch the whole file: the pages are dropped and read as zeros */
+  if ((ftruncate(fd, 0) != 0) || (ftruncate(fd, (off_t) (slots * sizeof(uint64_t))) != 0)) {
+    memset(counters, 0, (size_t) (slots * sizeof(uint64_t)));
+  }
+}
+
+//! C wrapper of a DiskCounts
+struct disk_counts {
+  //! Table
+  DiskCounts counts;
+};
+
+struct disk_counts *
+disk_counts_new(const char *path, const uint64_t count)
+{
+  struct disk_counts *table = new disk_counts();
+  if (table->counts.open(path, count, DISK_COUNTS_BUFFER)) {
+    const int saved = errno;
+    delete table;
+    errno = saved;
+    return NULL;
+  }
+  return table;
+}
+
+void
+disk_counts_increment(struct disk_counts *table, const uint64_t index)
+{
+  table->counts.increment(index);
+}
+
+uint64_t *
+disk_counts_data(struct disk_counts *table)
+{
+  return table->counts.data();
+}
+
+void
+disk_counts_free(struct disk_counts *table)
+{
+  delete table;
+}
@@ -0,0 +1,152 @@
+#ifndef DISKCOUNTS_H
+#define DISKCOUNTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @file diskcounts.h Counters kept in a memory-mapped file, for tables too large for the memory.
+ * Usable from C (udp-test/extract) through the disk_counts_* functions.
+ */
+
+//! Default number of buffered increments (8 bytes each, twice while sorting)
+#define DISK_COUNTS_BUFFER (((size_t) 1) << 24)
+
+#ifdef __cplusplus
+
+#include <vector>
+
+/**
+ * Table of 64-bit counters in a memory-mapped scratch file.
+ * The file is sparse: only the pages holding a non-null counter use disk space, and the kernel
+ * writes the dirty pages back when the memory is needed.\n
+ * The increments are buffered, then sorted by page (radix sort) before being applied,
+ * so that each flush touches the pages in order: sequential page writes instead of random ones.
+ * The file is removed as soon as it is mapped, it disappears with the table.
+ */
+class DiskCounts {
+
+  private:
+    //! File descriptor of the (unlinked) file
+    int fd;
+    //! Mapped counters
+    uint64_t *counters;
+    //! Number of counters
+    uint64_t slots;
+    //! Buffered increments (index of the counter)
+    std::vector<uint64_t> pending;
+    //! Buffer used by the radix sort
+    std::vector<uint64_t> scratch;
+    //! Number of increments buffered before a flush
+    size_t limit;
+    //! Can the holes of the file be skipped with SEEK_DATA ?
+    bool seek_data;
+
+    /* Not copyable (the mapping belongs to one object) */
+    DiskCounts(const DiskCounts&);
+    DiskCounts& operator=(const DiskCounts&);
+
+    //! Sort the buffered increments by page
+    void sortPending();
+
+  public:
+    DiskCounts();
+    ~DiskCounts();
+
+    /**
+     * Create the file and map it, all the counters are null
+     * @param path Name of the scratch file (removed once mapped)
+     * @param count Number of counters
+     * @param buffer Number of increments buffered
+     * @return Ok: 0, -1 in case of error (errno is set)
+     */
+    int open(const char *path, const uint64_t count, const size_t buffer);
+
+    //! Unmap and close the file
+    void close();
+
+    /**
+     * Increment a counter (buffered)
+     * @param index Index of the counter
+     */
+    inline void increment(const uint64_t index) {
+      pending.push_back(index);
+      if (pending.size() >= limit) {
+        flush();
+      }
+    }
+
+    /**
+     * Add to a counter (directly, for the rare large updates)
+     * @param index Index of the counter
+     * @param nb Value added
+     */
+    inline void add(const uint64_t index, const uint64_t nb) {
+      counters[index] += nb;
+    }
+
+    //! Apply the buffered increments
+    void flush();
+
+    /**
+     * Value of a counter, the buffered increments not included (see flush)
+     * @param index Index of the counter
+     * @return Value
+     */
+    inline uint64_t get(const uint64_t index) const { return counters[index]; }
+
+    /**
+     * Find the next non-null counter, skipping the holes of the file (flush first)
+     * @param index First index to look at, set to the index found
+     * @return False if there is no more non-null counter
+     */
+    bool next(uint64_t& index);
+
+    //! All the counters, flushed
+    uint64_t *data() { flush(); return counters; }
+
+    //! Number of counters
+    uint64_t size() const { return slots; }
+
+    //! Set all the counters to 0 (and release the disk space)
+    void clear();
+};
+
+extern "C" {
+#endif
+
+//! Opaque table of counters (DiskCounts)
+struct disk_counts;
+
+/**
+ * Create a table of null counters in a memory-mapped scratch file
+ * @param path Name of the scratch file (removed once mapped)
+ * @param count Number of counters
+ * @return The table, NULL in case of error (errno is set)
+ */
+struct disk_counts *disk_counts_new(const char *path, const uint64_t count);
+
+/**
+ * Increment a counter (buffered)
+ * @param counts Table
+ * @param index Index of the counter
+ */
+void disk_counts_increment(struct disk_counts *counts, const uint64_t index);
+
+/**
+ * All the counters, once the buffered increments applied
+ * @param counts Table
+ * @return Counters, valid until disk_counts_free
+ */
+uint64_t *disk_counts_data(struct disk_counts *counts);
+
+/**
+ * Free the table (and the file)
+ * @param counts Table
+ */
+void disk_counts_free(struct disk_counts *counts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
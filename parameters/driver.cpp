@@ -0,0 +1,653 @@
+/** @file driver.cpp Common parts of the drivers of parseInput: reading of the input, creation and output of the modules */
+
+#include "driver.h"
+#include "ring.h"
+#include "segment.h"
+#include "netem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+//! Number of blocks in the ring shared by the module threads
+#define RING_SLOTS 16
+
+//! Online mode: number of times the counts are decayed during a half-life
+#define ONLINE_DECAY_STEPS 8
+
+int
+read_error(const TraceReader *in, const ssize_t nbits)
+{
+  if (nbits == -1) {
+    std::cerr << "Parsing error : unauthorized char (" << in->badChar() << ") at offset " << in->badOffset() << std::endl;
+    return -6;
+  }
+  if (in->inflateError() != NULL) {
+    std::cerr << "Unable to decompress input (" << in->inflateError() << ")" << std::endl;
+    return -12;
+  }
+  std::cerr << "Unable to read input" << std::endl;
+  return -12;
+}
+
+int
+extract(TraceReader *in, const ModuleList &mods)
+{
+  const uint64_t *words;
+  ssize_t nbits;
+  ModuleList::const_iterator it;
+  int ret;
+  while ((nbits = in->next(&words)) > 0) {
+    for (it = mods.begin(); it != mods.end(); ++it) {
+      ret = (*it)->addBits(words, (size_t) nbits);
+      if (ret) {
+        std::cerr << "Parsing error" << ret << std::endl;
+        return ret;
+      }
+    }
+  }
+  if (nbits < 0) {
+    return read_error(in, nbits);
+  }
+  return 0;
+}
+
+/**
+ * Module fed by its own thread
+ */
+struct module_thread {
+  BlockRing *ring;      //!< Ring of blocks to read
+  unsigned int index;   //!< Index of this consumer in the ring
+  ParamModule *mod;     //!< Module to feed
+  int ret;              //!< First error returned by the module
+};
+
+/**
+ * Thread entry point: feed a module with the blocks of the ring
+ * @param arg The module (struct module_thread)
+ * @return NULL
+ */
+static void *
+feed_module(void *arg)
+{
+  struct module_thread *t = (struct module_thread *) arg;
+  const uint64_t *words;
+  size_t nbits;
+  while ((nbits = t->ring->acquire(t->index, &words)) > 0) {
+    /* Keep releasing the blocks after an error, not to block the reader */
+    if (t->ret == 0) {
+      t->ret = t->mod->addBits(words, nbits);
+    }
+    t->ring->release(t->index);
+  }
+  return NULL;
+}
+
+/**
+ * Read all the input once and feed each ParamModule from its own thread
+ * @param in Reader to read
+ * @param mods Modules to feed
+ * @return : 0K : 0, error-code if != 0
+ */
+static int
+extract_threaded(TraceReader *in, const ModuleList &mods)
+{
+  const uint64_t *words;
+  uint64_t *block;
+  ssize_t nbits;
+  size_t i;
+  int ret = 0;
+  const size_t nb = mods.size();
+  BlockRing ring(RING_SLOTS, READER_BLOCK_WORDS, (unsigned int) nb);
+  std::vector<struct module_thread> threads(nb);
+  std::vector<pthread_t> ids(nb);
+
+  for (i = 0; i < nb; ++i) {
+    threads[i].ring = &ring;
+    threads[i].index = (unsigned int) i;
+    threads[i].mod = mods[i];
+    threads[i].ret = 0;
+    if (pthread_create(&ids[i], NULL, feed_module, &threads[i])) {
+      std::cerr << "Unable to create thread" << std::endl;
+      exit(-1);
+    }
+  }
+  /* Copy each block once in the ring, all the modules read it from there */
+  while ((nbits = in->next(&words)) > 0) {
+    block = ring.reserve();
+    memcpy(block, words, ((((size_t) nbits) + 63) >> 6) * sizeof(uint64_t));
+    ring.publish((size_t) nbits);
+  }
+  ring.finish();
+  for (i = 0; i < nb; ++i) {
+    pthread_join(ids[i], NULL);
+    if ((ret == 0) && threads[i].ret) {
+      std::cerr << "Parsing error" << threads[i].ret << std::endl;
+      ret = threads[i].ret;
+    }
+  }
+  if (nbits < 0) {
+    return read_error(in, nbits);
+  }
+  return ret;
+}
+
+/**
+ * Part of the input counted by a thread
+ */
+struct chunk {
+  const char *data;     //!< First byte of the part
+  size_t size;          //!< Number of bytes in the part
+  uint64_t offset;      //!< Offset of the part in the input
+  ModuleList mods;      //!< Modules counting the part (created by fork)
+  uint64_t packets;     //!< Number of packets in the part
+  int ret;              //!< Result of extract
+};
+
+/**
+ * Thread entry point: count a part of the input
+ * @param arg The part (struct chunk)
+ * @return NULL
+ */
+static void *
+extract_chunk(void *arg)
+{
+  struct chunk *c = (struct chunk *) arg;
+  TraceReader in;
+  in.attach(c->data, c->size, c->offset);
+  c->ret = extract(&in, c->mods);
+  c->packets = in.packetsRead();
+  return NULL;
+}
+
+/**
+ * Collect the last packets before a position of the input
+ * @param data Input
+ * @param pos Position
+ * @param nbits Set to the number of packets found (at most 64)
+ * @return The packets (bit i is the i-th packet, the last one is the most recent)
+ */
+static uint64_t
+history_before(const char *data, size_t pos, unsigned int *nbits)
+{
+  uint64_t history = 0;
+  unsigned int n = 0;
+  /* Walk backward: the packets found first are the most recent ones */
+  while ((pos > 0) && (n < 64)) {
+    --pos;
+    if ((data[pos] == '0') || (data[pos] == '1')) {
+      history |= ((uint64_t) (data[pos] == '1')) << (63 - n);
+      ++n;
+    } else if (data[pos] != '\n') {
+      /* Invalid input, the previous part will report it */
+      break;
+    }
+  }
+  *nbits = n;
+  return n ? (history >> (64 - n)) : 0;
+}
+
+void
+drop_parts(ModuleList &mods)
+{
+  ModuleList::iterator it;
+  for (it = mods.begin(); it != mods.end(); ++it) {
+    (*it)->clean();
+    delete (*it);
+  }
+  mods.clear();
+}
+
+/**
+ * Read all the input and feed it to the ParamModules, using several threads.
+ * With several threads, the input is split in parts counted in parallel if it is mapped and the modules support it.
+ * Otherwise, if asked, each module is fed by its own thread.
+ * @param in Reader to read (just opened)
+ * @param mods Modules to feed
+ * @param threads Number of threads
+ * @param per_module Feed each module from its own thread
+ * @param packets Set to the number of packets read
+ * @return : 0K : 0, error-code if != 0
+ */
+static int
+extract_parallel(TraceReader *in, const ModuleList &mods, const unsigned int threads, const bool per_module, uint64_t *packets)
+{
+  struct chunk *chunks;
+  pthread_t *ids;
+  unsigned int i, nbits;
+  uint64_t history;
+  size_t start, end, j;
+  ParamModule *part;
+  bool supported = true;
+  int ret = 0;
+  const char *data = in->mappedData();
+  const size_t size = in->mappedSize();
+
+  if ((threads > 1) && in->isMapped()) {
+    chunks = new struct chunk[threads];
+    ids = new pthread_t[threads];
+    /* Split the input and create one module per part */
+    for (i = 0; (i < threads) && supported; ++i) {
+      start = (size_t) (((uint64_t) size) * i / threads);
+      end = (size_t) (((uint64_t) size) * (i + 1) / threads);
+      history = history_before(data, start, &nbits);
+      chunks[i].data = data + start;
+      chunks[i].size = end - start;
+      chunks[i].offset = start;
+      chunks[i].packets = 0;
+      chunks[i].ret = 0;
+      for (j = 0; j < mods.size(); ++j) {
+        part = mods[j]->fork(history, nbits);
+        if (part == NULL) {
+          supported = false;
+          break;
+        }
+        chunks[i].mods.push_back(part);
+      }
+    }
+    if (supported) {
+      /* Count all the parts in parallel */
+      for (i = 0; i < threads; ++i) {
+        if (pthread_create(&ids[i], NULL, extract_chunk, &chunks[i])) {
+          std::cerr << "Unable to create thread" << std::endl;
+          exit(-1);
+        }
+      }
+      *packets = 0;
+      for (i = 0; i < threads; ++i) {
+        pthread_join(ids[i], NULL);
+        *packets += chunks[i].packets;
+        if ((ret == 0) && (chunks[i].ret != 0)) {
+          ret = chunks[i].ret;
+        }
+      }
+      /* Join the parts, in order */
+      for (i = 0; i < threads; ++i) {
+        for (j = 0; j < mods.size(); ++j) {
+          if ((ret == 0) && mods[j]->join(chunks[i].mods[j])) {
+            std::cerr << "Unable to join the parts" << std::endl;
+            ret = -14;
+          }
+        }
+        if (ret == 0) {
+          chunks[i].mods.clear();
+        }
+      }
+    } else {
+      std::cerr << "Module doesn't support parallel counting, not splitting the input" << std::endl;
+    }
+    for (i = 0; i < threads; ++i) {
+      drop_parts(chunks[i].mods);
+    }
+    delete[] (ids);
+    delete[] (chunks);
+    if (supported) {
+      return ret;
+    }
+  } else if ((threads > 1) && !per_module) {
+    std::cerr << "Input not mapped, using 1 thread" << std::endl;
+  }
+  if (per_module && (mods.size() > 1)) {
+    ret = extract_threaded(in, mods);
+  } else {
+    ret = extract(in, mods);
+  }
+  *packets = in->packetsRead();
+  return ret;
+}
+
+double
+elapsed(const struct timeval *start)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return ((double) (now.tv_sec - start->tv_sec)) + ((double) (now.tv_usec - start->tv_usec)) / 1000000.;
+}
+
+/**
+ * Print the reading statistics on the error output
+ * @param in Reader used
+ * @param bytes Number of bytes read
+ * @param packets Number of packets read
+ * @param seconds Time spent reading
+ */
+static void
+print_stats(const TraceReader *in, const uint64_t bytes, const uint64_t packets, const double seconds)
+{
+  std::cerr << "Read " << bytes << " bytes (" << packets << " packets, "
+            << (in->isMapped() ? "mapped" : (in->isCompressed() ? "gzip" : "buffered")) << ") in " << seconds << "s: "
+            << ((double) bytes) / seconds / 1000000. << " MB/s, "
+            << ((double) packets) / seconds / 1000000. << " Mpackets/s" << std::endl;
+}
+
+int
+read_input(const char *input_file, const ModuleList &mods, const unsigned int threads, const bool per_module, const bool stats)
+{
+  TraceReader in;
+  ModuleList second;
+  ModuleList::const_iterator it;
+  uint64_t packets;
+  struct timeval start;
+  int ret;
+
+  /* Open the input file or use the standard input */
+  if (in.open(input_file)) {
+    std::cerr << "Unable to read input (" << strerror(errno) << ")" << std::endl;
+    return -12;
+  }
+
+  /* First run */
+  gettimeofday(&start, NULL);
+  ret = extract_parallel(&in, mods, threads, per_module, &packets);
+  if (ret) {
+    return ret;
+  }
+  if (stats) {
+    print_stats(&in, in.isMapped() ? in.mappedSize() : in.bytesRead(), packets, elapsed(&start));
+  }
+
+  /* Do a second run if needed */
+  for (it = mods.begin(); it != mods.end(); ++it) {
+    if ((*it)->nextRound()) {
+      second.push_back(*it);
+    }
+  }
+  if (!second.empty()) {
+    if (in.rewind()) {
+      std::cerr << "2nd round needed, input file needed" << std::endl;
+      return -13;
+    }
+    gettimeofday(&start, NULL);
+    ret = extract(&in, second);
+    if (ret) {
+      return ret;
+    }
+    if (stats) {
+      print_stats(&in, in.bytesRead(), in.packetsRead(), elapsed(&start));
+    }
+  }
+
+  /* Close input */
+  in.close();
+  return 0;
+}
+
+/**
+ * Convert a finalized module to the netem loss models and print them
+ * @param mod Module
+ * @param human_readable Generate output human-readable or not
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @return : 0K : 0, error-code if != 0
+ */
+static int
+print_netem(const ParamModule *mod, const bool human_readable, const uint32_t max_rand)
+{
+  NetemModel netem;
+  if (mod->netemModel(max_rand, netem)) {
+    std::cerr << "Unable to convert to a netem loss model (not supported by the module ?)" << std::endl;
+    return -16;
+  }
+  if (human_readable) {
+    netem.printHuman(std::cout);
+    return 0;
+  }
+  netem.print(std::cout);
+  std::cerr << "# netem fit error (total variation of the run lengths): gemodel " << netem.gemodel_error
+            << ", state " << netem.state_error << std::endl;
+  return 0;
+}
+
+int
+print_finalized(const ModuleList &mods, const bool human_readable, const int format, const uint32_t max_rand)
+{
+  ModuleList::const_iterator it;
+  for (it = mods.begin(); it != mods.end(); ++it) {
+    if (format == OUTPUT_NETEM) {
+      if (print_netem(*it, human_readable, max_rand)) {
+        return -16;
+      }
+    } else if (human_readable) {
+      (*it)->printHuman(max_rand);
+    } else if (format == OUTPUT_BINARY) {
+      if ((*it)->printPacked(max_rand)) {
+        std::cerr << "Unable to print the binary format (not supported by the module ?)" << std::endl;
+        return -16;
+      }
+    } else {
+      (*it)->printBinary();
+    }
+  }
+  return 0;
+}
+
+int
+print_modules(const ModuleList &mods, const bool human_readable, const int format, const uint32_t max_rand)
+{
+  ModuleList::const_iterator it;
+  for (it = mods.begin(); it != mods.end(); ++it) {
+    (*it)->finalize(max_rand);
+  }
+  return print_finalized(mods, human_readable, format, max_rand);
+}
+
+int
+read_online(const char *input_file, const ModuleList &mods, const uint64_t period, const double half_life,
+            const bool human_readable, const int format, const uint32_t max_rand, bool *printed)
+{
+  TraceReader in;
+  const uint64_t *words;
+  ModuleList::const_iterator it;
+  ssize_t nbits;
+  size_t pos, n;
+  uint64_t since_decay = 0, since_snapshot = 0;
+  uint64_t step = ((uint64_t) (half_life / ONLINE_DECAY_STEPS)) & ~((uint64_t) 63);
+  int ret;
+
+  *printed = false;
+  step = std::min(std::max(step, (uint64_t) 64), period);
+  if (in.open(input_file)) {
+    std::cerr << "Unable to read input (" << strerror(errno) << ")" << std::endl;
+    return -12;
+  }
+  in.setStreaming(true);
+  while ((nbits = in.next(&words)) > 0) {
+    for (pos = 0; pos < (size_t) nbits; pos += n) {
+      /* Up to the next decay or snapshot, rounded up to a word boundary */
+      n = (size_t) std::min(step - since_decay, period - since_snapshot);
+      if (n < ((size_t) nbits) - pos) {
+        n = ((pos + n + 63) & ~((size_t) 63)) - pos;
+      }
+      n = std::min(n, ((size_t) nbits) - pos);
+      for (it = mods.begin(); it != mods.end(); ++it) {
+        ret = (*it)->addBits(words + (pos >> 6), n);
+        if (ret) {
+          std::cerr << "Parsing error" << ret << std::endl;
+          return ret;
+        }
+      }
+      since_decay += n;
+      since_snapshot += n;
+      *printed = false;
+      if ((since_decay >= step) || (since_snapshot >= period)) {
+        for (it = mods.begin(); it != mods.end(); ++it) {
+          (*it)->decay(since_decay);
+        }
+        since_decay = 0;
+      }
+      if (since_snapshot >= period) {
+        ret = print_modules(mods, human_readable, format, max_rand);
+        if (ret) {
+          return ret;
+        }
+        since_snapshot = 0;
+        *printed = true;
+      }
+    }
+  }
+  if (nbits < 0) {
+    return read_error(&in, nbits);
+  }
+  for (it = mods.begin(); it != mods.end(); ++it) {
+    (*it)->decay(since_decay);
+  }
+  in.close();
+  return 0;
+}
+
+ParamModule *
+create_module(const int argc, char **argv, const bool human_readable, const int format, int *ret)
+{
+  const char *err_message;
+  ParamModule *mod;
+  /* Try to find the module */
+  mod = ParamModule::create(argv[0]);
+  if (mod == NULL) {
+    std::cerr << "Unknown Module" << std::endl;
+    *ret = -1;
+    return NULL;
+  }
+  /* Initialize the module, the netem models are printed without output files as the human-readable output */
+  *ret = mod->init(argc, argv, human_readable || (format == OUTPUT_NETEM), &err_message);
+  if (*ret) {
+    fprintf(stderr, "%s (%i)\n", err_message, *ret);
+    delete mod;
+    return NULL;
+  }
+  return mod;
+}
+
+int
+save_counts(const ModuleList &mods, const char *filename)
+{
+  size_t i;
+  for (i = 0; i < mods.size(); ++i) {
+    std::string name(filename);
+    if (mods.size() > 1) {
+      char suffix[24];
+      snprintf(suffix, sizeof(suffix), ".%zu", i + 1);
+      name += suffix;
+    }
+    std::ofstream output(name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+      std::cerr << "Unable to open " << name << " (" << strerror(errno) << ")" << std::endl;
+      return -15;
+    }
+    if (mods[i]->saveCounts(output)) {
+      std::cerr << "Unable to save the counts to " << name << " (not supported by the module ?)" << std::endl;
+      return -15;
+    }
+    output.close();
+  }
+  return 0;
+}
+
+int
+merge_counts(ParamModule *mod, const std::vector<const char*> &files, const int argc, char **argv,
+             const bool human_readable, const int format)
+{
+  std::vector<const char*>::const_iterator it;
+  ParamModule *snapshot;
+  int ret;
+  for (it = files.begin(); it != files.end(); ++it) {
+    std::ifstream input(*it, std::ios::in | std::ios::binary);
+    if (!input.is_open()) {
+      std::cerr << "Unable to open " << *it << " (" << strerror(errno) << ")" << std::endl;
+      return -15;
+    }
+    /* Load each snapshot in a module configured as the destination, then add it */
+    snapshot = create_module(argc, argv, human_readable, format, &ret);
+    if (snapshot == NULL) {
+      return ret;
+    }
+    ret = snapshot->loadCounts(input);
+    if (ret) {
+      std::cerr << "Unable to load the counts from " << *it << " (" << ret << ")" << std::endl;
+    } else if (mod->merge(snapshot)) {
+      std::cerr << "Unable to merge the counts from " << *it << std::endl;
+      ret = -15;
+    }
+    snapshot->clean();
+    delete snapshot;
+    if (ret) {
+      return ret < 0 ? ret : -15;
+    }
+  }
+  return 0;
+}
+
+void
+expand_args(const int argc, char **argv, const Patterns &patterns, struct class_args *out)
+{
+  Patterns::const_iterator it;
+  size_t pos, i;
+
+  out->args.assign(argv, argv + argc);
+  for (i = 0; i < out->args.size(); ++i) {
+    for (it = patterns.begin(); it != patterns.end(); ++it) {
+      for (pos = out->args[i].find(it->first); pos != std::string::npos; pos = out->args[i].find(it->first, pos + it->second.size())) {
+        out->args[i].replace(pos, it->first.size(), it->second);
+      }
+    }
+  }
+  /* The strings are not modified anymore: the pointers stay valid */
+  out->argv.clear();
+  for (i = 0; i < out->args.size(); ++i) {
+    out->argv.push_back(const_cast<char*>(out->args[i].c_str()));
+  }
+  out->argv.push_back(NULL);
+}
+
+int
+read_trace(const char *input_file, std::vector<uint64_t> *trace, uint64_t *packets, ChangeDetector *detector)
+{
+  TraceReader in;
+  const uint64_t *words;
+  ssize_t nbits;
+  uint64_t done = 0, word;
+  uint32_t losses;
+  size_t i;
+  const uint32_t window = (detector == NULL) ? 0 : detector->windowSize();
+
+  if (in.open(input_file)) {
+    std::cerr << "Unable to read input (" << strerror(errno) << ")" << std::endl;
+    return -12;
+  }
+  *packets = 0;
+  while ((nbits = in.next(&words)) > 0) {
+    /* Only the last block may end inside a word */
+    trace->insert(trace->end(), words, words + ((((size_t) nbits) + 63) >> 6));
+    *packets += (uint64_t) nbits;
+    for (; (detector != NULL) && (*packets - done >= window); done += window) {
+      losses = window;
+      for (i = (size_t) (done >> 6); i < (size_t) ((done + window) >> 6); ++i) {
+        losses -= (uint32_t) __builtin_popcountll((*trace)[i]);
+      }
+      detector->addWindow(losses, window);
+    }
+  }
+  if (nbits < 0) {
+    return read_error(&in, nbits);
+  }
+  if ((detector != NULL) && (*packets > done)) {
+    /* Last window, shorter */
+    losses = (uint32_t) (*packets - done);
+    for (i = (size_t) (done >> 6); i < trace->size(); ++i) {
+      word = (*trace)[i];
+      if ((i + 1 == trace->size()) && ((*packets & 63) != 0)) {
+        word &= (((uint64_t) 1) << (*packets & 63)) - 1;
+      }
+      losses -= (uint32_t) __builtin_popcountll(word);
+    }
+    detector->addWindow(losses, (uint32_t) (*packets - done));
+  }
+  if (detector != NULL) {
+    detector->finish();
+  }
+  in.close();
+  return 0;
+}
@@ -0,0 +1,164 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "module.h"
+#include "reader.h"
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ChangeDetector;
+
+//! Output format: text parameter files (one number per line)
+#define OUTPUT_TEXT 0
+//! Output format: binary parameter files (see paramfile.h)
+#define OUTPUT_BINARY 1
+//! Output format: netem loss models (see netem.h)
+#define OUTPUT_NETEM 2
+
+//! List of modules fed with the same input
+typedef std::vector<ParamModule*> ModuleList;
+
+/**
+ * Arguments of a module, the patterns replaced (see expand_args)
+ */
+struct class_args {
+  std::vector<std::string> args;  //!< Arguments, the patterns replaced
+  std::vector<char*> argv;        //!< Pointers to the arguments, as used by getopt
+};
+
+//! Patterns of the class options and their values, e.g. ('%r', regime)
+typedef std::vector<std::pair<std::string, std::string> > Patterns;
+
+/**
+ * Report a reading error
+ * @param in Reader
+ * @param nbits Value returned by TraceReader::next
+ * @return Error code
+ */
+int read_error(const TraceReader *in, const ssize_t nbits);
+
+/**
+ * Read all the input and feed it to the ParamModules
+ * @param in Reader to read
+ * @param mods Modules to feed
+ * @return : 0K : 0, error-code if != 0
+ */
+int extract(TraceReader *in, const ModuleList &mods);
+
+/**
+ * Delete modules created by fork
+ * @param mods Modules
+ */
+void drop_parts(ModuleList &mods);
+
+/**
+ * Time elapsed since a given date
+ * @param start Date of reference
+ * @return Elapsed time in seconds
+ */
+double elapsed(const struct timeval *start);
+
+/**
+ * Read the input (one or two rounds) and feed it to the ParamModules
+ * @param input_file Name of the input file, NULL for the standard input
+ * @param mods Modules to feed
+ * @param threads Number of threads
+ * @param per_module Feed each module from its own thread
+ * @param stats Print the reading statistics
+ * @return : 0K : 0, error-code if != 0
+ */
+int read_input(const char *input_file, const ModuleList &mods, const unsigned int threads, const bool per_module, const bool stats);
+
+/**
+ * Print the parameters of finalized modules
+ * @param mods Modules
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @return : 0K : 0, error-code if != 0
+ */
+int print_finalized(const ModuleList &mods, const bool human_readable, const int format, const uint32_t max_rand);
+
+/**
+ * Finalize the modules and print their parameters
+ * @param mods Modules
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @return : 0K : 0, error-code if != 0
+ */
+int print_modules(const ModuleList &mods, const bool human_readable, const int format, const uint32_t max_rand);
+
+/**
+ * Read the input as it comes and feed it to the ParamModules in online mode:
+ * the counts are decayed ONLINE_DECAY_STEPS times per half-life, and the parameters are printed every 'period' packets.
+ * The last parameters, at the end of the input, are left to the caller unless they were just printed.
+ * @param input_file Name of the input file, NULL for the standard input
+ * @param mods Modules to feed (in online mode, see ParamModule::setHalfLife)
+ * @param period Number of packets between two parameter snapshots
+ * @param half_life Half-life of the counts, in packets
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @param printed Set to true if the input ended on a snapshot (its length is a multiple of 'period'), which needs no reprint
+ * @return : 0K : 0, error-code if != 0
+ */
+int read_online(const char *input_file, const ModuleList &mods, const uint64_t period, const double half_life,
+                const bool human_readable, const int format, const uint32_t max_rand, bool *printed);
+
+/**
+ * Create and initialize a module
+ * @param argc Argument Count (the first argument is the name of the module)
+ * @param argv Argument Vector
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @param ret Set to the error code
+ * @return The module, NULL in case of error
+ */
+ParamModule *create_module(const int argc, char **argv, const bool human_readable, const int format, int *ret);
+
+/**
+ * Save the counts of the modules in count snapshots
+ * @param mods Modules
+ * @param filename Name of the snapshot (suffixed by .<n> for the n-th module if there are several)
+ * @return : 0K : 0, error-code if != 0
+ */
+int save_counts(const ModuleList &mods, const char *filename);
+
+/**
+ * Merge count snapshots into a module
+ * @param mod Module receiving the counts
+ * @param files Count snapshots
+ * @param argc Argument Count used to create the module (the first argument is the name of the module)
+ * @param argv Argument Vector used to create the module
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @return : 0K : 0, error-code if != 0
+ */
+int merge_counts(ParamModule *mod, const std::vector<const char*> &files, const int argc, char **argv,
+                 const bool human_readable, const int format);
+
+/**
+ * Replace patterns in the arguments of a class
+ * @param argc Argument Count (the first argument is the name of the module)
+ * @param argv Argument Vector
+ * @param patterns Patterns and their values
+ * @param out Set to the arguments
+ */
+void expand_args(const int argc, char **argv, const Patterns &patterns, struct class_args *out);
+
+/**
+ * Read all the input in memory, and optionally detect the changes of its loss rate as it is read
+ * @param input_file Name of the input file, NULL for the standard input
+ * @param trace Set to the packets of the input
+ * @param packets Set to the number of packets
+ * @param detector Detector fed with the windows of the input, NULL if not used
+ * @return : 0K : 0, error-code if != 0
+ */
+int read_trace(const char *input_file, std::vector<uint64_t> *trace, uint64_t *packets, ChangeDetector *detector);
+
+#endif
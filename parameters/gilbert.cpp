@@ -0,0 +1,874 @@
+/** @file gilbert.cpp Implementation of the Gilbert-Elliott (hidden Markov model) parameter generation module */
+
+#include "gilbert.h"
+#include "paramwriter.h"
+#include "netem.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+const char * const ParamGilbert::badstates = "The number of states needs to be 2 or 4 (-n option)";
+const char * const ParamGilbert::badnumber = "Invalid number (-i, -e or -j option)";
+
+//! Default maximal number of iterations
+#define GILBERT_ITERATIONS 100
+//! Default relative improvement of the log-likelihood under which the fitting stops
+#define GILBERT_TOLERANCE 1e-7
+
+//! Scaling factors below this are added to the log-likelihood one by one, not through their product
+#define GILBERT_MIN_SCALE 1e-100
+
+/**
+ * Log-likelihood of a segment: product * 2^exponent * e^rest, the product of the scaling factors being renormalized
+ * only when it gets small
+ */
+struct log_scale {
+  double product; //!< Product of the scaling factors, renormalized
+  int exponent;   //!< Power of 2 taken out of the product
+  double rest;    //!< Sum of the logarithms of the smallest scaling factors
+};
+
+/**
+ * Add a scaling factor to the log-likelihood
+ * @param c Scaling factor (sum of the forward probabilities of a packet)
+ * @param ls Log-likelihood, updated
+ * @return false if the packet is impossible under the model, its forward probabilities then restart from a uniform
+ *         distribution and its scaling factor is DBL_MIN
+ */
+static inline bool
+add_scale(const double c, log_scale& ls)
+{
+  int e;
+
+  if (!(c > DBL_MIN)) {
+    ls.rest += log(DBL_MIN);
+    return false;
+  }
+  if (!(c > GILBERT_MIN_SCALE)) {
+    ls.rest += log(c);
+  } else {
+    ls.product *= c;
+    if (ls.product < GILBERT_MIN_SCALE) {
+      ls.product = frexp(ls.product, &e);
+      ls.exponent += e;
+    }
+  }
+  return true;
+}
+
+/**
+ * Scale forward probabilities so that they sum to 1
+ * @param current Forward probabilities, before the scaling
+ * @param c Their sum (scaling factor)
+ * @param ls Log-likelihood, updated
+ * @return Inverse of the scaling factor
+ */
+template <unsigned int N>
+static inline double
+normalize(double *current, const double c, log_scale& ls)
+{
+  double inverse = 1. / DBL_MIN;
+  unsigned int j;
+
+  if (add_scale(c, ls)) {
+    inverse = 1. / c;
+    for (j = 0; j < N; ++j) {
+      current[j] *= inverse;
+    }
+  } else {
+    for (j = 0; j < N; ++j) {
+      current[j] = 1.0 / N;
+    }
+  }
+  return inverse;
+}
+
+#if defined(__SSE2__)
+/**
+ * Forward recursion, kept in registers. The probabilities are scaled by the inverse of the previous sum when the
+ * next packet is computed, so that the division is not on the path from a packet to the next one.
+ */
+template <unsigned int N>
+struct forward_state {
+  __m128d u[N / 2];  //!< Forward probabilities of the last packet, not scaled
+  __m128d inverse;   //!< Inverse of their sum
+};
+
+//! Start the forward recursion from scaled probabilities
+template <unsigned int N>
+static inline void
+forward_load(forward_state<N>& s, const double *alpha)
+{
+  unsigned int h;
+  for (h = 0; h < N / 2; ++h) {
+    s.u[h] = _mm_loadu_pd(alpha + 2 * h);
+  }
+  s.inverse = _mm_set1_pd(1.);
+}
+
+/**
+ * Forward probabilities of a packet
+ * @param s Forward recursion, updated
+ * @param ab Transition followed by the emission of the packet (from, to)
+ * @param current Set to the scaled forward probabilities of the packet
+ * @param ls Log-likelihood, updated
+ * @return Inverse of the scaling factor of the packet
+ */
+template <unsigned int N>
+static inline double
+forward_step(forward_state<N>& s, const double (*ab)[N], double *current, log_scale& ls)
+{
+  __m128d x[N / 2], p, sum;
+  unsigned int i, h;
+  double c, inverse;
+
+  for (h = 0; h < N / 2; ++h) {
+    x[h] = _mm_setzero_pd();
+  }
+  for (i = 0; i < N; ++i) {
+    p = (i & 1) ? _mm_unpackhi_pd(s.u[i / 2], s.u[i / 2]) : _mm_unpacklo_pd(s.u[i / 2], s.u[i / 2]);
+    for (h = 0; h < N / 2; ++h) {
+      x[h] = _mm_add_pd(x[h], _mm_mul_pd(p, _mm_loadu_pd(ab[i] + 2 * h)));
+    }
+  }
+  sum = _mm_setzero_pd();
+  for (h = 0; h < N / 2; ++h) {
+    x[h] = _mm_mul_pd(x[h], s.inverse);
+    sum = _mm_add_pd(sum, x[h]);
+  }
+  c = _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+  if (!add_scale(c, ls)) {
+    for (h = 0; h < N / 2; ++h) {
+      s.u[h] = _mm_set1_pd(1.0 / N);
+      _mm_storeu_pd(current + 2 * h, s.u[h]);
+    }
+    s.inverse = _mm_set1_pd(1.);
+    return 1. / DBL_MIN;
+  }
+  inverse = 1. / c;
+  s.inverse = _mm_set1_pd(inverse);
+  for (h = 0; h < N / 2; ++h) {
+    s.u[h] = x[h];
+    _mm_storeu_pd(current + 2 * h, _mm_mul_pd(x[h], s.inverse));
+  }
+  return inverse;
+}
+
+//! Backward recursion and statistics of a segment, kept in registers
+template <unsigned int N>
+struct backward_state {
+  __m128d beta[N / 2];               //!< Backward probabilities of the last packet
+  __m128d emission[2][N / 2];        //!< Expected number of failed (0) and successful (1) transmissions in each state
+  __m128d transition[N][N / 2];      //!< Expected number of transitions (from, to)
+};
+
+//! Start the backward recursion at the end of a segment
+template <unsigned int N>
+static inline void
+backward_init(backward_state<N>& s)
+{
+  unsigned int i, h;
+  for (h = 0; h < N / 2; ++h) {
+    s.beta[h] = _mm_set1_pd(1.);
+    s.emission[0][h] = _mm_setzero_pd();
+    s.emission[1][h] = _mm_setzero_pd();
+    for (i = 0; i < N; ++i) {
+      s.transition[i][h] = _mm_setzero_pd();
+    }
+  }
+}
+
+/**
+ * Backward step over a packet, with its statistics
+ * @param s Backward recursion, set to the one of the previous packet
+ * @param current Forward probabilities of the packet
+ * @param before Forward probabilities of the previous packet
+ * @param ab Transition followed by the emission of the packet (from, to)
+ * @param ba Same, transposed (to, from)
+ * @param o Outcome of the packet
+ * @param inverse Inverse of the scaling factor of the packet
+ */
+template <unsigned int N>
+static inline void
+backward_step(backward_state<N>& s, const double *current, const double *before, const double (*ab)[N],
+              const double (*ba)[N], const unsigned int o, const double inverse)
+{
+  const __m128d mask = _mm_castsi128_pd(_mm_set1_epi64x(-(int64_t) o)), scale = _mm_set1_pd(inverse);
+  __m128d scaled[N / 2], next[N / 2], gamma, b, x;
+  unsigned int i, h;
+
+  for (h = 0; h < N / 2; ++h) {
+    gamma = _mm_mul_pd(_mm_loadu_pd(current + 2 * h), s.beta[h]);
+    s.emission[0][h] = _mm_add_pd(s.emission[0][h], _mm_andnot_pd(mask, gamma));
+    s.emission[1][h] = _mm_add_pd(s.emission[1][h], _mm_and_pd(mask, gamma));
+    scaled[h] = _mm_mul_pd(s.beta[h], scale);
+    next[h] = _mm_setzero_pd();
+  }
+  for (i = 0; i < N; ++i) {
+    b = _mm_set1_pd(before[i]);
+    x = (i & 1) ? _mm_unpackhi_pd(scaled[i / 2], scaled[i / 2]) : _mm_unpacklo_pd(scaled[i / 2], scaled[i / 2]);
+    for (h = 0; h < N / 2; ++h) {
+      s.transition[i][h] = _mm_add_pd(s.transition[i][h], _mm_mul_pd(b, _mm_mul_pd(_mm_loadu_pd(ab[i] + 2 * h), scaled[h])));
+      next[h] = _mm_add_pd(next[h], _mm_mul_pd(_mm_loadu_pd(ba[i] + 2 * h), x));
+    }
+  }
+  for (h = 0; h < N / 2; ++h) {
+    s.beta[h] = next[h];
+  }
+}
+
+//! Get the backward probabilities and the statistics out of the registers
+template <unsigned int N>
+static inline void
+backward_store(const backward_state<N>& s, double *beta, double (*emission)[N], double (*transition)[N])
+{
+  unsigned int i, h;
+  for (h = 0; h < N / 2; ++h) {
+    _mm_storeu_pd(beta + 2 * h, s.beta[h]);
+    _mm_storeu_pd(emission[0] + 2 * h, s.emission[0][h]);
+    _mm_storeu_pd(emission[1] + 2 * h, s.emission[1][h]);
+    for (i = 0; i < N; ++i) {
+      _mm_storeu_pd(transition[i] + 2 * h, s.transition[i][h]);
+    }
+  }
+}
+#else
+//! Forward recursion (see the SSE2 version)
+template <unsigned int N>
+struct forward_state {
+  const double *previous;  //!< Scaled forward probabilities of the last packet
+};
+
+//! Start the forward recursion from scaled probabilities
+template <unsigned int N>
+static inline void
+forward_load(forward_state<N>& s, const double *alpha)
+{
+  s.previous = alpha;
+}
+
+//! Forward probabilities of a packet (see the SSE2 version)
+template <unsigned int N>
+static inline double
+forward_step(forward_state<N>& s, const double (*ab)[N], double *current, log_scale& ls)
+{
+  double x, c = 0;
+  unsigned int i, j;
+
+  for (j = 0; j < N; ++j) {
+    x = 0;
+    for (i = 0; i < N; ++i) {
+      x += s.previous[i] * ab[i][j];
+    }
+    current[j] = x;
+    c += x;
+  }
+  s.previous = current;
+  return normalize<N>(current, c, ls);
+}
+
+//! Backward recursion and statistics of a segment
+template <unsigned int N>
+struct backward_state {
+  double beta[N];              //!< Backward probabilities of the last packet
+  double emission[2][N];       //!< Expected number of failed (0) and successful (1) transmissions in each state
+  double transition[N][N];     //!< Expected number of transitions (from, to)
+};
+
+//! Start the backward recursion at the end of a segment
+template <unsigned int N>
+static inline void
+backward_init(backward_state<N>& s)
+{
+  unsigned int j;
+  memset(&s, 0, sizeof(s));
+  for (j = 0; j < N; ++j) {
+    s.beta[j] = 1;
+  }
+}
+
+//! Backward step over a packet, with its statistics (see the SSE2 version)
+template <unsigned int N>
+static inline void
+backward_step(backward_state<N>& s, const double *current, const double *before, const double (*ab)[N],
+              const double (*ba)[N], const unsigned int o, const double inverse)
+{
+  double scaled[N], next[N];
+  unsigned int i, j;
+
+  for (j = 0; j < N; ++j) {
+    s.emission[o][j] += current[j] * s.beta[j];
+    scaled[j] = s.beta[j] * inverse;
+    next[j] = 0;
+  }
+  for (i = 0; i < N; ++i) {
+    for (j = 0; j < N; ++j) {
+      s.transition[i][j] += before[i] * ab[i][j] * scaled[j];
+      next[j] += ba[i][j] * scaled[i];
+    }
+  }
+  for (j = 0; j < N; ++j) {
+    s.beta[j] = next[j];
+  }
+}
+
+//! Get the backward probabilities and the statistics
+template <unsigned int N>
+static inline void
+backward_store(const backward_state<N>& s, double *beta, double (*emission)[N], double (*transition)[N])
+{
+  memcpy(beta, s.beta, sizeof(s.beta));
+  memcpy(emission, s.emission, sizeof(s.emission));
+  memcpy(transition, s.transition, sizeof(s.transition));
+}
+#endif
+
+/**
+ * Forward-backward recursion over a segment, with scaling.
+ * The number of states is a template parameter so that the steps are unrolled and vectorized.
+ * The packets are read 64 at a time, and the log-likelihood is taken once per segment.
+ * @param model Hidden Markov model
+ * @param words Trace
+ * @param first Position of the first packet of the segment
+ * @param length Number of packets of the segment
+ * @param start Forward probabilities before the segment (NULL for the beginning of the trace)
+ * @param end Set to the forward probabilities at the end of the segment
+ * @param work Room for length * (N + 1) values
+ * @param stats Statistics, incremented
+ */
+template <unsigned int N>
+static void
+forward_backward(const ParamGilbert::hmm& model, const uint64_t *words, const uint64_t first, const size_t length,
+                 const double *start, double *end, double *work, ParamGilbert::hmm_stats& stats)
+{
+  double ab[2][N][N], ba[2][N][N], b[2][N], beta[N], emission[2][N], transition[N][N], c;
+  double *alpha = work, *inverse = work + length * N;
+  forward_state<N> forward;
+  backward_state<N> backward;
+  log_scale ls = { 1., 0, 0. };
+  uint64_t word;
+  unsigned int i, j, o;
+  size_t t, last;
+
+  /* Transition followed by the emission of o */
+  for (j = 0; j < N; ++j) {
+    b[0][j] = 1 - model.success[j];
+    b[1][j] = model.success[j];
+    for (i = 0; i < N; ++i) {
+      ab[0][i][j] = model.transition[i][j] * b[0][j];
+      ab[1][i][j] = model.transition[i][j] * b[1][j];
+      ba[0][j][i] = ab[0][i][j];
+      ba[1][j][i] = ab[1][i][j];
+    }
+  }
+
+  /* Forward, from the initial probabilities or from the end of the previous segment */
+  if (start == NULL) {
+    o = (unsigned int) ((words[first >> 6] >> (first & 63)) & 1);
+    c = 0;
+    for (j = 0; j < N; ++j) {
+      alpha[j] = model.initial[j] * b[o][j];
+      c += alpha[j];
+    }
+    inverse[0] = normalize<N>(alpha, c, ls);
+    forward_load<N>(forward, alpha);
+    t = 1;
+  } else {
+    forward_load<N>(forward, start);
+    t = 0;
+  }
+  while (t < length) {
+    word = words[(first + t) >> 6] >> ((first + t) & 63);
+    last = std::min(length, t + 64 - (size_t) ((first + t) & 63));
+    for (; t < last; ++t, word >>= 1) {
+      o = (unsigned int) (word & 1);
+      inverse[t] = forward_step<N>(forward, ab[o], alpha + t * N, ls);
+    }
+  }
+  stats.log_likelihood += log(ls.product) + ls.exponent * log(2.) + ls.rest;
+  for (j = 0; j < N; ++j) {
+    end[j] = alpha[(length - 1) * N + j];
+  }
+
+  /* Backward, with the statistics of each packet (the bit of packet t is moved to the top of the word) */
+  backward_init<N>(backward);
+  for (t = length - 1; t > 0; ) {
+    word = words[(first + t) >> 6] << (63 - ((first + t) & 63));
+    last = t - std::min(t - 1, (size_t) ((first + t) & 63));
+    for (; t >= last; --t, word <<= 1) {
+      o = (unsigned int) (word >> 63);
+      backward_step<N>(backward, alpha + t * N, alpha + (t - 1) * N, ab[o], ba[o], o, inverse[t]);
+    }
+  }
+  backward_store<N>(backward, beta, emission, transition);
+  o = (unsigned int) ((words[first >> 6] >> (first & 63)) & 1);
+  for (j = 0; j < N; ++j) {
+    c = alpha[j] * beta[j];
+    emission[o][j] += c;
+    if (start == NULL) {
+      stats.initial[j] += c;
+    }
+  }
+  for (i = 0; i < N; ++i) {
+    stats.emission[i][0] += emission[0][i];
+    stats.emission[i][1] += emission[1][i];
+    for (j = 0; j < N; ++j) {
+      stats.transition[i][j] += transition[i][j];
+    }
+  }
+}
+
+ParamGilbert::ParamGilbert()
+  : states(2), max_iterations(GILBERT_ITERATIONS), tolerance(GILBERT_TOLERANCE), threads(1), output_filename(NULL),
+    packets(0), iterations(0), log_likelihood(0)
+{
+  memset(&model, 0, sizeof(model));
+}
+
+int
+ParamGilbert::init(const int argc, char **argv, const bool human_readable, const char** err)
+{
+  int opt, value;
+  char *end;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  optind = 1;
+  states = 2;
+  max_iterations = GILBERT_ITERATIONS;
+  tolerance = GILBERT_TOLERANCE;
+  threads = (cpus > 0) ? (unsigned int) cpus : 1;
+  output_filename = NULL;
+  while((opt = getopt(argc, argv, "n:i:e:j:o:")) != -1) {
+    switch(opt) {
+      case 'n':
+        value = atoi(optarg);
+        if ((value != 2) && (value != 4)) {
+          *err = badstates;
+          return -1;
+        }
+        states = (unsigned int) value;
+        break;
+      case 'i':
+        value = atoi(optarg);
+        if (value <= 0) {
+          *err = badnumber;
+          return -1;
+        }
+        max_iterations = (unsigned int) value;
+        break;
+      case 'e':
+        tolerance = strtod(optarg, &end);
+        if ((*end != '\0') || !(tolerance >= 0)) {
+          *err = badnumber;
+          return -1;
+        }
+        break;
+      case 'j':
+        value = atoi(optarg);
+        if (value <= 0) {
+          *err = badnumber;
+          return -1;
+        }
+        threads = (unsigned int) value;
+        break;
+      case 'o':
+        output_filename = optarg;
+        break;
+      default:
+        *err = unknownOption;
+        return opt;
+    }
+  }
+  if(argc > optind) {
+    *err = tooMuchOption;
+    return argc;
+  }
+  trace.clear();
+  packets = 0;
+  return 0;
+}
+
+void
+ParamGilbert::clean()
+{
+  std::vector<uint64_t>().swap(trace);
+  packets = 0;
+  boundary.clear();
+  next_boundary.clear();
+  parameters.clear();
+  scaled.clear();
+}
+
+void
+ParamGilbert::append(const uint64_t *words, const uint64_t nbits)
+{
+  const unsigned int shift = (unsigned int) (packets & 63);
+  const size_t count = (size_t) ((nbits + 63) >> 6);
+  size_t i;
+  if (shift == 0) {
+    trace.insert(trace.end(), words, words + count);
+  } else {
+    for (i = 0; i < count; ++i) {
+      trace.back() |= words[i] << shift;
+      trace.push_back(words[i] >> (64 - shift));
+    }
+  }
+  packets += nbits;
+  /* Drop what is after the last packet */
+  trace.resize((size_t) ((packets + 63) >> 6));
+  if (packets & 63) {
+    trace.back() &= (((uint64_t) 1) << (packets & 63)) - 1;
+  }
+}
+
+int
+ParamGilbert::addChar(const bool in)
+{
+  const uint64_t word = in ? 1 : 0;
+  append(&word, 1);
+  return 0;
+}
+
+int
+ParamGilbert::addBits(const uint64_t *words, const size_t nbits)
+{
+  if (nbits != 0) {
+    append(words, nbits);
+  }
+  return 0;
+}
+
+ParamModule*
+ParamGilbert::fork(const uint64_t history, const unsigned int nbits)
+{
+  ParamGilbert *part = new ParamGilbert();
+  part->states = states;
+  part->max_iterations = max_iterations;
+  part->tolerance = tolerance;
+  part->threads = threads;
+  return part;
+}
+
+int
+ParamGilbert::join(ParamModule *p)
+{
+  ParamGilbert *part = dynamic_cast<ParamGilbert*>(p);
+  if (part == NULL) {
+    return -1;
+  }
+  if (part->packets != 0) {
+    append(&part->trace[0], part->packets);
+  }
+  part->clean();
+  delete part;
+  return 0;
+}
+
+bool
+ParamGilbert::nextRound()
+{
+  return false;
+}
+
+void
+ParamGilbert::initModel()
+{
+  uint64_t received = 0;
+  size_t i;
+  double loss;
+  unsigned int j;
+
+  for (i = 0; i < trace.size(); ++i) {
+    received += (uint64_t) __builtin_popcountll(trace[i]);
+  }
+  loss = (packets == 0) ? 0 : 1 - ((double) received) / ((double) packets);
+  /* Keep every parameter away from 0 and 1, a null probability stays null */
+  if (loss < 0.001) {
+    loss = 0.001;
+  } else if (loss > 0.999) {
+    loss = 0.999;
+  }
+
+  memset(&model, 0, sizeof(model));
+  model.states = states;
+  for (j = 0; j < states; ++j) {
+    model.initial[j] = 1.0 / states;
+  }
+  if (states == 2) {
+    /* State 0: good, state 1: bad */
+    model.transition[0][1] = loss / 2;
+    model.transition[0][0] = 1 - model.transition[0][1];
+    model.transition[1][0] = 0.5;
+    model.transition[1][1] = 0.5;
+    model.success[0] = 1 - loss / 2;
+    model.success[1] = (1 - loss) / 2;
+  } else {
+    /* States (netem numbering - 1): 0 reception in gap, 1 reception in burst, 2 loss in burst, 3 loss in gap */
+    model.transition[0][2] = loss / 2;
+    model.transition[0][3] = loss / 2;
+    model.transition[0][0] = 1 - loss;
+    model.transition[1][2] = 0.5;
+    model.transition[1][1] = 0.5;
+    model.transition[2][0] = 0.25;
+    model.transition[2][1] = 0.25;
+    model.transition[2][2] = 0.5;
+    model.transition[3][0] = 1;
+    model.success[0] = 1;
+    model.success[1] = 1;
+    model.success[2] = 0;
+    model.success[3] = 0;
+  }
+}
+
+void *
+ParamGilbert::run(void *arg)
+{
+  worker *w = (worker *) arg;
+  w->module->processSegments(*w);
+  return NULL;
+}
+
+void
+ParamGilbert::processSegments(worker& w)
+{
+  const uint64_t segments = (packets + GILBERT_SEGMENT - 1) / GILBERT_SEGMENT;
+  uint64_t s, first;
+  size_t length;
+  const double *start;
+
+  memset(&w.stats, 0, sizeof(w.stats));
+  w.work.resize(GILBERT_SEGMENT * (states + 1));
+  for (s = w.id; s < segments; s += threads) {
+    first = s * GILBERT_SEGMENT;
+    length = (size_t) ((packets - first < GILBERT_SEGMENT) ? packets - first : GILBERT_SEGMENT);
+    start = (s == 0) ? NULL : &boundary[(size_t) ((s - 1) * states)];
+    if (states == 2) {
+      forward_backward<2>(model, &trace[0], first, length, start, &next_boundary[(size_t) (s * states)], &w.work[0], w.stats);
+    } else {
+      forward_backward<4>(model, &trace[0], first, length, start, &next_boundary[(size_t) (s * states)], &w.work[0], w.stats);
+    }
+  }
+}
+
+int
+ParamGilbert::iterate(hmm_stats& stats)
+{
+  std::vector<worker> workers(threads);
+  std::vector<pthread_t> ids(threads);
+  unsigned int t, i, j;
+  int ret = 0;
+
+  for (t = 0; t < threads; ++t) {
+    workers[t].module = this;
+    workers[t].id = t;
+  }
+  /* The first worker runs in the calling thread */
+  for (t = 1; t < threads; ++t) {
+    if (pthread_create(&ids[t], NULL, &ParamGilbert::run, &workers[t]) != 0) {
+      ret = -1;
+      break;
+    }
+  }
+  processSegments(workers[0]);
+  stats = workers[0].stats;
+  for (i = 1; i < t; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+  if (ret) {
+    return ret;
+  }
+
+  /* Reduce */
+  for (t = 1; t < threads; ++t) {
+    const hmm_stats& part = workers[t].stats;
+    for (i = 0; i < states; ++i) {
+      for (j = 0; j < states; ++j) {
+        stats.transition[i][j] += part.transition[i][j];
+      }
+      stats.emission[i][0] += part.emission[i][0];
+      stats.emission[i][1] += part.emission[i][1];
+      stats.initial[i] += part.initial[i];
+    }
+    stats.log_likelihood += part.log_likelihood;
+  }
+  boundary.swap(next_boundary);
+  return 0;
+}
+
+void
+ParamGilbert::extractParameters()
+{
+  const double (*a)[GILBERT_MAX_STATES] = model.transition;
+  parameters.clear();
+  if (states == 2) {
+    /* The good state is the one with the highest probability of success */
+    const unsigned int good = (model.success[0] >= model.success[1]) ? 0 : 1, bad = 1 - good;
+    parameters.push_back(a[good][bad]);
+    parameters.push_back(a[bad][good]);
+    parameters.push_back(model.success[bad]);
+    parameters.push_back(model.success[good]);
+  } else {
+    parameters.push_back(a[0][2]);
+    parameters.push_back(a[2][0]);
+    parameters.push_back(a[2][1]);
+    parameters.push_back(a[1][2]);
+    parameters.push_back(a[0][3]);
+  }
+}
+
+void
+ParamGilbert::finalize(const uint32_t max_rand)
+{
+  hmm_stats stats;
+  double previous = 0, total;
+  unsigned int i, j;
+  std::vector<double>::const_iterator it;
+
+  initModel();
+  iterations = 0;
+  log_likelihood = 0;
+  if (packets != 0) {
+    boundary.assign((size_t) (((packets + GILBERT_SEGMENT - 1) / GILBERT_SEGMENT) * states), 1.0 / states);
+    next_boundary = boundary;
+    while (iterations < max_iterations) {
+      if (iterate(stats)) {
+        std::cerr << "Unable to create the threads" << std::endl;
+        exit(-1);
+      }
+      ++iterations;
+      log_likelihood = stats.log_likelihood;
+      /* Re-estimate the model (the null transitions of the 4-state model stay null) */
+      for (i = 0; i < states; ++i) {
+        total = 0;
+        for (j = 0; j < states; ++j) {
+          total += stats.transition[i][j];
+        }
+        if (total > 0) {
+          for (j = 0; j < states; ++j) {
+            model.transition[i][j] = stats.transition[i][j] / total;
+          }
+        }
+        total = stats.emission[i][0] + stats.emission[i][1];
+        if ((states == 2) && (total > 0)) {
+          model.success[i] = stats.emission[i][1] / total;
+        }
+        model.initial[i] = stats.initial[i];
+      }
+      if ((iterations > 1) && (log_likelihood - previous <= tolerance * fabs(previous))) {
+        break;
+      }
+      previous = log_likelihood;
+    }
+  }
+  extractParameters();
+  scaled.clear();
+  for (it = parameters.begin(); it != parameters.end(); ++it) {
+    scaled.push_back((uint32_t) (*it * max_rand));
+  }
+  /* The trace is no longer needed */
+  std::vector<uint64_t>().swap(trace);
+  boundary.clear();
+  next_boundary.clear();
+}
+
+int
+ParamGilbert::netemModel(const uint32_t max_rand, NetemModel& netem) const
+{
+  std::vector<std::vector<double> > transition(states, std::vector<double>(states));
+  std::vector<double> success(model.success, model.success + states);
+  RunLengths losses, receptions;
+  unsigned int i, j;
+
+  if (parameters.empty()) {
+    return -1;
+  }
+  for (i = 0; i < states; ++i) {
+    for (j = 0; j < states; ++j) {
+      transition[i][j] = model.transition[i][j];
+    }
+  }
+  /* The other model is fitted on the runs of this one */
+  NetemModel::hmmRuns(transition, success, losses, receptions);
+  netem.fit(losses, receptions);
+  if (states == 2) {
+    netem.setGemodel(parameters[0], parameters[1], parameters[2], parameters[3]);
+  } else {
+    netem.setState(&parameters[0]);
+  }
+  return 0;
+}
+
+//! Try to write something to output and detect any error
+#define WRITE(x)                                             \
+  *output << x << std::endl;                                 \
+  if (output->bad()) {                                       \
+    std::cerr << "error when writing to output" <<std::endl; \
+    exit (-1);;                                              \
+  }
+//"
+
+void
+ParamGilbert::printBinary()
+{
+  std::ostream *output;
+  std::ofstream *output_f;
+  std::vector<uint32_t>::const_iterator it;
+  if (output_filename == NULL ) {
+    output_f = NULL;
+    output = &std::cout;
+  } else {
+    output_f = new std::ofstream(output_filename);
+    output = output_f;
+  }
+  /* Number of states, then p, r, h, k (2 states) or p13, p31, p32, p23, p14 (4 states) */
+  WRITE(states)
+  for (it = scaled.begin(); it != scaled.end(); ++it) {
+    WRITE(*it)
+  }
+  if (output_f != NULL ) {
+    output_f->close();
+    delete (output_f);
+  }
+}
+
+int
+ParamGilbert::printPacked(const uint32_t max_rand)
+{
+  std::vector<uint32_t>::const_iterator it;
+  ParamWriter writer(PARAMFILE_GILBERT, max_rand, scaled.size());
+  writer.setMarkov(states, 0, 0);
+  for (it = scaled.begin(); it != scaled.end(); ++it) {
+    writer.addU32(*it);
+  }
+  if (writer.write(output_filename)) {
+    std::cerr << "error when writing to output" << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+void
+ParamGilbert::printHuman(const uint32_t max_rand)
+{
+  static const char * const names2[] = { "p (good to bad)", "r (bad to good)", "h (success in bad)", "k (success in good)" };
+  static const char * const names4[] = { "p13", "p31", "p32", "p23", "p14" };
+  size_t i;
+  std::cout << "(MaxRand: 0x" << std::hex << max_rand << ")" << std::endl;
+  std::cout << std::dec << states << "-state model fitted on " << packets << " packets in " << iterations
+            << " iterations (log-likelihood " << log_likelihood << ")" << std::endl;
+  for (i = 0; i < scaled.size(); ++i) {
+    std::cout << "- " << ((states == 2) ? names2[i] : names4[i]) << ": 0x%" << std::hex << scaled[i]
+              << " (" << parameters[i] * 100 << "%)" << std::endl;
+  }
+}
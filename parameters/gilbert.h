@@ -0,0 +1,152 @@
+#ifndef GILBERT_H
+#define GILBERT_H
+
+#include "module.h"
+#include <vector>
+
+/**
+ * Maximal number of hidden states
+ */
+#define GILBERT_MAX_STATES 4
+
+/**
+ * Number of packets of the segments processed in parallel by the forward-backward recursion
+ */
+#define GILBERT_SEGMENT (1 << 16)
+
+/**
+ * Fit a Gilbert-Elliott model (hidden Markov model) on the trace, with the Baum-Welch algorithm.
+ * Two models are supported:
+ *  - 2 states (Gilbert-Elliott): a good and a bad state, each with its own probability of success.
+ *    Parameters: p (good to bad), r (bad to good), h (success in the bad state), k (success in the good state)
+ *  - 4 states (as the "loss state" model of netem): reception and loss inside gaps and bursts, the state
+ *    fixes the outcome. Parameters: p13, p31, p32, p23 and p14
+ *
+ * The trace is stored (1 bit per packet) and processed by segments, in parallel. A segment starts from
+ * the forward probabilities at the end of the previous one, as computed by the previous iteration;
+ * the sufficient statistics of the segments are summed at the end of each iteration.
+ */
+class ParamGilbert : public ParamModule {
+
+  public:
+    //! Hidden Markov model
+    struct hmm {
+      //! Number of states
+      unsigned int states;
+      //! Transition probabilities (from, to)
+      double transition[GILBERT_MAX_STATES][GILBERT_MAX_STATES];
+      //! Probability of success in each state
+      double success[GILBERT_MAX_STATES];
+      //! Probability of each state for the first packet
+      double initial[GILBERT_MAX_STATES];
+    };
+
+    //! Sufficient statistics of the Baum-Welch algorithm
+    struct hmm_stats {
+      //! Expected number of transitions (from, to)
+      double transition[GILBERT_MAX_STATES][GILBERT_MAX_STATES];
+      //! Expected number of failed (0) and successful (1) transmissions in each state
+      double emission[GILBERT_MAX_STATES][2];
+      //! Probability of each state for the first packet
+      double initial[GILBERT_MAX_STATES];
+      //! Log-likelihood of the trace
+      double log_likelihood;
+    };
+
+  private:
+    //! Worker of an iteration
+    struct worker {
+      //! Module
+      ParamGilbert *module;
+      //! Index of the worker (it processes the segments id, id + threads, ...)
+      unsigned int id;
+      //! Statistics of the processed segments
+      hmm_stats stats;
+      //! Forward probabilities and scaling factors of a segment
+      std::vector<double> work;
+    };
+
+    //! Number of hidden states (2 or 4)
+    unsigned int states;
+    //! Maximal number of iterations
+    unsigned int max_iterations;
+    //! Relative improvement of the log-likelihood under which the fitting stops
+    double tolerance;
+    //! Number of threads
+    unsigned int threads;
+    //! File which will contain the generated parameters
+    const char *output_filename;
+
+    //! Trace, bit i of word j is the (64 * j + i)-th packet (1 if received)
+    std::vector<uint64_t> trace;
+    //! Number of packets in trace
+    uint64_t packets;
+
+    //! Current model
+    hmm model;
+    //! Forward probabilities at the end of each segment, by the previous iteration (input of the next segment)
+    std::vector<double> boundary;
+    //! Forward probabilities at the end of each segment, by the current iteration
+    std::vector<double> next_boundary;
+    //! Number of iterations done
+    unsigned int iterations;
+    //! Log-likelihood of the trace under the final model
+    double log_likelihood;
+    //! Parameters (p, r, h, k or p13, p31, p32, p23, p14)
+    std::vector<double> parameters;
+    //! Parameters, relatively to rand_max
+    std::vector<uint32_t> scaled;
+
+    /**
+     * Append packets to the trace
+     * @param words Packed bits
+     * @param nbits Number of packets
+     */
+    void append(const uint64_t *words, const uint64_t nbits);
+
+    //! Initial model, from the loss rate of the trace
+    void initModel();
+
+    /**
+     * One iteration of the Baum-Welch algorithm
+     * @param stats Set to the sufficient statistics of the whole trace
+     * @return Ok: 0, -1 if the threads cannot be created
+     */
+    int iterate(hmm_stats& stats);
+
+    //! Thread entry point: process the segments of a worker
+    static void *run(void *arg);
+
+    //! Process the segments of a worker
+    void processSegments(worker& w);
+
+    //! Extract the parameters from the model
+    void extractParameters();
+
+  public:
+    ParamGilbert();
+
+    /* Methodes of ParamModule */
+    int init(const int, char **, const bool, const char**);
+    void clean();
+    int addChar(const bool);
+    int addBits(const uint64_t *, const size_t);
+    ParamModule* fork(const uint64_t, const unsigned int);
+    int join(ParamModule *);
+    bool nextRound();
+    void finalize(const uint32_t);
+    int netemModel(const uint32_t, NetemModel&) const;
+    void printBinary();
+    int printPacked(const uint32_t);
+    void printHuman(const uint32_t);
+
+    //! Error message: The number of states is not supported
+    static const char * const badstates;
+    //! Error message: Invalid number
+    static const char * const badnumber;
+
+    //! Name of this module
+    static const char* name() { return "gilbert"; }
+};
+
+#endif
@@ -0,0 +1,95 @@
+/** @file histogram.cpp Implementation of the burst length histogram */
+
+#include "histogram.h"
+#include <algorithm>
+
+BurstHistogram::BurstHistogram()
+  : dense(HISTOGRAM_DENSE_SIZE, 0), dense_distinct(0)
+{
+}
+
+void
+BurstHistogram::add(const uint32_t len, const uint64_t nb)
+{
+  if (nb == 0) {
+    return;
+  }
+  if (len < HISTOGRAM_DENSE_SIZE) {
+    if (dense[len] == 0) {
+      ++dense_distinct;
+    }
+    dense[len] += nb;
+  } else {
+    overflow[len] += nb;
+  }
+}
+
+void
+BurstHistogram::merge(const BurstHistogram &other)
+{
+  const_iterator it;
+  for (it = other.begin(); it != other.end(); ++it) {
+    add(it->first, it->second);
+  }
+}
+
+void
+BurstHistogram::clear()
+{
+  std::fill(dense.begin(), dense.end(), 0);
+  dense_distinct = 0;
+  overflow.clear();
+}
+
+void
+BurstHistogram::cdf(const uint32_t max_rand, const uint64_t total, BurstCDF &dest) const
+{
+  uint64_t temp_total = 0;
+  const_iterator it;
+
+  dest.clear();
+  dest.reserve(size());
+  for (it = begin(); it != end(); ++it) {
+    temp_total += it->second;
+    dest.push_back(std::pair<uint32_t, uint32_t>(it->first, (uint32_t)(((long double) temp_total) / ((long double) total) * ((long double) max_rand))));
+  }
+}
+
+BurstHistogram::const_iterator::const_iterator(const BurstHistogram *h, const bool end)
+  : histogram(h)
+{
+  if (end) {
+    index = HISTOGRAM_DENSE_SIZE;
+    it = h->overflow.end();
+  } else {
+    index = 0;
+    it = h->overflow.begin();
+    settle();
+  }
+}
+
+void
+BurstHistogram::const_iterator::settle()
+{
+  while ((index < HISTOGRAM_DENSE_SIZE) && (histogram->dense[index] == 0)) {
+    ++index;
+  }
+  if (index < HISTOGRAM_DENSE_SIZE) {
+    current.first = index;
+    current.second = histogram->dense[index];
+  } else if (it != histogram->overflow.end()) {
+    current = *it;
+  }
+}
+
+BurstHistogram::const_iterator&
+BurstHistogram::const_iterator::operator++()
+{
+  if (index < HISTOGRAM_DENSE_SIZE) {
+    ++index;
+  } else {
+    ++it;
+  }
+  settle();
+  return *this;
+}
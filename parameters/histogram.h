@@ -0,0 +1,114 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <vector>
+
+/**
+ * Lengths below this value are counted in a dense array, the others in a map.
+ */
+#define HISTOGRAM_DENSE_SIZE 4096
+
+/**
+ * Cumulative distribution function: (length, cumulated probability in regard of rand_max), sorted by length
+ */
+typedef std::vector<std::pair<uint32_t, uint32_t> > BurstCDF;
+
+/**
+ * Histogram of burst lengths.
+ * Short bursts (the vast majority) are counted in a dense array with an O(1) increment,
+ * the rare long bursts go in an overflow map.
+ */
+class BurstHistogram {
+
+  private:
+    //! Number of bursts of each length below HISTOGRAM_DENSE_SIZE
+    std::vector<uint64_t> dense;
+    //! Number of distinct lengths in 'dense'
+    size_t dense_distinct;
+    //! Number of bursts of each length above HISTOGRAM_DENSE_SIZE
+    std::map<uint32_t, uint64_t> overflow;
+
+  public:
+    /**
+     * Iterator over the (length, number of bursts) pairs, by increasing length.
+     * Lengths without any burst are skipped.
+     */
+    class const_iterator {
+      private:
+        //! Histogram
+        const BurstHistogram *histogram;
+        //! Current dense position, HISTOGRAM_DENSE_SIZE if in the overflow map
+        uint32_t index;
+        //! Current overflow position
+        std::map<uint32_t, uint64_t>::const_iterator it;
+        //! Current pair
+        std::pair<uint32_t, uint64_t> current;
+
+        //! Move to the next non-empty length, starting from the current position
+        void settle();
+
+      public:
+        const_iterator() : histogram(NULL), index(0) {}
+        const_iterator(const BurstHistogram *h, const bool end);
+
+        const std::pair<uint32_t, uint64_t>& operator*() const { return current; }
+        const std::pair<uint32_t, uint64_t>* operator->() const { return &current; }
+        const_iterator& operator++();
+        bool operator==(const const_iterator& o) const { return (index == o.index) && ((index < HISTOGRAM_DENSE_SIZE) || (it == o.it)); }
+        bool operator!=(const const_iterator& o) const { return !(*this == o); }
+    };
+
+    BurstHistogram();
+
+    /**
+     * Count one more burst
+     * @param len Length of the burst
+     */
+    inline void increment(const uint32_t len) {
+      if (len < HISTOGRAM_DENSE_SIZE) {
+        if (dense[len]++ == 0) {
+          ++dense_distinct;
+        }
+      } else {
+        ++overflow[len];
+      }
+    }
+
+    /**
+     * Count several bursts of the same length
+     * @param len Length of the bursts
+     * @param nb Number of bursts
+     */
+    void add(const uint32_t len, const uint64_t nb);
+
+    /**
+     * Add all the bursts of another histogram
+     * @param other Histogram to add
+     */
+    void merge(const BurstHistogram& other);
+
+    //! Forget all the bursts
+    void clear();
+
+    //! Number of distinct lengths
+    size_t size() const { return dense_distinct + overflow.size(); }
+
+    //! First (shortest) length
+    const_iterator begin() const { return const_iterator(this, false); }
+    //! After the last length
+    const_iterator end() const { return const_iterator(this, true); }
+
+    /**
+     * Build the cumulative distribution function with a linear scan
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @param total Total number of bursts
+     * @param dest Cumulative distribution function
+     */
+    void cdf(const uint32_t max_rand, const uint64_t total, BurstCDF& dest) const;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/** @file inflater.cpp Implementation of the gzip decompression thread */
+
+#include "inflater.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+Inflater::Inflater(const size_t chunk_size)
+  : fd(-1), prefix(NULL), prefix_len(0), chunk(chunk_size), ring(NULL), running(false), holding(false),
+    stopping(false), error(NULL)
+{
+}
+
+Inflater::~Inflater()
+{
+  stop();
+}
+
+int
+Inflater::start(const int input, const char *data, const size_t data_len)
+{
+  stop();
+  fd = input;
+  stopping = false;
+  error = NULL;
+  if ((data != NULL) && (data_len > 0)) {
+    prefix = new unsigned char[data_len];
+    memcpy(prefix, data, data_len);
+    prefix_len = data_len;
+  }
+  /* The ring stores bytes in its blocks of words, one consumer: the reader */
+  ring = new BlockRing(INFLATER_SLOTS, chunk / sizeof(uint64_t), 1);
+  if (pthread_create(&thread, NULL, &Inflater::run, this) != 0) {
+    delete (ring);
+    ring = NULL;
+    return -1;
+  }
+  running = true;
+  return 0;
+}
+
+void
+Inflater::stop()
+{
+  const uint64_t *block;
+  if (!running) {
+    return;
+  }
+  /* Drain the ring so that the thread is not stuck waiting for a free slot */
+  stopping = true;
+  if (holding) {
+    ring->release(0);
+    holding = false;
+  }
+  while (ring->acquire(0, &block) > 0) {
+    ring->release(0);
+  }
+  pthread_join(thread, NULL);
+  running = false;
+  delete (ring);
+  ring = NULL;
+  if (prefix != NULL) {
+    delete[] (prefix);
+    prefix = NULL;
+    prefix_len = 0;
+  }
+}
+
+ssize_t
+Inflater::next(const char **data)
+{
+  const uint64_t *block;
+  size_t size;
+  if (!running) {
+    return -1;
+  }
+  if (holding) {
+    ring->release(0);
+    holding = false;
+  }
+  size = ring->acquire(0, &block);
+  if (size == 0) {
+    return (error != NULL) ? -1 : 0;
+  }
+  holding = true;
+  *data = (const char *) block;
+  return (ssize_t) size;
+}
+
+void *
+Inflater::run(void *arg)
+{
+  ((Inflater *) arg)->inflateAll();
+  return NULL;
+}
+
+void
+Inflater::inflateAll()
+{
+  z_stream strm;
+  unsigned char *in;
+  bool input_eof = false, ended = false;
+  ssize_t r;
+  int ret;
+
+  memset(&strm, 0, sizeof(strm));
+  /* 16: gzip wrapper only */
+  if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+    error = "Unable to initialize zlib";
+    ring->finish();
+    return;
+  }
+  in = new unsigned char[INFLATER_INPUT_SIZE];
+  strm.next_in = prefix;
+  strm.avail_in = (uInt) prefix_len;
+  strm.next_out = (Bytef *) ring->reserve();
+  strm.avail_out = (uInt) chunk;
+
+  while (!stopping) {
+    if (strm.avail_in == 0) {
+      if (!input_eof) {
+        do {
+          r = read(fd, in, INFLATER_INPUT_SIZE);
+        } while ((r < 0) && (errno == EINTR));
+        if (r < 0) {
+          error = "Read error";
+          break;
+        }
+        if (r == 0) {
+          input_eof = true;
+        }
+        strm.next_in = in;
+        strm.avail_in = (uInt) r;
+      }
+      if (strm.avail_in == 0) {
+        if (!ended) {
+          error = "Truncated gzip stream";
+        }
+        break;
+      }
+    }
+    if (ended) {
+      /* Another member follows */
+      inflateReset(&strm);
+      ended = false;
+    }
+    ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      ended = true;
+    } else if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+      error = (strm.msg != NULL) ? strm.msg : "Invalid gzip stream";
+      break;
+    }
+    if (strm.avail_out == 0) {
+      ring->publish(chunk);
+      strm.next_out = (Bytef *) ring->reserve();
+      strm.avail_out = (uInt) chunk;
+    }
+  }
+
+  if ((error == NULL) && (strm.avail_out < chunk)) {
+    ring->publish(chunk - strm.avail_out);
+  }
+  ring->finish();
+  inflateEnd(&strm);
+  delete[] (in);
+}
@@ -0,0 +1,100 @@
+#ifndef INFLATER_H
+#define INFLATER_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "ring.h"
+
+/** @file inflater.h Decompression of gzip traces in a separate thread */
+
+/**
+ * Number of decompressed chunks the inflater may get ahead of the reader.
+ */
+#define INFLATER_SLOTS 4
+
+/**
+ * Size of the compressed chunks read from the input.
+ */
+#define INFLATER_INPUT_SIZE (1 << 18)
+
+/**
+ * Decompress a gzip stream in a separate thread, by chunks of 'chunk' bytes.
+ * Decompression thus overlaps with the decoding of the previous chunks.
+ * Concatenated gzip members are read as one stream (as gzip -d does).
+ */
+class Inflater {
+
+  private:
+    //! Compressed input
+    int fd;
+    //! Bytes already read from fd (must be decompressed first)
+    unsigned char *prefix;
+    //! Size of 'prefix'
+    size_t prefix_len;
+    //! Size of the decompressed chunks (multiple of 8)
+    size_t chunk;
+    //! Decompressed chunks
+    BlockRing *ring;
+    //! Decompressing thread
+    pthread_t thread;
+    //! Is 'thread' running ?
+    bool running;
+    //! Is a chunk acquired by the reader ?
+    bool holding;
+    //! Set by the reader to stop the decompression early
+    volatile bool stopping;
+    //! Error of the decompressing thread (valid once the ring is finished)
+    const char *error;
+
+    //! Thread entry point
+    static void *run(void *arg);
+    //! Decompress the whole input (in the thread)
+    void inflateAll();
+
+  public:
+    /**
+     * Constructor
+     * @param chunk Size of the decompressed chunks (multiple of 8)
+     */
+    Inflater(const size_t chunk);
+    ~Inflater();
+
+    /**
+     * Start decompressing
+     * @param fd Compressed input, positioned after 'prefix'
+     * @param prefix Bytes already read from fd (copied), NULL if none
+     * @param prefix_len Size of prefix
+     * @return Ok: 0, anything else in case of error
+     */
+    int start(const int fd, const char *prefix, const size_t prefix_len);
+
+    /**
+     * Get the next decompressed chunk (waits for it), the previous one is released
+     * @param data Set to the chunk, valid until the next call or stop
+     * @return Size of the chunk, 0 at the end of the stream, -1 on error (see lastError)
+     */
+    ssize_t next(const char **data);
+
+    /**
+     * Stop the decompression (if it is not finished yet) and wait for the thread
+     */
+    void stop();
+
+    //! Description of the last error
+    const char *lastError() const { return error; }
+
+    /**
+     * Does a buffer start with the gzip magic ?
+     * @param data Buffer
+     * @param len Size of the buffer
+     */
+    static bool isGzip(const unsigned char *data, const size_t len) {
+      return (len >= 2) && (data[0] == 0x1f) && (data[1] == 0x8b);
+    }
+};
+
+#endif
@@ -1,6 +1,9 @@
 /** @file main.cpp Entry point for the modules */
 
-#include "module.h"
+#include "driver.h"
+#include "segment.h"
+#include "select.h"
+#include "batch.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,7 +11,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <iostream>
-#include <fstream>
+#include <vector>
 
 //! Default value for CLICK_RAND_MAX used by click on linux plateforms
 #define DEFAULT_MAX_RAND 0x7FFFFFFFU
@@ -26,17 +29,70 @@ static void usage(int err)
     output = &std::cerr;
   }
   *output << "parseInput: Parse an input onto a statistic representation" << std::endl;
-  *output << "Usage: ./parseInput [OPTIONS] CLASS [CLASS_OPTIONS]" << std::endl;
+  *output << "Usage: ./parseInput [OPTIONS] CLASS [CLASS_OPTIONS] [-- CLASS [CLASS_OPTIONS]]..." << std::endl;
   *output << "           Try to transform the input onto a static representation of class CLASS" << std::endl;
+  *output << "           Several classes separated by '--' are all fed with a single read of the input" << std::endl;
+  *output << "       ./parseInput [OPTIONS] merge FILE... -- CLASS [CLASS_OPTIONS]" << std::endl;
+  *output << "           Merge count snapshots (see --save-counts) of independent traces instead of reading an input" << std::endl;
+  *output << "           The class options need to be the ones used when saving the snapshots (markovchain and basiconoff)" << std::endl;
+  *output << "       ./parseInput [OPTIONS] segment [SEGMENT_OPTIONS] -- CLASS [CLASS_OPTIONS] [-- CLASS [CLASS_OPTIONS]]..." << std::endl;
+  *output << "           Split the input in stationary segments, group them in regimes of similar loss rates and estimate" << std::endl;
+  *output << "           the parameters of each regime (markovchain and basiconoff); '%r' in the class options is replaced by the" << std::endl;
+  *output << "           regime (0 is the lowest loss rate), e.g. -o markov.%r; the input is kept in memory (1 bit per packet)" << std::endl;
+  *output << "           and the segments are counted in parallel with -t" << std::endl;
+  *output << "       ./parseInput [OPTIONS] batch FILE... -- CLASS [CLASS_OPTIONS] [-- CLASS [CLASS_OPTIONS]]..." << std::endl;
+  *output << "           Process several input files (or glob patterns, e.g. 'traces/*.txt'), each with its own modules, -t files at once;" << std::endl;
+  *output << "           in the class options, '%f' is replaced by the name of the file without directory and extension and '%n' by its" << std::endl;
+  *output << "           number, e.g. -o params/%f.markov; a summary line (file, packets, loss rate, seconds, number of states of each class)" << std::endl;
+  *output << "           is printed as each file is done (on the error output with -h or -f netem); without -i; two files giving the" << std::endl;
+  *output << "           same output names (e.g. a/x.txt and b/x.txt with '%f') are refused before any is read" << std::endl;
+  *output << "       ./parseInput [OPTIONS] select [SELECT_OPTIONS]" << std::endl;
+  *output << "           Choose the order of a markovchain by cross-validation: the input is split in consecutive folds, each counted" << std::endl;
+  *output << "           once at the highest order (lower orders by marginalization), and each order is scored by the log-likelihood" << std::endl;
+  *output << "           of every fold under the chain estimated from the other ones; the orders ranked by score are printed" << std::endl;
+  *output << "           (on the error output if the chain is printed on the standard output), then the chain of the best order," << std::endl;
+  *output << "           estimated from the whole input; the input is kept in memory (1 bit per packet), -t threads are used" << std::endl;
   *output << "Options:" << std::endl;
   *output << "     --help           Print this ..." << std::endl;
   *output << " -h, --human-readable Do not output Binary representation but human readable representation" << std::endl;
   *output << " -m, --max_rand <max> Specify the CLICK_RAND_MAX used by click (Default value 0x%" << DEFAULT_MAX_RAND << " )" << std::endl;
-  *output << " -i, --input <file>   Specify the input file" << std::endl;
+  *output << " -i, --input <file>   Specify the input file (gzip compressed inputs are detected and decompressed)" << std::endl;
+  *output << " -f, --format <fmt>   Format of the non human-readable output: text (one number per line, default)" << std::endl;
+  *output << "                      binary (little-endian with header and checksum, loaded without parsing)" << std::endl;
+  *output << "                      or netem (\"loss gemodel\" and \"loss state\" parameters of tc-netem on the standard output," << std::endl;
+  *output << "                      fit errors on the error output; markovchain, basiconoff, basicmta, mta and gilbert)" << std::endl;
+  *output << "     --stats          Print the reading throughput on the error output" << std::endl;
+  *output << " -t, --threads <n>    Split the input file onto n parts counted in parallel (markovchain and basiconoff)" << std::endl;
+  *output << " -p, --parallel       Run each class in its own thread" << std::endl;
+  *output << " -c, --save-counts <file> Also save the raw counts in a count snapshot, to be merged later (<file>.<n> for the n-th class if several)" << std::endl;
+  *output << "     --online <n>     Online mode (markovchain and basiconoff): forget the counts exponentially and write the parameters" << std::endl;
+  *output << "                      every n packets, each regular file being atomically replaced; the standard input is read as it comes" << std::endl;
+  *output << "                      (e.g. from tail -f), without -t, -p, -c or merge" << std::endl;
+  *output << "     --half-life <h>  Online mode: the weight of a packet is halved every h packets (default: n)" << std::endl;
+  *output << "Segmentation options:" << std::endl;
+  *output << " -w <packets>         Size of the windows whose loss rates are tested (multiple of 64, default " << SEGMENT_WINDOW << ")" << std::endl;
+  *output << " -H <threshold>       Threshold of the log-likelihood ratio CUSUM detecting the changes (default " << SEGMENT_THRESHOLD << ")" << std::endl;
+  *output << " -r <ratio>           Relative change of the loss rate detected (default " << SEGMENT_RATIO << ")" << std::endl;
+  *output << " -n <regimes>         Maximal number of regimes (default " << SEGMENT_REGIMES << ")" << std::endl;
+  *output << " -o <filename>        Output of the regimes (only if !-h): number of regimes, mean segment length and loss rate of each" << std::endl;
+  *output << "                      regime, regime-transition table; the segments (start, length, regime) in <filename>.segments" << std::endl;
+  *output << "Selection options:" << std::endl;
+  *output << " -K <max>             Highest order tested (default " << SELECT_MAX_ORDER << ", < 64, orders above 24 counted in sparse tables)" << std::endl;
+  *output << " -n <folds>           Number of folds (default " << SELECT_FOLDS << ", at least 2)" << std::endl;
+  *output << " -o <filename>        File used as the output of the chain of the best order (only if !-h)" << std::endl;
   *output << "Supported class with subotions:" << std::endl;
-  *output << " * markovchain: k-order Marchov chain representation (2^k states)" << std::endl;
+  *output << " * markovchain: k-order Marchov chain representation (2^k states, k < 64)" << std::endl;
   *output << "   -k <k>             Order of the Markov chain" << std::endl;
+  *output << "   -K <max>           Estimate all the orders 1..max in one pass (output files <filename>.<k> and <filename>.scores)" << std::endl;
   *output << "   -o <filename>      File used as the output (only if !-h)" << std::endl;
+  *output << "   -s                 Count in a sparse table even if k <= 24 (always used above, output lists only the visited states)" << std::endl;
+  *output << "   -D <file>          Count the orders above 24 in a memory-mapped scratch file (2^(k+4) bytes, sparse, removed at exit)" << std::endl;
+  *output << "                      instead of the memory, when the visited states do not fit in it; lower orders of -K use <file>.<order>," << std::endl;
+  *output << "                      -t is ignored" << std::endl;
+  *output << "       --approx <eps>,<delta> Count the orders above 24 in a count-min sketch (e/eps * ln(1/delta) counters, conservative updates):" << std::endl;
+  *output << "                      counts overestimated by at most eps * N with probability 1 - delta, only the states counted more than" << std::endl;
+  *output << "                      that are listed, error bound of each probability in <filename>.bounds (standard error if no file);" << std::endl;
+  *output << "                      not with -K, -D, -t or --save-counts" << std::endl;
   *output << " * basiconoff: On-Off representation without cdf mathematic determination" << std::endl;
   *output << "       --free <file>  Filename used for error-free burst length cdf" << std::endl;
   *output << "       --err  <file>  Filename used for error burst length cdf" << std::endl;
@@ -45,6 +101,23 @@ static void usage(int err)
   *output << "       --free <file>  Filename used for error-free burst length cdf" << std::endl;
   *output << "       --err  <file>  Filename used for error burst length cdf" << std::endl;
   *output << "       --markov <f>   Filename used for the internal markovchain output" << std::endl;
+  *output << "       --run-memory <MiB> Memory used to record the trace between the rounds (4 bytes per burst, default 256)" << std::endl;
+  *output << "       --spill        Spill the record to a temporary file instead of failing when it is full" << std::endl;
+  *output << "       --percentile <p> Threshold between error and error-free periods: p-th percentile of the error burst lengths" << std::endl;
+  *output << "                      (default: mean plus standard deviation)" << std::endl;
+  *output << "       --threshold <C> Fixed threshold between error and error-free periods" << std::endl;
+  *output << " * mta: Markov-based Trace Analysis representation, burst lengths fitted by geometric, Weibull, Pareto, lognormal or 2-geometric mixture" << std::endl;
+  *output << "                      distributions (lowest AIC kept), same options as basicmta" << std::endl;
+  *output << " * vlmc: Variable-order Markov chain representation (context tree pruned by Kullback-Leibler divergence)" << std::endl;
+  *output << "   -d <depth>         Maximal length of the contexts (default 16, < 64, up to 2^(depth+1) contexts are counted)" << std::endl;
+  *output << "   -t <threshold>     A context is kept if its number of packets times its divergence from the shorter one exceeds it (default 1.92)" << std::endl;
+  *output << "   -o <filename>      File used as the output (only if !-h)" << std::endl;
+  *output << " * gilbert: Gilbert-Elliott representation (hidden Markov model fitted by Baum-Welch, output p r h k or p13 p31 p32 p23 p14)" << std::endl;
+  *output << "   -n <states>        2 (Gilbert-Elliott, default) or 4 (netem 4-state model)" << std::endl;
+  *output << "   -i <iterations>    Maximal number of iterations (default 100)" << std::endl;
+  *output << "   -e <tolerance>     Stop when the log-likelihood improves by less than this ratio (default 1e-7)" << std::endl;
+  *output << "   -j <threads>       Number of threads (default: number of processors)" << std::endl;
+  *output << "   -o <filename>      File used as the output (only if !-h)" << std::endl;
 
   exit(err);
 }
@@ -57,42 +130,106 @@ static const struct option long_options[] = {
   {"help",              no_argument, 0,  'e' },
   {"input",       required_argument, 0,  'i' },
   {"max_rand",    required_argument, 0,  'm' },
+  {"stats",             no_argument, 0,  's' },
+  {"threads",     required_argument, 0,  't' },
+  {"parallel",          no_argument, 0,  'p' },
+  {"save-counts", required_argument, 0,  'c' },
+  {"format",      required_argument, 0,  'f' },
+  {"online",      required_argument, 0,  'O' },
+  {"half-life",   required_argument, 0,  'L' },
   {NULL,                          0, 0,   0  }
 };
 
-#include "markovchain.h"
-#include "basiconoff.h"
-#include "basicmta.h"
-
 /**
- * Read all the istream and feed it to the ParamModule
- * @param in istream to read
- * @param mod Module to feed
- * @return : 0K : 0, error-code if != 0
+ * Parse the options of the segmentation (set to their default values beforehand), exit with the usage if they are invalid
+ * @param argc Argument Count (the first argument is 'segment')
+ * @param argv Argument Vector
+ * @param opts Set to the options
  */
-static int extract(std::istream *in, ParamModule *mod)
+static void parse_segment_options(const int argc, char **argv, struct segment_options *opts)
 {
-  char buf;
-  int ret;
-  in->get(buf);
-  while(in->good()) {
-    if (buf == '0') {
-      ret = mod->addChar(false);
-    } else if (buf == '1') {
-      ret = mod->addChar(true);
-    } else if (buf == '\n') {
-      ret = 0;
-    } else {
-      std::cerr << "Parsing error : unauthorized char (" << buf << ")" << std::endl;
-      return -6;
+  unsigned long value;
+  int opt;
+
+  optind = 1;
+  while((opt = getopt(argc, argv, "w:H:r:n:o:")) != -1) {
+    switch(opt) {
+      case 'w':
+        value = strtoul(optarg, NULL, 10);
+        if ((value == 0) || ((value & 63) != 0) || (value > (1UL << 30))) {
+          usage(1);
+        }
+        opts->window = (uint32_t) value;
+        break;
+      case 'H':
+        opts->threshold = strtod(optarg, NULL);
+        if (!(opts->threshold > 0)) {
+          usage(1);
+        }
+        break;
+      case 'r':
+        opts->ratio = strtod(optarg, NULL);
+        if (!(opts->ratio > 1)) {
+          usage(1);
+        }
+        break;
+      case 'n':
+        opts->regimes = (unsigned int) strtoul(optarg, NULL, 10);
+        if (opts->regimes == 0) {
+          usage(1);
+        }
+        break;
+      case 'o':
+        opts->output = optarg;
+        break;
+      default:
+        usage(1);
+        break;
     }
-    if (ret) {
-      std::cerr << "Parsing error" << ret << std::endl;
-      return ret;
+  }
+  if (argc > optind) {
+    usage(1);
+  }
+}
+
+/**
+ * Parse the options of the order selection, exit with the usage if they are invalid
+ * @param argc Argument Count (the first argument is 'select')
+ * @param argv Argument Vector
+ * @param max_order Set to the highest order tested
+ * @param folds Set to the number of folds
+ * @param output Set to the output of the chain
+ */
+static void parse_select_options(const int argc, char **argv, int *max_order, unsigned int *folds, const char **output)
+{
+  int opt;
+
+  optind = 1;
+  while((opt = getopt(argc, argv, "K:n:o:")) != -1) {
+    switch(opt) {
+      case 'K':
+        *max_order = atoi(optarg);
+        if ((*max_order < 1) || (*max_order > 63)) {
+          usage(1);
+        }
+        break;
+      case 'n':
+        *folds = (unsigned int) strtoul(optarg, NULL, 10);
+        if (*folds < 2) {
+          usage(1);
+        }
+        break;
+      case 'o':
+        *output = optarg;
+        break;
+      default:
+        usage(1);
+        break;
     }
-    in->get(buf);
   }
-  return 0;
+  if (argc > optind) {
+    usage(1);
+  }
 }
 
 /**
@@ -103,20 +240,50 @@ static int extract(std::istream *in, ParamModule *mod)
  */
 int main(int argc, char *argv[])
 {
-  bool human_readable;
-  const char *err_message, *input_file;
-  int opt, ret;
+  bool human_readable, stats, per_module, printed;
+  const char *input_file, *counts_file;
+  uint64_t online;
+  double half_life;
+  std::vector<const char*> merge_files;
+  std::vector<std::pair<int, char**> > classes;
+  std::vector<const char*> batch_patterns;
+  std::vector<std::string> batch_files;
+  struct segment_options segment;
+  struct class_args check;
+  bool segmented;
+  int select_order;
+  unsigned int select_folds;
+  const char *select_output;
+  int opt, ret, i, j, first, format;
+  unsigned int threads;
   uint32_t max_rand;
+  ModuleList mods;
+  ModuleList::iterator it;
   ParamModule *mod;
-  std::istream *in;
-  std::ifstream *fin = NULL;
 
   /* Default values */
   human_readable = 0;
+  stats = false;
+  per_module = false;
+  threads = 1;
   max_rand = DEFAULT_MAX_RAND;
   input_file = NULL;
+  counts_file = NULL;
+  format = OUTPUT_TEXT;
+  online = 0;
+  half_life = 0;
+  printed = false;
+  segmented = false;
+  segment.window = SEGMENT_WINDOW;
+  segment.threshold = SEGMENT_THRESHOLD;
+  segment.ratio = SEGMENT_RATIO;
+  segment.regimes = SEGMENT_REGIMES;
+  segment.output = NULL;
+  select_order = SELECT_MAX_ORDER;
+  select_folds = SELECT_FOLDS;
+  select_output = NULL;
 
-  while((opt = getopt_long(argc, argv, "+hm:i:", long_options, NULL)) != -1) {
+  while((opt = getopt_long(argc, argv, "+hm:i:t:pc:f:", long_options, NULL)) != -1) {
     switch(opt) {
       case 'e':
         usage(0);
@@ -127,6 +294,44 @@ int main(int argc, char *argv[])
       case 'i':
         input_file = optarg;
         break;
+      case 's':
+        stats = true;
+        break;
+      case 't':
+        threads = (unsigned int) strtoul(optarg, NULL, 10);
+        if (threads == 0) {
+          usage(1);
+        }
+        break;
+      case 'p':
+        per_module = true;
+        break;
+      case 'c':
+        counts_file = optarg;
+        break;
+      case 'f':
+        if (strcmp(optarg, "binary") == 0) {
+          format = OUTPUT_BINARY;
+        } else if (strcmp(optarg, "text") == 0) {
+          format = OUTPUT_TEXT;
+        } else if (strcmp(optarg, "netem") == 0) {
+          format = OUTPUT_NETEM;
+        } else {
+          usage(1);
+        }
+        break;
+      case 'O':
+        online = strtoull(optarg, NULL, 10);
+        if (online == 0) {
+          usage(1);
+        }
+        break;
+      case 'L':
+        half_life = strtod(optarg, NULL);
+        if (!(half_life > 0)) {
+          usage(1);
+        }
+        break;
       case 'm':
         if (max_rand == DEFAULT_MAX_RAND) {
           usage(1);
@@ -143,69 +348,129 @@ int main(int argc, char *argv[])
   {
     usage(1);
     return 1;
-  } else {
-    /* Try to find the module */
-    if (strcmp(argv[optind], ParamMarckovChain::name()) == 0) {
-      mod = new ParamMarckovChain();
-    } else if (strcmp(argv[optind], ParamBasicOnOff::name()) == 0) {
-      mod = new ParamBasicOnOff();
-    } else if (strcmp(argv[optind], ParamBasicMTA::name()) == 0) {
-      mod = new ParamBasicMTA();
-    } else {
-      std::cerr << "Unknown Module" << std::endl;
-      return -1;
-    }
-    /* Initialize the module */
-    ret = mod->init(argc - optind, argv + optind, human_readable, &err_message);
-    if (ret) {
-      fprintf(stderr, "%s (%i)\n", err_message, ret);
+  }
+  /* Order selection: only its options, no module */
+  if (strcmp(argv[optind], "select") == 0) {
+    if ((online != 0) || (counts_file != NULL)) {
+      usage(1);
+    }
+    parse_select_options(argc - optind, argv + optind, &select_order, &select_folds, &select_output);
+    return read_selected(input_file, select_order, select_folds, select_output, threads, human_readable, format, max_rand);
+  }
+  /* Segmentation mode: its options, then the modules (created for each regime) */
+  if (strcmp(argv[optind], "segment") == 0) {
+    for (i = optind + 1; (i < argc) && (strcmp(argv[i], "--") != 0); ++i);
+    if (i + 1 >= argc) {
+      usage(1);
+    }
+    parse_segment_options(i - optind, argv + optind, &segment);
+    segmented = true;
+    optind = i + 1;
+  }
+  /* Batch mode: input files, then the modules (created for each file) */
+  if (strcmp(argv[optind], "batch") == 0) {
+    for (i = optind + 1; (i < argc) && (strcmp(argv[i], "--") != 0); ++i) {
+      batch_patterns.push_back(argv[i]);
+    }
+    if (batch_patterns.empty() || (i + 1 >= argc)) {
+      usage(1);
+    }
+    optind = i + 1;
+  }
+  /* Merge mode: count snapshots, then a single module */
+  if (strcmp(argv[optind], "merge") == 0) {
+    for (i = optind + 1; (i < argc) && (strcmp(argv[i], "--") != 0); ++i) {
+      merge_files.push_back(argv[i]);
+    }
+    if (merge_files.empty() || (i + 1 >= argc)) {
+      usage(1);
+    }
+    optind = i + 1;
+  }
+  /* Create the modules, separated by '--' (the modules use getopt too) */
+  first = optind;
+  for (i = first; i < argc; i = j + 1) {
+    for (j = i; (j < argc) && (strcmp(argv[j], "--") != 0); ++j);
+    if (j == i) {
+      usage(1);
+    }
+    if (segmented || !batch_patterns.empty()) {
+      /* Check the options now, not after reading the input */
+      expand_args(j - i, argv + i, Patterns(), &check);
+      mod = create_module(j - i, &check.argv[0], human_readable, format, &ret);
+      if (mod == NULL) {
+        return ret;
+      }
+      mod->clean();
+      delete mod;
+      classes.push_back(std::make_pair(j - i, argv + i));
+      continue;
+    }
+    mod = create_module(j - i, argv + i, human_readable, format, &ret);
+    if (mod == NULL) {
       return ret;
     }
+    mods.push_back(mod);
   }
 
-  /* Open the input file or use the standard input */
-  if (input_file != NULL) {
-    fin = new std::ifstream(input_file);
-    in = fin;
+  if (!batch_patterns.empty()) {
+    if (segmented || (online != 0) || (counts_file != NULL) || (input_file != NULL)) {
+      usage(1);
+    }
+    ret = expand_inputs(batch_patterns, &batch_files);
+    if (ret == 0) {
+      ret = read_batch(batch_files, classes, threads, human_readable, format, max_rand);
+    }
+  } else if (segmented) {
+    if ((online != 0) || !merge_files.empty() || (counts_file != NULL)) {
+      usage(1);
+    }
+    ret = read_segmented(input_file, segment, classes, threads, human_readable, format, max_rand);
+  } else if (online != 0) {
+    /* The input is read as it comes, by a single thread */
+    if (!merge_files.empty() || (counts_file != NULL) || (threads > 1) || per_module) {
+      usage(1);
+    }
+    if (!(half_life > 0)) {
+      half_life = (double) online;
+    }
+    for (it = mods.begin(); it != mods.end(); ++it) {
+      if ((*it)->setHalfLife(half_life)) {
+        std::cerr << "Module doesn't support the online mode" << std::endl;
+        return -17;
+      }
+    }
+    ret = read_online(input_file, mods, online, half_life, human_readable, format, max_rand, &printed);
+  } else if (!merge_files.empty()) {
+    if (mods.size() != 1) {
+      usage(1);
+    }
+    ret = merge_counts(mods[0], merge_files, argc - first, argv + first, human_readable, format);
   } else {
-    in = &std::cin;
+    ret = read_input(input_file, mods, threads, per_module, stats);
   }
-
-  /* Verify input state */
-  if (in->bad()) {
-    std::cerr << "Unable to read input" << std::endl;
+  if (ret) {
+    return ret;
   }
 
-  /* First run */
-  extract(in, mod);
-
-  /* Do a second run if needed */
-  if (mod->nextRound()) {
-    if (input_file == NULL) {
-      std::cerr << "2nd round needed, input file needed" << std::endl;
-      return -13;
+  if (counts_file != NULL) {
+    ret = save_counts(mods, counts_file);
+    if (ret) {
+      return ret;
     }
-    fin->close();
-    fin->open(input_file);
-    extract(in, mod);
   }
 
-  /* Close input */
-  if (input_file != NULL) {
-    fin->close();
+  if (!printed) {
+    ret = print_modules(mods, human_readable, format, max_rand);
+    if (ret) {
+      return ret;
+    }
   }
 
-  /* Finalize module */
-  mod->finalize(max_rand);
-
-  /* Print */
-  if (human_readable) {
-    mod->printHuman(max_rand);
-  } else {
-    mod->printBinary();
+  for (it = mods.begin(); it != mods.end(); ++it) {
+    /* Clean the module */
+    (*it)->clean();
+    delete (*it);
   }
-
-  /* Clean the module */
-  mod->clean();
   return 0;
 }
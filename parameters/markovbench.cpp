@@ -0,0 +1,97 @@
+/**
+ * @file markovbench.cpp Benchmark of the Markov chain counting kernels (specialized by order vs generic),
+ * against the original counting: one ParamModule::addChar call per packet
+ */
+
+#include "markovkernel.h"
+#include "markovchain.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+//! Default number of packets counted for each order
+#define BENCH_PACKETS (((size_t) 1) << 26)
+
+/**
+ * Elapsed time since a date
+ * @param start Date
+ * @return Time in seconds
+ */
+static double
+elapsed(const struct timeval& start)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return ((double) (now.tv_sec - start.tv_sec)) + ((double) (now.tv_usec - start.tv_usec)) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t packets = BENCH_PACKETS, i;
+  uint64_t x = 0x9E3779B97F4A7C15ULL, state;
+  int k;
+  struct timeval start;
+  double per_bit, generic, specialized;
+
+  if (argc > 1) {
+    packets = (size_t) strtoull(argv[1], NULL, 10);
+  }
+  if (packets == 0) {
+    std::cerr << "Usage: " << argv[0] << " [packets]" << std::endl;
+    return -1;
+  }
+
+  /* Random trace (xorshift), with about 10% of losses to look like a real one */
+  std::vector<uint64_t> words((packets + 63) / 64);
+  for (i = 0; i < words.size(); ++i) {
+    uint64_t w = ~((uint64_t) 0);
+    for (int j = 0; j < 3; ++j) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      w &= x | (x >> 1) | (x >> 2);
+    }
+    words[i] = w;
+  }
+
+  std::cout << "order  addChar (ns/packet)  generic (ns/packet)  specialized (ns/packet)  speedup (vs addChar)" << std::endl;
+  std::cout << std::fixed << std::setprecision(3);
+  for (k = 1; k <= MARKOV_KERNEL_ORDER; ++k) {
+    std::vector<uint64_t> counts_generic(((size_t) 2) << k, 0), counts_specialized(((size_t) 2) << k, 0);
+    ParamMarckovChain chain;
+    ParamModule *module = &chain;
+
+    /* Original path: a virtual call per packet */
+    chain.init(k, NULL);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < packets; ++i) {
+      module->addChar((words[i >> 6] >> (i & 63)) & 1);
+    }
+    per_bit = elapsed(start);
+    chain.clean();
+
+    state = 0;
+    gettimeofday(&start, NULL);
+    markovCountGeneric(k, &counts_generic[0], &words[0], 0, packets, &state);
+    generic = elapsed(start);
+
+    state = 0;
+    gettimeofday(&start, NULL);
+    markovCountKernel(k)(&counts_specialized[0], &words[0], 0, packets, &state);
+    specialized = elapsed(start);
+
+    if (counts_generic != counts_specialized) {
+      std::cerr << "Order " << k << ": the kernels disagree" << std::endl;
+      return -1;
+    }
+    std::cout << std::setw(5) << k << "  " << std::setw(19) << per_bit * 1e9 / (double) packets
+              << "  " << std::setw(19) << generic * 1e9 / (double) packets
+              << "  " << std::setw(23) << specialized * 1e9 / (double) packets
+              << "  " << std::setw(20) << per_bit / specialized << std::endl;
+  }
+  return 0;
+}
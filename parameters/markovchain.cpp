@@ -1,93 +1,705 @@
 /** @file markovchain.cpp Implementation of the Markov chain parameter generation module */
 
 #include "markovchain.h"
+#include "counts.h"
+#include "paramwriter.h"
 
 #include <inttypes.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
 
 const char * const ParamMarckovChain::knotset = "K need to be set != (-k option)";
+const char * const ParamMarckovChain::ktoolarge = "K is too large (k < 64)";
+const char * const ParamMarckovChain::diskerror = "Unable to create the counters file (-D)";
+const char * const ParamMarckovChain::approxerror = "--approx needs eps,delta with 1e-9 <= eps < 1 and e^-32 <= delta < 1, and cannot be used with -K or -D";
 
-void
+const struct option ParamMarckovChain::long_options[] = {
+  {"approx",      required_argument, 0,  'a' },
+  {NULL,                          0, 0,   0  }
+};
+
+ParamMarckovChain::ParamMarckovChain()
+  : k(0), warmup(0), state(0), state_mod(0), states(NULL), transitions(NULL), kernel(NULL),
+    force_sparse(false), table(NULL), default_transition(0), disk(NULL),
+    approx_eps(0), approx_delta(0), sketch(NULL), candidate_limit(MARKOV_MIN_CANDIDATES),
+    half_life(0), output_filename(NULL), all_orders(false)
+{
+}
+
+int
 ParamMarckovChain::init(const int kb, const char* const filename)
 {
+  int ret = 0;
   k = kb;
-  state_mod = ((uint32_t)1) << k;
+  warmup = k;
+  state_mod = ((uint64_t)1) << k;
   state = 0;
-  states = new uint64_t[state_mod << 1];
-  transitions = new uint32_t[state_mod];
+  disk = NULL;
+  table = NULL;
+  sketch = NULL;
+  candidates.clear();
+  candidate_limit = MARKOV_MIN_CANDIDATES;
+  approx_counts[0] = 0;
+  approx_counts[1] = 0;
+  if ((k > MARKOV_DENSE_ORDER) && (approx_eps > 0)) {
+    /* Fixed memory, bounded error */
+    states = NULL;
+    transitions = NULL;
+    sketch = new CountMinSketch(approx_eps, approx_delta);
+  } else if ((k > MARKOV_DENSE_ORDER) && !disk_filename.empty()) {
+    /* Too many visited states for the memory: dense table in a file */
+    states = NULL;
+    transitions = NULL;
+    disk = new DiskCounts();
+    if (disk->open(disk_filename.c_str(), state_mod << 1, DISK_COUNTS_BUFFER)) {
+      delete disk;
+      disk = NULL;
+      table = new SparseCounts();
+      ret = -1;
+    }
+  } else if (force_sparse || (k > MARKOV_DENSE_ORDER)) {
+    /* 2^k states would not fit, only count the visited ones */
+    states = NULL;
+    transitions = NULL;
+    table = new SparseCounts();
+  } else {
+    states = new uint64_t[state_mod << 1]();
+    transitions = new uint32_t[state_mod];
+    kernel = markovCountKernel(k);
+  }
   if (filename != NULL) {
     output_filename = filename;
   }
+  all_orders = false;
+  return ret;
 }
 
 int
 ParamMarckovChain::init(const int argc, char **argv, const bool human_readable, const char** err)
 {
   int opt;
+  bool all = false;
+  char *end;
   optind = 1;
   k = 0;
   output_filename = NULL;
-  while((opt = getopt(argc, argv, "k:o:")) != -1) {
+  force_sparse = false;
+  disk_filename.clear();
+  approx_eps = 0;
+  approx_delta = 0;
+  while((opt = getopt_long(argc, argv, "k:K:o:sD:", long_options, NULL)) != -1) {
     switch(opt) {
       case 'k':
         k = atoi(optarg);
         break;
+      case 'K':
+        k = atoi(optarg);
+        all = true;
+        break;
       case 'o':
         output_filename = optarg;
         break;
+      case 's':
+        force_sparse = true;
+        break;
+      case 'D':
+        disk_filename = optarg;
+        break;
+      case 'a':
+        approx_eps = strtod(optarg, &end);
+        if (*end != ',') {
+          *err = approxerror;
+          return -1;
+        }
+        approx_delta = strtod(end + 1, &end);
+        if ((*end != '\0') || !CountMinSketch::valid(approx_eps, approx_delta)) {
+          *err = approxerror;
+          return -1;
+        }
+        break;
       default:
         *err = unknownOption;
         return opt;
     }
   }
-  if (k == 0) {
+  if (k <= 0) {
     *err = knotset;
     return -1;
   }
+  if (k >= 64) {
+    *err = ktoolarge;
+    return -1;
+  }
   if(argc > optind) {
     *err = tooMuchOption;
     return argc;
   }
-  init(k, NULL);
+  if ((approx_eps > 0) && (all || !disk_filename.empty())) {
+    /* The lower orders cannot be derived from a sketch */
+    *err = approxerror;
+    return -1;
+  }
+  if (init(k, NULL)) {
+    *err = diskerror;
+    return -1;
+  }
+  all_orders = all;
   return 0;
 }
 
 void
 ParamMarckovChain::clean()
 {
+  std::vector<ParamMarckovChain*>::iterator it;
+  for (it = orders.begin(); it != orders.end(); ++it) {
+    if (*it != NULL) {
+      (*it)->clean();
+      delete (*it);
+    }
+  }
+  orders.clear();
   delete[] (states);
   delete[] (transitions);
+  delete (table);
+  delete (disk);
+  delete (sketch);
+  states = NULL;
+  transitions = NULL;
+  table = NULL;
+  disk = NULL;
+  sketch = NULL;
+  candidates.clear();
+  sparse_transitions.clear();
+  sparse_errors.clear();
+  decayed.clear();
+}
+
+void
+ParamMarckovChain::releaseCounts()
+{
+  if (table != NULL) {
+    table->clear();
+  } else if (disk != NULL) {
+    /* Release the disk space, the storage is kept to print in the sparse format */
+    disk->clear();
+  } else {
+    delete[] (states);
+    states = NULL;
+  }
+}
+
+bool
+ParamMarckovChain::nextState(size_t& cursor, uint64_t& from, uint64_t counts[2]) const
+{
+  if (sketch != NULL) {
+    return false;
+  } else if (disk != NULL) {
+    uint64_t index = ((uint64_t) cursor) << 1;
+    if (!disk->next(index)) {
+      cursor = (size_t) state_mod;
+      return false;
+    }
+    from = index >> 1;
+    counts[0] = disk->get(from << 1);
+    counts[1] = disk->get((from << 1) + 1);
+    cursor = (size_t) (from + 1);
+    return true;
+  } else if (table == NULL) {
+    for (; cursor < state_mod; ++cursor) {
+      if (states[cursor << 1] || states[(cursor << 1) + 1]) {
+        from = cursor;
+        counts[0] = states[cursor << 1];
+        counts[1] = states[(cursor << 1) + 1];
+        ++cursor;
+        return true;
+      }
+    }
+  } else {
+    for (; cursor < table->capacity(); ++cursor) {
+      const SparseCounts::entry& e = table->slot(cursor);
+      if (e.state != SparseCounts::empty) {
+        from = e.state;
+        counts[0] = e.count[0];
+        counts[1] = e.count[1];
+        ++cursor;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void
+ParamMarckovChain::countsOf(const uint64_t from, uint64_t counts[2]) const
+{
+  if (table != NULL) {
+    const SparseCounts::entry *e = table->get(from);
+    counts[0] = (e == NULL) ? 0 : e->count[0];
+    counts[1] = (e == NULL) ? 0 : e->count[1];
+  } else if (disk != NULL) {
+    counts[0] = disk->get(from << 1);
+    counts[1] = disk->get((from << 1) + 1);
+  } else if (sketch != NULL) {
+    counts[0] = 0;
+    counts[1] = 0;
+  } else {
+    counts[0] = states[from << 1];
+    counts[1] = states[(from << 1) + 1];
+  }
+}
+
+uint64_t
+ParamMarckovChain::visitedStates() const
+{
+  size_t cursor = 0;
+  uint64_t from, counts[2], nb = 0;
+  if (table != NULL) {
+    return table->size();
+  }
+  while (nextState(cursor, from, counts)) {
+    ++nb;
+  }
+  return nb;
+}
+
+uint64_t
+ParamMarckovChain::stateCount() const
+{
+  return visitedStates();
+}
+
+void
+ParamMarckovChain::addApprox(const uint64_t from, const bool input, const uint64_t nb)
+{
+  const uint64_t key = (from << 1) + input;
+  const uint64_t count = sketch->add(key, nb) + sketch->estimate(key ^ 1);
+  approx_counts[input] += nb;
+  if ((count > sketch->errorBound()) && candidates.insert(from).second && (candidates.size() > candidate_limit)) {
+    pruneCandidates();
+  }
+}
+
+void
+ParamMarckovChain::pruneCandidates()
+{
+  std::set<uint64_t>::iterator it;
+  const uint64_t bound = sketch->errorBound();
+  /* The error bound grows with the trace: some of the candidates are no longer heavy */
+  for (it = candidates.begin(); it != candidates.end();) {
+    if (sketch->estimate(*it << 1) + sketch->estimate((*it << 1) + 1) > bound) {
+      ++it;
+    } else {
+      candidates.erase(it++);
+    }
+  }
+  candidate_limit = std::max((size_t) MARKOV_MIN_CANDIDATES, candidates.size() * 2);
 }
 
 int
 ParamMarckovChain::addChar(const bool input)
 {
-  if (k) {
-    --k;
+  if (warmup) {
+    --warmup;
   } else {
-    ++(states[(state << 1) + input]);
+    addCount(state, input, 1);
   }
   state <<= 1;
-  state %= state_mod;
+  state &= state_mod - 1;
   state += input;
   return 0;
 }
 
+void
+ParamMarckovChain::addRun(const bool input, uint64_t n)
+{
+  const uint64_t saturated = input ? state_mod - 1 : 0;
+  /* Until the history is full of 'input', each packet changes the state */
+  while ((n != 0) && (warmup || (state != saturated))) {
+    ParamMarckovChain::addChar(input);
+    --n;
+  }
+  if (n != 0) {
+    addCount(saturated, input, n);
+  }
+}
+
+int
+ParamMarckovChain::addBits(const uint64_t *words, const size_t nbits)
+{
+  size_t i, end, run;
+  bool value;
+  uint64_t w, current;
+  const uint64_t mask = state_mod - 1;
+
+  /* Warm-up: the first k packets are not counted */
+  for (i = 0; warmup && (i < nbits); ++i) {
+    ParamMarckovChain::addChar(bitAt(words, i));
+  }
+
+  /* Count the transitions, word by word */
+  current = state;
+  while (i < nbits) {
+    /* Saturated state (history full of the next value): count the whole run at once */
+    value = bitAt(words, i);
+    if (current == (value ? mask : 0)) {
+      run = runLength(words, i, nbits);
+      if (run > 64) {
+        addCount(current, value, run);
+        i += run;
+        continue;
+      }
+    }
+    end = (i | 63) + 1;
+    if (end > nbits) {
+      end = nbits;
+    }
+    if (isDense()) {
+      if (kernel != NULL) {
+        kernel(states, words, i, end, &current);
+      } else {
+        markovCountGeneric(k, states, words, i, end, &current);
+      }
+      i = end;
+    } else if (disk != NULL) {
+      w = words[i >> 6] >> (i & 63);
+      for (; i < end; ++i, w >>= 1) {
+        disk->increment((current << 1) | (w & 1));
+        current = ((current << 1) | (w & 1)) & mask;
+      }
+    } else if (sketch != NULL) {
+      w = words[i >> 6] >> (i & 63);
+      for (; i < end; ++i, w >>= 1) {
+        addApprox(current, w & 1, 1);
+        current = ((current << 1) | (w & 1)) & mask;
+      }
+    } else {
+      w = words[i >> 6] >> (i & 63);
+      for (; i < end; ++i, w >>= 1) {
+        table->increment(current, w & 1);
+        current = ((current << 1) | (w & 1)) & mask;
+      }
+    }
+  }
+  state = current;
+  return 0;
+}
+
+ParamModule*
+ParamMarckovChain::fork(const uint64_t history, const unsigned int nbits)
+{
+  unsigned int i;
+  ParamMarckovChain *part;
+  if ((disk != NULL) || (sketch != NULL)) {
+    /* Each part would need its own table as large as the file, and sketches cannot be added: count sequentially */
+    return NULL;
+  }
+  part = new ParamMarckovChain();
+  part->force_sparse = force_sparse;
+  part->init(k, NULL);
+  /* Seed the state with the end of the previous part, without counting */
+  for (i = 0; i < nbits; ++i) {
+    part->state = ((part->state << 1) + ((history >> i) & 1)) & (state_mod - 1);
+  }
+  /* Only the packets without a full history are not counted */
+  part->warmup = (nbits >= (unsigned int) k) ? 0 : k - (int) nbits;
+  return part;
+}
+
+int
+ParamMarckovChain::join(ParamModule *p)
+{
+  ParamMarckovChain *part = dynamic_cast<ParamMarckovChain*>(p);
+  if ((part == NULL) || merge(part)) {
+    return -1;
+  }
+  state = part->state;
+  warmup = part->warmup;
+  part->clean();
+  delete part;
+  return 0;
+}
+
+/*
+ * Snapshot payload:
+ *  - uint32: k
+ *  - if k <= MARKOV_DENSE_ORDER: 2 * (1 << k) uint64, number of occurences of (state << 1) + input
+ *  - otherwise: uint64 number of visited states, then for each: uint64 state, uint64 failures, uint64 successes
+ */
+int
+ParamMarckovChain::saveCounts(std::ostream& out)
+{
+  size_t cursor = 0;
+  uint64_t from, i, counts[2];
+  if (sketch != NULL) {
+    /* Approximate counts are not saved */
+    return -1;
+  }
+  counts_write_header(out, name());
+  counts_write_u32(out, (uint32_t) k);
+  if (k <= MARKOV_DENSE_ORDER) {
+    if (isDense()) {
+      for (i = 0; i < (state_mod << 1); ++i) {
+        counts_write_u64(out, states[i]);
+      }
+    } else {
+      std::vector<uint64_t> dense((size_t) (state_mod << 1), 0);
+      while (nextState(cursor, from, counts)) {
+        dense[(size_t) (from << 1)] = counts[0];
+        dense[(size_t) (from << 1) + 1] = counts[1];
+      }
+      for (i = 0; i < (state_mod << 1); ++i) {
+        counts_write_u64(out, dense[(size_t) i]);
+      }
+    }
+  } else {
+    counts_write_u64(out, visitedStates());
+    while (nextState(cursor, from, counts)) {
+      counts_write_u64(out, from);
+      counts_write_u64(out, counts[0]);
+      counts_write_u64(out, counts[1]);
+    }
+  }
+  return out.good() ? 0 : -1;
+}
+
+int
+ParamMarckovChain::loadCounts(std::istream& in)
+{
+  uint64_t i, nb, from, counts[2];
+  uint32_t kb;
+  int ret;
+  if (sketch != NULL) {
+    return -1;
+  }
+  ret = counts_read_header(in, name());
+  if (ret) {
+    return ret;
+  }
+  if (counts_read_u32(in, &kb) || (kb != (uint32_t) k)) {
+    return -4;
+  }
+  if (table != NULL) {
+    table->clear();
+  } else if (disk != NULL) {
+    disk->clear();
+  } else {
+    std::fill(states, states + (state_mod << 1), 0);
+  }
+  if (k <= MARKOV_DENSE_ORDER) {
+    for (i = 0; i < (state_mod << 1); ++i) {
+      if (counts_read_u64(in, &nb)) {
+        return -5;
+      }
+      if (nb) {
+        addCount(i >> 1, i & 1, nb);
+      }
+    }
+  } else {
+    if (counts_read_u64(in, &nb)) {
+      return -5;
+    }
+    for (i = 0; i < nb; ++i) {
+      if (counts_read_u64(in, &from) || counts_read_u64(in, &counts[0]) || counts_read_u64(in, &counts[1]) || (from >= state_mod)) {
+        return -5;
+      }
+      addCount(from, false, counts[0]);
+      addCount(from, true, counts[1]);
+    }
+  }
+  return 0;
+}
+
+int
+ParamMarckovChain::merge(const ParamModule *o)
+{
+  size_t cursor = 0;
+  uint64_t i, from, counts[2];
+  const ParamMarckovChain *other = dynamic_cast<const ParamMarckovChain*>(o);
+  if ((other == NULL) || (other->k != k) || (sketch != NULL) || (other->sketch != NULL)) {
+    return -1;
+  }
+  if (isDense() && other->isDense()) {
+    for (i = 0; i < (state_mod << 1); ++i) {
+      states[i] += other->states[i];
+    }
+  } else {
+    while (other->nextState(cursor, from, counts)) {
+      addCount(from, false, counts[0]);
+      addCount(from, true, counts[1]);
+    }
+  }
+  return 0;
+}
+
+int
+ParamMarckovChain::setHalfLife(const double h)
+{
+  /* The decayed counts are kept in memory: only the exact in-memory storages */
+  if ((disk != NULL) || (sketch != NULL) || all_orders || !(h > 0)) {
+    return -1;
+  }
+  half_life = h;
+  return 0;
+}
+
+void
+ParamMarckovChain::decay(const uint64_t packets)
+{
+  size_t cursor = 0;
+  uint64_t from, counts[2];
+  DecayedCounts::Counts recent;
+  while (nextState(cursor, from, counts)) {
+    if (counts[0]) {
+      recent.push_back(std::make_pair(from << 1, counts[0]));
+    }
+    if (counts[1]) {
+      recent.push_back(std::make_pair((from << 1) + 1, counts[1]));
+    }
+  }
+  if (!isDense()) {
+    std::sort(recent.begin(), recent.end());
+  }
+  decayed.fold(DecayedCounts::factor(packets, half_life), recent);
+  /* Start counting the next packets from scratch */
+  if (isDense()) {
+    std::fill(states, states + (state_mod << 1), 0);
+  } else {
+    table->clear();
+  }
+}
+
 bool
 ParamMarckovChain::nextRound()
 {
   return false;
 }
 
+ParamMarckovChain*
+ParamMarckovChain::marginalize(const char* const filename) const
+{
+  size_t cursor = 0;
+  uint64_t i, half, from, counts[2];
+  ParamMarckovChain *lower = new ParamMarckovChain();
+  if (!disk_filename.empty()) {
+    std::ostringstream name;
+    name << disk_filename << "." << (k - 1);
+    lower->disk_filename = name.str();
+  }
+  if (lower->init(k - 1, filename)) {
+    std::cerr << "Unable to create " << lower->disk_filename << ", counting order " << std::dec << (k - 1) << " in memory" << std::endl;
+  }
+  if (isDense() && lower->isDense()) {
+    /* Index (state << 1) + input: the oldest packet of the history is the highest bit of the index */
+    half = state_mod;
+    for (i = 0; i < half; ++i) {
+      lower->states[i] = states[i] + states[i + half];
+    }
+  } else {
+    /* Drop the oldest packet of each visited state */
+    while (nextState(cursor, from, counts)) {
+      lower->addCount(from & (lower->state_mod - 1), false, counts[0]);
+      lower->addCount(from & (lower->state_mod - 1), true, counts[1]);
+    }
+  }
+  return lower;
+}
+
+long double
+ParamMarckovChain::logLikelihood() const
+{
+  size_t cursor = 0;
+  uint64_t from, counts[2];
+  long double sum, ll = 0;
+  while (nextState(cursor, from, counts)) {
+    sum = ((long double) counts[1]) + counts[0];
+    if (counts[0]) {
+      ll += ((long double) counts[0]) * logl(((long double) counts[0]) / sum);
+    }
+    if (counts[1]) {
+      ll += ((long double) counts[1]) * logl(((long double) counts[1]) / sum);
+    }
+  }
+  return ll;
+}
+
+long double
+ParamMarckovChain::heldOutLogLikelihood(const ParamMarckovChain& total) const
+{
+  size_t cursor = 0;
+  uint64_t from, counts[2], all[2];
+  long double train[2], ll = 0;
+  while (nextState(cursor, from, counts)) {
+    total.countsOf(from, all);
+    train[0] = ((long double) (all[0] - counts[0])) + 0.5L;
+    train[1] = ((long double) (all[1] - counts[1])) + 0.5L;
+    if (counts[0]) {
+      ll += ((long double) counts[0]) * logl(train[0] / (train[0] + train[1]));
+    }
+    if (counts[1]) {
+      ll += ((long double) counts[1]) * logl(train[1] / (train[0] + train[1]));
+    }
+  }
+  return ll;
+}
+
 void
 ParamMarckovChain::finalize(const uint32_t manx_rand)
 {
-  uint32_t   i, tmp;
+  uint64_t   i, tmp;
   long double sum, max = 0;
 
+  if (half_life > 0) {
+    finalizeDecayed(manx_rand);
+    return;
+  }
+  if (all_orders) {
+    /* Derive every lower order from the counts of order k */
+    ParamMarckovChain *current = this;
+    int order;
+    orders.resize((size_t) k);
+    order_filenames.resize((size_t) k);
+    log_likelihood.resize((size_t) k);
+    if (output_filename != NULL) {
+      std::ostringstream name;
+      name << output_filename << "." << k;
+      order_filenames[(size_t) (k - 1)] = name.str();
+    }
+    for (order = k - 1; order > 0; --order) {
+      if (output_filename != NULL) {
+        std::ostringstream name;
+        name << output_filename << "." << order;
+        order_filenames[(size_t) (order - 1)] = name.str();
+      }
+      current = current->marginalize(output_filename == NULL ? NULL : order_filenames[(size_t) (order - 1)].c_str());
+      orders[(size_t) (order - 1)] = current;
+      /* The counts of order + 1 are no longer needed once order is derived */
+      if (order + 1 < k) {
+        orders[(size_t) order]->finalize(manx_rand);
+        log_likelihood[(size_t) order] = orders[(size_t) order]->logLikelihood();
+        orders[(size_t) order]->releaseCounts();
+      }
+    }
+    if (k > 1) {
+      orders[0]->finalize(manx_rand);
+      log_likelihood[0] = orders[0]->logLikelihood();
+      orders[0]->releaseCounts();
+    }
+    log_likelihood[(size_t) (k - 1)] = logLikelihood();
+  }
+
+  if (sketch != NULL) {
+    finalizeApprox(manx_rand);
+    return;
+  }
+  if (!isDense()) {
+    finalizeSparse(manx_rand);
+    return;
+  }
   for (i = 0; i < state_mod; ++i) {
     tmp = (i << 1);
     sum = ((long double)states[tmp + 1]) + states[tmp];
@@ -103,6 +715,122 @@ ParamMarckovChain::finalize(const uint32_t manx_rand)
   }
 }
 
+void
+ParamMarckovChain::finalizeSparse(const uint32_t manx_rand)
+{
+  size_t cursor = 0;
+  uint64_t from, counts[2], sum, max = 0, successes = 0, total = 0;
+  sparse_transitions.clear();
+  sparse_transitions.reserve((size_t) visitedStates());
+  while (nextState(cursor, from, counts)) {
+    sum = counts[0] + counts[1];
+    /* Same tie-break as the dense table: the smallest state wins */
+    if ((sum > max) || ((sum == max) && (from < state))) {
+      max = sum;
+      state = from;
+    }
+    successes += counts[1];
+    total += sum;
+    sparse_transitions.push_back(std::make_pair(from, counts[1] == 0 ? 0 : (uint32_t) (((long double) counts[1]) / ((long double) sum) * manx_rand)));
+  }
+  std::sort(sparse_transitions.begin(), sparse_transitions.end());
+  /* The states never visited get the overall probability of success */
+  if (successes == 0) {
+    default_transition = 0;
+  } else {
+    default_transition = (uint32_t) (((long double) successes) / ((long double) total) * manx_rand);
+  }
+}
+
+void
+ParamMarckovChain::finalizeApprox(const uint32_t manx_rand)
+{
+  std::set<uint64_t>::const_iterator it;
+  uint64_t counts[2], sum, max = 0, low, high;
+  long double p, pmin, pmax;
+  const uint64_t bound = sketch->errorBound();
+  sparse_transitions.clear();
+  sparse_errors.clear();
+  /* Only the heavy states are materialized, already sorted */
+  for (it = candidates.begin(); it != candidates.end(); ++it) {
+    counts[0] = sketch->estimate(*it << 1);
+    counts[1] = sketch->estimate((*it << 1) + 1);
+    sum = counts[0] + counts[1];
+    if (sum <= bound) {
+      continue;
+    }
+    if (sum > max) {
+      max = sum;
+      state = *it;
+    }
+    /* The true counts are in [estimate - bound, estimate] */
+    p = ((long double) counts[1]) / ((long double) sum);
+    low = (counts[1] > bound) ? counts[1] - bound : 0;
+    high = (counts[0] > bound) ? counts[0] - bound : 0;
+    pmin = ((low + counts[0]) == 0) ? 0 : ((long double) low) / ((long double) (low + counts[0]));
+    pmax = ((counts[1] + high) == 0) ? 1 : ((long double) counts[1]) / ((long double) (counts[1] + high));
+    sparse_transitions.push_back(std::make_pair(*it, counts[1] == 0 ? 0 : (uint32_t) (p * manx_rand)));
+    sparse_errors.push_back((uint32_t) (std::max(p - pmin, pmax - p) * manx_rand));
+  }
+  /* The other states get the overall probability of success (exact) */
+  if (approx_counts[1] == 0) {
+    default_transition = 0;
+  } else {
+    default_transition = (uint32_t) (((long double) approx_counts[1]) / ((long double) (approx_counts[0] + approx_counts[1])) * manx_rand);
+  }
+}
+
+void
+ParamMarckovChain::finalizeDecayed(const uint32_t manx_rand)
+{
+  DecayedCounts::const_iterator it;
+  uint64_t from;
+  double weights[2], sum, max = 0, successes = 0;
+  uint32_t p;
+  if (isDense()) {
+    std::fill(transitions, transitions + state_mod, 0);
+  } else {
+    sparse_transitions.clear();
+  }
+  state = 0;
+  /* Both weights of a state are consecutive */
+  for (it = decayed.begin(); it != decayed.end();) {
+    from = it->first >> 1;
+    weights[0] = 0;
+    weights[1] = 0;
+    for (; (it != decayed.end()) && ((it->first >> 1) == from); ++it) {
+      weights[it->first & 1] = it->second;
+    }
+    sum = weights[0] + weights[1];
+    if (sum > max) {
+      max = sum;
+      state = from;
+    }
+    successes += weights[1];
+    p = (uint32_t) (weights[1] / sum * manx_rand);
+    if (isDense()) {
+      transitions[from] = p;
+    } else {
+      sparse_transitions.push_back(std::make_pair(from, p));
+    }
+  }
+  if (!isDense()) {
+    default_transition = (decayed.total() > 0) ? (uint32_t) (successes / decayed.total() * manx_rand) : 0;
+  }
+}
+
+void
+ParamMarckovChain::printBounds(std::ostream& output) const
+{
+  size_t i;
+  output << "# count-min sketch: eps " << approx_eps << " delta " << approx_delta << ", " << std::dec << sketch->size()
+         << " transitions, counts overestimated by at most " << sketch->errorBound() << " with probability " << (1 - approx_delta) << std::endl;
+  output << "# state probability error (relatively to max_rand)" << std::endl;
+  for (i = 0; i < sparse_transitions.size(); ++i) {
+    output << sparse_transitions[i].first << " " << sparse_transitions[i].second << " " << sparse_errors[i] << std::endl;
+  }
+}
+
 //! Try to write something to output and detect any error
 #define WRITE(x)                                             \
   *output << x << std::endl;                                 \
@@ -112,38 +840,216 @@ ParamMarckovChain::finalize(const uint32_t manx_rand)
   }
 //"
 
+void
+ParamMarckovChain::printScores(std::ostream& output) const
+{
+  int order;
+  size_t cursor = 0;
+  uint64_t from, counts[2], total = 0;
+  long double ll, params;
+  while (nextState(cursor, from, counts)) {
+    total += counts[0] + counts[1];
+  }
+  output << "# order log-likelihood AIC BIC (" << std::dec << total << " transitions)" << std::endl;
+  std::streamsize precision = output.precision(15);
+  for (order = 1; order <= k; ++order) {
+    ll = log_likelihood[(size_t) (order - 1)];
+    params = (long double) (((uint64_t) 1) << order);
+    output << std::dec << order << " " << ll << " " << 2 * params - 2 * ll << " " << params * logl((long double) total) - 2 * ll << std::endl;
+  }
+  output.precision(precision);
+}
+
+int
+ParamMarckovChain::runLengths(const uint32_t max_rand, const double cut, RunLengths& losses, RunLengths& receptions) const
+{
+  std::vector<double> received, occupancy;
+  uint64_t i;
+  /* The frequencies of the states are needed: counts in memory, not decayed */
+  if (!isDense() || (half_life > 0)) {
+    return -1;
+  }
+  received.resize(state_mod);
+  occupancy.resize(state_mod);
+  for (i = 0; i < state_mod; ++i) {
+    received[i] = ((double) transitions[i]) / max_rand;
+    occupancy[i] = ((double) states[i << 1]) + ((double) states[(i << 1) + 1]);
+  }
+  NetemModel::chainRuns(received, occupancy, cut, losses, receptions);
+  return 0;
+}
+
+int
+ParamMarckovChain::netemModel(const uint32_t max_rand, NetemModel& netem) const
+{
+  RunLengths losses, receptions;
+  if (runLengths(max_rand, 0, losses, receptions)) {
+    return -1;
+  }
+  netem.fit(losses, receptions);
+  return 0;
+}
+
 void
 ParamMarckovChain::printBinary()
+{
+  printFile(false, 0);
+}
+
+int
+ParamMarckovChain::printPacked(const uint32_t max_rand)
+{
+  return printFile(true, max_rand);
+}
+
+int
+ParamMarckovChain::writePacked(const char *filename, const uint32_t max_rand) const
+{
+  uint64_t temp;
+  if (isDense()) {
+    ParamWriter writer(PARAMFILE_MARKOV, max_rand, state_mod);
+    writer.setMarkov((uint32_t) k, state, 0);
+    for (temp = 0; temp < state_mod; ++temp) {
+      writer.addU32(transitions[temp]);
+    }
+    return writer.write(filename);
+  } else {
+    std::vector<std::pair<uint64_t, uint32_t> >::const_iterator it;
+    ParamWriter writer(PARAMFILE_MARKOV_SPARSE, max_rand, sparse_transitions.size());
+    writer.setMarkov((uint32_t) k, state, default_transition);
+    for (it = sparse_transitions.begin(); it != sparse_transitions.end(); ++it) {
+      writer.addU64(it->first);
+    }
+    for (it = sparse_transitions.begin(); it != sparse_transitions.end(); ++it) {
+      writer.addU32(it->second);
+    }
+    return writer.write(filename);
+  }
+}
+
+int
+ParamMarckovChain::printFile(const bool packed, const uint32_t max_rand)
 {
   std::ostream *output;
   std::ofstream *output_f;
-  if (output_filename == NULL ) {
+  const char *filename = output_filename;
+  int ret = 0;
+  if (all_orders) {
+    /* Print the lower orders, then the scores, and finally order k */
+    std::vector<ParamMarckovChain*>::iterator it;
+    for (it = orders.begin(); it != orders.end(); ++it) {
+      if ((*it != NULL) && (*it)->printFile(packed, max_rand)) {
+        ret = -1;
+      }
+    }
+    if (output_filename == NULL) {
+      printScores(std::cerr);
+    } else {
+      std::string name(output_filename);
+      name += ".scores";
+      std::ofstream scores(name.c_str());
+      printScores(scores);
+      scores.close();
+      filename = order_filenames[(size_t) (k - 1)].c_str();
+    }
+  }
+  if (sketch != NULL) {
+    /* The parameter files stay loadable by click: the error bounds go in their own file */
+    if (filename == NULL) {
+      printBounds(std::cerr);
+    } else {
+      std::string name(filename);
+      name += ".bounds";
+      std::ofstream bounds(name.c_str());
+      printBounds(bounds);
+      bounds.close();
+    }
+  }
+  if (packed) {
+    if (writePacked(filename, max_rand)) {
+      std::cerr << "error when writing to output" << std::endl;
+      ret = -1;
+    }
+    return ret;
+  }
+  std::string output_name;
+  if (filename == NULL ) {
     output_f = NULL;
     output = &std::cout;
   } else {
-    output_f = new std::ofstream(output_filename);
+    output_name = paramfile_output(filename);
+    output_f = new std::ofstream(output_name.c_str());
     output = output_f;
   }
-  uint32_t temp;
-  WRITE(state_mod)
-  WRITE(state)
-  for (temp = 0; temp < state_mod; ++temp) {
-    WRITE(transitions[temp])
+  uint64_t temp;
+  if (isDense()) {
+    WRITE(state_mod)
+    WRITE(state)
+    for (temp = 0; temp < state_mod; ++temp) {
+      WRITE(transitions[temp])
+    }
+  } else {
+    /* Sparse format: 0 (never a valid number of states), k, initial state, default probability, number of states, then (state, probability) */
+    std::vector<std::pair<uint64_t, uint32_t> >::const_iterator it;
+    WRITE(0)
+    WRITE(k)
+    WRITE(state)
+    WRITE(default_transition)
+    WRITE(sparse_transitions.size())
+    for (it = sparse_transitions.begin(); it != sparse_transitions.end(); ++it) {
+      WRITE(it->first)
+      WRITE(it->second)
+    }
   }
   if (output_f != NULL ) {
     output_f->close();
+    delete output_f;
+    if (paramfile_replace(filename, output_name)) {
+      std::cerr << "Unable to replace " << filename << std::endl;
+      ret = -1;
+    }
   }
+  return ret;
 }
 
 void
 ParamMarckovChain::printHuman(const uint32_t max_rand)
 {
-  uint32_t temp;
+  uint64_t temp;
+  if (all_orders) {
+    std::vector<ParamMarckovChain*>::iterator it;
+    for (it = orders.begin(); it != orders.end(); ++it) {
+      if (*it != NULL) {
+        std::cout << "Order " << std::dec << (*it)->k << std::endl;
+        (*it)->printHuman(max_rand);
+        std::cout << std::endl;
+      }
+    }
+    printScores(std::cout);
+    std::cout << std::endl << "Order " << std::dec << k << std::endl;
+  }
   std::cout << "(MaxRand: 0x" << std::hex << max_rand << ")" << std::endl;
   std::cout << "State Number : 0x" << std::hex << max_rand << std::endl;
   std::cout << "Most probable state : 0x" << std::hex << state << std::endl;
   std::cout << "Probability of success of transmission in state:" << std::endl;
-  for (temp = 0; temp < state_mod; ++temp) {
-    std::cout << "- 0x" << std::hex << temp << ": 0x%" << std::hex << transitions[temp] << " (" << ((long double)transitions[temp]/((long double) max_rand))*100 << "%)" << std::endl;
+  if (isDense()) {
+    for (temp = 0; temp < state_mod; ++temp) {
+      std::cout << "- 0x" << std::hex << temp << ": 0x%" << std::hex << transitions[temp] << " (" << ((long double)transitions[temp]/((long double) max_rand))*100 << "%)" << std::endl;
+    }
+  } else {
+    std::vector<std::pair<uint64_t, uint32_t> >::const_iterator it;
+    for (it = sparse_transitions.begin(); it != sparse_transitions.end(); ++it) {
+      std::cout << "- 0x" << std::hex << it->first << ": 0x%" << std::hex << it->second << " (" << ((long double)it->second/((long double) max_rand))*100 << "%";
+      if (sketch != NULL) {
+        std::cout << " +- " << ((long double)sparse_errors[(size_t) (it - sparse_transitions.begin())]/((long double) max_rand))*100 << "%";
+      }
+      std::cout << ")" << std::endl;
+    }
+    std::cout << "- other states (" << std::dec << sparse_transitions.size() << " of 2^" << k << ((sketch != NULL) ? " heavy" : " visited") << "): 0x%" << std::hex << default_transition << " (" << ((long double)default_transition/((long double) max_rand))*100 << "%)" << std::endl;
+    if (sketch != NULL) {
+      std::cout << "Count-min sketch (" << std::dec << (sketch->memory() >> 20) << " MiB): eps " << approx_eps << ", delta " << approx_delta
+                << ", only the states counted more than " << sketch->errorBound() << " times (error bound, probability " << (1 - approx_delta)
+                << ") of " << sketch->size() << " are listed" << std::endl;
+    }
   }
 }
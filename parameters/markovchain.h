@@ -2,6 +2,25 @@
 #define MARKOVCHAIN_H
 
 #include "module.h"
+#include "sparsecounts.h"
+#include "markovkernel.h"
+#include "diskcounts.h"
+#include "countmin.h"
+#include "decay.h"
+#include "netem.h"
+#include <getopt.h>
+#include <string>
+#include <vector>
+#include <set>
+
+/**
+ * Highest order counted in a dense table (2^(k+1) counters), higher orders use a SparseCounts,
+ * a DiskCounts if a counters file is given (-D), or a CountMinSketch in approximate mode (--approx)
+ */
+#define MARKOV_DENSE_ORDER MARKOV_KERNEL_ORDER
+
+//! Minimal number of candidate heavy states kept by the approximate mode before pruning them
+#define MARKOV_MIN_CANDIDATES 1024
 
 /**
  * Extract a Markov-chain representation.
@@ -12,39 +31,261 @@ class ParamMarckovChain : public ParamModule {
   private:
     //! Order of the Markov state
     int k;
+    //! Number of packets still to be seen before counting (the first k packets have no full history)
+    int warmup;
     /**
      * Current history in binary.
      * state & (1 << k) means that k + 1 step ago it was a success
      */
-    uint32_t state;
+    uint64_t state;
     //! first state to forget, that is (1 << k)
-    uint32_t state_mod;
-    //! Number of occurences of the indexed state
+    uint64_t state_mod;
+    //! Number of occurences of the indexed state (dense storage, NULL if sparse)
     uint64_t *states;
-    //! Probability, relatively to rand_max, to have a success in the indexed state
+    //! Probability, relatively to rand_max, to have a success in the indexed state (dense storage)
     uint32_t *transitions;
+    //! Counting loop specialized for the order (dense storage)
+    MarkovCountKernel kernel;
+
+    /* Sparse storage, for high orders */
+    //! Use the sparse storage even for low orders ?
+    bool force_sparse;
+    //! Counters of the visited states (sparse storage, NULL if dense)
+    SparseCounts *table;
+    //! Probability, relatively to rand_max, to have a success in each visited state, sorted by state (sparse storage)
+    std::vector<std::pair<uint64_t, uint32_t> > sparse_transitions;
+    //! Probability, relatively to rand_max, to have a success in the states never visited (sparse storage)
+    uint32_t default_transition;
+    //! Counters of order > MARKOV_DENSE_ORDER in a memory-mapped file, indexed as the dense table (NULL if not used)
+    DiskCounts *disk;
+    //! Name of the counters file (-D), empty to count in memory
+    std::string disk_filename;
+
+    /* Approximate counting (--approx), for high orders */
+    //! Relative error of the sketch, 0 to count exactly
+    double approx_eps;
+    //! Probability to exceed the error
+    double approx_delta;
+    //! Estimated number of occurences of (state << 1) + input (NULL if not used)
+    CountMinSketch *sketch;
+    //! States which may be heavy (estimated count above the error bound), sorted
+    std::set<uint64_t> candidates;
+    //! Number of candidates triggering a pruning
+    size_t candidate_limit;
+    //! Exact number of failed (0) and successful (1) transmissions
+    uint64_t approx_counts[2];
+    //! Error bound, relatively to rand_max, of each probability of sparse_transitions (approximate mode)
+    std::vector<uint32_t> sparse_errors;
+
+    /* Online mode (exponential forgetting) */
+    //! Half-life of the counts, in packets (0 if not online)
+    double half_life;
+    //! Decayed number of occurences of (state << 1) + input
+    DecayedCounts decayed;
+
+    /**
+     * Long options used by getopt_long.
+     */
+    static const struct option long_options[];
     //! File which will contain the generated parameters
     const char *output_filename;
 
+    /* Simultaneous estimation of all the orders up to k (-K) */
+    //! Are all the orders 1..k estimated ?
+    bool all_orders;
+    //! Chains of order 1..k, marginalized from the order k counts (index: order - 1)
+    std::vector<ParamMarckovChain*> orders;
+    //! Names of the output files of the sub-chains
+    std::vector<std::string> order_filenames;
+    //! Log-likelihood of the trace for each sub-chain
+    std::vector<long double> log_likelihood;
+
+    /**
+     * Count transitions
+     * @param from State before the transitions
+     * @param input True if the packets were received, False if they weren't
+     * @param nb Number of transitions
+     */
+    inline void addCount(const uint64_t from, const bool input, const uint64_t nb) {
+      if (table != NULL) {
+        table->add(from, input, nb);
+      } else if (disk != NULL) {
+        disk->add((from << 1) + input, nb);
+      } else if (sketch != NULL) {
+        addApprox(from, input, nb);
+      } else {
+        states[(from << 1) + input] += nb;
+      }
+    }
+
+    //! Are the counters and probabilities stored in the dense tables ?
+    inline bool isDense() const { return (table == NULL) && (disk == NULL) && (sketch == NULL); }
+
+    /**
+     * Count transitions in the sketch, and keep the state as a candidate if it may be heavy
+     * @param from State before the transitions
+     * @param input True if the packets were received, False if they weren't
+     * @param nb Number of transitions
+     */
+    void addApprox(const uint64_t from, const bool input, const uint64_t nb);
+
+    //! Forget the candidates whose estimated count is below the error bound
+    void pruneCandidates();
+
+    //! Number of visited states (sparse or disk storage)
+    uint64_t visitedStates() const;
+
+    /**
+     * Release the memory used by the counters, once finalized (only the probabilities are kept)
+     */
+    void releaseCounts();
+
+    /**
+     * Iterate over the visited states, whatever the storage (except the sketch: no state is returned)
+     * @param cursor Position of the iteration, to be set to 0 before the first call
+     * @param from Set to the state
+     * @param counts Set to the number of failed (0) and successful (1) transmissions in this state
+     * @return False if there is no more state
+     */
+    bool nextState(size_t& cursor, uint64_t& from, uint64_t counts[2]) const;
+
+    /**
+     * Counters of a state, whatever the storage (0 for the sketch)
+     * @param from State
+     * @param counts Set to the number of failed (0) and successful (1) transmissions in this state
+     */
+    void countsOf(const uint64_t from, uint64_t counts[2]) const;
+
+    /**
+     * Finalize the sparse storage: probabilities of the visited states, sorted, and of the other states
+     * @param max_rand CLICK_RAND_MAX used by click
+     */
+    void finalizeSparse(const uint32_t max_rand);
+
+    /**
+     * Finalize the approximate storage: probabilities and error bounds of the heavy states, and of the other states
+     * @param max_rand CLICK_RAND_MAX used by click
+     */
+    void finalizeApprox(const uint32_t max_rand);
+
+    /**
+     * Print the error bound of each probability (approximate mode): state, probability, error
+     * @param output Destination
+     */
+    void printBounds(std::ostream& output) const;
+
+    /**
+     * Finalize from the decayed counts (online mode), the counts are left untouched
+     * @param max_rand CLICK_RAND_MAX used by click
+     */
+    void finalizeDecayed(const uint32_t max_rand);
+
+    /**
+     * Log-likelihood of the counted transitions under the maximum likelihood estimate of the chain
+     * @return Log-likelihood (natural logarithm)
+     */
+    long double logLikelihood() const;
+
+    /**
+     * Print the log-likelihood, AIC and BIC of each order
+     * @param output Destination
+     */
+    void printScores(std::ostream& output) const;
+
+    /**
+     * Print the chain, and the lower orders and the scores if all the orders are estimated
+     * @param packed Use the binary parameter format (see paramfile.h) instead of the text one
+     * @param max_rand CLICK_RAND_MAX used by click (binary format only)
+     * @return Ok: 0, -1 in case of error
+     */
+    int printFile(const bool packed, const uint32_t max_rand);
+
+    /**
+     * Write the chain in the binary parameter format
+     * @param filename Name of the file, NULL for the standard output
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @return Ok: 0, -1 in case of error
+     */
+    int writePacked(const char *filename, const uint32_t max_rand) const;
+
   public:
+    ParamMarckovChain();
+
     /* Methodes of ParamModule */
     int init(const int, char **, const bool, const char**);
     void clean();
     int addChar(const bool);
+    int addBits(const uint64_t *, const size_t);
+    ParamModule* fork(const uint64_t, const unsigned int);
+    int join(ParamModule *);
+    int saveCounts(std::ostream&);
+    int loadCounts(std::istream&);
+    int merge(const ParamModule *);
+    int setHalfLife(const double);
+    void decay(const uint64_t);
+    uint64_t stateCount() const;
     bool nextRound();
     void finalize(const uint32_t);
+    int netemModel(const uint32_t, NetemModel&) const;
     void printBinary();
+    int printPacked(const uint32_t);
     void printHuman(const uint32_t);
 
     /**
-     * Special module-dependant initialization
+     * Special module-dependant initialization.
+     * Orders above MARKOV_DENSE_ORDER are counted in a sparse table, or in the counters file if one was given.
      * @param k Order of the Markov chain
      * @param filename Name of the file used for printing the Markov chain representation
+     * @return Ok: 0, -1 if the counters file could not be created (the sparse table is used instead)
+     */
+    int init(const int k, const char* const filename);
+
+    /**
+     * Build a chain of order k - 1 by marginalizing the oldest packet of the history out of this one.
+     * @param filename Name of the file used for printing the new chain
+     * @return The new chain, not finalized
+     */
+    ParamMarckovChain* marginalize(const char* const filename) const;
+
+    /**
+     * Held-out log-likelihood (cross-validation): log-likelihood of the transitions counted by this chain
+     * under the chain estimated from the rest of the trace, that is total minus this chain.
+     * The estimated probabilities are smoothed (add 1/2), a state of this part may never be visited by the rest.
+     * @param total Chain of the same order counting the whole trace, this part included (not finalized)
+     * @return Log-likelihood (natural logarithm)
+     */
+    long double heldOutLogLikelihood(const ParamMarckovChain& total) const;
+
+    //! Order of the chain
+    int order() const { return k; }
+
+    /**
+     * Distributions of the lengths of the runs of lost and received packets of the finalized chain, in its stationary regime
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @param cut Probability that two consecutive lost packets belong to different runs (see NetemModel::chainRuns)
+     * @param losses Set to the probability of each length of the runs of lost packets
+     * @param receptions Set to the probability of each length of the runs of received packets
+     * @return Ok: 0, -1 if the chain is not stored in the dense tables or is online (the frequencies of the states are needed)
+     */
+    int runLengths(const uint32_t max_rand, const double cut, RunLengths& losses, RunLengths& receptions) const;
+
+    /**
+     * Add a run of identical packets (same as n calls to addChar), in O(k):
+     * once the history only holds the value of the run, the state does not change any more
+     * and the rest of the run is counted at once.
+     * @param in True if the packets were received, False if they weren't
+     * @param n Number of packets
      */
-    void init(const int k, const char* const filename);
+    void addRun(const bool in, uint64_t n);
 
     //! Error message: A k-th order Markov-chain need an order k
     static const char * const knotset;
+    //! Error message: The order is too large for the state representation
+    static const char * const ktoolarge;
+    //! Error message: The counters file could not be created
+    static const char * const diskerror;
+    //! Error message: Bad approximate mode parameters
+    static const char * const approxerror;
 
     //! Name of this module
     static const char* name() { return "markovchain"; }
@@ -0,0 +1,45 @@
+/** @file markovkernel.cpp Dispatch of the Markov chain counting kernels */
+
+#include "markovkernel.h"
+
+//! Kernels, indexed by order (bit-parallel up to MARKOV_POPCOUNT_ORDER, following the states above)
+static const MarkovCountKernel kernels[MARKOV_KERNEL_ORDER + 1] = {
+  NULL,
+  &MarkovPopcountCounter<1>::count, &MarkovPopcountCounter<2>::count, &MarkovPopcountCounter<3>::count,
+  &MarkovPopcountCounter<4>::count, &MarkovCounter<5>::count,  &MarkovCounter<6>::count,
+  &MarkovCounter<7>::count,  &MarkovCounter<8>::count,  &MarkovCounter<9>::count,  &MarkovCounter<10>::count,
+  &MarkovCounter<11>::count, &MarkovCounter<12>::count, &MarkovCounter<13>::count, &MarkovCounter<14>::count,
+  &MarkovCounter<15>::count, &MarkovCounter<16>::count, &MarkovCounter<17>::count, &MarkovCounter<18>::count,
+  &MarkovCounter<19>::count, &MarkovCounter<20>::count, &MarkovCounter<21>::count, &MarkovCounter<22>::count,
+  &MarkovCounter<23>::count, &MarkovCounter<24>::count
+};
+
+MarkovCountKernel
+markovCountKernel(const int k)
+{
+  if ((k <= 0) || (k > MARKOV_KERNEL_ORDER)) {
+    return NULL;
+  }
+  return kernels[k];
+}
+
+void
+markovCountGeneric(const int k, uint64_t *counts, const uint64_t *words, size_t pos, const size_t nbits, uint64_t *state)
+{
+  size_t end;
+  uint64_t w, index, current = *state;
+  const uint64_t mask = (((uint64_t) 1) << k) - 1;
+  while (pos < nbits) {
+    w = words[pos >> 6] >> (pos & 63);
+    end = (pos | 63) + 1;
+    if (end > nbits) {
+      end = nbits;
+    }
+    for (; pos < end; ++pos, w >>= 1) {
+      index = (current << 1) | (w & 1);
+      ++(counts[index]);
+      current = index & mask;
+    }
+  }
+  *state = current;
+}
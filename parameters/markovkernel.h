@@ -0,0 +1,146 @@
+#ifndef MARKOVKERNEL_H
+#define MARKOVKERNEL_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Highest order with a specialized counting kernel
+ */
+#define MARKOV_KERNEL_ORDER 24
+
+/**
+ * Highest order counted by bit-parallel pattern matching (see MarkovPopcountCounter)
+ */
+#define MARKOV_POPCOUNT_ORDER 4
+
+/**
+ * Counting kernel of a dense Markov chain.
+ * Count the transitions of the packets [pos, nbits[ in the table of 2^(k+1) counters
+ * (number of occurences of (state << 1) + input), the history being full (no warm-up).
+ * @param counts Counters
+ * @param words Packed bits, bit i of word j is the (64 * j + i)-th packet
+ * @param pos Position of the first packet to count
+ * @param nbits Number of packets in words
+ * @param state Current state, updated
+ */
+typedef void (*MarkovCountKernel)(uint64_t *counts, const uint64_t *words, size_t pos, const size_t nbits, uint64_t *state);
+
+/**
+ * Counting loop with the order known at compile time: the mask is a constant and the
+ * inner loop is unrolled by the compiler, no runtime shift is left.
+ */
+template <unsigned int K>
+class MarkovCounter {
+
+  public:
+    //! Mask of the state
+    static const uint64_t mask = (((uint64_t) 1) << K) - 1;
+
+    //! Kernel (see MarkovCountKernel)
+    static void count(uint64_t *counts, const uint64_t *words, size_t pos, const size_t nbits, uint64_t *state) {
+      size_t end;
+      uint64_t w, index, current = *state;
+      while (pos < nbits) {
+        w = words[pos >> 6] >> (pos & 63);
+        end = (pos | 63) + 1;
+        if (end > nbits) {
+          end = nbits;
+        }
+        for (; pos < end; ++pos, w >>= 1) {
+          index = (current << 1) | (w & 1);
+          ++(counts[index]);
+          current = index & mask;
+        }
+      }
+      *state = current;
+    }
+};
+
+/**
+ * Number of bits set in a word (portable, the builtin is a library call without a popcount instruction)
+ * @param x Word
+ * @return Number of bits set
+ */
+static inline uint64_t markovPopcount(uint64_t x)
+{
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (x * 0x0101010101010101ULL) >> 56;
+}
+
+/**
+ * Counting by bit-parallel pattern matching, for low orders.
+ * For each aligned word, the 2^(k+1) possible (state, input) patterns are matched against the 64
+ * positions at once (k + 1 shifted copies of the word ANDed together), and the matches are popcounted.
+ * This is independent of the run of the chain, hence faster than following the states for k <= MARKOV_POPCOUNT_ORDER.
+ */
+template <unsigned int K>
+class MarkovPopcountCounter {
+
+  public:
+    //! Kernel (see MarkovCountKernel)
+    static void count(uint64_t *counts, const uint64_t *words, size_t pos, const size_t nbits, uint64_t *state) {
+      uint64_t current = *state, previous = 0, w, shifted, match[2 << K];
+      size_t aligned = (pos + 63) & ~((size_t) 63);
+      unsigned int j, p, width;
+
+      /* Follow the states up to the first aligned word */
+      if (aligned > pos) {
+        MarkovCounter<K>::count(counts, words, pos, (aligned < nbits) ? aligned : nbits, &current);
+        pos = aligned;
+      }
+      if (pos + 64 <= nbits) {
+        /* Last packets before the word, the most recent one being the MSB */
+        for (j = 0; j < K; ++j) {
+          previous |= ((current >> j) & 1) << (63 - j);
+        }
+        for (; pos + 64 <= nbits; pos += 64) {
+          /* Bit i of match[p] is set if packet pos + i - j is the bit j of p, for all j <= K */
+          w = words[pos >> 6];
+          match[0] = ~w;
+          match[1] = w;
+          for (j = 1, width = 2; j <= K; ++j, width <<= 1) {
+            shifted = (w << j) | (previous >> (64 - j));
+            for (p = 0; p < width; ++p) {
+              match[p | width] = match[p] & shifted;
+              match[p] &= ~shifted;
+            }
+          }
+          for (p = 0; p < (2u << K); ++p) {
+            counts[p] += markovPopcount(match[p]);
+          }
+          previous = w;
+        }
+        current = 0;
+        for (j = 0; j < K; ++j) {
+          current |= ((previous >> (63 - j)) & 1) << j;
+        }
+      }
+      /* Follow the states for the last packets */
+      MarkovCounter<K>::count(counts, words, pos, nbits, &current);
+      *state = current;
+    }
+};
+
+/**
+ * Specialized kernel of an order
+ * @param k Order of the chain
+ * @return Kernel, NULL if k is 0 or above MARKOV_KERNEL_ORDER
+ */
+MarkovCountKernel markovCountKernel(const int k);
+
+/**
+ * Reference counting loop, with the order known at runtime
+ * @param k Order of the chain
+ * @param counts Counters
+ * @param words Packed bits
+ * @param pos Position of the first packet to count
+ * @param nbits Number of packets in words
+ * @param state Current state, updated
+ */
+void markovCountGeneric(const int k, uint64_t *counts, const uint64_t *words, size_t pos, const size_t nbits, uint64_t *state);
+
+#endif
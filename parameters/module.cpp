@@ -1,5 +1,104 @@
 #include "module.h"
+#include "markovchain.h"
+#include "basiconoff.h"
+#include "basicmta.h"
+#include "vlmc.h"
+#include "gilbert.h"
+#include "mta.h"
+
+#include <string.h>
 
 const char * const ParamModule::unknownOption = "An unknown option was passed to the Module";
 const char * const ParamModule::tooMuchOption = "Too much option where passed to the module";
 
+ParamModule*
+ParamModule::create(const char *name)
+{
+  if (strcmp(name, ParamMarckovChain::name()) == 0) {
+    return new ParamMarckovChain();
+  } else if (strcmp(name, ParamBasicOnOff::name()) == 0) {
+    return new ParamBasicOnOff();
+  } else if (strcmp(name, ParamBasicMTA::name()) == 0) {
+    return new ParamBasicMTA();
+  } else if (strcmp(name, ParamVLMC::name()) == 0) {
+    return new ParamVLMC();
+  } else if (strcmp(name, ParamGilbert::name()) == 0) {
+    return new ParamGilbert();
+  } else if (strcmp(name, ParamMTA::name()) == 0) {
+    return new ParamMTA();
+  }
+  return NULL;
+}
+
+int
+ParamModule::addBits(const uint64_t *words, const size_t nbits)
+{
+  size_t i;
+  int ret;
+  for (i = 0; i < nbits; ++i) {
+    ret = addChar(bitAt(words, i));
+    if (ret) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+ParamModule*
+ParamModule::fork(const uint64_t history, const unsigned int nbits)
+{
+  return NULL;
+}
+
+int
+ParamModule::join(ParamModule *part)
+{
+  return -1;
+}
+
+int
+ParamModule::saveCounts(std::ostream& out)
+{
+  return -1;
+}
+
+int
+ParamModule::loadCounts(std::istream& in)
+{
+  return -1;
+}
+
+int
+ParamModule::merge(const ParamModule *other)
+{
+  return -1;
+}
+
+int
+ParamModule::setHalfLife(const double half_life)
+{
+  return -1;
+}
+
+void
+ParamModule::decay(const uint64_t packets)
+{
+}
+
+uint64_t
+ParamModule::stateCount() const
+{
+  return 0;
+}
+
+int
+ParamModule::netemModel(const uint32_t max_rand, NetemModel& netem) const
+{
+  return -1;
+}
+
+int
+ParamModule::printPacked(const uint32_t max_rand)
+{
+  return -1;
+}
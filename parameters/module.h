@@ -3,6 +3,10 @@
 
 #define __STDC_FORMAT_MACROS
 #include <stdint.h>
+#include <stddef.h>
+#include <iostream>
+
+class NetemModel;
 
 /**
  * Common class for the parameter generation tool.
@@ -19,14 +23,63 @@ class ParamModule {
     //! Error message: Too much argument were passed
     static const char * const tooMuchOption;
 
+    /* Helpers for packed bits */
+    /**
+     * Get one packet out of a block of packed bits
+     * @param words Packed bits, bit i of word j is the (64 * j + i)-th packet
+     * @param pos Position of the packet
+     * @return True if the packet was received, False if it wasn't
+     */
+    static inline bool bitAt(const uint64_t *words, const size_t pos) {
+      return (words[pos >> 6] >> (pos & 63)) & 1;
+    }
+
+    /**
+     * Length of the run of identical packets starting at a given position
+     * @param words Packed bits, bit i of word j is the (64 * j + i)-th packet
+     * @param pos Position of the first packet of the run
+     * @param nbits Number of packets in words
+     * @return Number of consecutive packets equal to the one at pos (at least 1)
+     */
+    static inline size_t runLength(const uint64_t *words, const size_t pos, const size_t nbits) {
+      size_t i = pos >> 6, run;
+      const uint64_t flip = bitAt(words, pos) ? ~((uint64_t) 0) : 0;
+      uint64_t w = (words[i] ^ flip) >> (pos & 63);
+      if (w) {
+        run = (size_t) __builtin_ctzll(w);
+      } else {
+        run = 64 - (pos & 63);
+        for (++i; (i << 6) < nbits; ++i) {
+          w = words[i] ^ flip;
+          if (w) {
+            run += (size_t) __builtin_ctzll(w);
+            break;
+          }
+          run += 64;
+        }
+      }
+      if (pos + run > nbits) {
+        run = nbits - pos;
+      }
+      return run;
+    }
+
   public:
+    virtual ~ParamModule() {}
+
+    /**
+     * Create a module from its name (not initialized)
+     * @param name Name of the class of module
+     * @return A new module, NULL if the class is unknown
+     */
+    static ParamModule* create(const char *name);
 
     /**
      * Module initialisation.
      * Parses the arguments
      * @param argc Argument Count
      * @param argv Argument Vector
-     * @param human Generate output human-readable or not
+     * @param human Generate output human-readable or not (no output file is needed then, as for the netem models)
      * @param error String to be passed back in case of error
      * @return Ok: 0, anything else in case of error (error code)
      */
@@ -44,6 +97,86 @@ class ParamModule {
      */
     virtual int addChar(const bool in) = 0;
 
+    /**
+     * Add a block of input chars.
+     * The default implementation calls addChar for each packet.
+     * @param words Packed bits, bit i of word j is the (64 * j + i)-th packet (1 if received)
+     * @param nbits Number of packets in words
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int addBits(const uint64_t *words, const size_t nbits);
+
+    /**
+     * Create a module counting an independent part of the trace, to be run in parallel.
+     * The new module is configured as this one and is given the end of the previous part.
+     * The default implementation returns NULL: the module does not support parallel counting.
+     * @param history The last packets before the part (bit i is the i-th packet, the last one is the most recent)
+     * @param nbits Number of packets in history (0-64, less than 64 means that the part starts close to the beginning of the trace)
+     * @return A new module (to be joined), or NULL if not supported
+     */
+    virtual ParamModule* fork(const uint64_t history, const unsigned int nbits);
+
+    /**
+     * Add the counts of a module created by fork to this one.
+     * The parts need to be joined in the order of the trace; the result is identical to a sequential counting.
+     * The joined module is cleaned and deleted.
+     * @param part Module created by fork
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int join(ParamModule *part);
+
+    /**
+     * Save the raw counts (before finalization) as a count snapshot (see counts.h).
+     * The default implementation returns -1: the module does not support snapshots.
+     * @param out Output stream (binary)
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int saveCounts(std::ostream& out);
+
+    /**
+     * Replace the counts of the module by a count snapshot created by saveCounts.
+     * The module needs to be configured as the one that saved the snapshot.
+     * The default implementation returns -1: the module does not support snapshots.
+     * @param in Input stream (binary)
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int loadCounts(std::istream& in);
+
+    /**
+     * Add the counts of a module that counted an independent trace to this one.
+     * Unlike join, the traces are not consecutive: the current run of other is closed, not continued.
+     * other is left untouched.
+     * The default implementation returns -1: the module does not support merging.
+     * @param other Module of the same class, with the same configuration
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int merge(const ParamModule *other);
+
+    /**
+     * Switch to the online mode: the counts are forgotten exponentially, the weight of a packet being halved
+     * every half_life packets. The module keeps counting as usual, decay folds these counts into the decayed ones,
+     * and finalize then uses the decayed counts without changing them (it is called for each parameter snapshot).
+     * The default implementation returns -1: the module does not support the online mode.
+     * @param half_life Half-life, in packets
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int setHalfLife(const double half_life);
+
+    /**
+     * Online mode: age the decayed counts, then add the packets counted since the previous call.
+     * The default implementation does nothing.
+     * @param packets Number of packets added since the previous call
+     */
+    virtual void decay(const uint64_t packets);
+
+    /**
+     * Size of the counted representation, before finalization: number of visited states of a Markov chain,
+     * of distinct burst lengths of an on-off model...
+     * The default implementation returns 0: not meaningful for the module.
+     * @return Number of states
+     */
+    virtual uint64_t stateCount() const;
+
     /**
       * Is-there a 2nd round ?
       * (prepare the module to the potential 2nd round
@@ -57,11 +190,28 @@ class ParamModule {
      */
     virtual void finalize(const uint32_t max_rand) = 0;
 
+    /**
+     * Convert the finalized model to the loss models of netem (see netem.h).
+     * The default implementation returns -1: the module does not support it.
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @param netem Set to the netem models and their fit errors
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int netemModel(const uint32_t max_rand, NetemModel& netem) const;
+
     /**
      * Print a binary output
      */
     virtual void printBinary() = 0;
 
+    /**
+     * Print a binary output in the packed format (see paramfile.h), read directly by the loaders.
+     * The default implementation returns -1: the module does not support it.
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @return Ok: 0, anything else in case of error (error code)
+     */
+    virtual int printPacked(const uint32_t max_rand);
+
     /**
      * Print a human-readable output
      * @param max_rand CLICK_RAND_MAX used by click
@@ -0,0 +1,128 @@
+/** @file mta.cpp Implementation of the MTA parameter generation module */
+
+#include "mta.h"
+#include "paramwriter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <iomanip>
+#include <limits>
+
+void
+ParamMTA::finalize(const uint32_t max_rand)
+{
+  /* Split the trace and build the histograms */
+  ParamBasicMTA::finalize(max_rand);
+  /* Fit the distributions */
+  if (onoff->getRawErrorFreeBurstNumber() != 0) {
+    free_fit = BurstDistribution::fitBest(*onoff->getRawErrorFreeBurstLengthCDF(), free_all);
+  }
+  if (onoff->getRawErrorBurstNumber() != 0) {
+    error_fit = BurstDistribution::fitBest(*onoff->getRawErrorBurstLengthCDF(), error_all);
+  }
+}
+
+//! Try to write something to output and detect any error
+#define WRITE(x)                                             \
+  output << x << std::endl;                                  \
+  if (output.bad()) {                                        \
+    std::cerr << "error when writing to output" <<std::endl; \
+    exit (-1);;                                              \
+  }
+//"
+
+void
+ParamMTA::printBinaryToFile(const BurstDistribution& distribution, const char* dest)
+{
+  std::ofstream output;
+  unsigned int i;
+  const unsigned int count = BurstDistribution::parameterCount(distribution.family);
+  output.open(dest);
+  output << std::setprecision(std::numeric_limits<double>::digits10 + 2);
+  WRITE(distribution.family)
+  WRITE(count)
+  for (i = 0; i < count; ++i) {
+    WRITE(distribution.params[i])
+  }
+  output.close();
+}
+
+void
+ParamMTA::printBinary(void)
+{
+  printBinaryToFile(free_fit, free_filename);
+  printBinaryToFile(error_fit, error_filename);
+  markov->printBinary();
+}
+
+int
+ParamMTA::printPackedToFile(const BurstDistribution& distribution, const char* dest, const uint32_t max_rand)
+{
+  const unsigned int count = BurstDistribution::parameterCount(distribution.family);
+  ParamWriter writer(PARAMFILE_DISTRIBUTION, max_rand, count);
+  unsigned int i;
+  uint64_t bits;
+  writer.setMarkov(distribution.family, 0, 0);
+  for (i = 0; i < count; ++i) {
+    memcpy(&bits, &distribution.params[i], sizeof(bits));
+    writer.addU64(bits);
+  }
+  if (writer.write(dest)) {
+    std::cerr << "error when writing to output" << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+int
+ParamMTA::printPacked(const uint32_t max_rand)
+{
+  if (printPackedToFile(free_fit, free_filename, max_rand) || printPackedToFile(error_fit, error_filename, max_rand)
+      || markov->printPacked(max_rand)) {
+    return -1;
+  }
+  return 0;
+}
+
+void
+ParamMTA::printHumanToStream(const BurstDistribution& distribution, const BurstDistribution *all, std::ostream& streamout)
+{
+  unsigned int i, family;
+  if (distribution.family == 0) {
+    streamout << "No burst" << std::endl;
+    return;
+  }
+  for (family = 1; family <= BURSTFIT_FAMILIES; ++family) {
+    const BurstDistribution& d = all[family - 1];
+    streamout << ((family == distribution.family) ? "* " : "- ") << BurstDistribution::familyName(family) << "(";
+    for (i = 0; i < BurstDistribution::parameterCount(family); ++i) {
+      streamout << ((i == 0) ? "" : ", ") << d.params[i];
+    }
+    streamout << "): log-likelihood " << d.log_likelihood << ", AIC " << d.aic() << std::endl;
+  }
+}
+
+void
+ParamMTA::printHuman(const uint32_t max_rand)
+{
+  std::ofstream output;
+
+  if (free_filename == NULL ) {
+    std::cout << "Error-Free-Burst length distribution" << std::endl;
+    printHumanToStream(free_fit, free_all, std::cout);
+    std::cout << std::endl;
+  } else {
+    output.open(free_filename);
+    printHumanToStream(free_fit, free_all, output);
+    output.close();
+  }
+  if (error_filename == NULL ) {
+    std::cout << "Error-Burst length distribution" << std::endl;
+    printHumanToStream(error_fit, error_all, std::cout);
+    std::cout << std::endl;
+  } else {
+    output.open(error_filename);
+    printHumanToStream(error_fit, error_all, output);
+    output.close();
+  }
+  markov->printHuman(max_rand);
+}
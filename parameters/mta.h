@@ -0,0 +1,59 @@
+#ifndef MTA_H
+#define MTA_H
+
+#include "basicmta.h"
+#include "burstfit.h"
+
+/**
+ * Extract a MTA representation.
+ * The trace is split as for the Basic MTA representation, but instead of the CDFs of the
+ * error-free and error burst lengths, parametric distributions (geometric, Weibull, Pareto,
+ * lognormal or mixture of two geometric distributions) are fitted by maximum likelihood on them.
+ * The family with the lowest AIC is kept: a few parameters, sampled in O(1) (see BurstDistribution).
+ */
+class ParamMTA : public ParamBasicMTA {
+
+  private:
+    //! Distribution of the error-free burst lengths
+    BurstDistribution free_fit;
+    //! Distribution of the error burst lengths
+    BurstDistribution error_fit;
+    //! Fit of each family on the error-free burst lengths
+    BurstDistribution free_all[BURSTFIT_FAMILIES];
+    //! Fit of each family on the error burst lengths
+    BurstDistribution error_all[BURSTFIT_FAMILIES];
+
+    /**
+     * Print a distribution to a file, in 'binary' format: family, number of parameters, parameters
+     * @param distribution Distribution to be printed
+     * @param filename Name of the file in which we will print the output
+     */
+    static void printBinaryToFile(const BurstDistribution& distribution, const char* filename);
+    /**
+     * Print a distribution to a file, in the binary parameter format (see paramfile.h)
+     * @param distribution Distribution to be printed
+     * @param filename Name of the file in which we will print the output
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @return Ok: 0, -1 in case of error
+     */
+    static int printPackedToFile(const BurstDistribution& distribution, const char* filename, const uint32_t max_rand);
+    /**
+     * Print a distribution and the fit of each family, in human-readable format
+     * @param distribution Distribution kept
+     * @param all Fit of each family
+     * @param destination Destination in which we will print the output
+     */
+    static void printHumanToStream(const BurstDistribution& distribution, const BurstDistribution *all, std::ostream& destination);
+
+  public:
+    /* Methodes of ParamModule */
+    void finalize(const uint32_t);
+    void printBinary();
+    int printPacked(const uint32_t);
+    void printHuman(const uint32_t);
+
+    //! Name of this module
+    static const char* name() { return "mta"; }
+};
+
+#endif
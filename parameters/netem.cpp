@@ -0,0 +1,513 @@
+/** @file netem.cpp Implementation of the conversion to the netem loss models */
+
+#include "netem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+/**
+ * Probability of a run length under a mixture of isolated losses and of two geometric distributions:
+ * iso * [length = 1] + (1 - iso) * (v * Geom(g1) + (1 - v) * Geom(g2)), Geom(g) being (1 - g) * g^(length - 1)
+ */
+static double
+mixture(const uint64_t length, const double iso, const double v, const double g1, const double g2)
+{
+  const double l = (double) (length - 1);
+  return ((length == 1) ? iso : 0.) + (1. - iso) * (v * (1. - g1) * pow(g1, l) + (1. - v) * (1. - g2) * pow(g2, l));
+}
+
+/**
+ * Total variation distance between run lengths and a mixture (see mixture)
+ */
+static double
+distance(const RunLengths& runs, const double iso, const double v, const double g1, const double g2)
+{
+  RunLengths::const_iterator it;
+  double diff = 0, seen = 0, m;
+  for (it = runs.begin(); it != runs.end(); ++it) {
+    m = mixture(it->first, iso, v, g1, g2);
+    diff += fabs(it->second - m);
+    seen += m;
+  }
+  /* The model may give lengths absent from the runs */
+  return (diff + std::max(0., 1. - seen)) / 2.;
+}
+
+double
+NetemModel::mean(const RunLengths& runs)
+{
+  RunLengths::const_iterator it;
+  double m = 0;
+  for (it = runs.begin(); it != runs.end(); ++it) {
+    m += ((double) it->first) * it->second;
+  }
+  return m;
+}
+
+//! Parameter of the geometric distribution of a mean
+static double
+geometric(const double m)
+{
+  return (m > 1) ? 1. - 1. / m : 0.;
+}
+
+/**
+ * Fit a mixture of runs of 1 and of a geometric distribution w * [length = 1] + (1 - w) * Geom(q),
+ * with the same probability of runs of 1 and the same mean (w = 0 if there are too few runs of 1)
+ * @param runs Run lengths
+ * @param m Mean of the runs
+ * @param w Set to the weight of the runs of 1
+ * @param q Set to the parameter of the geometric distribution
+ */
+static void
+fitIsolated(const RunLengths& runs, const double m, double& w, double& q)
+{
+  const double p1 = (runs.front().first == 1) ? runs.front().second : 0.;
+  double a;
+  w = 0;
+  q = geometric(m);
+  if (!(m > 1)) {
+    w = 1;
+    q = 0;
+    return;
+  }
+  /* P(length > 1) = (1 - w) * q and mean - 1 = (1 - w) * q / (1 - q) */
+  a = (1 - p1) / (m - 1);
+  if (a < 1) {
+    w = 1 - (1 - p1) / (1 - a);
+    q = 1 - a;
+  }
+  if (w < 0) {
+    w = 0;
+    q = geometric(m);
+  }
+}
+
+/**
+ * Iterate EM on a mixture of two geometric distributions v * Geom(g1) + (1 - v) * Geom(g2), from the given parameters
+ * @param fixed Keep the weight v, only fit g1 and g2
+ */
+static void
+iterateMixture(const RunLengths& runs, const bool fixed, double& v, double& g1, double& g2)
+{
+  RunLengths::const_iterator it;
+  double resp, f1, f2, w, l1, l2, nv, ng1, ng2;
+  unsigned int iteration;
+
+  for (iteration = 0; iteration < NETEM_MAX_ITERATIONS; ++iteration) {
+    w = 0;
+    l1 = 0;
+    l2 = 0;
+    for (it = runs.begin(); it != runs.end(); ++it) {
+      f1 = v * mixture(it->first, 0, 1, g1, 0);
+      f2 = (1 - v) * mixture(it->first, 0, 0, 0, g2);
+      resp = (f1 + f2 > 0) ? f1 / (f1 + f2) : 0.5;
+      w += it->second * resp;
+      l1 += it->second * resp * (double) it->first;
+      l2 += it->second * (1 - resp) * (double) it->first;
+    }
+    if (!(w > 0) || !(w < 1)) {
+      /* A single component left */
+      break;
+    }
+    nv = fixed ? v : w;
+    ng1 = geometric(l1 / w);
+    ng2 = geometric(l2 / (1 - w));
+    if (fabs(nv - v) + fabs(ng1 - g1) + fabs(ng2 - g2) < NETEM_TOLERANCE) {
+      v = nv;
+      g1 = ng1;
+      g2 = ng2;
+      break;
+    }
+    v = nv;
+    g1 = ng1;
+    g2 = ng2;
+  }
+}
+
+/**
+ * Fit a mixture of two geometric distributions v * Geom(g1) + (1 - v) * Geom(g2), g1 >= g2, by maximum likelihood (EM)
+ * @return Total variation distance of the fit
+ */
+static double
+fitMixture(const RunLengths& runs, const double m, double& v, double& g1, double& g2)
+{
+  /* Start from a long and a short component around the mean */
+  v = 0.5;
+  g1 = geometric(2 * m);
+  g2 = geometric(m / 2);
+  iterateMixture(runs, false, v, g1, g2);
+  if (g1 < g2) {
+    std::swap(g1, g2);
+    v = 1 - v;
+  }
+  return distance(runs, 0, v, g1, g2);
+}
+
+/**
+ * Fit a mixture of two geometric distributions v * Geom(g1) + (1 - v) * Geom(g2) of a given weight v by maximum
+ * likelihood (EM), the first component being either the long or the short one
+ * @return Total variation distance of the fit
+ */
+static double
+fitWeighted(const RunLengths& runs, const double m, const double v, double& g1, double& g2)
+{
+  double weight = v, long_g1 = geometric(2 * m), long_g2 = geometric(m / 2), long_error;
+
+  iterateMixture(runs, true, weight, long_g1, long_g2);
+  long_error = distance(runs, 0, v, long_g1, long_g2);
+  g1 = geometric(m / 2);
+  g2 = geometric(2 * m);
+  iterateMixture(runs, true, weight, g1, g2);
+  if (long_error < distance(runs, 0, v, g1, g2)) {
+    g1 = long_g1;
+    g2 = long_g2;
+  }
+  return distance(runs, 0, v, g1, g2);
+}
+
+NetemModel::NetemModel()
+  : gemodel_error(0), state_error(0), loss_rate(0)
+{
+  std::fill(gemodel, gemodel + 4, 0.);
+  std::fill(state, state + 5, 0.);
+}
+
+void
+NetemModel::fit(const RunLengths& losses, const RunLengths& receptions)
+{
+  double ml, mr, ql, w, v, g1, g2, mix_v, mix_g1, mix_g2, mix_error, alpha, beta, x, y;
+
+  std::fill(gemodel, gemodel + 4, 0.);
+  std::fill(state, state + 5, 0.);
+  gemodel_error = 0;
+  state_error = 0;
+  if (losses.empty()) {
+    /* No loss: never leave the good state */
+    loss_rate = 0;
+    gemodel[1] = 1;
+    gemodel[2] = 1;
+    state[1] = 1;
+    return;
+  }
+  if (receptions.empty()) {
+    /* Everything is lost: never leave the bad state */
+    loss_rate = 1;
+    gemodel[0] = 1;
+    gemodel[2] = 1;
+    state[0] = 1;
+    return;
+  }
+  ml = mean(losses);
+  mr = mean(receptions);
+  loss_rate = ml / (ml + mr);
+
+  /* Gilbert: geometric runs of the same means */
+  gemodel[0] = 1. / mr;
+  gemodel[1] = 1. / ml;
+  gemodel[2] = 1;
+  gemodel[3] = 0;
+  gemodel_error = std::max(distance(losses, 0, 1, geometric(ml), 0), distance(receptions, 0, 1, geometric(mr), 0));
+
+  /* Lost runs: w * isolated + (1 - w) * Geom(ql) */
+  fitIsolated(losses, ml, w, ql);
+
+  /*
+   * Received runs: v * Geom(g1) (gaps, state 1) + (1 - v) * Geom(g2) (bursts, state 2).
+   * Candidates: a single geometric distribution, runs of 1 (g2 = 0) as for the lost runs, and the maximum
+   * likelihood mixture; a candidate replaces a simpler one only if it is closer to the runs.
+   * The isolated losses follow gaps only: v >= w. A mixture below this bound is refitted on it (v = w).
+   */
+  v = 1;
+  g1 = geometric(mr);
+  g2 = 0;
+  state_error = distance(receptions, 0, 1, g1, 0);
+  if (state_error > NETEM_EXACT) {
+    fitIsolated(receptions, mr, mix_v, mix_g1);
+    mix_v = 1 - mix_v;
+    mix_error = distance(receptions, 0, mix_v, mix_g1, 0);
+    if ((mix_error < state_error - NETEM_EXACT) && (mix_v >= w)) {
+      v = mix_v;
+      g1 = mix_g1;
+      state_error = mix_error;
+    }
+  }
+  if (state_error > NETEM_EXACT) {
+    mix_error = fitMixture(receptions, mr, mix_v, mix_g1, mix_g2);
+    if ((mix_v < w) && (1 - mix_v >= w)) {
+      /* The short runs may be the gaps as well */
+      mix_v = 1 - mix_v;
+      std::swap(mix_g1, mix_g2);
+    }
+    if (mix_v < w) {
+      mix_v = w;
+      mix_error = fitWeighted(receptions, mr, mix_v, mix_g1, mix_g2);
+    }
+    if (mix_error < state_error - NETEM_EXACT) {
+      v = mix_v;
+      g1 = mix_g1;
+      g2 = mix_g2;
+    }
+  }
+
+  /* Ways out of the states giving these mixtures in the stationary regime */
+  beta = (v > 0) ? std::min(1., w / v) : 0.;
+  alpha = (w < 1) ? std::min(1., std::max(0., (v - w) / (1 - w))) : 1.;
+  state[0] = (1 - beta) * (1 - g1);
+  state[1] = alpha * (1 - ql);
+  state[2] = (1 - alpha) * (1 - ql);
+  state[3] = (alpha < 1) ? 1 - g2 : 0.;
+  state[4] = beta * (1 - g1);
+
+  /* Mixtures actually given by the chain */
+  if (1 - beta + alpha * beta > 0) {
+    y = alpha / (1 - beta + alpha * beta);
+    x = y * beta;
+  } else {
+    y = v;
+    x = w;
+  }
+  state_error = std::max(distance(losses, x, 1, ql, 0), distance(receptions, 0, y, g1, g2));
+}
+
+/**
+ * Add the lengths of the runs of a Markov chain, from the distribution of the states where they start
+ * @param received Probability to receive a packet in each state
+ * @param start Probability of each state after the first packet of a run (modified)
+ * @param value Value of the packets of the run
+ * @param cut Probability to end the run before each packet, whatever the state
+ * @param runs Set to the probability of each length
+ */
+static void
+runsFrom(const std::vector<double>& received, std::vector<double>& start, const bool value, const double cut,
+         RunLengths& runs)
+{
+  const uint64_t mask = received.size() - 1;
+  const uint64_t saturated = value ? mask : 0;
+  std::vector<double> next(received.size());
+  uint64_t length, s, k;
+  double total = 0, end, stay, left;
+
+  runs.clear();
+  for (s = 0; s <= mask; ++s) {
+    total += start[s];
+  }
+  if (!(total > 0)) {
+    return;
+  }
+  for (s = 0; s <= mask; ++s) {
+    start[s] /= total;
+  }
+  /* After k packets, the history only holds the value of the run */
+  for (k = 0; (((uint64_t) 1) << k) <= mask; ++k) {}
+  left = 1;
+  for (length = 1; length <= k; ++length) {
+    std::fill(next.begin(), next.end(), 0.);
+    end = 0;
+    for (s = 0; s <= mask; ++s) {
+      if (start[s] > 0) {
+        stay = (value ? received[s] : 1 - received[s]) * (1 - cut);
+        end += start[s] * (1 - stay);
+        next[((s << 1) | value) & mask] += start[s] * stay;
+      }
+    }
+    if (end > 0) {
+      runs.push_back(std::make_pair(length, end));
+    }
+    left -= end;
+    start.swap(next);
+  }
+
+  /* Geometric tail from the saturated state */
+  stay = (value ? received[saturated] : 1 - received[saturated]) * (1 - cut);
+  left = std::max(0., left);
+  if (left < NETEM_MIN_MASS) {
+    if (left > 0) {
+      runs.push_back(std::make_pair(length, left));
+    }
+    return;
+  }
+  if (!(stay < 1)) {
+    /* The run never ends */
+    runs.push_back(std::make_pair(NETEM_MAX_RUN, left));
+    return;
+  }
+  for (; (left >= NETEM_MIN_MASS) && (length < NETEM_MAX_RUN); ++length) {
+    end = left * (1 - stay);
+    runs.push_back(std::make_pair(length, end));
+    left -= end;
+  }
+  if (left > 0) {
+    runs.push_back(std::make_pair(length, left));
+  }
+}
+
+/**
+ * Add the lengths of the runs of a hidden Markov model, from the distribution of the states of the first packet
+ * @param transition Transition probabilities (from, to)
+ * @param success Probability of success in each state
+ * @param start Probability of each state on the first packet of a run (modified)
+ * @param value Value of the packets of the run
+ * @param runs Set to the probability of each length
+ */
+static void
+hmmRunsFrom(const std::vector<std::vector<double> >& transition, const std::vector<double>& success,
+            std::vector<double>& start, const bool value, RunLengths& runs)
+{
+  const size_t n = success.size();
+  std::vector<double> next(n);
+  uint64_t length;
+  double total = 0, end, left = 1, same;
+  size_t i, j;
+
+  runs.clear();
+  for (i = 0; i < n; ++i) {
+    total += start[i];
+  }
+  if (!(total > 0)) {
+    return;
+  }
+  for (i = 0; i < n; ++i) {
+    start[i] /= total;
+  }
+  for (length = 1; (left >= NETEM_MIN_MASS) && (length < NETEM_MAX_RUN); ++length) {
+    std::fill(next.begin(), next.end(), 0.);
+    end = 0;
+    for (i = 0; i < n; ++i) {
+      for (j = 0; j < n; ++j) {
+        same = value ? success[j] : 1 - success[j];
+        next[j] += start[i] * transition[i][j] * same;
+        end += start[i] * transition[i][j] * (1 - same);
+      }
+    }
+    if (end > 0) {
+      runs.push_back(std::make_pair(length, end));
+    }
+    left -= end;
+    start.swap(next);
+  }
+  if (left > 0) {
+    runs.push_back(std::make_pair(length, left));
+  }
+}
+
+void
+NetemModel::hmmRuns(const std::vector<std::vector<double> >& transition, const std::vector<double>& success,
+                    RunLengths& losses, RunLengths& receptions)
+{
+  const size_t n = success.size();
+  std::vector<std::vector<double> > power(n, std::vector<double>(n, 0.)), square(power);
+  std::vector<double> stationary(n, 0.), start(n, 0.);
+  unsigned int step;
+  double total;
+  size_t i, j, l;
+
+  /* Stationary distribution: (I + transition)^(2^NETEM_SQUARINGS) / 2^NETEM_SQUARINGS, from a uniform start */
+  for (i = 0; i < n; ++i) {
+    for (j = 0; j < n; ++j) {
+      power[i][j] = (transition[i][j] + ((i == j) ? 1. : 0.)) / 2;
+    }
+  }
+  for (step = 0; step < NETEM_SQUARINGS; ++step) {
+    for (i = 0; i < n; ++i) {
+      total = 0;
+      for (j = 0; j < n; ++j) {
+        square[i][j] = 0;
+        for (l = 0; l < n; ++l) {
+          square[i][j] += power[i][l] * power[l][j];
+        }
+        total += square[i][j];
+      }
+      /* The rounding errors would grow exponentially */
+      for (j = 0; j < n; ++j) {
+        square[i][j] /= total;
+      }
+    }
+    power.swap(square);
+  }
+  for (i = 0; i < n; ++i) {
+    for (j = 0; j < n; ++j) {
+      stationary[j] += power[i][j] / (double) n;
+    }
+  }
+
+  /* Lost runs start after a reception, and received runs after a loss */
+  for (i = 0; i < n; ++i) {
+    for (j = 0; j < n; ++j) {
+      start[j] += stationary[i] * success[i] * transition[i][j] * (1 - success[j]);
+    }
+  }
+  hmmRunsFrom(transition, success, start, false, losses);
+  std::fill(start.begin(), start.end(), 0.);
+  for (i = 0; i < n; ++i) {
+    for (j = 0; j < n; ++j) {
+      start[j] += stationary[i] * (1 - success[i]) * transition[i][j] * success[j];
+    }
+  }
+  hmmRunsFrom(transition, success, start, true, receptions);
+}
+
+void
+NetemModel::setGemodel(const double p, const double r, const double h, const double k)
+{
+  gemodel[0] = p;
+  gemodel[1] = r;
+  gemodel[2] = 1 - h;
+  gemodel[3] = 1 - k;
+  gemodel_error = 0;
+}
+
+void
+NetemModel::setState(const double params[5])
+{
+  std::copy(params, params + 5, state);
+  state_error = 0;
+}
+
+void
+NetemModel::chainRuns(const std::vector<double>& received, const std::vector<double>& occupancy, const double cut,
+                      RunLengths& losses, RunLengths& receptions)
+{
+  const uint64_t mask = received.size() - 1;
+  std::vector<double> start(received.size(), 0.);
+  uint64_t s;
+
+  /* Lost runs start after a reception or a cut, and received runs after a loss */
+  for (s = 0; s <= mask; ++s) {
+    start[(s << 1) & mask] += occupancy[s] * (1 - received[s]) * ((s & 1) ? 1 : cut);
+  }
+  runsFrom(received, start, false, cut, losses);
+  std::fill(start.begin(), start.end(), 0.);
+  for (s = 0; s <= mask; ++s) {
+    if (!(s & 1)) {
+      start[((s << 1) | 1) & mask] += occupancy[s] * received[s];
+    }
+  }
+  runsFrom(received, start, true, 0, receptions);
+}
+
+void
+NetemModel::print(std::ostream& output) const
+{
+  std::ios_base::fmtflags flags = output.flags();
+  std::streamsize precision = output.precision(6);
+  output << std::fixed << "loss gemodel " << gemodel[0] * 100 << "% " << gemodel[1] * 100 << "% "
+         << gemodel[2] * 100 << "% " << gemodel[3] * 100 << "%" << std::endl;
+  output << "loss state " << state[0] * 100 << "% " << state[1] * 100 << "% " << state[2] * 100 << "% "
+         << state[3] * 100 << "% " << state[4] * 100 << "%" << std::endl;
+  output.precision(precision);
+  output.flags(flags);
+}
+
+void
+NetemModel::printHuman(std::ostream& output) const
+{
+  output << "Loss rate: " << loss_rate * 100 << "%" << std::endl;
+  output << "Gilbert-Elliott (loss gemodel): p " << gemodel[0] * 100 << "%, r " << gemodel[1] * 100
+         << "%, 1-h " << gemodel[2] * 100 << "%, 1-k " << gemodel[3] * 100 << "%" << std::endl;
+  output << "- fit error: " << gemodel_error << ((gemodel_error < NETEM_EXACT) ? " (exact)" : "") << std::endl;
+  output << "4-state (loss state): p13 " << state[0] * 100 << "%, p31 " << state[1] * 100 << "%, p32 "
+         << state[2] * 100 << "%, p23 " << state[3] * 100 << "%, p14 " << state[4] * 100 << "%" << std::endl;
+  output << "- fit error: " << state_error << ((state_error < NETEM_EXACT) ? " (exact)" : "") << std::endl;
+}
@@ -0,0 +1,114 @@
+#ifndef NETEM_H
+#define NETEM_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+
+//! Maximal number of iterations of the fit of the received runs (EM)
+#define NETEM_MAX_ITERATIONS 10000
+//! Convergence threshold of the EM iterations
+#define NETEM_TOLERANCE 1e-13
+//! Run lengths whose probability falls below this are not listed
+#define NETEM_MIN_MASS 1e-12
+//! Longest run listed, the remaining probability is put on this length
+#define NETEM_MAX_RUN (((uint64_t) 1) << 20)
+//! Fit error below which a conversion is reported as exact
+#define NETEM_EXACT 1e-6
+//! Number of squarings of the transition matrix of a hidden Markov model giving its stationary distribution
+#define NETEM_SQUARINGS 64
+
+//! Probability of each length of the runs of lost (or received) packets: (length, probability), by increasing length
+typedef std::vector<std::pair<uint64_t, double> > RunLengths;
+
+/**
+ * Loss models of the Linux netem queueing discipline, fitted on the runs of lost and received packets of a model:
+ *  - loss gemodel p r 1-h 1-k: Gilbert-Elliott, only its simple Gilbert form is used (1-h = 100%, 1-k = 0%:
+ *    the packets are lost in the bad state and only there), p = 1 / mean received run, r = 1 / mean lost run
+ *  - loss state p13 p31 p32 p23 p14: 4-state Markov chain, state 1 received packets of the gaps, 4 isolated losses,
+ *    3 lost and 2 received packets of the bursts. The lost runs are fitted by a mixture of isolated losses and of a
+ *    geometric distribution (same probability of length 1 and same mean), the received runs by a mixture of two
+ *    geometric distributions (gaps and bursts, maximum likelihood), and the weights of the mixtures give the way out
+ *    of the states. The isolated losses are followed by gaps only, so the weight of the gaps is at least the one of
+ *    the isolated losses: a mixture below this bound is refitted on it.
+ * Both match the loss rate and the mean lengths of the runs. They are exact for a first order Markov chain only:
+ * the runs of higher orders are approximated, with the error reported.
+ * The fit error is the total variation distance between the distributions of the run lengths of the source
+ * and the ones of the netem model (the largest of the lost and received runs). Only these distributions are
+ * compared: netem may chain the runs differently (after a gap, an isolated loss is more likely than in the source).
+ */
+class NetemModel {
+
+  public:
+    //! gemodel: p, r, 1-h, 1-k (probabilities)
+    double gemodel[4];
+    //! 4-state model: p13, p31, p32, p23, p14 (probabilities)
+    double state[5];
+    //! Fit error of gemodel
+    double gemodel_error;
+    //! Fit error of the 4-state model
+    double state_error;
+    //! Loss rate of the source
+    double loss_rate;
+
+    NetemModel();
+
+    /**
+     * Fit the models
+     * @param losses Probability of each length of the runs of lost packets, by increasing length
+     * @param receptions Same for the runs of received packets
+     */
+    void fit(const RunLengths& losses, const RunLengths& receptions);
+
+    /**
+     * Use the exact parameters of a Gilbert-Elliott model as gemodel (the 4-state model is left as fitted)
+     * @param p Good to bad
+     * @param r Bad to good
+     * @param h Probability of success in the bad state
+     * @param k Probability of success in the good state
+     */
+    void setGemodel(const double p, const double r, const double h, const double k);
+
+    /**
+     * Use exact parameters as 4-state model (gemodel is left as fitted)
+     * @param params p13, p31, p32, p23, p14
+     */
+    void setState(const double params[5]);
+
+    /**
+     * Run lengths of a hidden Markov model, in its stationary regime
+     * @param transition Transition probabilities (from, to)
+     * @param success Probability of success in each state
+     * @param losses Set to the probability of each length of the runs of lost packets
+     * @param receptions Same for the runs of received packets
+     */
+    static void hmmRuns(const std::vector<std::vector<double> >& transition, const std::vector<double>& success,
+                        RunLengths& losses, RunLengths& receptions);
+
+    /**
+     * Run lengths of a Markov chain
+     * @param received Probability to receive a packet in each state (2^k states, bit 0 is the last packet, 1 if received)
+     * @param occupancy Frequency of each state (number of visits in the trace)
+     * @param cut Probability that two consecutive lost packets of the chain belong to different runs
+     *        (the chain describes periods of losses separated by error-free periods it does not see), 0 for a plain chain
+     * @param losses Set to the probability of each length of the runs of lost packets
+     * @param receptions Same for the runs of received packets
+     */
+    static void chainRuns(const std::vector<double>& received, const std::vector<double>& occupancy, const double cut,
+                          RunLengths& losses, RunLengths& receptions);
+
+    //! Mean of run lengths
+    static double mean(const RunLengths& runs);
+
+    /**
+     * Print the parameters of tc, one model per line ("loss gemodel ..." and "loss state ...")
+     * @param output Destination
+     */
+    void print(std::ostream& output) const;
+
+    //! Print the models and their fit errors in a human readable way
+    void printHuman(std::ostream& output) const;
+};
+
+#endif
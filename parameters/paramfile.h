@@ -0,0 +1,198 @@
+#ifndef PARAMFILE_H
+#define PARAMFILE_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/** @file paramfile.h Binary parameter file format, shared by parseInput and the loaders.
+ * The file is a fixed header followed by a payload, all the integers are little-endian.\n
+ * Header (PARAMFILE_HEADER_SIZE bytes):
+ *  - 0: magic "PMPB"
+ *  - 4: uint32 version (PARAMFILE_VERSION)
+ *  - 8: uint32 type of payload (PARAMFILE_MARKOV, PARAMFILE_MARKOV_SPARSE, PARAMFILE_CDF, PARAMFILE_VLMC, PARAMFILE_GILBERT or PARAMFILE_DISTRIBUTION)
+ *  - 12: uint32 max_rand used to scale the probabilities
+ *  - 16: uint32 order of the Markov chain (depth of a context tree, number of states of a Gilbert-Elliott model, family of a distribution, 0 for a cdf)
+ *  - 20: uint32 probability of the states not listed (sparse Markov chain, 0 otherwise)
+ *  - 24: uint64 number of entries of the payload
+ *  - 32: uint64 initial state (Markov chain, 0 otherwise)
+ *  - 40: uint64 FNV-1a hash of the payload
+ *
+ * Payload, depending on the type:
+ *  - PARAMFILE_MARKOV: count uint32, probability of success in each state (count = 2^order)
+ *  - PARAMFILE_MARKOV_SPARSE: count uint64 listed states (sorted), then count uint32 probabilities of success
+ *  - PARAMFILE_CDF: count (uint32 length, uint32 cumulated probability) pairs, sorted by length
+ *  - PARAMFILE_VLMC: count (uint32 child 0, uint32 child 1, uint32 probability of success) nodes of a context tree, the root first
+ *  - PARAMFILE_GILBERT: count uint32 probabilities, p, r, h, k (2 states) or p13, p31, p32, p23, p14 (4 states)
+ *  - PARAMFILE_DISTRIBUTION: count IEEE-754 doubles (as uint64), parameters of a burst length distribution
+ *
+ * A text file can never start with the magic, loaders use it to accept both formats.
+ */
+
+//! Magic number of the binary parameter files
+#define PARAMFILE_MAGIC "PMPB"
+//! Version of the binary parameter format
+#define PARAMFILE_VERSION 1
+//! Size of the header
+#define PARAMFILE_HEADER_SIZE 48
+
+//! Payload: dense Markov chain
+#define PARAMFILE_MARKOV 1
+//! Payload: sparse Markov chain
+#define PARAMFILE_MARKOV_SPARSE 2
+//! Payload: cumulative distribution function of burst lengths
+#define PARAMFILE_CDF 3
+//! Payload: context tree of a variable-order Markov chain
+#define PARAMFILE_VLMC 4
+//! Payload: parameters of a Gilbert-Elliott model
+#define PARAMFILE_GILBERT 5
+//! Payload: parametric distribution of burst lengths
+#define PARAMFILE_DISTRIBUTION 6
+
+//! Decoded header of a binary parameter file
+struct paramfile_header {
+  uint32_t version;               //!< Version of the format
+  uint32_t type;                  //!< Type of payload
+  uint32_t max_rand;              //!< max_rand used to scale the probabilities
+  uint32_t order;                 //!< Order of the Markov chain
+  uint32_t default_probability;   //!< Probability of the states not listed
+  uint64_t count;                 //!< Number of entries of the payload
+  uint64_t initial_state;         //!< Initial state of the Markov chain
+  uint64_t checksum;              //!< FNV-1a hash of the payload
+};
+
+//! Read a little-endian 32-bit integer
+static inline uint32_t paramfile_get_u32(const unsigned char *p)
+{
+  return ((uint32_t) p[0]) | (((uint32_t) p[1]) << 8) | (((uint32_t) p[2]) << 16) | (((uint32_t) p[3]) << 24);
+}
+
+//! Read a little-endian 64-bit integer
+static inline uint64_t paramfile_get_u64(const unsigned char *p)
+{
+  return ((uint64_t) paramfile_get_u32(p)) | (((uint64_t) paramfile_get_u32(p + 4)) << 32);
+}
+
+//! Write a little-endian 32-bit integer
+static inline void paramfile_put_u32(unsigned char *p, const uint32_t value)
+{
+  p[0] = (unsigned char) (value & 0xFF);
+  p[1] = (unsigned char) ((value >> 8) & 0xFF);
+  p[2] = (unsigned char) ((value >> 16) & 0xFF);
+  p[3] = (unsigned char) ((value >> 24) & 0xFF);
+}
+
+//! Write a little-endian 64-bit integer
+static inline void paramfile_put_u64(unsigned char *p, const uint64_t value)
+{
+  paramfile_put_u32(p, (uint32_t) (value & 0xFFFFFFFF));
+  paramfile_put_u32(p + 4, (uint32_t) (value >> 32));
+}
+
+//! Is the host little-endian ? (the payload can then be used in place)
+static inline int paramfile_host_le(void)
+{
+  const uint16_t one = 1;
+  return *((const unsigned char *) &one) == 1;
+}
+
+//! Continue a FNV-1a hash (start with 0xcbf29ce484222325)
+static inline uint64_t paramfile_fnv1a(uint64_t hash, const unsigned char *data, size_t size)
+{
+  while (size != 0) {
+    --size;
+    hash ^= *(data++);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+//! Size of the payload described by a header, ~0 if the type is unknown or the size overflows
+static inline uint64_t paramfile_payload_size(const struct paramfile_header *h)
+{
+  uint64_t record;
+  switch (h->type) {
+    case PARAMFILE_MARKOV:
+    case PARAMFILE_GILBERT:
+      record = 4;
+      break;
+    case PARAMFILE_MARKOV_SPARSE:
+      record = 12;
+      break;
+    case PARAMFILE_CDF:
+    case PARAMFILE_DISTRIBUTION:
+      record = 8;
+      break;
+    case PARAMFILE_VLMC:
+      record = 12;
+      break;
+    default:
+      return ~((uint64_t) 0);
+  }
+  if (h->count >= (~((uint64_t) 0)) / record) {
+    return ~((uint64_t) 0);
+  }
+  return h->count * record;
+}
+
+/**
+ * Decode the header of a binary parameter file
+ * @param head First PARAMFILE_HEADER_SIZE bytes of the file
+ * @param h Set to the decoded header
+ * @return Ok: 0, -1 if it isn't a binary parameter file (text), -2 if the version is unknown, -3 if the type is unknown
+ */
+static inline int paramfile_decode_header(const unsigned char *head, struct paramfile_header *h)
+{
+  if (memcmp(head, PARAMFILE_MAGIC, 4) != 0) {
+    return -1;
+  }
+  h->version = paramfile_get_u32(head + 4);
+  if (h->version != PARAMFILE_VERSION) {
+    return -2;
+  }
+  h->type = paramfile_get_u32(head + 8);
+  h->max_rand = paramfile_get_u32(head + 12);
+  h->order = paramfile_get_u32(head + 16);
+  h->default_probability = paramfile_get_u32(head + 20);
+  h->count = paramfile_get_u64(head + 24);
+  h->initial_state = paramfile_get_u64(head + 32);
+  h->checksum = paramfile_get_u64(head + 40);
+  if (paramfile_payload_size(h) == ~((uint64_t) 0)) {
+    return -3;
+  }
+  return 0;
+}
+
+/**
+ * Decode and check the header and the payload of a binary parameter file
+ * @param data Content of the file
+ * @param size Size of the file
+ * @param h Set to the decoded header
+ * @return Ok: 0, -1 if it isn't a binary parameter file (text), -2 if the version is unknown, -3 if the file is truncated or the type unknown, -4 if the checksum is wrong
+ */
+static inline int paramfile_read_header(const unsigned char *data, const size_t size, struct paramfile_header *h)
+{
+  uint64_t payload;
+  int ret;
+  if ((size < 4) || (memcmp(data, PARAMFILE_MAGIC, 4) != 0)) {
+    return -1;
+  }
+  if (size < PARAMFILE_HEADER_SIZE) {
+    return -3;
+  }
+  ret = paramfile_decode_header(data, h);
+  if (ret) {
+    return ret;
+  }
+  payload = paramfile_payload_size(h);
+  if (payload != size - PARAMFILE_HEADER_SIZE) {
+    return -3;
+  }
+  if (paramfile_fnv1a(0xcbf29ce484222325ULL, data + PARAMFILE_HEADER_SIZE, (size_t) payload) != h->checksum) {
+    return -4;
+  }
+  return 0;
+}
+
+#endif
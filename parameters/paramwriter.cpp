@@ -0,0 +1,134 @@
+/** @file paramwriter.cpp Implementation of the binary parameter file writer */
+
+#include "paramwriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <fstream>
+
+std::string
+paramfile_output(const char *filename)
+{
+  struct stat st;
+  std::string name(filename);
+  if (lstat(filename, &st) == 0) {
+    if (S_ISLNK(st.st_mode)) {
+      char *target = realpath(filename, NULL);
+      if (target == NULL) {
+        /* Dangling link: opening it creates the target */
+        return name;
+      }
+      name = target;
+      free(target);
+      if (stat(name.c_str(), &st)) {
+        return std::string(filename);
+      }
+    }
+    if (!S_ISREG(st.st_mode)) {
+      return std::string(filename);
+    }
+  }
+  name += PARAMFILE_TEMPORARY_SUFFIX;
+  int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    return std::string(filename);
+  }
+  close(fd);
+  return name;
+}
+
+int
+paramfile_replace(const char *filename, const std::string &output)
+{
+  if (output == filename) {
+    return 0;
+  }
+  std::string target(output, 0, output.size() - (sizeof(PARAMFILE_TEMPORARY_SUFFIX) - 1));
+  return rename(output.c_str(), target.c_str()) ? -1 : 0;
+}
+
+ParamWriter::ParamWriter(const uint32_t type, const uint32_t max_rand, const uint64_t count)
+{
+  header.version = PARAMFILE_VERSION;
+  header.type = type;
+  header.max_rand = max_rand;
+  header.order = 0;
+  header.default_probability = 0;
+  header.count = count;
+  header.initial_state = 0;
+  header.checksum = 0;
+  payload.reserve((size_t) paramfile_payload_size(&header));
+}
+
+void
+ParamWriter::setMarkov(const uint32_t order, const uint64_t initial_state, const uint32_t default_probability)
+{
+  header.order = order;
+  header.initial_state = initial_state;
+  header.default_probability = default_probability;
+}
+
+void
+ParamWriter::addU32(const uint32_t value)
+{
+  const size_t pos = payload.size();
+  payload.resize(pos + 4);
+  paramfile_put_u32(&payload[pos], value);
+}
+
+void
+ParamWriter::addU64(const uint64_t value)
+{
+  const size_t pos = payload.size();
+  payload.resize(pos + 8);
+  paramfile_put_u64(&payload[pos], value);
+}
+
+int
+ParamWriter::write(const char *filename)
+{
+  unsigned char head[PARAMFILE_HEADER_SIZE];
+  std::ostream *output;
+  std::ofstream output_f;
+  if (payload.size() != paramfile_payload_size(&header)) {
+    return -1;
+  }
+  header.checksum = paramfile_fnv1a(0xcbf29ce484222325ULL, payload.empty() ? NULL : &payload[0], payload.size());
+  memcpy(head, PARAMFILE_MAGIC, 4);
+  paramfile_put_u32(head + 4, header.version);
+  paramfile_put_u32(head + 8, header.type);
+  paramfile_put_u32(head + 12, header.max_rand);
+  paramfile_put_u32(head + 16, header.order);
+  paramfile_put_u32(head + 20, header.default_probability);
+  paramfile_put_u64(head + 24, header.count);
+  paramfile_put_u64(head + 32, header.initial_state);
+  paramfile_put_u64(head + 40, header.checksum);
+  std::string name;
+  if (filename == NULL) {
+    output = &std::cout;
+  } else {
+    name = paramfile_output(filename);
+    output_f.open(name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!output_f.is_open()) {
+      return -1;
+    }
+    output = &output_f;
+  }
+  output->write((const char *) head, PARAMFILE_HEADER_SIZE);
+  if (!payload.empty()) {
+    output->write((const char *) &payload[0], (std::streamsize) payload.size());
+  }
+  output->flush();
+  if (!output->good()) {
+    return -1;
+  }
+  if (filename != NULL) {
+    output_f.close();
+    return paramfile_replace(filename, name);
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef PARAMWRITER_H
+#define PARAMWRITER_H
+
+#include "paramfile.h"
+#include <string>
+#include <vector>
+
+//! Suffix of the temporary file a parameter file is written to before being renamed
+#define PARAMFILE_TEMPORARY_SUFFIX ".tmp"
+
+/**
+ * Writer of a binary parameter file (see paramfile.h).
+ * The payload is built in memory, then written after the header, which contains its checksum.
+ */
+class ParamWriter {
+
+  private:
+    //! Header
+    struct paramfile_header header;
+    //! Payload
+    std::vector<unsigned char> payload;
+
+  public:
+    /**
+     * Constructor
+     * @param type Type of payload
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @param count Number of entries of the payload
+     */
+    ParamWriter(const uint32_t type, const uint32_t max_rand, const uint64_t count);
+
+    /**
+     * Set the Markov chain fields of the header
+     * @param order Order of the chain
+     * @param initial_state Initial state
+     * @param default_probability Probability of the states not listed (sparse chain)
+     */
+    void setMarkov(const uint32_t order, const uint64_t initial_state, const uint32_t default_probability);
+
+    //! Append a 32-bit integer to the payload
+    void addU32(const uint32_t value);
+    //! Append a 64-bit integer to the payload
+    void addU64(const uint64_t value);
+
+    /**
+     * Write the file (atomically when possible, see paramfile_output)
+     * @param filename Name of the file, NULL for the standard output
+     * @return Ok: 0, -1 in case of error
+     */
+    int write(const char *filename);
+};
+
+/**
+ * Name to write a parameter file to before paramfile_replace: a temporary file next to the file, symbolic links resolved,
+ * so that the link is kept and its target replaced.
+ * Non-regular files (e.g. /dev/stdout, a fifo) and files whose directory does not accept the temporary file are written in place.
+ * @param filename Name of the parameter file
+ * @return Name of the temporary file (followed by PARAMFILE_TEMPORARY_SUFFIX), or filename to write in place
+ */
+std::string paramfile_output(const char *filename);
+
+/**
+ * Replace a parameter file by the temporary file it was written to (see paramfile_output), nothing when written in place.
+ * The rename is atomic: a loader reading the file while it is rewritten (online mode) sees the old or the new one, never a partial file.
+ * @param filename Name of the parameter file
+ * @param output Name returned by paramfile_output
+ * @return Ok: 0, -1 in case of error
+ */
+int paramfile_replace(const char *filename, const std::string &output);
+
+#endif
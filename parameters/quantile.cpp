@@ -0,0 +1,111 @@
+/** @file quantile.cpp Implementation of the streaming quantile estimation */
+
+#include "quantile.h"
+
+#include <algorithm>
+
+void
+StreamingQuantile::init(const double quantile)
+{
+  p = quantile;
+  count = 0;
+  desired[0] = 0;
+  desired[1] = 2 * p;
+  desired[2] = 4 * p;
+  desired[3] = 2 + 2 * p;
+  desired[4] = 4;
+  increment[0] = 0;
+  increment[1] = p / 2;
+  increment[2] = p;
+  increment[3] = (1 + p) / 2;
+  increment[4] = 1;
+}
+
+double
+StreamingQuantile::parabolic(const unsigned int i, const double d) const
+{
+  return height[i] + d / (position[i + 1] - position[i - 1])
+    * ((position[i] - position[i - 1] + d) * (height[i + 1] - height[i]) / (position[i + 1] - position[i])
+       + (position[i + 1] - position[i] - d) * (height[i] - height[i - 1]) / (position[i] - position[i - 1]));
+}
+
+double
+StreamingQuantile::linear(const unsigned int i, const int d) const
+{
+  const unsigned int j = (d > 0) ? i + 1 : i - 1;
+  return height[i] + d * (height[j] - height[i]) / (position[j] - position[i]);
+}
+
+void
+StreamingQuantile::add(const double x)
+{
+  unsigned int i, k;
+  double d, h;
+
+  /* The first observations are kept sorted */
+  if (count < 5) {
+    height[count] = x;
+    ++count;
+    if (count == 5) {
+      std::sort(height, height + 5);
+      for (i = 0; i < 5; ++i) {
+        position[i] = i;
+      }
+    }
+    return;
+  }
+  ++count;
+
+  /* Cell of the observation, the extreme markers follow the minimum and the maximum */
+  if (x < height[0]) {
+    height[0] = x;
+    k = 0;
+  } else if (x >= height[4]) {
+    height[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while (x >= height[k + 1]) {
+      ++k;
+    }
+  }
+  for (i = k + 1; i < 5; ++i) {
+    position[i] += 1;
+  }
+  for (i = 0; i < 5; ++i) {
+    desired[i] += increment[i];
+  }
+
+  /* Move the middle markers toward their desired positions */
+  for (i = 1; i < 4; ++i) {
+    d = desired[i] - position[i];
+    if (((d >= 1) && (position[i + 1] - position[i] > 1)) || ((d <= -1) && (position[i - 1] - position[i] < -1))) {
+      const int step = (d > 0) ? 1 : -1;
+      h = parabolic(i, step);
+      if ((height[i - 1] < h) && (h < height[i + 1])) {
+        height[i] = h;
+      } else {
+        height[i] = linear(i, step);
+      }
+      position[i] += step;
+    }
+  }
+}
+
+double
+StreamingQuantile::value() const
+{
+  double sorted[5];
+  size_t n;
+  if (count == 0) {
+    return 0;
+  }
+  if (count >= 5) {
+    return height[2];
+  }
+  /* Exact quantile of the few observations */
+  n = (size_t) count;
+  std::copy(height, height + n, sorted);
+  std::sort(sorted, sorted + n);
+  return sorted[(size_t) (p * (double) (n - 1) + 0.5)];
+}
@@ -0,0 +1,56 @@
+#ifndef QUANTILE_H
+#define QUANTILE_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+
+/**
+ * Streaming estimation of a quantile with the P-square algorithm (Jain and Chlamtac).
+ * Only 5 markers are kept, whatever the number of observations: the estimation is exact
+ * for the first 5 observations, then the markers are moved toward their desired positions
+ * with a piecewise-parabolic interpolation.
+ */
+class StreamingQuantile {
+
+  private:
+    //! Quantile estimated (in ]0,1[)
+    double p;
+    //! Number of observations
+    uint64_t count;
+    //! Heights of the markers
+    double height[5];
+    //! Positions of the markers
+    double position[5];
+    //! Desired positions of the markers
+    double desired[5];
+    //! Increments of the desired positions
+    double increment[5];
+
+    //! Parabolic prediction of the height of marker i moved by d
+    double parabolic(const unsigned int i, const double d) const;
+    //! Linear prediction of the height of marker i moved by d
+    double linear(const unsigned int i, const int d) const;
+
+  public:
+    StreamingQuantile() : p(0.5), count(0) {}
+
+    /**
+     * Forget the observations
+     * @param quantile Quantile to estimate (in ]0,1[)
+     */
+    void init(const double quantile);
+
+    /**
+     * Add an observation
+     * @param x Observation
+     */
+    void add(const double x);
+
+    //! Number of observations
+    uint64_t size() const { return count; }
+
+    //! Estimation of the quantile (0 without any observation)
+    double value() const;
+};
+
+#endif
@@ -0,0 +1,437 @@
+/** @file reader.cpp Implementation of the fast trace reader */
+
+#include "reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__AVX2__) || defined(__BMI2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+//! Mask of the even bits of a 64-bit word
+#define EVEN_BITS 0x5555555555555555ULL
+
+/**
+ * Classify 64 consecutive characters.
+ * @param p Pointer to the first character
+ * @param ones Bit i is set if p[i] == '1'
+ * @param zeros Bit i is set if p[i] == '0'
+ * @param newlines Bit i is set if p[i] == '\\n'
+ */
+static inline void
+classify(const char *p, uint64_t *ones, uint64_t *zeros, uint64_t *newlines)
+{
+#if defined(__AVX2__)
+  const __m256i c1 = _mm256_set1_epi8('1');
+  const __m256i c0 = _mm256_set1_epi8('0');
+  const __m256i cn = _mm256_set1_epi8('\n');
+  __m256i lo = _mm256_loadu_si256((const __m256i *) p);
+  __m256i hi = _mm256_loadu_si256((const __m256i *) (p + 32));
+# define MASK256(c) \
+  (((uint64_t)(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c))) | \
+   (((uint64_t)(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, c))) << 32))
+  *ones = MASK256(c1);
+  *zeros = MASK256(c0);
+  *newlines = MASK256(cn);
+# undef MASK256
+#elif defined(__SSE2__)
+  const __m128i c1 = _mm_set1_epi8('1');
+  const __m128i c0 = _mm_set1_epi8('0');
+  const __m128i cn = _mm_set1_epi8('\n');
+  unsigned int i;
+  *ones = 0;
+  *zeros = 0;
+  *newlines = 0;
+  for (i = 0; i < 4; ++i) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (p + 16 * i));
+    *ones |= ((uint64_t)(uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, c1))) << (16 * i);
+    *zeros |= ((uint64_t)(uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, c0))) << (16 * i);
+    *newlines |= ((uint64_t)(uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, cn))) << (16 * i);
+  }
+#else
+  unsigned int i;
+  *ones = 0;
+  *zeros = 0;
+  *newlines = 0;
+  for (i = 0; i < 64; ++i) {
+    *ones |= ((uint64_t)(p[i] == '1')) << i;
+    *zeros |= ((uint64_t)(p[i] == '0')) << i;
+    *newlines |= ((uint64_t)(p[i] == '\n')) << i;
+  }
+#endif
+}
+
+/**
+ * Gather the even bits of a word in its lower half.
+ * @param x Input word
+ * @return The 32 even bits of x, packed
+ */
+static inline uint64_t
+compress_even(uint64_t x)
+{
+  x &= EVEN_BITS;
+  x = (x | (x >> 1))  & 0x3333333333333333ULL;
+  x = (x | (x >> 2))  & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | (x >> 4))  & 0x00FF00FF00FF00FFULL;
+  x = (x | (x >> 8))  & 0x0000FFFF0000FFFFULL;
+  x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+  return x;
+}
+
+/**
+ * Gather the bits of 'value' selected by 'mask' (as BMI2 'pext')
+ * @param value Input word
+ * @param mask Selected bits
+ * @param n Number of gathered bits
+ * @return The gathered bits, packed
+ */
+static inline uint64_t
+gather(const uint64_t value, uint64_t mask, unsigned int *n)
+{
+#if defined(__BMI2__)
+  *n = (unsigned int) __builtin_popcountll(mask);
+  return _pext_u64(value, mask);
+#else
+  uint64_t out = 0;
+  unsigned int count = 0;
+  /* One packet per line is the most common layout */
+  if (mask == EVEN_BITS) {
+    *n = 32;
+    return compress_even(value);
+  } else if (mask == (EVEN_BITS << 1)) {
+    *n = 32;
+    return compress_even(value >> 1);
+  }
+  while (mask) {
+    out |= ((value >> __builtin_ctzll(mask)) & 1) << count;
+    ++count;
+    mask &= mask - 1;
+  }
+  *n = count;
+  return out;
+#endif
+}
+
+BitDecoder::BitDecoder(const size_t cap)
+{
+  capacity = cap;
+  words = new uint64_t[capacity];
+  reset();
+}
+
+BitDecoder::~BitDecoder()
+{
+  delete[] (words);
+}
+
+void
+BitDecoder::reset()
+{
+  full = 0;
+  fill = 0;
+  words[0] = 0;
+}
+
+void
+BitDecoder::consume()
+{
+  words[0] = words[full];
+  full = 0;
+}
+
+inline void
+BitDecoder::append(const uint64_t value, const unsigned int n)
+{
+  words[full] |= value << fill;
+  if (fill + n >= 64) {
+    ++full;
+    words[full] = fill ? (value >> (64 - fill)) : 0;
+    fill = fill + n - 64;
+  } else {
+    fill += n;
+  }
+}
+
+int
+BitDecoder::decode(const char *buf, const size_t len, size_t *used)
+{
+  size_t i = 0;
+  uint64_t ones, zeros, newlines, invalid, value;
+  unsigned int n;
+
+  /* Bulk classification, 64 characters at a time */
+  while ((i + 64 <= len) && !isFull()) {
+    classify(buf + i, &ones, &zeros, &newlines);
+    invalid = ~(ones | zeros | newlines);
+    if (invalid) {
+      bad_offset = i + (size_t) __builtin_ctzll(invalid);
+      *used = bad_offset;
+      return -1;
+    }
+    if (newlines == 0) {
+      append(ones, 64);
+    } else {
+      value = gather(ones, ones | zeros, &n);
+      if (n) {
+        append(value, n);
+      }
+    }
+    i += 64;
+  }
+
+  /* Remaining characters (less than 64, there is always room for them) */
+  if (!isFull()) {
+    for (; i < len; ++i) {
+      if (buf[i] == '0') {
+        append(0, 1);
+      } else if (buf[i] == '1') {
+        append(1, 1);
+      } else if (buf[i] != '\n') {
+        bad_offset = i;
+        *used = i;
+        return -1;
+      }
+    }
+  }
+  *used = i;
+  return 0;
+}
+
+TraceReader::TraceReader()
+  : fd(-1), own_fd(false), map(NULL), map_size(0), own_map(false), base(0), buffer(NULL), inflater(NULL),
+    chunk(NULL), pos(0), len(0),
+    eof(false), offset(0), packets(0), decoder(READER_BLOCK_WORDS), drained(false), streaming(false),
+    bad_char(0), bad_offset(0)
+{
+}
+
+TraceReader::~TraceReader()
+{
+  close();
+}
+
+int
+TraceReader::open(const char *filename)
+{
+  struct stat st;
+  unsigned char magic[2];
+  bool regular;
+  ssize_t r;
+
+  if (filename == NULL) {
+    fd = STDIN_FILENO;
+    own_fd = false;
+  } else {
+    fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+      return -1;
+    }
+    own_fd = true;
+  }
+
+  /* Try to map regular files, fallback to read(2) otherwise */
+  regular = (fstat(fd, &st) == 0) && S_ISREG(st.st_mode);
+  if (regular && (st.st_size > 0)) {
+    if ((pread(fd, magic, 2, 0) == 2) && Inflater::isGzip(magic, 2)) {
+      return start_inflater(NULL, 0);
+    }
+    void *m = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m != MAP_FAILED) {
+      map = (char *) m;
+      map_size = (size_t) st.st_size;
+      own_map = true;
+      madvise(m, map_size, MADV_SEQUENTIAL);
+    }
+  }
+  if (map == NULL) {
+    buffer = new char[READER_BUFFER_SIZE];
+  }
+  rewind_state();
+  if (!regular) {
+    /* Look at the first chunk to detect a compressed stream */
+    if (fill()) {
+      return -1;
+    }
+    /* A pipe may hand out less than the 2 bytes of the magic number at once */
+    while ((len < 2) && !eof) {
+      do {
+        r = read(fd, buffer + len, READER_BUFFER_SIZE - len);
+      } while ((r < 0) && (errno == EINTR));
+      if (r < 0) {
+        return -1;
+      }
+      if (r == 0) {
+        eof = true;
+      }
+      len += (size_t) r;
+    }
+    if (Inflater::isGzip((const unsigned char *) buffer, len)) {
+      return start_inflater(buffer, len);
+    }
+  }
+  return 0;
+}
+
+int
+TraceReader::start_inflater(const char *prefix, const size_t prefix_len)
+{
+  inflater = new Inflater(READER_BUFFER_SIZE);
+  if (inflater->start(fd, prefix, prefix_len)) {
+    return -1;
+  }
+  if (buffer != NULL) {
+    delete[] (buffer);
+    buffer = NULL;
+  }
+  return rewind_state();
+}
+
+int
+TraceReader::attach(const char *data, const size_t size, const uint64_t off)
+{
+  close();
+  /* The memory is only read, never written nor unmapped */
+  map = const_cast<char *>(data);
+  map_size = size;
+  own_map = false;
+  base = off;
+  return rewind_state();
+}
+
+int
+TraceReader::rewind_state()
+{
+  offset = base;
+  packets = 0;
+  pos = 0;
+  drained = false;
+  decoder.reset();
+  if (map != NULL) {
+    len = map_size;
+    eof = true;
+  } else {
+    len = 0;
+    eof = false;
+  }
+  return 0;
+}
+
+void
+TraceReader::close()
+{
+  if ((map != NULL) && own_map) {
+    munmap(map, map_size);
+  }
+  map = NULL;
+  if (inflater != NULL) {
+    delete (inflater);
+    inflater = NULL;
+    chunk = NULL;
+  }
+  if (buffer != NULL) {
+    delete[] (buffer);
+    buffer = NULL;
+  }
+  if (own_fd && (fd >= 0)) {
+    ::close(fd);
+  }
+  fd = -1;
+}
+
+int
+TraceReader::rewind()
+{
+  if ((map == NULL) && (lseek(fd, 0, SEEK_SET) != 0)) {
+    return -1;
+  }
+  if ((inflater != NULL) && inflater->start(fd, NULL, 0)) {
+    return -1;
+  }
+  return rewind_state();
+}
+
+int
+TraceReader::fill()
+{
+  ssize_t r;
+  offset += len;
+  pos = 0;
+  len = 0;
+  if (inflater != NULL) {
+    r = inflater->next(&chunk);
+    if (r < 0) {
+      return -1;
+    }
+    if (r == 0) {
+      eof = true;
+    }
+    len = (size_t) r;
+    return 0;
+  }
+  do {
+    r = read(fd, buffer, READER_BUFFER_SIZE);
+  } while ((r < 0) && (errno == EINTR));
+  if (r < 0) {
+    return -1;
+  }
+  if (r == 0) {
+    eof = true;
+  }
+  len = (size_t) r;
+  return 0;
+}
+
+ssize_t
+TraceReader::next(const uint64_t **words)
+{
+  size_t used, nbits;
+
+  /* Forget what was handed out by the previous call */
+  if (drained) {
+    decoder.reset();
+    drained = false;
+  } else {
+    decoder.consume();
+  }
+
+  while (!decoder.isFull()) {
+    if (pos == len) {
+      if (eof) {
+        break;
+      }
+      if (streaming && (decoder.fullBits() != 0)) {
+        /* Hand out what was read before waiting for more */
+        break;
+      }
+      if (fill()) {
+        return -2;
+      }
+      continue;
+    }
+    if (decoder.decode(current() + pos, len - pos, &used)) {
+      bad_offset = offset + pos + decoder.badOffset();
+      bad_char = current()[pos + decoder.badOffset()];
+      pos += used;
+      return -1;
+    }
+    pos += used;
+  }
+
+  if (decoder.isFull() || !eof) {
+    /* Only hand out complete words, the partial one will be completed by the next call */
+    nbits = decoder.fullBits();
+  } else {
+    /* End of input */
+    nbits = decoder.bits();
+    drained = true;
+  }
+  packets += nbits;
+  *words = decoder.data();
+  return (ssize_t) nbits;
+}
@@ -0,0 +1,218 @@
+#ifndef READER_H
+#define READER_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "inflater.h"
+
+/** @file reader.h Fast reader for the 0's and 1's traces */
+
+/**
+ * Number of 64-bit words handed to the caller in one block.
+ */
+#define READER_BLOCK_WORDS 8192
+
+/**
+ * Size of the buffer used when the input cannot be mapped in memory.
+ */
+#define READER_BUFFER_SIZE (1 << 20)
+
+/**
+ * Decode '0'/'1'/'\\n' characters onto packed 64-bit words.
+ * Bit i of word j is the (64 * j + i)-th packet of the stream (1 means received).\n
+ * Characters are classified by 64-bytes blocks using SSE2 or AVX2 when available.
+ */
+class BitDecoder {
+
+  private:
+    //! Output words
+    uint64_t *words;
+    //! Capacity of 'words' (in words)
+    size_t capacity;
+    //! Number of complete words in 'words'
+    size_t full;
+    //! Number of bits already stored in words[full]
+    unsigned int fill;
+    //! Offset of the first invalid character, relatively to the start of the decoded buffer
+    size_t bad_offset;
+
+    /**
+     * Append up to 64 bits to the output.
+     * @param value Bits to append (LSB first)
+     * @param n Number of meaningful bits in value (1-64)
+     */
+    inline void append(const uint64_t value, const unsigned int n);
+
+  public:
+    /**
+     * Constructor
+     * @param capacity Number of words the decoder may store before being flushed
+     */
+    BitDecoder(const size_t capacity);
+    ~BitDecoder();
+
+    /**
+     * Decode a buffer.
+     * Stops when the output is full or on an invalid character.
+     * @param buf Buffer to decode
+     * @param len Length of buf
+     * @param used Number of bytes of buf actually decoded
+     * @return Ok: 0, -1 on invalid character (see badOffset)
+     */
+    int decode(const char *buf, const size_t len, size_t *used);
+
+    //! Is there no room left for a new 64-bytes block ?
+    bool isFull() const { return full + 2 > capacity; }
+    //! Decoded words
+    const uint64_t *data() const { return words; }
+    //! Number of decoded bits
+    size_t bits() const { return (full << 6) + fill; }
+    //! Number of decoded bits in complete words
+    size_t fullBits() const { return full << 6; }
+    //! Offset of the invalid character found by the last decode
+    size_t badOffset() const { return bad_offset; }
+    //! Forget all the decoded bits
+    void reset();
+    //! Forget the complete words, keep the partial one
+    void consume();
+};
+
+/**
+ * Read a whole trace by block of packed bits.
+ * Regular files are mapped in memory, other inputs (stdin, pipes) are read by large chunks.
+ * Gzip inputs are detected and decompressed by an Inflater thread.
+ */
+class TraceReader {
+
+  private:
+    //! File descriptor
+    int fd;
+    //! Should 'fd' be closed by close() ?
+    bool own_fd;
+    //! Mapped file, NULL if the input is read
+    char *map;
+    //! Size of the mapped file
+    size_t map_size;
+    //! Was 'map' mapped by this reader (and thus should be unmapped) ?
+    bool own_map;
+    //! Offset of 'map' in the whole input (for error messages)
+    uint64_t base;
+    //! Read buffer (if not mapped nor compressed)
+    char *buffer;
+    //! Decompressing thread (if compressed), NULL otherwise
+    Inflater *inflater;
+    //! Current decompressed chunk (if compressed)
+    const char *chunk;
+    //! Position of the next byte to decode in the current buffer
+    size_t pos;
+    //! Number of valid bytes in the current buffer
+    size_t len;
+    //! Was the end of file reached ?
+    bool eof;
+    //! Number of bytes consumed before the current buffer
+    uint64_t offset;
+    //! Total number of packets read
+    uint64_t packets;
+    //! Decoder used to fill the blocks
+    BitDecoder decoder;
+    //! Was the partial word handed out with the last block ?
+    bool drained;
+    //! Hand out the packets as soon as they are read (see setStreaming)
+    bool streaming;
+    //! Invalid character found, if any
+    char bad_char;
+    //! Absolute offset of the invalid character
+    uint64_t bad_offset;
+
+    /**
+     * Get more input
+     * @return Ok: 0, anything else in case of error
+     */
+    int fill();
+
+    /**
+     * Reset the reading state to the beginning of the input
+     * @return Ok: 0
+     */
+    int rewind_state();
+
+    /**
+     * Read the input through an Inflater
+     * @param prefix Bytes already read from the input, NULL if none
+     * @param prefix_len Size of prefix
+     * @return Ok: 0, anything else in case of error
+     */
+    int start_inflater(const char *prefix, const size_t prefix_len);
+
+    //! Current buffer
+    const char *current() const { return (map != NULL) ? map : ((inflater != NULL) ? chunk : buffer); }
+
+  public:
+    TraceReader();
+    ~TraceReader();
+
+    /**
+     * Open an input
+     * @param filename Name of the file to read, NULL for the standard input
+     * @return Ok: 0, anything else in case of error (errno is set)
+     */
+    int open(const char *filename);
+
+    /**
+     * Read a part of an input already in memory
+     * @param data First byte to read
+     * @param size Number of bytes to read
+     * @param offset Offset of 'data' in the whole input (for error messages)
+     * @return Ok: 0
+     */
+    int attach(const char *data, const size_t size, const uint64_t offset);
+
+    /**
+     * Close the input
+     */
+    void close();
+
+    /**
+     * Restart the reading from the beginning of the input
+     * @return Ok: 0, -1 if the input cannot be read twice (pipes)
+     */
+    int rewind();
+
+    /**
+     * Get the next block of packets
+     * @param words Pointer set to the block of packed bits, valid until the next call
+     * @return Number of packets in the block, 0 at the end of the input, -1 on invalid character, -2 on read or decompression error
+     */
+    ssize_t next(const uint64_t **words);
+
+    /**
+     * Streaming: next() returns the complete words already read instead of waiting for a full block,
+     * when reading more would block (pipes, e.g. a trace still being written followed with tail -f)
+     * @param s Enable the streaming
+     */
+    void setStreaming(const bool s) { streaming = s; }
+
+    //! Invalid character found by next()
+    char badChar() const { return bad_char; }
+    //! Offset of the invalid character found by next()
+    uint64_t badOffset() const { return bad_offset; }
+    //! Number of bytes decoded (after decompression)
+    uint64_t bytesRead() const { return offset + pos - base; }
+    //! Number of packets decoded
+    uint64_t packetsRead() const { return packets; }
+    //! Is the input mapped in memory ?
+    bool isMapped() const { return map != NULL; }
+    //! Is the input compressed ?
+    bool isCompressed() const { return inflater != NULL; }
+    //! Decompression error found by next() (NULL if none)
+    const char *inflateError() const { return (inflater != NULL) ? inflater->lastError() : NULL; }
+    //! Input mapped in memory (NULL if not mapped)
+    const char *mappedData() const { return map; }
+    //! Size of the input mapped in memory
+    size_t mappedSize() const { return map_size; }
+};
+
+#endif
@@ -0,0 +1,105 @@
+/** @file ring.cpp Implementation of the ring of blocks shared by the module threads */
+
+#include "ring.h"
+
+BlockRing::BlockRing(const size_t nb_slots, const size_t nb_words, const unsigned int nb_consumers)
+  : slots(nb_slots), words(nb_words), consumers(nb_consumers), produced(0), finished(false)
+{
+  size_t i;
+  blocks = new uint64_t*[slots];
+  for (i = 0; i < slots; ++i) {
+    blocks[i] = new uint64_t[words];
+  }
+  sizes = new size_t[slots];
+  consumed = new uint64_t[consumers]();
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&not_empty, NULL);
+  pthread_cond_init(&not_full, NULL);
+}
+
+BlockRing::~BlockRing()
+{
+  size_t i;
+  pthread_cond_destroy(&not_full);
+  pthread_cond_destroy(&not_empty);
+  pthread_mutex_destroy(&lock);
+  delete[] (consumed);
+  delete[] (sizes);
+  for (i = 0; i < slots; ++i) {
+    delete[] (blocks[i]);
+  }
+  delete[] (blocks);
+}
+
+uint64_t
+BlockRing::slowest() const
+{
+  unsigned int i;
+  uint64_t min = consumed[0];
+  for (i = 1; i < consumers; ++i) {
+    if (consumed[i] < min) {
+      min = consumed[i];
+    }
+  }
+  return min;
+}
+
+uint64_t *
+BlockRing::reserve()
+{
+  uint64_t *block;
+  pthread_mutex_lock(&lock);
+  while (produced - slowest() >= slots) {
+    pthread_cond_wait(&not_full, &lock);
+  }
+  block = blocks[produced % slots];
+  pthread_mutex_unlock(&lock);
+  return block;
+}
+
+void
+BlockRing::publish(const size_t nbits)
+{
+  pthread_mutex_lock(&lock);
+  sizes[produced % slots] = nbits;
+  ++produced;
+  pthread_cond_broadcast(&not_empty);
+  pthread_mutex_unlock(&lock);
+}
+
+void
+BlockRing::finish()
+{
+  pthread_mutex_lock(&lock);
+  finished = true;
+  pthread_cond_broadcast(&not_empty);
+  pthread_mutex_unlock(&lock);
+}
+
+size_t
+BlockRing::acquire(const unsigned int consumer, const uint64_t **block)
+{
+  size_t nbits;
+  pthread_mutex_lock(&lock);
+  while ((consumed[consumer] == produced) && !finished) {
+    pthread_cond_wait(&not_empty, &lock);
+  }
+  if (consumed[consumer] == produced) {
+    /* Finished and everything was consumed */
+    nbits = 0;
+  } else {
+    *block = blocks[consumed[consumer] % slots];
+    nbits = sizes[consumed[consumer] % slots];
+  }
+  pthread_mutex_unlock(&lock);
+  return nbits;
+}
+
+void
+BlockRing::release(const unsigned int consumer)
+{
+  pthread_mutex_lock(&lock);
+  ++consumed[consumer];
+  pthread_cond_broadcast(&not_full);
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,85 @@
+#ifndef RING_H
+#define RING_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+/**
+ * Ring of blocks of packed bits, written by one producer and read by several consumers.
+ * Each consumer sees every block, in order; a slot is reused once all the consumers released it.
+ */
+class BlockRing {
+
+  private:
+    //! Number of slots
+    size_t slots;
+    //! Number of words per slot
+    size_t words;
+    //! Blocks
+    uint64_t **blocks;
+    //! Number of packets in each block
+    size_t *sizes;
+    //! Number of consumers
+    unsigned int consumers;
+    //! Number of blocks published by the producer
+    uint64_t produced;
+    //! Number of blocks released by each consumer
+    uint64_t *consumed;
+    //! Is the producer done ?
+    bool finished;
+    //! Lock protecting the counters
+    pthread_mutex_t lock;
+    //! Signaled when a block is published
+    pthread_cond_t not_empty;
+    //! Signaled when a block is released
+    pthread_cond_t not_full;
+
+    //! Number of blocks released by the slowest consumer (lock held)
+    uint64_t slowest() const;
+
+  public:
+    /**
+     * Constructor
+     * @param slots Number of blocks in the ring
+     * @param words Number of words of a block
+     * @param consumers Number of consumers
+     */
+    BlockRing(const size_t slots, const size_t words, const unsigned int consumers);
+    ~BlockRing();
+
+    /**
+     * Producer: get the next block to be filled (waits for it to be released by all the consumers)
+     * @return The block
+     */
+    uint64_t *reserve();
+
+    /**
+     * Producer: publish the block obtained by reserve
+     * @param nbits Number of packets in the block
+     */
+    void publish(const size_t nbits);
+
+    /**
+     * Producer: there will be no more block
+     */
+    void finish();
+
+    /**
+     * Consumer: get the next block (waits for it to be published)
+     * @param consumer Index of the consumer
+     * @param block Set to the block, valid until release
+     * @return Number of packets in the block, 0 if there is no more block
+     */
+    size_t acquire(const unsigned int consumer, const uint64_t **block);
+
+    /**
+     * Consumer: release the block obtained by acquire
+     * @param consumer Index of the consumer
+     */
+    void release(const unsigned int consumer);
+};
+
+#endif
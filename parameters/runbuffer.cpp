@@ -0,0 +1,142 @@
+/** @file runbuffer.cpp Implementation of the run-length record of a trace */
+
+#include "runbuffer.h"
+
+//! Number of bursts read at once from the temporary file
+#define REPLAY_CHUNK (1 << 16)
+
+RunBuffer::RunBuffer()
+  : limit(0), can_spill(false), spill(NULL), spilled(0), first_value(false), last_value(false), count(0),
+    replay_pos(0), replay_spilled(0), replay_value(false), replay_memory(false)
+{
+}
+
+RunBuffer::~RunBuffer()
+{
+  clean();
+}
+
+void
+RunBuffer::init(const size_t memory, const bool allow_spill)
+{
+  clean();
+  limit = memory / sizeof(uint32_t);
+  if (limit < 2) {
+    limit = 2;
+  }
+  can_spill = allow_spill;
+}
+
+void
+RunBuffer::clean()
+{
+  /* Release the memory, clear() only keeps it */
+  std::vector<uint32_t>().swap(runs);
+  std::vector<uint32_t>().swap(replay_buf);
+  if (spill != NULL) {
+    fclose(spill);
+    spill = NULL;
+  }
+  spilled = 0;
+  count = 0;
+}
+
+int
+RunBuffer::flush()
+{
+  size_t n = runs.size() - 1;
+  if (spill == NULL) {
+    spill = tmpfile();
+    if (spill == NULL) {
+      return -1;
+    }
+  }
+  if (fwrite(&runs[0], sizeof(uint32_t), n, spill) != n) {
+    return -2;
+  }
+  spilled += n;
+  runs[0] = runs[n];
+  runs.resize(1);
+  return 0;
+}
+
+int
+RunBuffer::add(const bool value, const uint32_t len)
+{
+  if (len == 0) {
+    return 0;
+  }
+  if (count == 0) {
+    first_value = value;
+  } else if (value == last_value) {
+    /* Same value as the last burst: extend it */
+    runs.back() += len;
+    return 0;
+  }
+  if (runs.size() >= limit) {
+    if (!can_spill) {
+      return -3;
+    }
+    if (flush()) {
+      return -4;
+    }
+  }
+  runs.push_back(len);
+  last_value = value;
+  ++count;
+  return 0;
+}
+
+int
+RunBuffer::rewind()
+{
+  replay_pos = 0;
+  replay_spilled = 0;
+  replay_value = first_value;
+  replay_memory = (spill == NULL);
+  replay_buf.clear();
+  if (spill != NULL) {
+    if (fflush(spill) || fseek(spill, 0, SEEK_SET)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int
+RunBuffer::next(bool *value, uint32_t *len)
+{
+  size_t n;
+  if (!replay_memory) {
+    if (replay_pos == replay_buf.size()) {
+      if (replay_spilled == spilled) {
+        /* The temporary file is over, continue with the memory */
+        replay_memory = true;
+        replay_pos = 0;
+      } else {
+        n = REPLAY_CHUNK;
+        if (spilled - replay_spilled < n) {
+          n = (size_t) (spilled - replay_spilled);
+        }
+        replay_buf.resize(n);
+        if (fread(&replay_buf[0], sizeof(uint32_t), n, spill) != n) {
+          return -1;
+        }
+        replay_spilled += n;
+        replay_pos = 0;
+      }
+    }
+  }
+  if (replay_memory) {
+    if (replay_pos == runs.size()) {
+      return 0;
+    }
+    *len = runs[replay_pos];
+  } else {
+    *len = replay_buf[replay_pos];
+  }
+  ++replay_pos;
+  *value = replay_value;
+  replay_value = !replay_value;
+  return 1;
+}
@@ -0,0 +1,99 @@
+#ifndef RUNBUFFER_H
+#define RUNBUFFER_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+
+/**
+ * Run-length record of a trace.
+ * Store the lengths of the consecutive bursts of identical packets (4 bytes per burst)
+ * so that a trace can be replayed without reading it again.\n
+ * The memory used is bounded: once 'limit' bursts are stored, the buffer either refuses new bursts
+ * or, if allowed to, spills them to a temporary file and only keeps the last 'limit' bursts in memory.
+ */
+class RunBuffer {
+
+  private:
+    //! Bursts kept in memory (the most recent ones)
+    std::vector<uint32_t> runs;
+    //! Maximum number of bursts kept in memory
+    size_t limit;
+    //! Are we allowed to use a temporary file ?
+    bool can_spill;
+    //! Temporary file, NULL if everything is in memory
+    FILE *spill;
+    //! Number of bursts written to the temporary file
+    uint64_t spilled;
+    //! Value of the first burst
+    bool first_value;
+    //! Value of the last burst
+    bool last_value;
+    //! Total number of bursts
+    uint64_t count;
+
+    /* Replay state */
+    //! Buffer used to read back the temporary file
+    std::vector<uint32_t> replay_buf;
+    //! Position in the current replay buffer
+    size_t replay_pos;
+    //! Number of bursts read back from the temporary file
+    uint64_t replay_spilled;
+    //! Value of the next burst to be replayed
+    bool replay_value;
+    //! Are we replaying the bursts kept in memory ?
+    bool replay_memory;
+
+    /**
+     * Move the bursts kept in memory (except the last one) to the temporary file
+     * @return Ok: 0, anything else in case of error
+     */
+    int flush();
+
+  public:
+    RunBuffer();
+    ~RunBuffer();
+
+    /**
+     * Initialize the buffer
+     * @param memory Maximum memory used by the bursts kept in memory (in bytes)
+     * @param spill Allow the use of a temporary file
+     */
+    void init(const size_t memory, const bool spill);
+
+    /**
+     * Free everything
+     */
+    void clean();
+
+    /**
+     * Add a burst
+     * @param value True if the packets were received, False if they weren't
+     * @param len Length of the burst
+     * @return Ok: 0, anything else in case of error (buffer full or I/O error)
+     */
+    int add(const bool value, const uint32_t len);
+
+    /**
+     * Start the replay from the first burst
+     * @return Ok: 0, anything else in case of error
+     */
+    int rewind();
+
+    /**
+     * Get the next burst
+     * @param value Set to the value of the burst
+     * @param len Set to the length of the burst
+     * @return 1 if a burst was returned, 0 at the end of the record, -1 in case of error
+     */
+    int next(bool *value, uint32_t *len);
+
+    //! Number of bursts stored
+    uint64_t size() const { return count; }
+    //! Is the record using a temporary file ?
+    bool isSpilled() const { return spill != NULL; }
+};
+
+#endif
@@ -0,0 +1,491 @@
+/** @file segment.cpp Implementation of the change detection and of the regimes */
+
+#include "segment.h"
+#include "driver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+
+ChangeDetector::ChangeDetector(const uint32_t w, const double t, const double r)
+  : window(w), threshold(t), ratio(r), last(0), seg_start(0), seg_losses(0), seg_packets(0),
+    up(0), down(0), zero_up(SEGMENT_MIN_WINDOWS), zero_down(SEGMENT_MIN_WINDOWS)
+{
+}
+
+double
+ChangeDetector::llr(const uint32_t x, const uint32_t n, const double p0, const double p1)
+{
+  return ((double) x) * log(p1 / p0) + ((double) (n - x)) * (log1p(-p1) - log1p(-p0));
+}
+
+void
+ChangeDetector::split(const size_t first, const size_t end)
+{
+  Segment seg;
+  size_t i;
+
+  seg.start = ((uint64_t) seg_start) * window;
+  seg.length = ((uint64_t) (first - seg_start)) * window;
+  seg.losses = 0;
+  seg.regime = 0;
+  for (i = seg_start; i < first; ++i) {
+    seg.losses += losses[i];
+  }
+  segs.push_back(seg);
+
+  /* The windows after the change belong to the new segment */
+  seg_start = first;
+  seg_losses = 0;
+  for (i = first; i < end; ++i) {
+    seg_losses += losses[i];
+  }
+  seg_packets = ((uint64_t) (end - first)) * window;
+  up = 0;
+  down = 0;
+  zero_up = first + SEGMENT_MIN_WINDOWS;
+  zero_down = zero_up;
+}
+
+bool
+ChangeDetector::test(const size_t index)
+{
+  size_t change;
+  /* Loss rate of the segment, never 0 or 1 */
+  const double p0 = (((double) seg_losses) + 0.5) / (((double) seg_packets) + 1.);
+  const double p_up = (p0 * ratio < 1) ? p0 * ratio : (1. + p0) / 2.;
+  const double p_down = p0 / ratio;
+
+  up += llr(losses[index], last, p0, p_up);
+  if (up <= 0) {
+    up = 0;
+    zero_up = index + 1;
+  }
+  down += llr(losses[index], last, p0, p_down);
+  if (down <= 0) {
+    down = 0;
+    zero_down = index + 1;
+  }
+  if ((up <= threshold) && (down <= threshold)) {
+    return false;
+  }
+  /* The change happened after the last time the sum was null */
+  change = (up > threshold) ? zero_up : zero_down;
+  change = std::min(std::max(change, seg_start + SEGMENT_MIN_WINDOWS), index);
+  split(change, index + 1);
+  return true;
+}
+
+void
+ChangeDetector::addWindow(const uint32_t x, const uint32_t packets)
+{
+  const size_t index = losses.size();
+  losses.push_back(x);
+  last = packets;
+  if ((index < seg_start + SEGMENT_MIN_WINDOWS) || !test(index)) {
+    seg_losses += x;
+    seg_packets += packets;
+  }
+}
+
+void
+ChangeDetector::finish()
+{
+  if (losses.size() <= seg_start) {
+    return;
+  }
+  split(losses.size(), losses.size());
+  /* The last window may be shorter */
+  segs.back().length -= window - last;
+}
+
+/**
+ * Order of the segments by loss rate
+ */
+class LossRateOrder {
+  private:
+    //! Segments compared
+    const std::vector<Segment>& segs;
+  public:
+    LossRateOrder(const std::vector<Segment>& s) : segs(s) {}
+    //! Is the loss rate of segment a below the one of segment b ?
+    bool operator()(const size_t a, const size_t b) const {
+      return ((double) segs[a].losses) * ((double) segs[b].length) < ((double) segs[b].losses) * ((double) segs[a].length);
+    }
+};
+
+unsigned int
+Regimes::classify(std::vector<Segment>& segs, const unsigned int regimes)
+{
+  std::vector<double> centers, sum_losses, sum_packets;
+  std::vector<std::pair<double, unsigned int> > sorted;
+  std::vector<unsigned int> remap;
+  std::vector<size_t> order;
+  std::vector<Segment> merged;
+  std::vector<Segment>::iterator it;
+  uint64_t total = 0, cumulated = 0;
+  unsigned int n, i, best, iteration;
+  double rate;
+  bool changed = true;
+  size_t s;
+
+  rates.clear();
+  packets.clear();
+  count.clear();
+  transitions.clear();
+  n = (unsigned int) std::min((size_t) regimes, segs.size());
+  if (n == 0) {
+    return 0;
+  }
+
+  /* Initial centers: loss rates at the quantiles (i + 1/2) / n of the packets */
+  for (s = 0; s < segs.size(); ++s) {
+    order.push_back(s);
+    total += segs[s].length;
+    segs[s].regime = n;
+  }
+  std::sort(order.begin(), order.end(), LossRateOrder(segs));
+  for (s = 0, i = 0; (s < order.size()) && (i < n); ++s) {
+    cumulated += segs[order[s]].length;
+    while ((i < n) && (((double) cumulated) >= ((double) total) * (i + 0.5) / n)) {
+      centers.push_back(((double) segs[order[s]].losses) / ((double) std::max(segs[order[s]].length, (uint64_t) 1)));
+      ++i;
+    }
+  }
+  while (centers.size() < n) {
+    centers.push_back(centers.back());
+  }
+
+  /* Lloyd iterations, each segment weighted by its number of packets */
+  for (iteration = 0; changed && (iteration < SEGMENT_MAX_ITERATIONS); ++iteration) {
+    changed = false;
+    sum_losses.assign(n, 0);
+    sum_packets.assign(n, 0);
+    for (it = segs.begin(); it != segs.end(); ++it) {
+      rate = ((double) it->losses) / ((double) std::max(it->length, (uint64_t) 1));
+      best = 0;
+      for (i = 1; i < n; ++i) {
+        if (fabs(rate - centers[i]) < fabs(rate - centers[best])) {
+          best = i;
+        }
+      }
+      if (it->regime != best) {
+        it->regime = best;
+        changed = true;
+      }
+      sum_losses[best] += (double) it->losses;
+      sum_packets[best] += (double) it->length;
+    }
+    for (i = 0; i < n; ++i) {
+      if (sum_packets[i] > 0) {
+        centers[i] = sum_losses[i] / sum_packets[i];
+      }
+    }
+  }
+
+  /* Drop the empty regimes, sort the others by loss rate */
+  for (i = 0; i < n; ++i) {
+    if (sum_packets[i] > 0) {
+      sorted.push_back(std::make_pair(centers[i], i));
+    }
+  }
+  std::sort(sorted.begin(), sorted.end());
+  remap.assign(n, 0);
+  for (i = 0; i < sorted.size(); ++i) {
+    remap[sorted[i].second] = i;
+  }
+  n = (unsigned int) sorted.size();
+
+  /* Merge the consecutive segments of a same regime */
+  for (it = segs.begin(); it != segs.end(); ++it) {
+    it->regime = remap[it->regime];
+    if (!merged.empty() && (merged.back().regime == it->regime)) {
+      merged.back().length += it->length;
+      merged.back().losses += it->losses;
+    } else {
+      merged.push_back(*it);
+    }
+  }
+  segs.swap(merged);
+
+  /* Statistics of the regimes */
+  packets.assign(n, 0);
+  count.assign(n, 0);
+  transitions.assign(((size_t) n) * n, 0);
+  sum_losses.assign(n, 0);
+  for (s = 0; s < segs.size(); ++s) {
+    packets[segs[s].regime] += segs[s].length;
+    sum_losses[segs[s].regime] += (double) segs[s].losses;
+    ++count[segs[s].regime];
+    if (s > 0) {
+      ++transitions[((size_t) segs[s - 1].regime) * n + segs[s].regime];
+    }
+  }
+  for (i = 0; i < n; ++i) {
+    rates.push_back(sum_losses[i] / (double) std::max(packets[i], (uint64_t) 1));
+  }
+  return n;
+}
+
+void
+Regimes::print(std::ostream &output, const uint32_t max_rand) const
+{
+  unsigned int i, j;
+  uint64_t out;
+  const unsigned int n = size();
+
+  output << n << std::endl;
+  for (i = 0; i < n; ++i) {
+    output << packets[i] / count[i] << std::endl;
+    output << (uint32_t) (rates[i] * max_rand) << std::endl;
+  }
+  for (i = 0; i < n; ++i) {
+    out = 0;
+    for (j = 0; j < n; ++j) {
+      out += transitions[((size_t) i) * n + j];
+    }
+    for (j = 0; j < n; ++j) {
+      output << (out ? (uint32_t) (((long double) transitions[((size_t) i) * n + j]) / ((long double) out) * max_rand) : 0) << std::endl;
+    }
+  }
+}
+
+void
+Regimes::printHuman(std::ostream &output) const
+{
+  unsigned int i, j;
+  uint64_t out;
+  const unsigned int n = size();
+
+  output << "Regimes: " << n << std::endl;
+  for (i = 0; i < n; ++i) {
+    output << "- Regime " << i << ": loss rate " << rates[i] * 100 << "%, " << count[i] << " segments, "
+           << packets[i] << " packets (mean length " << packets[i] / count[i] << ")" << std::endl;
+  }
+  output << "Regime transitions:" << std::endl;
+  for (i = 0; i < n; ++i) {
+    out = 0;
+    for (j = 0; j < n; ++j) {
+      out += transitions[((size_t) i) * n + j];
+    }
+    for (j = 0; j < n; ++j) {
+      if (transitions[((size_t) i) * n + j] != 0) {
+        output << "- " << i << " -> " << j << ": " << transitions[((size_t) i) * n + j]
+               << " (" << ((double) transitions[((size_t) i) * n + j]) / ((double) out) * 100 << "%)" << std::endl;
+      }
+    }
+  }
+}
+
+void
+Regimes::printSegments(std::ostream &output, const std::vector<Segment>& segs)
+{
+  std::vector<Segment>::const_iterator it;
+  for (it = segs.begin(); it != segs.end(); ++it) {
+    output << it->start << " " << it->length << " " << it->regime << std::endl;
+  }
+}
+
+/**
+ * Replace '%r' by a regime in the arguments of a class
+ * @param argc Argument Count (the first argument is the name of the module)
+ * @param argv Argument Vector
+ * @param regime Regime
+ * @param out Set to the arguments of the regime
+ */
+static void
+regime_args(const int argc, char **argv, const unsigned int regime, struct class_args *out)
+{
+  char number[16];
+  snprintf(number, sizeof(number), "%u", regime);
+  expand_args(argc, argv, Patterns(1, std::make_pair(std::string("%r"), std::string(number))), out);
+}
+
+/**
+ * Segments counted by the threads
+ */
+struct segment_work {
+  const uint64_t *trace;                          //!< Packets of the input
+  const std::vector<Segment> *segs;               //!< Segments
+  std::vector<std::vector<struct class_args> > *args; //!< Arguments of the classes, per regime
+  std::vector<ModuleList> *mods;                  //!< Modules of each regime, receiving the counts of the segments
+  bool human_readable;                            //!< Generate output human-readable or not
+  int format;                                     //!< Format of the non human-readable output (OUTPUT_*)
+  size_t next;                                    //!< Next segment to count
+  pthread_mutex_t lock;                           //!< Protects 'next', 'ret' and the creation of modules (getopt)
+  std::vector<pthread_mutex_t> merge_locks;       //!< Protects the modules of each regime
+  int ret;                                        //!< First error
+};
+
+/**
+ * Thread entry point: count segments in their own modules, then add them to the modules of their regime
+ * @param arg The segments (struct segment_work)
+ * @return NULL
+ */
+static void *
+count_segments(void *arg)
+{
+  struct segment_work *w = (struct segment_work *) arg;
+  const Segment *seg;
+  ModuleList parts;
+  ParamModule *mod;
+  size_t i;
+  int ret;
+
+  for (;;) {
+    /* Take the next segment, and create its modules */
+    pthread_mutex_lock(&w->lock);
+    if ((w->ret != 0) || (w->next >= w->segs->size())) {
+      pthread_mutex_unlock(&w->lock);
+      break;
+    }
+    seg = &(*w->segs)[w->next++];
+    std::vector<struct class_args> &classes = (*w->args)[seg->regime];
+    ret = 0;
+    for (i = 0; i < classes.size(); ++i) {
+      mod = create_module((int) classes[i].args.size(), &classes[i].argv[0], w->human_readable, w->format, &ret);
+      if (mod == NULL) {
+        w->ret = ret;
+        break;
+      }
+      parts.push_back(mod);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    /* Each segment is an independent trace */
+    for (i = 0; (i < parts.size()) && (ret == 0); ++i) {
+      ret = parts[i]->addBits(w->trace + (seg->start >> 6), (size_t) seg->length);
+      if ((ret == 0) && parts[i]->nextRound()) {
+        ret = parts[i]->addBits(w->trace + (seg->start >> 6), (size_t) seg->length);
+      }
+      if (ret) {
+        std::cerr << "Parsing error" << ret << std::endl;
+      }
+    }
+    if (ret == 0) {
+      pthread_mutex_lock(&w->merge_locks[seg->regime]);
+      for (i = 0; (i < parts.size()) && (ret == 0); ++i) {
+        if ((*w->mods)[seg->regime][i]->merge(parts[i])) {
+          std::cerr << "Module doesn't support the segmentation" << std::endl;
+          ret = -18;
+        }
+      }
+      pthread_mutex_unlock(&w->merge_locks[seg->regime]);
+    }
+    if (ret) {
+      pthread_mutex_lock(&w->lock);
+      if (w->ret == 0) {
+        w->ret = ret;
+      }
+      pthread_mutex_unlock(&w->lock);
+    }
+    drop_parts(parts);
+  }
+  return NULL;
+}
+
+int
+read_segmented(const char *input_file, const struct segment_options &opts, const std::vector<std::pair<int, char**> > &classes,
+               const unsigned int threads, const bool human_readable, const int format, const uint32_t max_rand)
+{
+  ChangeDetector detector(opts.window, opts.threshold, opts.ratio);
+  std::vector<uint64_t> trace;
+  std::vector<std::vector<struct class_args> > args;
+  std::vector<ModuleList> mods;
+  struct segment_work work;
+  std::vector<pthread_t> ids(threads);
+  Regimes regimes;
+  ParamModule *mod;
+  uint64_t packets;
+  unsigned int n, r, i;
+  int ret;
+
+  ret = read_trace(input_file, &trace, &packets, &detector);
+  if (ret) {
+    return ret;
+  }
+  std::vector<Segment> &segs = detector.segments();
+  n = regimes.classify(segs, opts.regimes);
+
+  /* Modules of each regime */
+  args.resize(n);
+  mods.resize(n);
+  for (r = 0; r < n; ++r) {
+    args[r].resize(classes.size());
+    for (i = 0; i < classes.size(); ++i) {
+      regime_args(classes[i].first, classes[i].second, r, &args[r][i]);
+      mod = create_module(classes[i].first, &args[r][i].argv[0], human_readable, format, &ret);
+      if (mod == NULL) {
+        return ret;
+      }
+      mods[r].push_back(mod);
+    }
+  }
+
+  /* Count the segments in parallel */
+  work.trace = trace.empty() ? NULL : &trace[0];
+  work.segs = &segs;
+  work.args = &args;
+  work.mods = &mods;
+  work.human_readable = human_readable;
+  work.format = format;
+  work.next = 0;
+  work.ret = 0;
+  pthread_mutex_init(&work.lock, NULL);
+  work.merge_locks.resize(n);
+  for (r = 0; r < n; ++r) {
+    pthread_mutex_init(&work.merge_locks[r], NULL);
+  }
+  for (i = 0; i < threads; ++i) {
+    if (pthread_create(&ids[i], NULL, count_segments, &work)) {
+      std::cerr << "Unable to create thread" << std::endl;
+      exit(-1);
+    }
+  }
+  for (i = 0; i < threads; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+  for (r = 0; r < n; ++r) {
+    pthread_mutex_destroy(&work.merge_locks[r]);
+  }
+  pthread_mutex_destroy(&work.lock);
+  if (work.ret) {
+    return work.ret;
+  }
+  std::vector<uint64_t>().swap(trace);
+
+  /* Regimes, then the parameters of each regime */
+  if (human_readable) {
+    regimes.printHuman(std::cout);
+    std::cout << "Segments:" << std::endl;
+    Regimes::printSegments(std::cout, segs);
+  } else if (opts.output == NULL) {
+    regimes.print(std::cout, max_rand);
+  } else {
+    std::ofstream output(opts.output, std::ios::out | std::ios::trunc);
+    std::ofstream segments((std::string(opts.output) + ".segments").c_str(), std::ios::out | std::ios::trunc);
+    if (!output.is_open() || !segments.is_open()) {
+      std::cerr << "Unable to open " << opts.output << " (" << strerror(errno) << ")" << std::endl;
+      return -15;
+    }
+    regimes.print(output, max_rand);
+    Regimes::printSegments(segments, segs);
+  }
+  for (r = 0; r < n; ++r) {
+    if (human_readable) {
+      std::cout << std::dec << "Regime " << r << std::endl;
+    }
+    ret = print_modules(mods[r], human_readable, format, max_rand);
+    drop_parts(mods[r]);
+    if (ret) {
+      return ret;
+    }
+  }
+  return 0;
+}
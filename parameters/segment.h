@@ -0,0 +1,190 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+//! Number of windows of a segment before testing for a change (estimation of its loss rate)
+#define SEGMENT_MIN_WINDOWS 4
+//! Maximal number of iterations of the classification of the segments into regimes
+#define SEGMENT_MAX_ITERATIONS 100
+//! Segmentation: default number of packets of a window
+#define SEGMENT_WINDOW 1024
+//! Segmentation: default threshold of the CUSUM
+#define SEGMENT_THRESHOLD 15.
+//! Segmentation: default relative change of the loss rate detected
+#define SEGMENT_RATIO 2.
+//! Segmentation: default maximal number of regimes
+#define SEGMENT_REGIMES 2
+
+/**
+ * Part of a trace considered as stationary
+ */
+struct Segment {
+  uint64_t start;       //!< First packet (multiple of 64)
+  uint64_t length;      //!< Number of packets
+  uint64_t losses;      //!< Number of lost packets (0)
+  unsigned int regime;  //!< Regime of the segment (see Regimes::classify)
+};
+
+/**
+ * Detection of the changes of the loss rate of a trace, in one pass over the loss counts of consecutive windows.
+ * Two one-sided CUSUM of the log-likelihood ratio are run on the windows (binomial model):
+ * the loss rate p0 of the current segment against p0 * ratio and p0 / ratio.
+ * p0 is estimated from the windows of the segment seen so far (self-starting CUSUM).
+ * When a sum exceeds the threshold, the change is placed after the last window where this sum was null,
+ * and a new segment starts there.
+ */
+class ChangeDetector {
+
+  private:
+    //! Number of packets of a window
+    uint32_t window;
+    //! Threshold of the CUSUM (log-likelihood)
+    double threshold;
+    //! Relative change of the loss rate detected
+    double ratio;
+    //! Number of losses of each window
+    std::vector<uint32_t> losses;
+    //! Number of packets of the last window (the others are full)
+    uint32_t last;
+    //! First window of the current segment
+    size_t seg_start;
+    //! Losses in the current segment
+    uint64_t seg_losses;
+    //! Packets in the current segment
+    uint64_t seg_packets;
+    //! CUSUM for an increase of the loss rate
+    double up;
+    //! CUSUM for a decrease of the loss rate
+    double down;
+    //! Window following the last reset of 'up'
+    size_t zero_up;
+    //! Window following the last reset of 'down'
+    size_t zero_down;
+    //! Segments found
+    std::vector<Segment> segs;
+
+    //! Log-likelihood ratio of x losses out of n packets, loss rate p1 against p0
+    static double llr(const uint32_t x, const uint32_t n, const double p0, const double p1);
+
+    /**
+     * Close the current segment and start a new one
+     * @param first First window of the new segment
+     * @param end Window following the last one seen
+     */
+    void split(const size_t first, const size_t end);
+
+    //! Test a window against the current segment, return true if a change is detected
+    bool test(const size_t index);
+
+  public:
+    /**
+     * Create a detector
+     * @param window Number of packets of a window (multiple of 64)
+     * @param threshold Threshold of the CUSUM (log-likelihood, > 0)
+     * @param ratio Relative change of the loss rate detected (> 1)
+     */
+    ChangeDetector(const uint32_t window, const double threshold, const double ratio);
+
+    /**
+     * Add the next window
+     * @param losses Number of lost packets
+     * @param packets Number of packets (less than the window size only for the last one)
+     */
+    void addWindow(const uint32_t losses, const uint32_t packets);
+
+    //! Close the last segment
+    void finish();
+
+    //! Number of packets of a window
+    uint32_t windowSize() const { return window; }
+
+    //! Segments found (after finish)
+    std::vector<Segment>& segments() { return segs; }
+};
+
+/**
+ * Regimes of a trace: classes of segments of similar loss rates, and the transitions between them
+ */
+class Regimes {
+
+  private:
+    //! Loss rate of each regime
+    std::vector<double> rates;
+    //! Number of packets of each regime
+    std::vector<uint64_t> packets;
+    //! Number of segments of each regime
+    std::vector<uint64_t> count;
+    //! Number of transitions between regimes (from * regimes + to)
+    std::vector<uint64_t> transitions;
+
+  public:
+    /**
+     * Classify the segments by loss rate (k-means weighted by the number of packets), then merge the
+     * consecutive segments of a same regime. The regimes are sorted by increasing loss rate, empty ones are dropped.
+     * @param segs Segments, in the order of the trace
+     * @param regimes Maximal number of regimes
+     * @return Number of regimes
+     */
+    unsigned int classify(std::vector<Segment>& segs, const unsigned int regimes);
+
+    //! Number of regimes
+    unsigned int size() const { return (unsigned int) rates.size(); }
+    //! Loss rate of a regime
+    double lossRate(const unsigned int regime) const { return rates[regime]; }
+    //! Number of segments of a regime
+    uint64_t segments(const unsigned int regime) const { return count[regime]; }
+    //! Number of packets of a regime
+    uint64_t length(const unsigned int regime) const { return packets[regime]; }
+
+    /**
+     * Print the regimes, one number per line: number of regimes, then the mean length of the segments (in packets)
+     * and the loss rate (relatively to max_rand) of each regime, then the regime-transition table
+     * (row by row, relatively to max_rand)
+     * @param output Output stream
+     * @param max_rand CLICK_RAND_MAX used by click
+     */
+    void print(std::ostream &output, const uint32_t max_rand) const;
+
+    //! Print the regimes and their transitions in a human readable way
+    void printHuman(std::ostream &output) const;
+
+    /**
+     * Print the segments: first packet, number of packets, regime, one segment per line
+     * @param output Output stream
+     * @param segs Segments (classified)
+     */
+    static void printSegments(std::ostream &output, const std::vector<Segment>& segs);
+};
+
+/**
+ * Options of the segmentation
+ */
+struct segment_options {
+  uint32_t window;      //!< Number of packets of a window
+  double threshold;     //!< Threshold of the CUSUM
+  double ratio;         //!< Relative change of the loss rate detected
+  unsigned int regimes; //!< Maximal number of regimes
+  const char *output;   //!< Output of the regimes, NULL for the standard output
+};
+
+/**
+ * Split the input in stationary segments, group them in regimes and estimate the parameters of each regime
+ * @param input_file Name of the input file, NULL for the standard input
+ * @param opts Options of the segmentation
+ * @param classes Arguments of the classes (argc, argv), '%r' standing for the regime
+ * @param threads Number of threads counting the segments
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @return : 0K : 0, error-code if != 0
+ */
+int read_segmented(const char *input_file, const struct segment_options &opts, const std::vector<std::pair<int, char**> > &classes,
+                   const unsigned int threads, const bool human_readable, const int format, const uint32_t max_rand);
+
+#endif
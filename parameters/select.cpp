@@ -0,0 +1,220 @@
+/** @file select.cpp Implementation of the selection of the order of a Markov chain */
+
+#include "select.h"
+#include "driver.h"
+
+#include <stdlib.h>
+#include <iostream>
+#include <algorithm>
+
+OrderSelection::OrderSelection(const int k, const unsigned int f)
+  : max_order(k), folds(f), transitions(0), trace(NULL), packets(0), filename(NULL), next(0), tasks(0), task(NULL)
+{
+  pthread_mutex_init(&lock, NULL);
+}
+
+OrderSelection::~OrderSelection()
+{
+  std::vector<std::vector<ParamMarckovChain*> >::iterator fold;
+  std::vector<ParamMarckovChain*>::iterator it;
+  for (fold = parts.begin(); fold != parts.end(); ++fold) {
+    for (it = fold->begin(); it != fold->end(); ++it) {
+      if (*it != NULL) {
+        (*it)->clean();
+        delete (*it);
+      }
+    }
+  }
+  for (it = totals.begin(); it != totals.end(); ++it) {
+    if (*it != NULL) {
+      (*it)->clean();
+      delete (*it);
+    }
+  }
+  pthread_mutex_destroy(&lock);
+}
+
+void *
+OrderSelection::worker(void *arg)
+{
+  OrderSelection *s = (OrderSelection *) arg;
+  size_t i;
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    i = s->next++;
+    pthread_mutex_unlock(&s->lock);
+    if (i >= s->tasks) {
+      break;
+    }
+    (s->*(s->task))(i);
+  }
+  return NULL;
+}
+
+void
+OrderSelection::run(void (OrderSelection::*fn)(const size_t), const size_t count, const unsigned int threads)
+{
+  std::vector<pthread_t> ids(std::min((size_t) threads, count));
+  size_t i;
+  task = fn;
+  tasks = count;
+  next = 0;
+  for (i = 0; i < ids.size(); ++i) {
+    if (pthread_create(&ids[i], NULL, worker, this)) {
+      std::cerr << "Unable to create thread" << std::endl;
+      exit(-1);
+    }
+  }
+  for (i = 0; i < ids.size(); ++i) {
+    pthread_join(ids[i], NULL);
+  }
+}
+
+void
+OrderSelection::countFold(const size_t fold)
+{
+  /* Consecutive parts, starting on a word */
+  const uint64_t start = (packets * fold / folds) & ~((uint64_t) 63);
+  const uint64_t end = (fold + 1 == folds) ? packets : ((packets * (fold + 1) / folds) & ~((uint64_t) 63));
+  ParamMarckovChain *chain = parts[0][(size_t) (max_order - 1)];
+  if (fold != 0) {
+    /* Continue the history of the previous fold: every transition is counted once */
+    chain = dynamic_cast<ParamMarckovChain*>(start ? chain->fork(trace[(start >> 6) - 1], 64) : chain->fork(0, 0));
+    parts[fold][(size_t) (max_order - 1)] = chain;
+  }
+  if (end > start) {
+    chain->addBits(trace + (start >> 6), (size_t) (end - start));
+  }
+}
+
+void
+OrderSelection::marginalizeFold(const size_t fold)
+{
+  int order;
+  for (order = max_order - 1; order > 0; --order) {
+    parts[fold][(size_t) (order - 1)] = parts[fold][(size_t) order]->marginalize(NULL);
+  }
+}
+
+void
+OrderSelection::scoreOrder(const size_t index)
+{
+  size_t fold;
+  long double ll = 0;
+  ParamMarckovChain *total = new ParamMarckovChain();
+  total->init((int) index + 1, filename);
+  for (fold = 0; fold < folds; ++fold) {
+    total->merge(parts[fold][index]);
+  }
+  for (fold = 0; fold < folds; ++fold) {
+    ll += parts[fold][index]->heldOutLogLikelihood(*total);
+    /* The counts of the fold are no longer needed */
+    parts[fold][index]->clean();
+    delete parts[fold][index];
+    parts[fold][index] = NULL;
+  }
+  totals[index] = total;
+  scores[index] = ll;
+}
+
+void
+OrderSelection::score(const uint64_t *t, const uint64_t n, const unsigned int threads, const char *f)
+{
+  size_t fold;
+  ParamMarckovChain *base;
+
+  trace = t;
+  packets = n;
+  filename = f;
+  parts.assign(folds, std::vector<ParamMarckovChain*>((size_t) max_order, NULL));
+  totals.assign((size_t) max_order, NULL);
+  scores.assign((size_t) max_order, 0);
+  /* Only the first packets of the trace have no full history */
+  transitions = (packets > (uint64_t) max_order) ? packets - (uint64_t) max_order : 0;
+
+  base = new ParamMarckovChain();
+  base->init(max_order, NULL);
+  parts[0][(size_t) (max_order - 1)] = base;
+  run(&OrderSelection::countFold, folds, threads);
+  run(&OrderSelection::marginalizeFold, folds, threads);
+  run(&OrderSelection::scoreOrder, (size_t) max_order, threads);
+  for (fold = 0; fold < folds; ++fold) {
+    parts[fold].clear();
+  }
+}
+
+int
+OrderSelection::best() const
+{
+  size_t i, best = 0;
+  /* On a tie, the smallest chain */
+  for (i = 1; i < scores.size(); ++i) {
+    if (scores[i] > scores[best]) {
+      best = i;
+    }
+  }
+  return (int) best + 1;
+}
+
+/**
+ * Order of the chains by decreasing score
+ */
+class ScoreOrder {
+  private:
+    //! Scores compared
+    const std::vector<long double>& scores;
+  public:
+    ScoreOrder(const std::vector<long double>& s) : scores(s) {}
+    //! Is the score of a above the one of b (the smallest order first on a tie) ?
+    bool operator()(const size_t a, const size_t b) const {
+      return (scores[a] > scores[b]) || (!(scores[a] < scores[b]) && (a < b));
+    }
+};
+
+void
+OrderSelection::printTable(std::ostream& output) const
+{
+  std::vector<size_t> ranked;
+  size_t i;
+  for (i = 0; i < scores.size(); ++i) {
+    ranked.push_back(i);
+  }
+  std::sort(ranked.begin(), ranked.end(), ScoreOrder(scores));
+  output << "# rank order held-out-log-likelihood per-transition (" << std::dec << transitions << " transitions, "
+         << folds << " folds)" << std::endl;
+  std::streamsize precision = output.precision(15);
+  for (i = 0; i < ranked.size(); ++i) {
+    output << std::dec << (i + 1) << " " << (ranked[i] + 1) << " " << scores[ranked[i]] << " "
+           << (transitions ? scores[ranked[i]] / (long double) transitions : 0) << std::endl;
+  }
+  output.precision(precision);
+}
+
+int
+read_selected(const char *input_file, const int max_order, const unsigned int folds, const char *output,
+              const unsigned int threads, const bool human_readable, const int format, const uint32_t max_rand)
+{
+  std::vector<uint64_t> trace;
+  OrderSelection selection(max_order, folds);
+  ModuleList best;
+  uint64_t packets;
+  int ret;
+
+  ret = read_trace(input_file, &trace, &packets, NULL);
+  if (ret) {
+    return ret;
+  }
+  selection.score(trace.empty() ? NULL : &trace[0], packets, threads, human_readable ? NULL : output);
+  std::vector<uint64_t>().swap(trace);
+
+  if (human_readable) {
+    selection.printTable(std::cout);
+    std::cout << std::endl << "Order " << std::dec << selection.best() << std::endl;
+  } else if (output == NULL) {
+    selection.printTable(std::cerr);
+  } else {
+    selection.printTable(std::cout);
+  }
+  best.push_back(selection.chain(selection.best()));
+  return print_modules(best, human_readable, format, max_rand);
+}
@@ -0,0 +1,124 @@
+#ifndef SELECT_H
+#define SELECT_H
+
+#include "markovchain.h"
+#include <pthread.h>
+#include <ostream>
+#include <vector>
+
+//! Order selection: default highest order tested
+#define SELECT_MAX_ORDER 10
+//! Order selection: default number of folds
+#define SELECT_FOLDS 5
+
+/**
+ * Selection of the order of a Markov chain by cross-validation.
+ * The trace is split in consecutive folds, each counted once at the highest order (in parallel),
+ * the lower orders being derived by marginalization. For each order, every fold is scored by its
+ * log-likelihood under the chain estimated from the other folds (the whole trace minus the fold);
+ * the order with the highest total held-out log-likelihood is selected.
+ */
+class OrderSelection {
+
+  private:
+    //! Highest order tested
+    int max_order;
+    //! Number of folds
+    unsigned int folds;
+    //! Chains of each fold, by order (index: fold, order - 1)
+    std::vector<std::vector<ParamMarckovChain*> > parts;
+    //! Chains of the whole trace, by order (index: order - 1)
+    std::vector<ParamMarckovChain*> totals;
+    //! Held-out log-likelihood of each order (index: order - 1)
+    std::vector<long double> scores;
+    //! Number of transitions scored
+    uint64_t transitions;
+
+    /* Shared by the threads */
+    //! Packets of the trace
+    const uint64_t *trace;
+    //! Number of packets of the trace
+    uint64_t packets;
+    //! Name of the output file of the selected chain
+    const char *filename;
+    //! Next task to run
+    size_t next;
+    //! Number of tasks
+    size_t tasks;
+    //! Protects 'next'
+    pthread_mutex_t lock;
+    //! Task run by the threads
+    void (OrderSelection::*task)(const size_t);
+
+    //! Thread entry point: run tasks until there is no more
+    static void *worker(void *arg);
+
+    /**
+     * Run tasks on a pool of threads
+     * @param fn Task
+     * @param count Number of tasks (the task gets its index)
+     * @param threads Number of threads
+     */
+    void run(void (OrderSelection::*fn)(const size_t), const size_t count, const unsigned int threads);
+
+    //! Count a fold at the highest order
+    void countFold(const size_t fold);
+    //! Derive the lower orders of a fold
+    void marginalizeFold(const size_t fold);
+    //! Sum the folds of an order (index: order - 1) and score them
+    void scoreOrder(const size_t index);
+
+    /* Not copyable */
+    OrderSelection(const OrderSelection&);
+    OrderSelection& operator=(const OrderSelection&);
+
+  public:
+    /**
+     * Create a selection
+     * @param max_order Highest order tested (1..63)
+     * @param folds Number of folds (at least 2)
+     */
+    OrderSelection(const int max_order, const unsigned int folds);
+    ~OrderSelection();
+
+    /**
+     * Count the trace and score all the orders
+     * @param trace Packets (bit i of word j is the packet 64 * j + i)
+     * @param packets Number of packets
+     * @param threads Number of threads
+     * @param filename Name of the output file of the selected chain, NULL for the standard output
+     */
+    void score(const uint64_t *trace, const uint64_t packets, const unsigned int threads, const char *filename);
+
+    //! Order with the highest held-out log-likelihood
+    int best() const;
+
+    /**
+     * Chain of an order, counted on the whole trace, to be finalized and printed (owned by the selection)
+     * @param order Order
+     */
+    ParamMarckovChain* chain(const int order) const { return totals[(size_t) (order - 1)]; }
+
+    /**
+     * Print the orders ranked by held-out log-likelihood: rank, order, log-likelihood, per transition
+     * @param output Destination
+     */
+    void printTable(std::ostream& output) const;
+};
+
+/**
+ * Choose the order of a Markov chain by cross-validation, then print the chain of the best order
+ * @param input_file Name of the input file, NULL for the standard input
+ * @param max_order Highest order tested
+ * @param folds Number of folds
+ * @param output Output of the chain, NULL for the standard output
+ * @param threads Number of threads
+ * @param human_readable Generate output human-readable or not
+ * @param format Format of the non human-readable output (OUTPUT_*)
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @return : 0K : 0, error-code if != 0
+ */
+int read_selected(const char *input_file, const int max_order, const unsigned int folds, const char *output,
+                  const unsigned int threads, const bool human_readable, const int format, const uint32_t max_rand);
+
+#endif
@@ -0,0 +1,120 @@
+/** @file sink.cpp Implementation of the C interface to the parameter modules */
+
+#include "sink.h"
+#include "module.h"
+
+//! Number of 64-bit words buffered before being handed to the module
+#define SINK_WORDS 1024
+
+//! Sink: a module and a block of packed bits not yet handed to it
+struct param_sink {
+  //! Module fed
+  ParamModule *mod;
+  //! Output format
+  int format;
+  //! Packed bits, bit i of word j is the (64 * j + i)-th packet
+  uint64_t words[SINK_WORDS];
+  //! Number of packets in words
+  size_t nbits;
+};
+
+/**
+ * Hand the buffered packets to the module
+ * @param sink Sink
+ * @return Ok: 0, anything else in case of error (error code of the module)
+ */
+static int
+flush(struct param_sink *sink)
+{
+  int ret = 0;
+  if (sink->nbits != 0) {
+    ret = sink->mod->addBits(sink->words, sink->nbits);
+    sink->nbits = 0;
+  }
+  return ret;
+}
+
+struct param_sink *
+param_sink_new(const int argc, char **argv, const int format, const char **error)
+{
+  struct param_sink *sink;
+  ParamModule *mod;
+  if (argc < 1) {
+    *error = "No module specified";
+    return NULL;
+  }
+  mod = ParamModule::create(argv[0]);
+  if (mod == NULL) {
+    *error = "Unknown Module";
+    return NULL;
+  }
+  if (mod->init(argc, argv, false, error)) {
+    delete mod;
+    return NULL;
+  }
+  sink = new param_sink;
+  sink->mod = mod;
+  sink->format = format;
+  sink->nbits = 0;
+  return sink;
+}
+
+int
+param_sink_add(struct param_sink *sink, const int received, uint64_t count)
+{
+  size_t word, shift, n;
+  uint64_t bits;
+  int ret;
+  while (count != 0) {
+    if (sink->nbits == SINK_WORDS * 64) {
+      ret = flush(sink);
+      if (ret) {
+        return ret;
+      }
+    }
+    word = sink->nbits >> 6;
+    shift = sink->nbits & 63;
+    if (shift == 0) {
+      sink->words[word] = 0;
+    }
+    /* Fill the current word */
+    n = 64 - shift;
+    if (count < n) {
+      n = (size_t) count;
+    }
+    if (received) {
+      bits = (n == 64) ? ~((uint64_t) 0) : ((((uint64_t) 1) << n) - 1);
+      sink->words[word] |= bits << shift;
+    }
+    sink->nbits += n;
+    count -= n;
+  }
+  return 0;
+}
+
+int
+param_sink_finish(struct param_sink *sink, const uint32_t max_rand)
+{
+  int ret = flush(sink);
+  if (ret) {
+    return ret;
+  }
+  /* The packets are not kept: the modules needing to read them twice are not supported */
+  if (sink->mod->nextRound()) {
+    return -1;
+  }
+  sink->mod->finalize(max_rand);
+  if (sink->format == PARAM_SINK_BINARY) {
+    return sink->mod->printPacked(max_rand);
+  }
+  sink->mod->printBinary();
+  return 0;
+}
+
+void
+param_sink_free(struct param_sink *sink)
+{
+  sink->mod->clean();
+  delete sink->mod;
+  delete sink;
+}
@@ -0,0 +1,60 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdint.h>
+
+/** @file sink.h C interface to the parameter modules.
+ * Lets C programs (udp-test/extract) feed the packets directly to a ParamModule
+ * instead of writing a trace of 0's and 1's to be parsed again.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Output in the text format (as parseInput)
+#define PARAM_SINK_TEXT 0
+//! Output in the binary format (see paramfile.h)
+#define PARAM_SINK_BINARY 1
+
+//! Opaque sink (a ParamModule and a buffer of packed bits)
+struct param_sink;
+
+/**
+ * Create and initialize a module
+ * @param argc Argument Count
+ * @param argv Argument Vector, argv[0] is the name of the class (as on the parseInput command line)
+ * @param format Format of the output (PARAM_SINK_TEXT or PARAM_SINK_BINARY)
+ * @param error Set to a message in case of error
+ * @return The sink, NULL in case of error
+ */
+struct param_sink *param_sink_new(const int argc, char **argv, const int format, const char **error);
+
+/**
+ * Add identical packets
+ * @param sink Sink
+ * @param received Non-zero if the packets were received, 0 if they were lost
+ * @param count Number of packets
+ * @return Ok: 0, anything else in case of error (error code of the module)
+ */
+int param_sink_add(struct param_sink *sink, const int received, uint64_t count);
+
+/**
+ * Finalize the module and write its output files
+ * @param sink Sink
+ * @param max_rand CLICK_RAND_MAX used by click
+ * @return Ok: 0, anything else in case of error
+ */
+int param_sink_finish(struct param_sink *sink, const uint32_t max_rand);
+
+/**
+ * Clean and free the sink
+ * @param sink Sink
+ */
+void param_sink_free(struct param_sink *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+/** @file sparsecounts.cpp Implementation of the sparse transition counters */
+
+#include "sparsecounts.h"
+
+#include <string.h>
+
+const uint64_t SparseCounts::empty;
+
+SparseCounts::SparseCounts()
+  : mask(SPARSE_INITIAL_SLOTS - 1), used(0)
+{
+  slots = new entry[SPARSE_INITIAL_SLOTS];
+  clear();
+}
+
+SparseCounts::~SparseCounts()
+{
+  delete[] (slots);
+}
+
+void
+SparseCounts::clear()
+{
+  size_t i;
+  if (mask != SPARSE_INITIAL_SLOTS - 1) {
+    delete[] (slots);
+    mask = SPARSE_INITIAL_SLOTS - 1;
+    slots = new entry[SPARSE_INITIAL_SLOTS];
+  }
+  for (i = 0; i <= mask; ++i) {
+    slots[i].state = empty;
+    slots[i].count[0] = 0;
+    slots[i].count[1] = 0;
+  }
+  used = 0;
+}
+
+void
+SparseCounts::grow()
+{
+  size_t i, j;
+  entry *old = slots;
+  const size_t old_size = mask + 1;
+  mask = (old_size << 1) - 1;
+  slots = new entry[mask + 1];
+  for (i = 0; i <= mask; ++i) {
+    slots[i].state = empty;
+    slots[i].count[0] = 0;
+    slots[i].count[1] = 0;
+  }
+  /* Re-insert the used slots */
+  for (i = 0; i < old_size; ++i) {
+    if (old[i].state != empty) {
+      j = hash(old[i].state) & mask;
+      while (slots[j].state != empty) {
+        j = (j + 1) & mask;
+      }
+      memcpy(&slots[j], &old[i], sizeof(entry));
+    }
+  }
+  delete[] (old);
+}
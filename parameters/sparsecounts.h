@@ -0,0 +1,120 @@
+#ifndef SPARSECOUNTS_H
+#define SPARSECOUNTS_H
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <stddef.h>
+
+//! Initial number of slots of a SparseCounts (power of 2)
+#define SPARSE_INITIAL_SLOTS 4096
+
+/**
+ * Counters of the transitions of the visited states of a Markov chain.
+ * Open-addressing hash table (linear probing) keyed by state, for orders where a dense
+ * table of 2^k states would not fit in memory while a trace only visits a few of them.
+ */
+class SparseCounts {
+
+  public:
+    //! Counters of a state
+    struct entry {
+      //! State (SPARSE_EMPTY if the slot is free)
+      uint64_t state;
+      //! Number of failed (0) and successful (1) transmissions in this state
+      uint64_t count[2];
+    };
+
+  private:
+    //! Slots (power of 2)
+    entry *slots;
+    //! Number of slots - 1
+    size_t mask;
+    //! Number of used slots
+    size_t used;
+
+    //! Hash of a state
+    static inline size_t hash(const uint64_t state) {
+      return (size_t) ((state * 0x9E3779B97F4A7C15ULL) >> 20);
+    }
+
+    //! Double the number of slots
+    void grow();
+
+  public:
+    //! Marker of a free slot (not a valid state: states have less than 64 bits)
+    static const uint64_t empty = ~((uint64_t) 0);
+
+    SparseCounts();
+    ~SparseCounts();
+
+    /**
+     * Find the counters of a state, inserting it if needed
+     * @param state State
+     * @return Counters of the state
+     */
+    inline entry* find(const uint64_t state) {
+      size_t i = hash(state) & mask;
+      while (slots[i].state != state) {
+        if (slots[i].state == empty) {
+          if ((used + 1) * 2 > mask + 1) {
+            grow();
+            return find(state);
+          }
+          slots[i].state = state;
+          ++used;
+          break;
+        }
+        i = (i + 1) & mask;
+      }
+      return &slots[i];
+    }
+
+    /**
+     * Find the counters of a state, without inserting it
+     * @param state State
+     * @return Counters of the state, NULL if it was never visited
+     */
+    inline const entry* get(const uint64_t state) const {
+      size_t i = hash(state) & mask;
+      while (slots[i].state != state) {
+        if (slots[i].state == empty) {
+          return NULL;
+        }
+        i = (i + 1) & mask;
+      }
+      return &slots[i];
+    }
+
+    /**
+     * Count one transition
+     * @param state State before the transition
+     * @param input True if the packet was received, False if it wasn't
+     */
+    inline void increment(const uint64_t state, const bool input) {
+      ++(find(state)->count[input]);
+    }
+
+    /**
+     * Count several transitions
+     * @param state State before the transitions
+     * @param input True if the packets were received, False if they weren't
+     * @param nb Number of transitions
+     */
+    inline void add(const uint64_t state, const bool input, const uint64_t nb) {
+      find(state)->count[input] += nb;
+    }
+
+    //! Number of visited states
+    size_t size() const { return used; }
+
+    //! Number of slots, for iteration
+    size_t capacity() const { return mask + 1; }
+
+    //! Slot, for iteration (free if its state is 'empty')
+    const entry& slot(const size_t i) const { return slots[i]; }
+
+    //! Forget all the states (and release the memory)
+    void clear();
+};
+
+#endif
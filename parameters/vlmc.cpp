@@ -0,0 +1,298 @@
+/** @file vlmc.cpp Implementation of the variable-order Markov chain parameter generation module */
+
+#include "vlmc.h"
+#include "paramwriter.h"
+
+#include <stdlib.h>
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+
+const char * const ParamVLMC::baddepth = "The depth needs to be in 1..63 (-d option)";
+const char * const ParamVLMC::badthreshold = "The pruning threshold needs to be a positive number (-t option)";
+const char * const ParamVLMC::toomanynodes = "Too many contexts for 32-bit node indexes, use a smaller depth (-d option)";
+
+//! Number of nodes allocated at once in the pool
+#define VLMC_POOL_STEP 65536
+
+ParamVLMC::ParamVLMC()
+  : depth(VLMC_DEFAULT_DEPTH), threshold(VLMC_DEFAULT_THRESHOLD), history(0), seen(0), tree_depth(0),
+    output_filename(NULL)
+{
+}
+
+int
+ParamVLMC::init(const int argc, char **argv, const bool human_readable, const char** err)
+{
+  int opt, d;
+  char *end;
+  optind = 1;
+  depth = VLMC_DEFAULT_DEPTH;
+  threshold = VLMC_DEFAULT_THRESHOLD;
+  output_filename = NULL;
+  while((opt = getopt(argc, argv, "d:t:o:")) != -1) {
+    switch(opt) {
+      case 'd':
+        d = atoi(optarg);
+        if ((d <= 0) || (d >= 64)) {
+          *err = baddepth;
+          return -1;
+        }
+        depth = (unsigned int) d;
+        break;
+      case 't':
+        threshold = strtod(optarg, &end);
+        if ((*end != '\0') || !(threshold >= 0)) {
+          *err = badthreshold;
+          return -1;
+        }
+        break;
+      case 'o':
+        output_filename = optarg;
+        break;
+      default:
+        *err = unknownOption;
+        return opt;
+    }
+  }
+  if(argc > optind) {
+    *err = tooMuchOption;
+    return argc;
+  }
+  history = 0;
+  seen = 0;
+  pool.reserve(VLMC_POOL_STEP);
+  pool.resize(1);
+  pool[0].child[0] = 0;
+  pool[0].child[1] = 0;
+  pool[0].count[0] = 0;
+  pool[0].count[1] = 0;
+  return 0;
+}
+
+void
+ParamVLMC::clean()
+{
+  std::vector<count_node>().swap(pool);
+  tree.clear();
+}
+
+int
+ParamVLMC::addChar(const bool in)
+{
+  unsigned int level;
+  uint32_t node = 0, next;
+  bool older;
+  ++pool[0].count[in];
+  /* Count the packet in all the contexts matching the history, from the shortest */
+  for (level = 0; level < seen; ++level) {
+    older = (history >> level) & 1;
+    next = pool[node].child[older];
+    if (next == 0) {
+      if (pool.size() > UINT32_MAX) {
+        std::cerr << toomanynodes << std::endl;
+        return -1;
+      }
+      if (pool.size() == pool.capacity()) {
+        pool.reserve(pool.size() + (pool.size() >> 1));
+      }
+      next = (uint32_t) pool.size();
+      pool.resize(pool.size() + 1);
+      pool[next].child[0] = 0;
+      pool[next].child[1] = 0;
+      pool[next].count[0] = 0;
+      pool[next].count[1] = 0;
+      pool[node].child[older] = next;
+    }
+    node = next;
+    ++pool[node].count[in];
+  }
+  history = (history << 1) | (in ? 1 : 0);
+  if (seen < depth) {
+    ++seen;
+  }
+  return 0;
+}
+
+int
+ParamVLMC::addBits(const uint64_t *words, const size_t nbits)
+{
+  size_t i;
+  int ret;
+  for (i = 0; i < nbits; ++i) {
+    ret = addChar(bitAt(words, i));
+    if (ret) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+bool
+ParamVLMC::nextRound()
+{
+  return false;
+}
+
+bool
+ParamVLMC::prune(const uint32_t node, const uint64_t parent[2])
+{
+  unsigned int b;
+  uint32_t child;
+  uint64_t counts[2] = { pool[node].count[0], pool[node].count[1] };
+  long double total, parent_total, gain = 0, p, q;
+
+  for (b = 0; b < 2; ++b) {
+    child = pool[node].child[b];
+    if ((child != 0) && prune(child, counts)) {
+      pool[node].child[b] = 0;
+    }
+  }
+  if ((pool[node].child[0] != 0) || (pool[node].child[1] != 0)) {
+    return false;
+  }
+  /* Leaf: keep it only if it differs enough from its parent */
+  total = ((long double) counts[0]) + ((long double) counts[1]);
+  parent_total = ((long double) parent[0]) + ((long double) parent[1]);
+  for (b = 0; b < 2; ++b) {
+    if (counts[b] != 0) {
+      p = ((long double) counts[b]) / total;
+      q = ((long double) parent[b]) / parent_total;
+      gain += ((long double) counts[b]) * logl(p / q);
+    }
+  }
+  return gain < threshold;
+}
+
+uint32_t
+ParamVLMC::flatten(const uint32_t node, const unsigned int level, const uint32_t max_rand)
+{
+  unsigned int b;
+  uint32_t child;
+  const uint32_t index = (uint32_t) tree.size();
+  const uint64_t total = pool[node].count[0] + pool[node].count[1];
+
+  tree.resize(tree.size() + 1);
+  tree[index].count = total;
+  if (pool[node].count[1] == 0) {
+    tree[index].probability = 0;
+  } else {
+    tree[index].probability = (uint32_t) (((long double) pool[node].count[1]) / ((long double) total) * max_rand);
+  }
+  if (level > tree_depth) {
+    tree_depth = level;
+  }
+  for (b = 0; b < 2; ++b) {
+    child = pool[node].child[b];
+    /* 'tree' may be reallocated by the recursion */
+    child = (child == 0) ? 0 : flatten(child, level + 1, max_rand);
+    tree[index].child[b] = child;
+  }
+  return index;
+}
+
+void
+ParamVLMC::finalize(const uint32_t max_rand)
+{
+  unsigned int b;
+  uint32_t child;
+  /* The root is always kept, its children are compared to it */
+  for (b = 0; b < 2; ++b) {
+    child = pool[0].child[b];
+    if ((child != 0) && prune(child, pool[0].count)) {
+      pool[0].child[b] = 0;
+    }
+  }
+  tree.clear();
+  tree_depth = 0;
+  flatten(0, 0, max_rand);
+  /* The counts are no longer needed */
+  std::vector<count_node>().swap(pool);
+}
+
+//! Try to write something to output and detect any error
+#define WRITE(x)                                             \
+  *output << x << std::endl;                                 \
+  if (output->bad()) {                                       \
+    std::cerr << "error when writing to output" <<std::endl; \
+    exit (-1);;                                              \
+  }
+//"
+
+void
+ParamVLMC::printBinary()
+{
+  std::ostream *output;
+  std::ofstream *output_f;
+  std::vector<tree_node>::const_iterator it;
+  std::string output_name;
+  if (output_filename == NULL ) {
+    output_f = NULL;
+    output = &std::cout;
+  } else {
+    output_name = paramfile_output(output_filename);
+    output_f = new std::ofstream(output_name.c_str());
+    output = output_f;
+  }
+  /* Number of nodes, depth, then (child 0, child 1, probability) for each node, the root first */
+  WRITE(tree.size())
+  WRITE(tree_depth)
+  for (it = tree.begin(); it != tree.end(); ++it) {
+    WRITE(it->child[0])
+    WRITE(it->child[1])
+    WRITE(it->probability)
+  }
+  if (output_f != NULL ) {
+    output_f->close();
+    delete (output_f);
+    if (paramfile_replace(output_filename, output_name)) {
+      std::cerr << "Unable to replace " << output_filename << std::endl;
+      exit(-1);
+    }
+  }
+}
+
+int
+ParamVLMC::printPacked(const uint32_t max_rand)
+{
+  std::vector<tree_node>::const_iterator it;
+  ParamWriter writer(PARAMFILE_VLMC, max_rand, tree.size());
+  writer.setMarkov(tree_depth, 0, 0);
+  for (it = tree.begin(); it != tree.end(); ++it) {
+    writer.addU32(it->child[0]);
+    writer.addU32(it->child[1]);
+    writer.addU32(it->probability);
+  }
+  if (writer.write(output_filename)) {
+    std::cerr << "error when writing to output" << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+void
+ParamVLMC::printContexts(const uint32_t node, std::string& context, const uint32_t max_rand) const
+{
+  unsigned int b;
+  const tree_node& n = tree[node];
+  std::cout << "- '" << context << "' (" << std::dec << n.count << " packets): 0x%" << std::hex << n.probability
+            << " (" << ((long double) n.probability / ((long double) max_rand)) * 100 << "%)" << std::endl;
+  for (b = 0; b < 2; ++b) {
+    if (n.child[b] != 0) {
+      context.push_back(b ? '1' : '0');
+      printContexts(n.child[b], context, max_rand);
+      context.erase(context.size() - 1);
+    }
+  }
+}
+
+void
+ParamVLMC::printHuman(const uint32_t max_rand)
+{
+  std::string context;
+  std::cout << "(MaxRand: 0x" << std::hex << max_rand << ")" << std::endl;
+  std::cout << "Contexts: " << std::dec << tree.size() << " (depth " << tree_depth << ", at most " << depth << ")" << std::endl;
+  std::cout << "Probability of success of transmission after the context (most recent packet first):" << std::endl;
+  printContexts(0, context, max_rand);
+}
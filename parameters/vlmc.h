@@ -0,0 +1,114 @@
+#ifndef VLMC_H
+#define VLMC_H
+
+#include "module.h"
+#include <string>
+#include <vector>
+
+/**
+ * Default maximal depth of the context tree
+ */
+#define VLMC_DEFAULT_DEPTH 16
+
+/**
+ * Default pruning threshold: half the 95% quantile of the chi-square distribution with 1 degree of freedom
+ */
+#define VLMC_DEFAULT_THRESHOLD 1.92
+
+/**
+ * Extract a variable-order Markov chain (context tree) representation.
+ * The probability of success depends on the longest context of the tree matching the last packets.
+ * All the contexts up to the maximal depth are counted in one pass, then the tree is pruned:
+ * a context is removed when it does not bring more than the threshold over its parent
+ * (number of observations times Kullback-Leibler divergence of its distribution from the parent's).
+ */
+class ParamVLMC : public ParamModule {
+
+  public:
+    //! Node of the final (pruned) tree
+    struct tree_node {
+      //! Index of the children (0 if none, the root is never a child): context extended by an older lost (0) or received (1) packet
+      uint32_t child[2];
+      //! Probability, relatively to rand_max, to have a success in this context
+      uint32_t probability;
+      //! Number of observations of this context
+      uint64_t count;
+    };
+
+  private:
+    //! Node of the counting tree, allocated in 'pool'
+    struct count_node {
+      //! Index of the children in 'pool' (0 if none)
+      uint32_t child[2];
+      //! Number of failed (0) and successful (1) transmissions after this context
+      uint64_t count[2];
+    };
+
+    //! Maximal depth of the tree
+    unsigned int depth;
+    //! Pruning threshold (in nats)
+    double threshold;
+    //! Last packets, the most recent one being the LSB
+    uint64_t history;
+    //! Number of packets in 'history' (at most depth)
+    unsigned int seen;
+    //! Counting tree (the root is pool[0])
+    std::vector<count_node> pool;
+    //! Pruned tree, in depth-first order (the root is tree[0])
+    std::vector<tree_node> tree;
+    //! Depth of the pruned tree
+    unsigned int tree_depth;
+    //! File which will contain the generated parameters
+    const char *output_filename;
+
+    /**
+     * Prune the subtree of a node
+     * @param node Index of the node in 'pool'
+     * @param parent Counts of its parent
+     * @return True if the node itself can be removed
+     */
+    bool prune(const uint32_t node, const uint64_t parent[2]);
+
+    /**
+     * Copy a pruned subtree of 'pool' to 'tree'
+     * @param node Index of the node in 'pool'
+     * @param level Depth of the node
+     * @param max_rand CLICK_RAND_MAX used by click
+     * @return Index of the node in 'tree'
+     */
+    uint32_t flatten(const uint32_t node, const unsigned int level, const uint32_t max_rand);
+
+    /**
+     * Print the contexts of a subtree
+     * @param node Index of the node in 'tree'
+     * @param context Context of the node, most recent packet first
+     * @param max_rand CLICK_RAND_MAX used by click
+     */
+    void printContexts(const uint32_t node, std::string& context, const uint32_t max_rand) const;
+
+  public:
+    ParamVLMC();
+
+    /* Methodes of ParamModule */
+    int init(const int, char **, const bool, const char**);
+    void clean();
+    int addChar(const bool);
+    int addBits(const uint64_t *, const size_t);
+    bool nextRound();
+    void finalize(const uint32_t);
+    void printBinary();
+    int printPacked(const uint32_t);
+    void printHuman(const uint32_t);
+
+    //! Error message: The depth is out of range
+    static const char * const baddepth;
+    //! Error message: The threshold is not a positive number
+    static const char * const badthreshold;
+    //! Error message: The contexts do not fit in 32-bit node indexes
+    static const char * const toomanynodes;
+
+    //! Name of this module
+    static const char* name() { return "vlmc"; }
+};
+
+#endif
@@ -104,7 +104,34 @@ BasicOnOffChannel::load_cdf_from_file(const char *filename, std::vector<CDFPoint
   uint32_t buffer;
   uint32_t len;
   CDFPoint point;
-  
+  struct paramfile_header header;
+  ParamFile file;
+  int ret;
+
+  /* Binary format: the pairs are read from the mapped file, without parsing */
+  ret = file.open(filename, &header);
+  if (ret == 0) {
+    const unsigned char *payload = file.payload();
+    uint64_t i;
+    if (header.type != PARAMFILE_CDF) {
+      return -2;
+    }
+    dist.reserve((size_t) header.count);
+    for (i = 0; i < header.count; ++i) {
+      buffer = paramfile_get_u32(payload + 8 * i);
+      if (buffer > INT_MAX) {
+        dist.clear();
+        return -4;
+      }
+      point.point = (int) buffer;
+      point.probability = paramfile_get_u32(payload + 8 * i + 4);
+      dist.push_back(point);
+    }
+    return 0;
+  } else if (ret != -1) {
+    return ret;
+  }
+
   std::ifstream ff;
   ff.open(filename);
   if (ff.fail()) {
@@ -4,9 +4,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <algorithm>
 
 const char * const MarkovChainChannel::needfiles = "MarckChain needs 1 intput files";
 
+/* Highest order with a specialized generation loop */
+#define GENERATE_KERNEL_ORDER 24
+
+/* Generate 64 packets (the first one in the LSB) with the order known at compile time */
+template <unsigned int K>
+static uint64_t
+generate_word(const uint32_t *probabilities, uint64_t *state, TestRandom& rand)
+{
+  const uint64_t mask = (((uint64_t) 1) << K) - 1;
+  uint64_t word = 0, current = *state, transmit;
+  unsigned int i;
+  for (i = 0; i < 64; ++i) {
+    transmit = (rand.random() < probabilities[current]) ? 1 : 0;
+    word |= transmit << i;
+    current = ((current << 1) | transmit) & mask;
+  }
+  *state = current;
+  return word;
+}
+
+const MarkovChainChannel::GenerateKernel MarkovChainChannel::kernels[GENERATE_KERNEL_ORDER + 1] = {
+  NULL,
+  &generate_word<1>,  &generate_word<2>,  &generate_word<3>,  &generate_word<4>,  &generate_word<5>,  &generate_word<6>,
+  &generate_word<7>,  &generate_word<8>,  &generate_word<9>,  &generate_word<10>, &generate_word<11>, &generate_word<12>,
+  &generate_word<13>, &generate_word<14>, &generate_word<15>, &generate_word<16>, &generate_word<17>, &generate_word<18>,
+  &generate_word<19>, &generate_word<20>, &generate_word<21>, &generate_word<22>, &generate_word<23>, &generate_word<24>
+};
+
 int
 MarkovChainChannel::configure(const int argc, char **argv, const char** err)
 {
@@ -40,7 +69,24 @@ MarkovChainChannel::initialize(TestRandom& rand)
   char buf[UINT32_SIZE_IN_DEC + 1];
   uint32_t buffer;
   uint32_t len;
-  
+  struct paramfile_header header;
+  int ret;
+
+  _kernel = NULL;
+  _buffered = 0;
+
+  /* Binary format, mapped */
+  ret = _file.open(filename, &header);
+  if (ret == 0) {
+    ret = initializeBinary(header);
+    if (ret == 0) {
+      selectKernel();
+    }
+    return ret;
+  } else if (ret != -1) {
+    return ret;
+  }
+
   std::ifstream ff;
   ff.open(filename);
   if (ff.fail()) {
@@ -50,12 +96,23 @@ MarkovChainChannel::initialize(TestRandom& rand)
   if (ff.fail() || (sscanf(buf, "%"SCNu32, &len) != 1)) {
     return -2;
   }
+
+  /* A length of 0 introduces the sparse representation */
+  _sparse = (len == 0);
+  if (_sparse) {
+    ret = initializeSparse(ff);
+    ff.close();
+    _sparse_states = _sparse_state_list.empty() ? NULL : &_sparse_state_list[0];
+    _sparse_probabilities = _sparse_probability_list.empty() ? NULL : &_sparse_probability_list[0];
+    _sparse_length = _sparse_state_list.size();
+    return ret;
+  }
   
   _success_probablilty.reserve(len);
   _state_modulo = len;
   
   ff.getline(buf, UINT32_SIZE_IN_DEC + 1);
-  if (ff.fail() || (sscanf(buf, "%"SCNu32, &_current_state) != 1)) {
+  if (ff.fail() || (sscanf(buf, "%"SCNu64, &_current_state) != 1)) {
     return -3;
   }
   
@@ -70,6 +127,123 @@ MarkovChainChannel::initialize(TestRandom& rand)
     _success_probablilty.push_back(buffer);
   }
   ff.close();
+  _probabilities = &_success_probablilty[0];
+  selectKernel();
+  return 0;
+}
+
+void
+MarkovChainChannel::selectKernel()
+{
+  unsigned int k;
+  _kernel = NULL;
+  _buffered = 0;
+  if (_sparse) {
+    return;
+  }
+  /* Only for 2^k states */
+  for (k = 1; k <= GENERATE_KERNEL_ORDER; ++k) {
+    if (_state_modulo == (((uint64_t) 1) << k)) {
+      _kernel = kernels[k];
+      return;
+    }
+  }
+}
+
+int
+MarkovChainChannel::initializeBinary(const struct paramfile_header& header)
+{
+  const unsigned char *payload = _file.payload();
+  uint64_t i;
+
+  if ((header.order == 0) || (header.order >= 64)) {
+    return -2;
+  }
+  _state_modulo = ((uint64_t) 1) << header.order;
+  _current_state = header.initial_state % _state_modulo;
+  _sparse = (header.type == PARAMFILE_MARKOV_SPARSE);
+  if (_sparse) {
+    _default_probability = header.default_probability;
+    _sparse_length = header.count;
+    if (paramfile_host_le()) {
+      _sparse_states = (const uint64_t *) (const void *) payload;
+      _sparse_probabilities = (const uint32_t *) (const void *) (payload + 8 * header.count);
+    } else {
+      _sparse_state_list.resize((size_t) header.count);
+      _sparse_probability_list.resize((size_t) header.count);
+      for (i = 0; i < header.count; ++i) {
+        _sparse_state_list[(size_t) i] = paramfile_get_u64(payload + 8 * i);
+        _sparse_probability_list[(size_t) i] = paramfile_get_u32(payload + 8 * header.count + 4 * i);
+      }
+      _sparse_states = _sparse_state_list.empty() ? NULL : &_sparse_state_list[0];
+      _sparse_probabilities = _sparse_probability_list.empty() ? NULL : &_sparse_probability_list[0];
+      _file.close();
+    }
+  } else if (header.type == PARAMFILE_MARKOV) {
+    if (header.count != _state_modulo) {
+      return -3;
+    }
+    if (paramfile_host_le()) {
+      _probabilities = (const uint32_t *) (const void *) payload;
+    } else {
+      _success_probablilty.resize((size_t) header.count);
+      for (i = 0; i < header.count; ++i) {
+        _success_probablilty[(size_t) i] = paramfile_get_u32(payload + 4 * i);
+      }
+      _probabilities = &_success_probablilty[0];
+      _file.close();
+    }
+  } else {
+    return -3;
+  }
+  return 0;
+}
+
+int
+MarkovChainChannel::initializeSparse(std::ifstream& ff)
+{
+  #define UINT64_SIZE_IN_DEC 20
+  char buf[UINT64_SIZE_IN_DEC + 1];
+  uint32_t k, buffer;
+  uint64_t len, state;
+
+  _sparse_state_list.clear();
+  _sparse_probability_list.clear();
+
+  /* k, initial state, probability of the states not listed, number of listed states */
+  ff.getline(buf, UINT64_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%"SCNu32, &k) != 1) || (k == 0) || (k >= 64)) {
+    return -2;
+  }
+  _state_modulo = ((uint64_t) 1) << k;
+  ff.getline(buf, UINT64_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%"SCNu64, &_current_state) != 1)) {
+    return -3;
+  }
+  ff.getline(buf, UINT64_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%"SCNu32, &_default_probability) != 1)) {
+    return -3;
+  }
+  ff.getline(buf, UINT64_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%"SCNu64, &len) != 1)) {
+    return -3;
+  }
+
+  /* (state, probability) pairs */
+  while (len != 0) {
+    --len;
+    ff.getline(buf, UINT64_SIZE_IN_DEC + 1);
+    /* The states are sorted, for the binary search */
+    if (ff.fail() || (sscanf(buf, "%"SCNu64, &state) != 1) || ((!_sparse_state_list.empty()) && (state <= _sparse_state_list.back()))) {
+      return -4;
+    }
+    ff.getline(buf, UINT64_SIZE_IN_DEC + 1);
+    if (ff.fail() || (sscanf(buf, "%"SCNu32, &buffer) != 1)) {
+      return -4;
+    }
+    _sparse_state_list.push_back(state);
+    _sparse_probability_list.push_back(buffer);
+  }
   return 0;
 }
 
@@ -77,13 +251,35 @@ void
 MarkovChainChannel::cleanup()
 {
   _success_probablilty.clear();
+  _sparse_state_list.clear();
+  _sparse_probability_list.clear();
+  _file.close();
 }
 
 int
 MarkovChainChannel::generate ()
 {
+  /* Specialized loop: packets generated in advance */
+  if (_kernel != NULL) {
+    if (_buffered == 0) {
+      _buffer = _kernel(_probabilities, &_current_state, myRand);
+      _buffered = 64;
+    }
+    --_buffered;
+    const int transmit = (int) (_buffer & 1);
+    _buffer >>= 1;
+    return transmit;
+  }
+
   /* Evaluate the transmission */
-  bool transmit = myRand.random() < _success_probablilty[_current_state];
+  uint32_t probability;
+  if (_sparse) {
+    const uint64_t *it = std::lower_bound(_sparse_states, _sparse_states + _sparse_length, _current_state);
+    probability = ((it == _sparse_states + _sparse_length) || (*it != _current_state)) ? _default_probability : _sparse_probabilities[it - _sparse_states];
+  } else {
+    probability = _probabilities[_current_state];
+  }
+  bool transmit = myRand.random() < probability;
   
   /* Update the state */
   _current_state = ((_current_state << 1) + transmit) % _state_modulo;
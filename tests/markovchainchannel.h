@@ -11,19 +11,47 @@ class MarkovChainChannel : public TestModule {
   private:
     /* Variables used to store the statistic representation from the configuration files */
     std::vector<uint32_t> _success_probablilty;
+    /* Sparse representation (high orders): visited states (sorted), and probability of the others */
+    bool _sparse;
+    std::vector<uint64_t> _sparse_state_list;
+    std::vector<uint32_t> _sparse_probability_list;
+    uint32_t _default_probability;
+
+    /* Binary files are used in place (little-endian hosts), the tables point either to the file or to the vectors */
+    ParamFile _file;
+    const uint32_t *_probabilities;
+    const uint64_t *_sparse_states;
+    const uint32_t *_sparse_probabilities;
+    uint64_t _sparse_length;
 
     /* FileDescriptor */
     const char* filename;
 
     /* Current state description */
-    uint32_t _current_state;
-    uint32_t _state_modulo;
+    uint64_t _current_state;
+    uint64_t _state_modulo;
 
     TestRandom myRand;
 
     /* Configuration */
     static const char * const needfiles;
 
+    /* Dense chains of order 1..GENERATE_KERNEL_ORDER: the packets are generated 64 at a time
+       by a loop specialized for the order (the state is masked, no modulo) */
+    typedef uint64_t (*GenerateKernel)(const uint32_t *, uint64_t *, TestRandom&);
+    static const GenerateKernel kernels[];
+    GenerateKernel _kernel;
+    uint64_t _buffer;
+    unsigned int _buffered;
+
+    /* Use the specialized loop if the chain allows it */
+    void selectKernel();
+
+    /* Read the sparse representation, after its first line */
+    int initializeSparse(std::ifstream&);
+    /* Use a binary parameter file */
+    int initializeBinary(const struct paramfile_header&);
+
   public:
 
     /* Configure the Element */
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <iostream>
 #include <fstream>
+#include "../parameters/paramfile.h"
 
 class TestRandom {
   private:
@@ -19,6 +20,27 @@ class TestRandom {
   
 };
 
+/* Binary parameter file (see paramfile.h), mapped in memory */
+class ParamFile {
+  private:
+    unsigned char *_data;
+    size_t _size;
+
+    /* Not copyable (the mapping belongs to one object) */
+    ParamFile(const ParamFile&);
+    ParamFile& operator=(const ParamFile&);
+
+  public:
+    ParamFile() : _data(NULL), _size(0) {}
+    ~ParamFile() { close(); }
+
+    /* Map and check a file: 0 if it's a binary parameter file, -1 if it isn't (text format), < -1 on error */
+    int open(const char *, struct paramfile_header *);
+    /* Payload of the file, valid until close */
+    const unsigned char *payload() const { return _data + PARAMFILE_HEADER_SIZE; }
+    void close();
+};
+
 class TestModule {
 
   protected:
@@ -0,0 +1,206 @@
+#include "mtachannel.h"
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+
+const struct option MTAChannel::long_options[] = {
+  {"free",        required_argument, 0,  'f' },
+  {"err",         required_argument, 0,  'r' },
+  {"markov",      required_argument, 0,  'm' },
+  {NULL,                          0, 0,   0  }
+};
+
+const char * const MTAChannel::needfiles  = "MTA needs 3 intput files";
+
+/* Families of distributions, see parameters/burstfit.h */
+#define FAMILY_GEOMETRIC 1
+#define FAMILY_WEIBULL 2
+#define FAMILY_PARETO 3
+#define FAMILY_LOGNORMAL 4
+#define FAMILY_GEOMETRIC_MIXTURE 5
+
+/* Number of parameters of each family */
+static const unsigned int family_parameters[] = { 0, 1, 2, 1, 2, 3 };
+
+/* Longest burst generated */
+#define MAX_LENGTH 4294967295.0
+
+int
+MTAChannel::configure(const int argc, char **argv, const char** err)
+{
+  int opt;
+  optind = 1;
+  char *markov_file = NULL;
+  _error_free_filename = NULL;
+  _error_filename = NULL;
+  while((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+    switch(opt) {
+      case 'f':
+        _error_free_filename = optarg;
+        break;
+      case 'r':
+        _error_filename = optarg;
+        break;
+      case 'm':
+        markov_file = optarg;
+        break;
+      default:
+        *err = unknownOption;
+        return opt;
+    }
+  }
+
+  if(argc > optind) {
+    *err = tooMuchOption;
+    return argc;
+  }
+
+  if ((_error_free_filename == NULL) || (_error_filename == NULL) || (markov_file == NULL)) {
+    *err = needfiles;
+    return -1;
+  }
+
+  markov.configure(markov_file);
+  return 0;
+}
+
+int
+MTAChannel::load_distribution_from_file(const char *filename, Distribution &dist)
+{
+  #define DOUBLE_SIZE_IN_DEC 32
+  char buf[DOUBLE_SIZE_IN_DEC + 1];
+  uint32_t count, i;
+  uint64_t bits;
+  struct paramfile_header header;
+  ParamFile file;
+  int ret;
+
+  /* Binary format: family in the order field, then the parameters as doubles */
+  ret = file.open(filename, &header);
+  if (ret == 0) {
+    if ((header.type != PARAMFILE_DISTRIBUTION) || (header.order == 0) || (header.order > FAMILY_GEOMETRIC_MIXTURE)
+        || (header.count != family_parameters[header.order])) {
+      return -2;
+    }
+    dist.family = header.order;
+    for (i = 0; i < header.count; ++i) {
+      bits = paramfile_get_u64(file.payload() + 8 * i);
+      memcpy(&dist.params[i], &bits, sizeof(bits));
+    }
+    return 0;
+  } else if (ret != -1) {
+    return ret;
+  }
+
+  /* Text format: family, number of parameters, parameters */
+  std::ifstream ff;
+  ff.open(filename);
+  if (ff.fail()) {
+    return -1;
+  }
+  ff.getline(buf, DOUBLE_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%"SCNu32, &dist.family) != 1) || (dist.family == 0) || (dist.family > FAMILY_GEOMETRIC_MIXTURE)) {
+    return -2;
+  }
+  ff.getline(buf, DOUBLE_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%"SCNu32, &count) != 1) || (count != family_parameters[dist.family])) {
+    return -3;
+  }
+  for (i = 0; i < count; ++i) {
+    ff.getline(buf, DOUBLE_SIZE_IN_DEC + 1);
+    if (ff.fail() || (sscanf(buf, "%lf", &dist.params[i]) != 1)) {
+      return -4;
+    }
+  }
+  return 0;
+}
+
+double
+MTAChannel::uniform()
+{
+  /* TestRandom draws in [0, 2^31) */
+  return (((double) myRand.random()) + 0.5) / 2147483648.0;
+}
+
+uint64_t
+MTAChannel::sample(const Distribution &dist)
+{
+  double length, q;
+  switch (dist.family) {
+    case FAMILY_GEOMETRIC:
+    case FAMILY_GEOMETRIC_MIXTURE:
+      if (dist.family == FAMILY_GEOMETRIC) {
+        q = dist.params[0];
+      } else {
+        q = (uniform() < dist.params[0]) ? dist.params[1] : dist.params[2];
+      }
+      length = (q > 0) ? 1 + floor(log(uniform()) / log(q)) : 1;
+      break;
+    case FAMILY_WEIBULL:
+      length = ceil(dist.params[0] * pow(-log(uniform()), 1 / dist.params[1]));
+      break;
+    case FAMILY_PARETO:
+      length = floor(pow(uniform(), -1 / dist.params[0]));
+      break;
+    case FAMILY_LOGNORMAL:
+      /* Box-Muller */
+      length = ceil(exp(dist.params[0] + dist.params[1] * sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform())));
+      break;
+    default:
+      length = 1;
+  }
+  if (!(length >= 1)) {
+    return 1;
+  } else if (length > MAX_LENGTH) {
+    return (uint64_t) MAX_LENGTH;
+  }
+  return (uint64_t) length;
+}
+
+int
+MTAChannel::initialize(TestRandom& rand)
+{
+  myRand = rand;
+
+  /* Initialize state: start by an error-free burst */
+  _remaining_length_in_state = 0;
+  _current_state = false;
+
+  return (load_distribution_from_file(_error_filename, _error_burst_length)
+          || load_distribution_from_file(_error_free_filename, _error_free_burst_length)
+          || markov.initialize(rand));
+}
+
+void
+MTAChannel::cleanup()
+{
+  markov.cleanup();
+}
+
+int
+MTAChannel::generate ()
+{
+  /* Evaluate the remaining time if we need to */
+  if (_remaining_length_in_state == 0) {
+    _current_state = !_current_state;
+    if (_current_state) {
+      _remaining_length_in_state = sample(_error_free_burst_length);
+    } else {
+      _remaining_length_in_state = sample(_error_burst_length);
+    }
+  }
+
+  /* Decrease the remaining length in current state/sub-state */
+  --_remaining_length_in_state;
+
+  /* Error-free bursts transmit, the error bursts follow the Markov chain */
+  if (_current_state) {
+    return 1;
+  } else {
+    return markov.generate();
+  }
+}
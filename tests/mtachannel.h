@@ -0,0 +1,61 @@
+#ifndef CLICK_MTACHANNEL_HH
+#define CLICK_MTACHANNEL_HH
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include "module.h"
+#include "markovchainchannel.h"
+
+class MTAChannel : public TestModule {
+
+  private:
+
+    /* Parametric distribution of burst lengths (see parameters/burstfit.h): family, then its parameters */
+    class Distribution {
+      public:
+        uint32_t family;
+        double params[3];
+    };
+
+    Distribution _error_free_burst_length;
+    Distribution _error_burst_length;
+    MarkovChainChannel markov;
+
+    const char *_error_filename;
+    const char *_error_free_filename;
+
+    /* Load a distribution from a file */
+    int load_distribution_from_file(const char *, Distribution&);
+
+    /* Uniform random number in (0,1) */
+    double uniform();
+
+    /* Draw a burst length, in O(1) */
+    uint64_t sample(const Distribution&);
+
+    /* Current state description */
+    bool _current_state;  // True if error-free, false if error
+    uint64_t _remaining_length_in_state;
+
+    TestRandom myRand;
+
+    static const char * const needfiles;
+    static const struct option long_options[];
+
+  public:
+
+    /* Configure the Element */
+    int configure(const int, char **, const char**);
+
+    /* Initialize/cleanup the Element, called after the configure */
+    int initialize(TestRandom&);
+    void cleanup();
+
+    /* receive packet from above */
+    int generate();
+
+    /* name */
+    static const char* name() { return "mta"; }
+};
+
+#endif
@@ -6,12 +6,17 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <fstream>
 
 #include "markovchainchannel.h"
 #include "basiconoffchannel.h"
 #include "basicmtachannel.h"
+#include "vlmcchannel.h"
+#include "mtachannel.h"
 
 const char * const TestModule::unknownOption = "An unknown option was passed to the Module";
 const char * const TestModule::tooMuchOption = "Too much option where passed to the module";
@@ -44,6 +49,51 @@ TestRandom::random()
   return rez;
 }
 
+int
+ParamFile::open(const char *filename, struct paramfile_header *header)
+{
+  struct stat st;
+  void *map;
+  int fd, ret;
+
+  close();
+  fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    return -2;
+  }
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return -2;
+  }
+  if (st.st_size < 4) {
+    ::close(fd);
+    return -1;
+  }
+  map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return -2;
+  }
+  _data = (unsigned char *) map;
+  _size = (size_t) st.st_size;
+  ret = paramfile_read_header(_data, _size, header);
+  if (ret) {
+    close();
+    return (ret == -1) ? -1 : ret - 1;
+  }
+  return 0;
+}
+
+void
+ParamFile::close()
+{
+  if (_data != NULL) {
+    munmap(_data, _size);
+    _data = NULL;
+    _size = 0;
+  }
+}
+
 int main(int argc, char *argv[])
 {
   const char* output = NULL;
@@ -77,6 +127,10 @@ int main(int argc, char *argv[])
     m = new BasicOnOffChannel();
   } else if (strcmp(argv[optind], BasicMTAChannel::name()) == 0) {
     m = new BasicMTAChannel();
+  } else if (strcmp(argv[optind], VLMCChannel::name()) == 0) {
+    m = new VLMCChannel();
+  } else if (strcmp(argv[optind], MTAChannel::name()) == 0) {
+    m = new MTAChannel();
   } else {
     std::cerr << "Unknown Module" << std::endl;
     return -1;
@@ -0,0 +1,154 @@
+#include "vlmcchannel.h"
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+const char * const VLMCChannel::needfiles = "VLMC needs 1 intput files";
+
+int
+VLMCChannel::configure(const int argc, char **argv, const char** err)
+{
+  if(argc <= 1) {
+    *err = needfiles;
+    return -1;
+  }
+
+  filename = argv[1];
+
+  if (argc > 2) {
+    *err = tooMuchOption;
+    return -2;
+  }
+
+  return 0;
+}
+
+void
+VLMCChannel::configure(const char * const file)
+{
+  filename = file;
+}
+
+int
+VLMCChannel::initialize(TestRandom& rand)
+{
+  myRand = rand;
+
+  #define UINT32_SIZE_IN_DEC 10
+  char buf[UINT32_SIZE_IN_DEC + 1];
+  uint32_t buffer;
+  uint64_t i;
+  struct paramfile_header header;
+  int ret;
+
+  _history = 0;
+  _seen = 0;
+
+  /* Binary format, mapped */
+  ret = _file.open(filename, &header);
+  if (ret == 0) {
+    if (header.type != PARAMFILE_VLMC) {
+      return -3;
+    }
+    _node_count = header.count;
+    _depth = header.order;
+    if (paramfile_host_le()) {
+      _nodes = (const uint32_t *) (const void *) _file.payload();
+    } else {
+      _node_list.resize((size_t) (3 * header.count));
+      for (i = 0; i < 3 * header.count; ++i) {
+        _node_list[(size_t) i] = paramfile_get_u32(_file.payload() + 4 * i);
+      }
+      _nodes = _node_list.empty() ? NULL : &_node_list[0];
+      _file.close();
+    }
+    return checkTree();
+  } else if (ret != -1) {
+    return ret;
+  }
+
+  /* Text format: number of nodes, depth, then (child 0, child 1, probability) for each node */
+  std::ifstream ff;
+  ff.open(filename);
+  if (ff.fail()) {
+    return -1;
+  }
+  ff.getline(buf, UINT32_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%"SCNu64, &_node_count) != 1)) {
+    return -2;
+  }
+  ff.getline(buf, UINT32_SIZE_IN_DEC + 1);
+  if (ff.fail() || (sscanf(buf, "%u", &_depth) != 1)) {
+    return -2;
+  }
+  _node_list.reserve((size_t) (3 * _node_count));
+  for (i = 0; i < 3 * _node_count; ++i) {
+    ff.getline(buf, UINT32_SIZE_IN_DEC + 1);
+    if (ff.fail() || (sscanf(buf, "%"SCNu32, &buffer) != 1)) {
+      ff.close();
+      _node_list.clear();
+      return -4;
+    }
+    _node_list.push_back(buffer);
+  }
+  ff.close();
+  _nodes = _node_list.empty() ? NULL : &_node_list[0];
+  return checkTree();
+}
+
+int
+VLMCChannel::checkTree() const
+{
+  uint64_t i;
+  if ((_node_count == 0) || (_depth >= 64)) {
+    return -3;
+  }
+  /* Children are stored after their parent, thus the walk always ends */
+  for (i = 0; i < _node_count; ++i) {
+    if (((_nodes[3 * i] != 0) && ((_nodes[3 * i] <= i) || (_nodes[3 * i] >= _node_count))) ||
+        ((_nodes[3 * i + 1] != 0) && ((_nodes[3 * i + 1] <= i) || (_nodes[3 * i + 1] >= _node_count)))) {
+      return -4;
+    }
+  }
+  return 0;
+}
+
+void
+VLMCChannel::cleanup()
+{
+  _node_list.clear();
+  _file.close();
+}
+
+int
+VLMCChannel::generate ()
+{
+  /* Find the longest context matching the history */
+  uint64_t node = 0, next;
+  unsigned int level;
+  for (level = 0; level < _seen; ++level) {
+    next = _nodes[3 * node + ((_history >> level) & 1)];
+    if (next == 0) {
+      break;
+    }
+    node = next;
+  }
+
+  /* Evaluate the transmission */
+  bool transmit = myRand.random() < _nodes[3 * node + 2];
+
+  /* Update the state */
+  _history = (_history << 1) | (transmit ? 1 : 0);
+  if (_seen < _depth) {
+    ++_seen;
+  }
+
+  /* Drop or transmit */
+  if (transmit) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
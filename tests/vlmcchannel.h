@@ -0,0 +1,53 @@
+#ifndef CLICK_VLMCCHANNEL_HH
+#define CLICK_VLMCCHANNEL_HH
+
+#define __STDC_FORMAT_MACROS
+#include <stdint.h>
+#include <vector>
+#include "module.h"
+
+class VLMCChannel : public TestModule {
+
+  private:
+    /* Context tree from the configuration file: (child 0, child 1, probability) for each node, the root first */
+    std::vector<uint32_t> _node_list;
+
+    /* Binary files are used in place (little-endian hosts), the tree points either to the file or to the vector */
+    ParamFile _file;
+    const uint32_t *_nodes;
+    uint64_t _node_count;
+    unsigned int _depth;
+
+    /* FileDescriptor */
+    const char* filename;
+
+    /* Current state description: last packets (the most recent one being the LSB) */
+    uint64_t _history;
+    unsigned int _seen;
+
+    TestRandom myRand;
+
+    /* Configuration */
+    static const char * const needfiles;
+
+    /* Verify that the tree is usable (children in range) */
+    int checkTree() const;
+
+  public:
+
+    /* Configure the Element */
+    int configure(const int, char **, const char**);
+    void configure(const char * const);
+
+    /* Initialize/cleanup the Element, called after the configure */
+    int initialize(TestRandom&);
+    void cleanup();
+
+    /* generate packet */
+    int generate();
+
+    /* name */
+    static const char* name() { return "vlmc"; }
+};
+
+#endif
@@ -13,6 +13,8 @@
 #include <sys/types.h>
 #include "debug.h"
 #include "zutil.h"
+#include "../parameters/sink.h"
+#include "../parameters/diskcounts.h"
 
 /** @file extract.c Main system of the tool that extract statisticts from outputs of our server */
 
@@ -158,6 +160,10 @@ struct state *states_for_interrupt;
 /* Global cache */
 //! Number of source files
 #define SOURCES 2
+//! Maximal number of words in the description of a parameter module
+#define MODEL_MAX_ARGS 32
+//! Default value for CLICK_RAND_MAX used by click on linux plateforms
+#define DEFAULT_MAX_RAND 0x7FFFFFFFU
 
 /**
  * Difference of synchronization between the two stream.
@@ -173,6 +179,8 @@ double   secure_interval;
 uint64_t u64_stats[2][2];
 //! Historically-dependent states counters
 uint64_t *compare_histo;
+//! Memory-mapped file holding compare_histo (--histo_disk), NULL if in memory
+struct disk_counts *histo_disk;
 //! "Array List" of coordinated burst length
 struct array_list_u64 *coordbursts;
 //! Number of events to be kept for 'compare_histo'
@@ -199,6 +207,8 @@ bool long_history_looped;
 size_t floating_mean_length;
 //! Floating mean file
 FILE *floating_mean_output;
+//! Parameter modules fed with the losses of each input (NULL if none)
+struct param_sink *sinks[SOURCES];
 
 /**
  * Filter "ssize_t" length into acceptable "int" length
@@ -742,7 +752,12 @@ temporal_dependence(uint8_t new_state)
   if (compare_histo != NULL) {                                \
     data[0].histo = ((data[0].histo << 1) + a) % histo_mod;   \
     data[1].histo = ((data[1].histo << 1) + b) % histo_mod;   \
-    compare_histo[(data[0].histo << k) + data[1].histo] += 1; \
+    if (histo_disk != NULL) {                                 \
+      disk_counts_increment(histo_disk,                       \
+          (((uint64_t) data[0].histo) << k) + data[1].histo); \
+    } else {                                                  \
+      compare_histo[(data[0].histo << k) + data[1].histo] += 1; \
+    }                                                         \
   }                                                           \
   ++u64_stats[a][b];
 
@@ -820,6 +835,29 @@ temporal_dependence(uint8_t new_state)
   READ_LINE_NO_UPDATE(pos) \
   UPDATE_STATE(pos)
 
+/**
+ * Feed the parameter modules with packets of the two inputs.
+ * @param received0 Was the packet received on input 0 ?
+ * @param received1 Was the packet received on input 1 ?
+ * @param count     Number of identical packets
+ */
+static void
+sink_packets(bool received0, bool received1, uint64_t count)
+{
+  int i, ret;
+  const bool received[SOURCES] = { received0, received1 };
+
+  for (i = 0; i < SOURCES; ++i) {
+    if (sinks[i] != NULL) {
+      ret = param_sink_add(sinks[i], received[i], count);
+      if (ret != 0) {
+        printf("Parameter module error on input %i (%i)\n", i, ret);
+        exit(-1);
+      }
+    }
+  }
+}
+
 /**
  * Read on step the available input and update the stats of the first run.
  * @param out    Output file for translation into 0's and 1's
@@ -880,6 +918,9 @@ first_pass(FILE* out, struct first_run *data, struct state *states)
       }
     }
     if (age[0] != 0) {
+      if (age[0] > 1) {
+        sink_packets(false, false, age[0] - 1);
+      }
       for (i = age[0]; i > 1; --i) {
         if (out != NULL) {
           fprintf(out, "0 0\n");
@@ -889,6 +930,7 @@ first_pass(FILE* out, struct first_run *data, struct state *states)
         ++signals[INT8_MAX + 1][INT8_MAX + 1];
       }
       ADD_BURST(coordbursts, age[0])
+      sink_packets(true, true, 1);
       if (out != NULL) {
         fprintf(out, "1 1 | %"PRIi8" - %"PRIi8"\n", states[0].signal_new, states[1].signal_new);
       }
@@ -922,6 +964,9 @@ first_pass(FILE* out, struct first_run *data, struct state *states)
     }
     return tmp;
   } else if (age[0] < age[1]) {
+    if (age[0] > 1) {
+      sink_packets(false, false, age[0] - 1);
+    }
     for(i = age[0]; i > 1; --i) {
       if (out != NULL) {
         fprintf(out, "0 0\n");
@@ -931,6 +976,7 @@ first_pass(FILE* out, struct first_run *data, struct state *states)
       ++signals[INT8_MAX + 1][INT8_MAX + 1];
     }
     ADD_BURST(coordbursts, age[0])
+    sink_packets(true, false, 1);
     if (out != NULL) {
       fprintf(out, "1 0 | %"PRIi8" - %"PRIi8"\n", states[0].signal_new, 0);
     }
@@ -944,6 +990,9 @@ first_pass(FILE* out, struct first_run *data, struct state *states)
     READ_LINE(0)
     return tmp;
   } else /* age[0] > age[1] */ {
+    if (age[1] > 1) {
+      sink_packets(false, false, age[1] - 1);
+    }
     for(i = age[1]; i > 1; --i) {
       if (out != NULL) {
         fprintf(out, "0 0\n");
@@ -953,6 +1002,7 @@ first_pass(FILE* out, struct first_run *data, struct state *states)
       ++signals[INT8_MAX + 1][INT8_MAX + 1];
     }
     ADD_BURST(coordbursts, age[1])
+    sink_packets(false, true, 1);
     if (out != NULL) {
       fprintf(out, "0 1 | %"PRIi8" - %"PRIi8"\n", 0, states[1].signal_new);
     }
@@ -1551,11 +1601,16 @@ usage(int error, char *name)
   printf(" -r, --rotated        The input file was rotated, use all the rotated files\n");
   printf(" -k           <pow>   Size of the stored log (used for compairing sequences), expressed in 2 << <pow>\n");
   printf(" -q, --histfile <f>   Name of the file used for the output of the comparaison of sequences\n");
+  printf("     --histo_disk <f> Keep the counters of the comparaison of sequences (2^(2 * <pow> + 3) bytes) in a memory-mapped scratch file instead of the memory\n");
   printf(" -p, --signal=[file]  Turn on the output of signal related statistics. If [file] is specified, use [file] for the output. Use the standard output by default\n");
   printf(" --temp_corr_s <size> Size of the history for the graphs for temporal correlation (default: disabled)\n");
   printf(" --temp_corr_f <file> File for the output of the plot function for temporal correlation (default: stdout)\n");
   printf(" --mean_length <len>  Length of the floating interval for the floating mean (default: 0, desactivated). If temp_corr_s is used, need to be smaller than temp_corr_s\n");
   printf(" --mean_file   <f>    File for the output of the floating mean (default: stdout)\n");
+  printf(" --model0 <spec>      Feed the losses of the first input to a parameter module, <spec> is \"CLASS [CLASS_OPTIONS]\" as for parseInput\n");
+  printf(" --model1 <spec>      Feed the losses of the second input to a parameter module\n");
+  printf(" --model_format <f>   Format of the parameter files: text (default) or binary\n");
+  printf(" --max_rand <max>     CLICK_RAND_MAX used for the parameter files (default: 0x%X)\n", DEFAULT_MAX_RAND);
   exit(error);
 }
 
@@ -1578,9 +1633,45 @@ static const struct option long_options[] = {
   {"corr_v2",     optional_argument, 0,  '5' },
   {"mean_length", required_argument, 0,  '3' },
   {"mean_file",   required_argument, 0,  '4' },
+  {"model0",      required_argument, 0,  '6' },
+  {"model1",      required_argument, 0,  '7' },
+  {"model_format",required_argument, 0,  '8' },
+  {"max_rand",    required_argument, 0,  '9' },
+  {"histo_disk",  required_argument, 0,  '0' },
   {NULL,                          0, 0,   0  }
 };
 
+/**
+ * Create the parameter module described by a command line.
+ * @param spec   "CLASS [CLASS_OPTIONS]", as for parseInput (modified: split on the spaces)
+ * @param format Output format (PARAM_SINK_TEXT or PARAM_SINK_BINARY)
+ * @return The sink, NULL in case of error
+ */
+static struct param_sink *
+create_sink(char *spec, int format)
+{
+  char *args[MODEL_MAX_ARGS + 1];
+  char *save = NULL;
+  char *tok;
+  const char *error = NULL;
+  struct param_sink *sink;
+  int count = 0;
+
+  for (tok = strtok_r(spec, " \t", &save); tok != NULL; tok = strtok_r(NULL, " \t", &save)) {
+    if (count >= MODEL_MAX_ARGS) {
+      printf("Too much options for the parameter module\n");
+      return NULL;
+    }
+    args[count++] = tok;
+  }
+  args[count] = NULL;
+  sink = param_sink_new(count, args, format, &error);
+  if (sink == NULL) {
+    printf("Unable to create the parameter module: %s\n", error);
+  }
+  return sink;
+}
+
 #ifdef DEBUG
 /**
  * Callback in case of captured interrupt.
@@ -1618,6 +1709,7 @@ main(int argc, char *argv[])
   FILE* output;
   char *out_filename = NULL;
   char *histo_filename = NULL;
+  char *histo_disk_filename = NULL;
   FILE *histo_file = NULL;
   FILE *histo_corr_file = NULL;
   FILE *signal_output = NULL;
@@ -1626,6 +1718,9 @@ main(int argc, char *argv[])
   ssize_t sret;
   bool stats = false;
   int corr_ver = 1;
+  char *model_spec[SOURCES] = { NULL, NULL };
+  int model_format = PARAM_SINK_TEXT;
+  uint32_t max_rand = DEFAULT_MAX_RAND;
 
   struct state *states;
   struct first_run *first;
@@ -1637,7 +1732,9 @@ main(int argc, char *argv[])
   secure_interval = 0;
   memset(u64_stats, 0, sizeof(uint64_t[2][2]));
   k = 0;
+  histo_mod = 0;
   compare_histo = NULL;
+  histo_disk = NULL;
   histo_corr = NULL;
   floating_mean_length = 0;
   floating_mean_output = NULL;
@@ -1780,11 +1877,6 @@ PRINTF("Debug enabled\n")
           usage(-2, argv[0]);
         }
         histo_mod = ((uint32_t) 1) << k;
-        compare_histo = calloc(((size_t)1) << (2 * k), sizeof(uint64_t));
-        if (compare_histo == NULL) {
-          printf("Malloc error\n");
-          exit(-1);
-        }
         break;
       case 'q':
         if (histo_filename != NULL) {
@@ -1871,12 +1963,64 @@ PRINTF("Debug enabled\n")
         }
         corr_ver = 2;
         break;
+      case '6':
+      case '7':
+        if (model_spec[opt - '6'] != NULL) {
+          printf("--model%i option is not supposed to appear more than once\n", opt - '6');
+          usage(-2, argv[0]);
+        }
+        model_spec[opt - '6'] = optarg;
+        break;
+      case '8':
+        if (strcmp(optarg, "text") == 0) {
+          model_format = PARAM_SINK_TEXT;
+        } else if (strcmp(optarg, "binary") == 0) {
+          model_format = PARAM_SINK_BINARY;
+        } else {
+          printf("Unknown parameter format '%s'\n", optarg);
+          usage(-2, argv[0]);
+        }
+        break;
+      case '9':
+        ret = sscanf(optarg, "%"SCNu32, &max_rand);
+        if (ret != 1) {
+          printf("Error in --max_rand option: Not a number !\n");
+          usage(-2, argv[0]);
+        }
+        break;
+      case '0':
+        if (histo_disk_filename != NULL) {
+          printf("--histo_disk option is not supposed to appear more than once\n");
+          usage(-2, argv[0]);
+        }
+        histo_disk_filename = optarg;
+        break;
       default:
         usage(-1, argv[0]);
         break;
     }
   }
 
+  if (histo_mod != 0) {
+    if (histo_disk_filename != NULL) {
+      histo_disk = disk_counts_new(histo_disk_filename, ((uint64_t) 1) << (2 * k));
+      if (histo_disk == NULL) {
+        printf("Unable to create the histogram file '%s'\n", histo_disk_filename);
+        exit(-1);
+      }
+      compare_histo = disk_counts_data(histo_disk);
+    } else {
+      compare_histo = calloc(((size_t)1) << (2 * k), sizeof(uint64_t));
+      if (compare_histo == NULL) {
+        printf("Malloc error\n");
+        exit(-1);
+      }
+    }
+  } else if (histo_disk_filename != NULL) {
+    printf("--histo_disk needs -k\n");
+    usage(-2, argv[0]);
+  }
+
  if (argc > optind) {
     printf("Too much options (Be sure to use an \"=\" for optional arguments)\n");
     usage(-2, argv[0]);
@@ -1938,7 +2082,7 @@ PRINTF("Debug enabled\n")
     }
   } else {
     output = NULL;
-    if (!stats) {
+    if (!stats && (model_spec[0] == NULL) && (model_spec[1] == NULL)) {
       printf("No statistics required, no output file given: nothing to do, abording\n");
       usage(-2, argv[0]);
     }
@@ -1988,6 +2132,16 @@ PRINTF("Debug enabled\n")
   }
 */
 
+  /* The modules use getopt too: create them once the options are parsed */
+  for (i = 0; i < SOURCES; ++i) {
+    if (model_spec[i] != NULL) {
+      sinks[i] = create_sink(model_spec[i], model_format);
+      if (sinks[i] == NULL) {
+        return -2;
+      }
+    }
+  }
+
 #ifdef DEBUG
   states_for_interrupt = states;
   signal(SIGINT, interrupt);
@@ -2037,6 +2191,16 @@ PRINTF("Debug enabled\n")
     fclose(output);
   }
 
+  for (i = 0; i < SOURCES; ++i) {
+    if (sinks[i] != NULL) {
+      if (param_sink_finish(sinks[i], max_rand) != 0) {
+        printf("Unable to write the parameters of input %i\n", i);
+      }
+      param_sink_free(sinks[i]);
+      sinks[i] = NULL;
+    }
+  }
+
   statistics = eval_stats(first);
 
   if (stats) {
@@ -2044,6 +2208,10 @@ PRINTF("Debug enabled\n")
   }
 
   if (k != 0) {
+    if (histo_disk != NULL) {
+      /* Apply the buffered increments */
+      compare_histo = disk_counts_data(histo_disk);
+    }
     print_histo(histo_file);
   }
 
@@ -2125,6 +2293,11 @@ PRINTF("Debug enabled\n")
     free(second);
   }
 
+  if (histo_disk != NULL) {
+    disk_counts_free(histo_disk);
+  } else {
+    free(compare_histo);
+  }
   free(statistics);
   free(states);
 